@@ -164,6 +164,25 @@ void mapper_signal_instance_update(mapper_signal sig, mapper_id instance,
                                    const void *value, int count,
                                    mapper_timetag_t tt);
 
+/*! Update the values of several signal instances at once.  All of the
+ *  updates share one timetag, and are sent in a single bundle per link.  If
+ *  a queue for this timetag has already been started on a link using
+ *  mapper_device_start_queue(), the updates are added to it and it is left
+ *  for the caller to send.  Each instance is processed by the signal's maps
+ *  in turn, as by mapper_signal_instance_update().
+ *  \param sig          The signal to operate on.
+ *  \param instances    An array of the identifiers of the instances to update.
+ *  \param values       A pointer to 'num' consecutive value vectors, each of
+ *                      the signal's length and type.
+ *  \param num          The number of instances to update.
+ *  \param tt           The time at which the value updates were aquired. If
+ *                      MAPPER_NOW, libmapper will tag the updates with the
+ *                      current time. */
+void mapper_signal_instances_update(mapper_signal sig,
+                                    const mapper_id *instances,
+                                    const void *values, int num,
+                                    mapper_timetag_t tt);
+
 /*! Release a specific instance of a signal by removing it from the list of
  *  active instances and adding it to the reserve list.
  *  \param sig          The signal to operate on.
@@ -175,6 +194,39 @@ void mapper_signal_instance_update(mapper_signal sig, mapper_id instance,
 void mapper_signal_instance_release(mapper_signal sig, mapper_id instance,
                                     mapper_timetag_t tt);
 
+/*! Queue an update for a signal from any thread.  The update is copied into
+ *  the device's update queue, which must first be allocated using
+ *  mapper_device_reserve_update_queue(), and is processed as if by
+ *  mapper_signal_update() during the next call to mapper_device_poll().  This
+ *  function never blocks or allocates memory.
+ *  \param sig          The signal to operate on.
+ *  \param value        A pointer to a new value for this signal, as for
+ *                      mapper_signal_update().
+ *  \param count        The number of values being updated, or 0 for
+ *                      non-periodic signals.
+ *  \param tt           The time at which the value update was aquired. If
+ *                      MAPPER_NOW, the update is tagged with the current time
+ *                      when it is queued.
+ *  \return             Zero if the update was queued, non-zero if the queue is
+ *                      full or missing, or the value is too large. */
+int mapper_signal_enqueue_update(mapper_signal sig, const void *value,
+                                 int count, mapper_timetag_t tt);
+
+/*! Queue an update for a specific signal instance from any thread.  As for
+ *  mapper_signal_enqueue_update(), but processed as if by
+ *  mapper_signal_instance_update().  A NULL value queues the release of the
+ *  instance.
+ *  \param sig          The signal to operate on.
+ *  \param instance     The identifier of the instance to update.
+ *  \param value        A pointer to a new value for this signal instance.
+ *  \param count        The number of values being updated, or 0 for
+ *                      non-periodic signals.
+ *  \param tt           The time at which the value update was aquired.
+ *  \return             Zero if the update was queued, non-zero otherwise. */
+int mapper_signal_instance_enqueue_update(mapper_signal sig, mapper_id instance,
+                                          const void *value, int count,
+                                          mapper_timetag_t tt);
+
 /*! Remove a specific instance of a signal and free its memory.
  *  \param sig          The signal to operate on.
  *  \param instance     The identifier of the instance to suspend. */
@@ -604,7 +656,8 @@ void *mapper_device_user_data(mapper_device dev);
  *  \param dev          The device to add a signal to.
  *  \param dir          The signal direction.
  *  \param num_instances The number of signal instances.
- *  \param name         The name of the signal.
+ *  \param name         The name of the signal.  Names beginning with "_/"
+ *                      are reserved for short OSC paths.
  *  \param length   	The length of the signal vector, or 1 for a scalar.
  *  \param type         The type fo the signal value.
  *  \param unit         The unit of the signal, or 0 for none.
@@ -624,7 +677,8 @@ mapper_signal mapper_device_add_signal(mapper_device dev, mapper_direction dir,
  *  this call (except user_data) will be copied.  For minimum and maximum,
  *  actual type must correspond to 'type' (if type='i', then int*, etc).
  *  \param dev          The device to add a signal to.
- *  \param name         The name of the signal.
+ *  \param name         The name of the signal.  Names beginning with "_/"
+ *                      are reserved for short OSC paths.
  *  \param length   	The length of the signal vector, or 1 for a scalar.
  *  \param type         The type fo the signal value.
  *  \param unit         The unit of the signal, or 0 for none.
@@ -647,7 +701,8 @@ mapper_signal mapper_device_add_input_signal(mapper_device dev,
  *  this call (except user_data) will be copied.  For minimum and maximum,
  *  actual type must correspond to 'type' (if type='i', then int*, etc).
  *  \param dev          The device to add a signal to.
- *  \param name         The name of the signal.
+ *  \param name         The name of the signal.  Names beginning with "_/"
+ *                      are reserved for short OSC paths.
  *  \param length   	The length of the signal vector, or 1 for a scalar.
  *  \param type         The type fo the signal value.
  *  \param unit         The unit of the signal, or 0 for none.
@@ -813,6 +868,63 @@ int mapper_device_remove_property(mapper_device dev, const char *name);
  *                      nothing to do. */
 int mapper_device_poll(mapper_device dev, int block_ms);
 
+/*! Enable or disable batched reception of signal updates.  When enabled, the
+ *  device reads many datagrams per system call into a preallocated ring of
+ *  buffers before dispatching them, reducing overhead for devices that receive
+ *  heavy traffic.  Batched reception is only available on platforms providing
+ *  recvmmsg().
+ *  \param dev          The device to operate on.
+ *  \param enable       1 to enable batched reception, 0 to disable it.
+ *  \return             1 if batched reception is active, 0 otherwise. */
+int mapper_device_set_batch_receive(mapper_device dev, int enable);
+
+/*! Enable or disable short path aliases for incoming maps.  When enabled, the
+ *  device offers each map source a compact OSC path such as "/_/17" for
+ *  addressing the destination signal, reducing the size of update messages and
+ *  the cost of dispatching them.  Only affects maps established afterwards;
+ *  aliases are enabled by default.
+ *  \param dev          The device to operate on.
+ *  \param enable       1 to enable path aliases, 0 to disable them.
+ *  \return             1 if path aliases are enabled, 0 otherwise. */
+int mapper_device_set_path_aliases(mapper_device dev, int enable);
+
+/*! Enable or disable direct delivery of updates to other devices in the same
+ *  process.  When enabled, updates for maps whose destination device lives in
+ *  this process are passed to the destination signal by function call instead
+ *  of being serialised and sent over the loopback interface, so the
+ *  destination's update handler runs inside mapper_signal_update().  This is
+ *  only done if the destination device was last polled by the calling thread
+ *  and neither device is serviced by a network thread.  Updates sent while a
+ *  queue is open on the link, or from a handler during a direct delivery, go
+ *  over the network and may be received after later direct updates.  Direct
+ *  delivery is disabled by default.
+ *  \param dev          The device to operate on.
+ *  \param enable       1 to enable direct delivery, 0 to disable it.
+ *  \return             1 if direct delivery is enabled, 0 otherwise. */
+int mapper_device_set_in_process_delivery(mapper_device dev, int enable);
+
+/*! Enable or disable the shared-memory transport for incoming updates.  When
+ *  enabled, the device offers a ring buffer in shared memory to each linked
+ *  device reporting an address on the same host, and those devices write
+ *  their updates to the ring instead of sending them over the loopback
+ *  interface.  Devices on other hosts, or unable to open the ring, continue
+ *  to use UDP.  Only affects links established afterwards.
+ *  \param dev          The device to operate on.
+ *  \param enable       1 to enable the shared-memory transport, 0 to disable.
+ *  \return             1 if the shared-memory transport is enabled, 0 if it
+ *                      is disabled or not available on this platform. */
+int mapper_device_set_shared_memory(mapper_device dev, int enable);
+
+/*! Enable or disable batched sending of queued updates.  When enabled,
+ *  mapper_device_send_queue() serialises the bundles pending for all linked
+ *  devices and emits them with a single system call, which reduces overhead
+ *  for devices that fan out to many destinations.  Batched sending is only
+ *  available on platforms providing sendmmsg().
+ *  \param dev          The device to operate on.
+ *  \param enable       1 to enable batched sending, 0 to disable it.
+ *  \return             1 if batched sending is active, 0 otherwise. */
+int mapper_device_set_batch_send(mapper_device dev, int enable);
+
 /*! Return the number of file descriptors needed for this device.  This can be
  *  used to allocated an appropriately-sized list for called to
  *  mapper_device_fds.  Note that the number of descriptors needed can change
@@ -904,6 +1016,51 @@ void mapper_device_start_queue(mapper_device dev, mapper_timetag_t tt);
  *                      mapper_device_start_queue(). */
 void mapper_device_send_queue(mapper_device dev, mapper_timetag_t tt);
 
+/*! Allocate a lock-free queue through which any number of threads may submit
+ *  signal updates using mapper_signal_enqueue_update().  Queued updates are
+ *  processed in order during mapper_device_poll().  The queue cannot be
+ *  resized once reserved.
+ *  \param dev          The device to use.
+ *  \param num_slots    The number of updates the queue can hold; this will be
+ *                      rounded up to a power of two.
+ *  \param value_size   The size in bytes of the largest value to be queued.
+ *  \return             Zero on success, non-zero otherwise. */
+int mapper_device_reserve_update_queue(mapper_device dev, int num_slots,
+                                       int value_size);
+
+/*! Start a thread which services the device's network traffic and
+ *  housekeeping, so that the application no longer needs to call
+ *  mapper_device_poll() to keep signals flowing.  While the thread runs,
+ *  updates from the application must be submitted with
+ *  mapper_signal_enqueue_update(); an update queue is reserved automatically
+ *  if necessary.  Any other call concerning the device or its database must
+ *  be made between mapper_device_lock() and mapper_device_unlock().  Update
+ *  and instance event handlers are called on the network thread, unless
+ *  'defer_handlers' is set, in which case they are queued and called from the
+ *  application thread during mapper_device_poll(), which wakes as soon as one
+ *  is queued.  Either way the device is locked while handlers are called.
+ *  \param dev          The device to use.
+ *  \param defer_handlers  Non-zero to call update and instance event handlers
+ *                      from mapper_device_poll() rather than the network
+ *                      thread.
+ *  \return             Zero if the thread was started, non-zero otherwise. */
+int mapper_device_start_thread(mapper_device dev, int defer_handlers);
+
+/*! Stop the network thread started by mapper_device_start_thread().  Any
+ *  deferred handler calls are made before returning.
+ *  \param dev          The device to use. */
+void mapper_device_stop_thread(mapper_device dev);
+
+/*! Lock a device serviced by a network thread, preventing the thread from
+ *  handling messages until mapper_device_unlock() is called.  Locks may be
+ *  nested.  Has no effect if no network thread is running.
+ *  \param dev          The device to use. */
+void mapper_device_lock(mapper_device dev);
+
+/*! Release a lock taken with mapper_device_lock().
+ *  \param dev          The device to use. */
+void mapper_device_unlock(mapper_device dev);
+
 /*! Get access to the device's underlying lo_server.
  *  \param dev          The device to use.
  *  \return             The liblo server used by this device. */
@@ -1044,7 +1201,19 @@ void mapper_network_send_message(mapper_network net, const char *path,
 
 /*! @defgroup links Links
 
-    @{ Links define network connections between pairs of devices. */
+    @{ Links define network connections between pairs of devices.
+
+    Updates are sent over UDP by default.  Setting the link property
+    "transport" to "tcp" and calling mapper_link_push() switches both
+    devices to a TCP stream for the link, which is better suited to high
+    message rates since updates are written in batches once per call to
+    mapper_device_poll() or mapper_device_send_queue().  Messages are limited
+    to the size of a UDP datagram either way.  A device only listens for
+    streams while one of its links uses "tcp", on the network interface in
+    use, and only from hosts of devices it is linked to.  Setting the
+    transport back to "udp" closes the stream.  Updates are sent over UDP
+    while a stream is being connected, and updates buffered when a stream is
+    lost are written once it reconnects. */
 
 /*! Get the mapper_device for a specific link endpoint.
  *  \param link         The link to check.
@@ -1806,6 +1975,7 @@ mapper_device mapper_database_device_by_id(mapper_database db, mapper_id id);
 /*! Return the list of devices matching a name or pattern.
  *  \param db           The database to query.
  *  \param name         The name or pattern to search for. Use '*' for wildcard.
+ *                      The pattern must match the whole device name.
  *  \return             A double-pointer to the first item in a list of results.
  *                      Use mapper_device_query_next() to iterate. */
 mapper_device *mapper_database_devices_by_name(mapper_database db,
@@ -1878,7 +2048,8 @@ mapper_signal *mapper_database_signals(mapper_database db, mapper_direction dir)
 /*! Return a list of signals matching a name.
  *  \param db           The database to query.
  *  \param name         Name of the signal to find in the database.  Use '*' for
- *                      wildcards.
+ *                      wildcards.  The pattern must match the whole signal
+ *                      name.
  *  \return             A double-pointer to the first item in the list of
  *                      results.  Use mapper_signal_query_next() to iterate. */
 mapper_signal *mapper_database_signals_by_name(mapper_database db,
@@ -2045,6 +2216,72 @@ mapper_map *mapper_database_maps_by_slot_property(mapper_database db,
                                                   char type, const void *value,
                                                   mapper_op op);
 
+/*! Maintain a sorted index over a named property of devices, signals, maps
+ *  or links, used to answer mapper_database_*_by_property() queries without
+ *  visiting every record.  The index is rebuilt lazily after records of the
+ *  indexed type are modified.  Results of queries answered from an index are
+ *  returned in order of property value.
+ *  \param db           The database to index.
+ *  \param type         One of MAPPER_OBJ_DEVICES, MAPPER_OBJ_SIGNALS,
+ *                      MAPPER_OBJ_MAPS or MAPPER_OBJ_LINKS.
+ *  \param name         The name of the property to index.
+ *  \return             Zero if the index was added or already exists, non-zero
+ *                      if the property cannot be indexed. */
+int mapper_database_add_property_index(mapper_database db,
+                                       mapper_object_type type,
+                                       const char *name);
+
+/*! Remove a property index previously added using
+ *  mapper_database_add_property_index().
+ *  \param db           The database containing the index.
+ *  \param type         The object type of the index.
+ *  \param name         The name of the indexed property. */
+void mapper_database_remove_property_index(mapper_database db,
+                                           mapper_object_type type,
+                                           const char *name);
+
+/*! Create a live query: a stored set of the devices, signals, maps or links
+ *  matching a property query.  The result set is updated incrementally by the
+ *  database record callbacks, so reading it does not re-evaluate the query.
+ *  Changes to records that are not reported through the database callbacks,
+ *  such as edits to local signals, are not reflected.  The order of results
+ *  is not specified.
+ *  \param db           The database to query.
+ *  \param type         One of MAPPER_OBJ_DEVICES, MAPPER_OBJ_SIGNALS,
+ *                      MAPPER_OBJ_MAPS or MAPPER_OBJ_LINKS.
+ *  \param name         The name of the property to compare, or 0 to match all
+ *                      records of the given type.
+ *  \param length       The value length.
+ *  \param value_type   The value type.
+ *  \param value        The value, which is copied by the live query.
+ *  \param op           The comparison operator.
+ *  \return             A new live query, or zero on error.  It must be freed
+ *                      using mapper_live_query_free() before the database. */
+mapper_live_query mapper_database_new_live_query(mapper_database db,
+                                                 mapper_object_type type,
+                                                 const char *name, int length,
+                                                 char value_type,
+                                                 const void *value,
+                                                 mapper_op op);
+
+/*! Free a live query and unregister it from its database.
+ *  \param query        The live query to free. */
+void mapper_live_query_free(mapper_live_query query);
+
+/*! Return the number of records currently matching a live query.
+ *  \param query        The live query.
+ *  \return             The number of results. */
+int mapper_live_query_num_results(mapper_live_query query);
+
+/*! Return a record currently matching a live query.
+ *  \param query        The live query.
+ *  \param index        The index of the result, from zero to
+ *                      mapper_live_query_num_results() - 1.  Indexes may
+ *                      change when the results are updated.
+ *  \return             The device, signal, map or link, or zero if the index
+ *                      is out of range. */
+void *mapper_live_query_result(mapper_live_query query, int index);
+
 /* @} */
 
 /***** Time *****/
@@ -1187,6 +1187,43 @@ namespace mapper {
             mapper_signal_instance_set_user_data(_sig, id, 0);
             return Instance(_sig, id);
         }
+        Signal& update_instances(int num, const mapper_id *ids,
+                                 const void *values, Timetag tt=0)
+        {
+            mapper_signal_instances_update(_sig, ids, values, num, *tt);
+            return (*this);
+        }
+        Signal& update_instances(int num, const mapper_id *ids,
+                                 const int *values, Timetag tt=0)
+        {
+            if (mapper_signal_type(_sig) == 'i')
+                mapper_signal_instances_update(_sig, ids, values, num, *tt);
+            return (*this);
+        }
+        Signal& update_instances(int num, const mapper_id *ids,
+                                 const float *values, Timetag tt=0)
+        {
+            if (mapper_signal_type(_sig) == 'f')
+                mapper_signal_instances_update(_sig, ids, values, num, *tt);
+            return (*this);
+        }
+        Signal& update_instances(int num, const mapper_id *ids,
+                                 const double *values, Timetag tt=0)
+        {
+            if (mapper_signal_type(_sig) == 'd')
+                mapper_signal_instances_update(_sig, ids, values, num, *tt);
+            return (*this);
+        }
+        template <typename T>
+        Signal& update_instances(const std::vector<Instance>& instances,
+                                 const std::vector<T>& values, Timetag tt=0)
+        {
+            int num = values.size() / mapper_signal_length(_sig);
+            if (num > (int)instances.size())
+                num = instances.size();
+            std::vector<mapper_id> ids(instances.begin(), instances.end());
+            return update_instances(num, &ids[0], &values[0], tt);
+        }
         Signal& reserve_instances(int num, mapper_id *ids = 0)
         {
             mapper_signal_reserve_instances(_sig, num, ids, 0);
@@ -1369,6 +1406,24 @@ namespace mapper {
 
         int poll(int block_ms=0) const
             { return mapper_device_poll(_dev, block_ms); }
+        bool set_batch_receive(bool enable)
+            { return mapper_device_set_batch_receive(_dev, enable); }
+        bool set_path_aliases(bool enable)
+            { return mapper_device_set_path_aliases(_dev, enable); }
+        bool set_in_process_delivery(bool enable)
+            { return mapper_device_set_in_process_delivery(_dev, enable); }
+        bool set_shared_memory(bool enable)
+            { return mapper_device_set_shared_memory(_dev, enable); }
+        bool set_batch_send(bool enable)
+            { return mapper_device_set_batch_send(_dev, enable); }
+        bool start_thread(bool defer_handlers=false)
+            { return !mapper_device_start_thread(_dev, defer_handlers); }
+        Device& stop_thread()
+            { mapper_device_stop_thread(_dev); return (*this); }
+        Device& lock()
+            { mapper_device_lock(_dev); return (*this); }
+        Device& unlock()
+            { mapper_device_unlock(_dev); return (*this); }
         int num_fds() const
             { return mapper_device_num_fds(_dev); }
         int fds(int *fds, int num) const
@@ -1611,6 +1666,17 @@ namespace mapper {
         }
         inline Map::Query maps(const Property& p) const
             { return maps(p, MAPPER_OP_EXISTS); }
+
+        // property indexes
+        int add_property_index(mapper_object_type type,
+                               const string_type &name) const
+            { return mapper_database_add_property_index(_db, type, name); }
+        const Database& remove_property_index(mapper_object_type type,
+                                              const string_type &name) const
+        {
+            mapper_database_remove_property_index(_db, type, name);
+            return (*this);
+        }
     private:
         mapper_database _db;
         bool _owned;
@@ -30,6 +30,9 @@ typedef void *mapper_network;
 //! This can be retrieved by calling mapper_network_db() or mapper_device_db().
 typedef void *mapper_database;
 
+//! An internal structure holding the stored results of a database query.
+typedef void *mapper_live_query;
+
 //! An internal data structure defining a mapper queue
 //! Used to handle a queue of mapper signals
 typedef void *mapper_queue;
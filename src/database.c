@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <zlib.h>
 #include <sys/time.h>
 
@@ -130,6 +131,185 @@ void mapper_database_flush(mapper_database db, int timeout_sec, int quiet)
     }
 }
 
+/**** Indexes ****/
+
+void mapper_database_init_indexes(mapper_database db)
+{
+    mapper_hash_index_init(&db->device_ids, offsetof(mapper_device_t, id_link));
+    mapper_hash_index_init(&db->device_names,
+                           offsetof(mapper_device_t, name_link));
+    mapper_hash_index_init(&db->signal_ids, offsetof(mapper_signal_t, id_link));
+    mapper_hash_index_init(&db->signal_names,
+                           offsetof(mapper_signal_t, name_link));
+    mapper_hash_index_init(&db->map_ids, offsetof(mapper_map_t, id_link));
+    mapper_hash_index_init(&db->link_ids, offsetof(mapper_link_t, id_link));
+    db->device_name_index = mapper_property_index_new("@name",
+        (void**)&db->devices, &db->device_name_version,
+        (mapper_property_getter*)mapper_device_property);
+    db->signal_name_index = mapper_property_index_new("@name",
+        (void**)&db->signals, &db->signal_name_version,
+        (mapper_property_getter*)mapper_signal_property);
+}
+
+void mapper_database_free_indexes(mapper_database db)
+{
+    mapper_hash_index_free(&db->device_ids);
+    mapper_hash_index_free(&db->device_names);
+    mapper_hash_index_free(&db->signal_ids);
+    mapper_hash_index_free(&db->signal_names);
+    mapper_hash_index_free(&db->map_ids);
+    mapper_hash_index_free(&db->link_ids);
+    mapper_property_index_free(db->device_name_index);
+    mapper_property_index_free(db->signal_name_index);
+    db->device_name_index = db->signal_name_index = 0;
+    while (db->property_indexes) {
+        mapper_property_index idx = db->property_indexes;
+        db->property_indexes = idx->next;
+        mapper_property_index_free(idx);
+    }
+}
+
+/*! Find the list, modification counter and property getter for an object
+ *  type.  Returns non-zero if the type cannot be indexed. */
+static int property_index_target(mapper_database db, mapper_object_type type,
+                                 void ***list, uint32_t **version,
+                                 mapper_property_getter **get)
+{
+    switch (type) {
+        case MAPPER_OBJ_DEVICES:
+            *list = (void**)&db->devices;
+            *version = &db->device_version;
+            *get = (mapper_property_getter*)mapper_device_property;
+            return 0;
+        case MAPPER_OBJ_SIGNALS:
+            *list = (void**)&db->signals;
+            *version = &db->signal_version;
+            *get = (mapper_property_getter*)mapper_signal_property;
+            return 0;
+        case MAPPER_OBJ_MAPS:
+            *list = (void**)&db->maps;
+            *version = &db->map_version;
+            *get = (mapper_property_getter*)mapper_map_property;
+            return 0;
+        case MAPPER_OBJ_LINKS:
+            *list = (void**)&db->links;
+            *version = &db->link_version;
+            *get = (mapper_property_getter*)mapper_link_property;
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static mapper_property_index find_property_index(mapper_database db,
+                                                 void **list, const char *name)
+{
+    mapper_property_index idx = db->property_indexes;
+    while (idx) {
+        if (idx->list == list && !strcmp(idx->name, name))
+            return idx;
+        idx = idx->next;
+    }
+    return 0;
+}
+
+int mapper_database_add_property_index(mapper_database db,
+                                       mapper_object_type type,
+                                       const char *name)
+{
+    void **list;
+    uint32_t *version;
+    mapper_property_getter *get;
+
+    if (!db || !name || property_index_target(db, type, &list, &version, &get))
+        return 1;
+    switch (mapper_property_from_string(name)) {
+        case AT_NUM_INCOMING_MAPS:
+        case AT_NUM_OUTGOING_MAPS:
+        case AT_NUM_INPUTS:
+        case AT_NUM_OUTPUTS:
+        case AT_NUM_INSTANCES:
+        case AT_NUM_LINKS:
+        case AT_NUM_MAPS:
+        case AT_STATUS:
+        case AT_SYNCED:
+        case AT_VERSION:
+        case AT_USER_DATA:
+            // bookkeeping fields are updated without touching the table
+            trace("property '%s' cannot be indexed.\n", name);
+            return 1;
+        default:
+            break;
+    }
+    if (find_property_index(db, list, name))
+        return 0;
+    mapper_property_index idx = mapper_property_index_new(name, list, version,
+                                                          get);
+    if (!idx)
+        return 1;
+    idx->next = db->property_indexes;
+    db->property_indexes = idx;
+    return 0;
+}
+
+void mapper_database_remove_property_index(mapper_database db,
+                                           mapper_object_type type,
+                                           const char *name)
+{
+    void **list;
+    uint32_t *version;
+    mapper_property_getter *get;
+
+    if (!db || !name || property_index_target(db, type, &list, &version, &get))
+        return;
+    mapper_property_index *idx = &db->property_indexes;
+    while (*idx) {
+        if ((*idx)->list == list && !strcmp((*idx)->name, name)) {
+            mapper_property_index temp = *idx;
+            *idx = temp->next;
+            mapper_property_index_free(temp);
+            return;
+        }
+        idx = &(*idx)->next;
+    }
+}
+
+void mapper_database_index_device(mapper_database db, mapper_device dev)
+{
+    ++db->device_version;
+    mapper_hash_index_set(&db->device_ids, dev, dev->id);
+    // local devices are unnamed until registered
+    if (dev->name) {
+        if (mapper_hash_index_set(&db->device_names, dev,
+                                  mapper_hash_string(dev->name)))
+            ++db->device_name_version;
+    }
+    else
+        mapper_hash_index_remove(&db->device_names, dev);
+}
+
+void mapper_database_index_signal(mapper_database db, mapper_signal sig)
+{
+    ++db->signal_version;
+    mapper_hash_index_set(&db->signal_ids, sig, sig->id);
+    if (sig->name && mapper_hash_index_set(&db->signal_names, sig,
+                                           mapper_signal_name_key(sig->device,
+                                                                  sig->name)))
+        ++db->signal_name_version;
+}
+
+void mapper_database_index_map(mapper_database db, mapper_map map)
+{
+    ++db->map_version;
+    mapper_hash_index_set(&db->map_ids, map, map->id);
+}
+
+void mapper_database_index_link(mapper_database db, mapper_link link)
+{
+    ++db->link_version;
+    mapper_hash_index_set(&db->link_ids, link, link->id);
+}
+
 static void add_callback(fptr_list *head, const void *f, const void *user)
 {
     fptr_list cb = (fptr_list)malloc(sizeof(struct _fptr_list));
@@ -162,6 +342,10 @@ static void remove_callback(fptr_list *head, const void *f, const void *user)
 
 /**** Device records ****/
 
+static void live_query_device_handler(mapper_database db, mapper_device dev,
+                                      mapper_record_event event,
+                                      const void *user);
+
 mapper_device mapper_database_add_or_update_device(mapper_database db,
                                                    const char *name,
                                                    mapper_message_t *props)
@@ -178,6 +362,7 @@ mapper_device mapper_database_add_or_update_device(mapper_database db,
         dev->id <<= 32;
         dev->database = db;
         init_device_prop_table(dev);
+        mapper_database_index_device(db, dev);
         rc = 1;
     }
 
@@ -224,14 +409,18 @@ void mapper_database_remove_device(mapper_database db, mapper_device dev,
                                             event);
 
     mapper_list_remove_item((void**)&db->devices, dev);
+    mapper_hash_index_remove(&db->device_ids, dev);
+    mapper_hash_index_remove(&db->device_names, dev);
+    ++db->device_version;
+    ++db->device_name_version;
 
-    if (!quiet) {
-        fptr_list cb = db->device_callbacks;
-        while (cb) {
-            mapper_database_device_handler *h = cb->f;
+    fptr_list cb = db->device_callbacks;
+    while (cb) {
+        mapper_database_device_handler *h = cb->f;
+        // live queries must forget the device even if removal is quiet
+        if (!quiet || h == live_query_device_handler)
             h(db, dev, event, cb->context);
-            cb = cb->next;
-        }
+        cb = cb->next;
     }
 
     if (dev->props)
@@ -263,53 +452,65 @@ mapper_device mapper_database_device_by_name(mapper_database db,
                                              const char *name)
 {
     const char *no_slash = skip_slash(name);
-    mapper_device dev = db->devices;
+    mapper_hash_index idx = &db->device_names;
+    mapper_device dev = mapper_hash_index_find(idx, mapper_hash_string(no_slash));
     while (dev) {
-        if (strcmp(dev->name, no_slash)==0)
+        if (dev->name && strcmp(dev->name, no_slash)==0)
             return dev;
-        dev = mapper_list_next(dev);
+        dev = mapper_hash_index_next(idx, dev);
     }
     return 0;
 }
 
 mapper_device mapper_database_device_by_id(mapper_database db, mapper_id id)
 {
-    mapper_device dev = db->devices;
+    mapper_device dev = mapper_hash_index_find(&db->device_ids, id);
     while (dev) {
         if (id == dev->id)
             return dev;
-        dev = mapper_list_next(dev);
+        dev = mapper_hash_index_next(&db->device_ids, dev);
     }
     return 0;
 }
 
+/*! Match a string against a pattern in which '*' matches any sequence of
+ *  characters.  The pattern must match the whole string. */
 static int match_pattern(const char* string, const char* pattern)
 {
+    const char *str = string, *pat = pattern, *star = 0, *retry = 0;
     if (!string || !pattern)
         return 0;
 
-    if (!strchr(pattern, '*'))
-        return strcmp(string, pattern)==0;
-
-    // 1) tokenize pattern using strtok() with delimiter character '*'
-    // 2) use strstr() to check if token exists in offset string
-    char *str = (char*)string, *tok;
-    char dup[strlen(pattern)+1], *pat = dup;
-    strcpy(pat, pattern);
-    int ends_wild = pattern[strlen(pattern)-1]  == '*';
-    while (str && *str) {
-        tok = strtok(pat, "*");
-        if (!tok)
-            return ends_wild;
-        str = strstr(str, tok);
-        if (str && *str)
-            str += strlen(tok);
+    while (*str) {
+        if (*pat == '*') {
+            // remember where to resume if the rest of the pattern fails
+            star = ++pat;
+            retry = str;
+        }
+        else if (*pat == *str) {
+            ++pat;
+            ++str;
+        }
+        else if (star) {
+            pat = star;
+            str = ++retry;
+        }
         else
             return 0;
-        // subsequent calls to strtok() need first argument to be NULL
-        pat = NULL;
     }
-    return 1;
+    while (*pat == '*')
+        ++pat;
+    return !*pat;
+}
+
+/*! Copy the literal prefix of a pattern preceding its first wildcard. */
+static void pattern_prefix(const char *pattern, char *prefix, int size)
+{
+    int length = pattern ? strcspn(pattern, "*") : 0;
+    if (length >= size)
+        length = size - 1;
+    memcpy(prefix, pattern, length);
+    prefix[length] = 0;
 }
 
 static int cmp_query_devices_by_name(const void *context_data, mapper_device dev)
@@ -321,9 +522,14 @@ static int cmp_query_devices_by_name(const void *context_data, mapper_device dev
 mapper_device *mapper_database_devices_by_name(mapper_database db,
                                                const char *name)
 {
+    if (!name)
+        return 0;
+    char prefix[strlen(name) + 1];
+    pattern_prefix(name, prefix, sizeof(prefix));
     return ((mapper_device *)
-            mapper_list_new_query(db->devices, cmp_query_devices_by_name,
-                                  "s", name));
+            mapper_list_new_prefix_query(db->device_name_index, prefix,
+                                         db->devices, cmp_query_devices_by_name,
+                                         "s", name));
 }
 
 static inline int check_type(char type)
@@ -404,19 +610,15 @@ static int compare_value(mapper_op op, int length, char type, const void *val1,
     }
 }
 
-static int cmp_query_devices_by_property(const void *context_data,
-                                         mapper_device dev)
+/*! Test whether a record satisfies a property query. */
+static int match_property(mapper_property_getter *get, const void *item,
+                          const char *name, mapper_op op, int length,
+                          char type, const void *value)
 {
-    int op = *(int*)context_data;
-    int length = *(int*)(context_data + sizeof(int));
-    char type = *(char*)(context_data + sizeof(int) * 2);
-    void *value = *(void**)(context_data + sizeof(int) * 3);
-    const char *name = (const char*)(context_data + sizeof(int) * 3
-                                     + sizeof(void*));
     int _length;
     char _type;
     const void *_value;
-    if (mapper_device_property(dev, name, &_length, &_type, &_value))
+    if (get(item, name, &_length, &_type, &_value))
         return (op == MAPPER_OP_DOES_NOT_EXIST);
     if (op == MAPPER_OP_EXISTS)
         return 1;
@@ -427,6 +629,19 @@ static int cmp_query_devices_by_property(const void *context_data,
     return compare_value(op, length, type, _value, value);
 }
 
+static int cmp_query_devices_by_property(const void *context_data,
+                                         mapper_device dev)
+{
+    int op = *(int*)context_data;
+    int length = *(int*)(context_data + sizeof(int));
+    char type = *(char*)(context_data + sizeof(int) * 2);
+    void *value = *(void**)(context_data + sizeof(int) * 3);
+    const char *name = (const char*)(context_data + sizeof(int) * 3
+                                     + sizeof(void*));
+    return match_property((mapper_property_getter*)mapper_device_property,
+                          dev, name, op, length, type, value);
+}
+
 mapper_device *mapper_database_devices_by_property(mapper_database db,
                                                    const char *name, int length,
                                                    char type, const void *value,
@@ -436,9 +651,14 @@ mapper_device *mapper_database_devices_by_property(mapper_database db,
         return 0;
     if (op <= MAPPER_OP_UNDEFINED || op >= NUM_MAPPER_OPS)
         return 0;
+    mapper_property_index idx = find_property_index(db, (void**)&db->devices,
+                                                    name);
     return ((mapper_device *)
-            mapper_list_new_query(db->devices, cmp_query_devices_by_property,
-                                  "iicvs", op, length, type, &value, name));
+            mapper_list_new_indexed_query(idx, op, length, type, value,
+                                          db->devices,
+                                          cmp_query_devices_by_property,
+                                          "iicvs", op, length, type, &value,
+                                          name));
 }
 
 void mapper_database_add_device_callback(mapper_database db,
@@ -515,6 +735,7 @@ mapper_signal mapper_database_add_or_update_signal(mapper_database db,
 
         // Defaults (int, length=1)
         mapper_signal_init(sig, 0, 0, name, 0, 0, 0, 0, 0, 0, 0);
+        mapper_database_index_signal(db, sig);
 
         rc = 1;
     }
@@ -578,14 +799,11 @@ mapper_signal *mapper_database_signals(mapper_database db, mapper_direction dir)
 
 mapper_signal mapper_database_signal_by_id(mapper_database db, mapper_id id)
 {
-    mapper_signal sig = db->signals;
-    if (!sig)
-        return 0;
-
+    mapper_signal sig = mapper_hash_index_find(&db->signal_ids, id);
     while (sig) {
         if (sig->id == id)
             return sig;
-        sig = mapper_list_next(sig);
+        sig = mapper_hash_index_next(&db->signal_ids, sig);
     }
     return 0;
 }
@@ -602,9 +820,14 @@ static int cmp_query_signals_by_name(const void *context_data,
 mapper_signal *mapper_database_signals_by_name(mapper_database db,
                                                const char *name)
 {
+    if (!name)
+        return 0;
+    char prefix[strlen(name) + 1];
+    pattern_prefix(name, prefix, sizeof(prefix));
     return ((mapper_signal *)
-            mapper_list_new_query(db->signals, cmp_query_signals_by_name,
-                                  "is", MAPPER_DIR_ANY, name));
+            mapper_list_new_prefix_query(db->signal_name_index, prefix,
+                                         db->signals, cmp_query_signals_by_name,
+                                         "is", MAPPER_DIR_ANY, name));
 }
 
 static int cmp_query_signals_by_property(const void *context_data,
@@ -616,18 +839,8 @@ static int cmp_query_signals_by_property(const void *context_data,
     void *value = *(void**)(context_data + sizeof(int) * 3);
     const char *name = (const char*)(context_data + sizeof(int) * 3
                                      + sizeof(void*));
-    int _length;
-    char _type;
-    const void *_value;
-    if (mapper_signal_property(sig, name, &_length, &_type, &_value))
-        return (op == MAPPER_OP_DOES_NOT_EXIST);
-    if (op == MAPPER_OP_EXISTS)
-        return 1;
-    if (op == MAPPER_OP_DOES_NOT_EXIST)
-        return 0;
-    if (_type != type || _length != length)
-        return 0;
-    return compare_value(op, length, type, _value, value);
+    return match_property((mapper_property_getter*)mapper_signal_property,
+                          sig, name, op, length, type, value);
 }
 
 mapper_signal *mapper_database_signals_by_property(mapper_database db,
@@ -639,9 +852,14 @@ mapper_signal *mapper_database_signals_by_property(mapper_database db,
         return 0;
     if (op <= MAPPER_OP_UNDEFINED || op >= NUM_MAPPER_OPS)
         return 0;
+    mapper_property_index idx = find_property_index(db, (void**)&db->signals,
+                                                    name);
     return ((mapper_signal *)
-            mapper_list_new_query(db->signals, cmp_query_signals_by_property,
-                                  "iicvs", op, length, type, &value, name));
+            mapper_list_new_indexed_query(idx, op, length, type, value,
+                                          db->signals,
+                                          cmp_query_signals_by_property,
+                                          "iicvs", op, length, type, &value,
+                                          name));
 }
 
 void mapper_database_remove_signal(mapper_database db, mapper_signal sig,
@@ -653,6 +871,10 @@ void mapper_database_remove_signal(mapper_database db, mapper_signal sig,
                                          event);
 
     mapper_list_remove_item((void**)&db->signals, sig);
+    mapper_hash_index_remove(&db->signal_ids, sig);
+    mapper_hash_index_remove(&db->signal_names, sig);
+    ++db->signal_version;
+    ++db->signal_name_version;
 
     fptr_list cb = db->signal_callbacks;
     while (cb) {
@@ -707,6 +929,7 @@ mapper_link mapper_database_add_or_update_link(mapper_database db,
             link->remote_device = dev2;
         }
         mapper_link_init(link, 0);
+        mapper_database_index_link(db, link);
         rc = 1;
     }
 
@@ -760,11 +983,11 @@ mapper_link *mapper_database_links(mapper_database db)
 
 mapper_link mapper_database_link_by_id(mapper_database db, mapper_id id)
 {
-    mapper_link link = db->links;
+    mapper_link link = mapper_hash_index_find(&db->link_ids, id);
     while (link) {
         if (link->id == id)
             return link;
-        link = mapper_list_next(link);
+        link = mapper_hash_index_next(&db->link_ids, link);
     }
     return 0;
 }
@@ -777,18 +1000,8 @@ static int cmp_query_links_by_property(const void *context_data, mapper_link lin
     void *value = *(void**)(context_data + sizeof(int) * 3);
     const char *name = (const char*)(context_data + sizeof(int) * 3
                                      + sizeof(void*));
-    int _length;
-    char _type;
-    const void *_value;
-    if (mapper_link_property(link, name, &_length, &_type, &_value))
-        return (op == MAPPER_OP_DOES_NOT_EXIST);
-    if (op == MAPPER_OP_EXISTS)
-        return 1;
-    if (op == MAPPER_OP_DOES_NOT_EXIST)
-        return 0;
-    if (_type != type || _length != length)
-        return 0;
-    return compare_value(op, length, type, _value, value);
+    return match_property((mapper_property_getter*)mapper_link_property,
+                          link, name, op, length, type, value);
 }
 
 mapper_link *mapper_database_links_by_property(mapper_database db,
@@ -800,9 +1013,14 @@ mapper_link *mapper_database_links_by_property(mapper_database db,
         return 0;
     if (op <= MAPPER_OP_UNDEFINED || op >= NUM_MAPPER_OPS)
         return 0;
+    mapper_property_index idx = find_property_index(db, (void**)&db->links,
+                                                    name);
     return ((mapper_link *)
-            mapper_list_new_query(db->links, cmp_query_links_by_property,
-                                  "iicvs", op, length, type, &value, name));
+            mapper_list_new_indexed_query(idx, op, length, type, value,
+                                          db->links,
+                                          cmp_query_links_by_property,
+                                          "iicvs", op, length, type, &value,
+                                          name));
 }
 
 void mapper_database_remove_links_by_query(mapper_database db,
@@ -825,6 +1043,8 @@ void mapper_database_remove_link(mapper_database db, mapper_link link,
     mapper_database_remove_maps_by_query(db, mapper_link_maps(link), event);
 
     mapper_list_remove_item((void**)&db->links, link);
+    mapper_hash_index_remove(&db->link_ids, link);
+    ++db->link_version;
 
     fptr_list cb = db->link_callbacks;
     while (cb) {
@@ -953,6 +1173,7 @@ mapper_map mapper_database_add_or_update_map(mapper_database db, int num_sources
         }
 
         mapper_map_init(map);
+        mapper_database_index_map(db, map);
         rc = 1;
     }
     else {
@@ -1060,11 +1281,11 @@ mapper_map *mapper_database_maps(mapper_database db)
 
 mapper_map mapper_database_map_by_id(mapper_database db, mapper_id id)
 {
-    mapper_map map = db->maps;
+    mapper_map map = mapper_hash_index_find(&db->map_ids, id);
     while (map) {
         if (map->id == id)
             return map;
-        map = mapper_list_next(map);
+        map = mapper_hash_index_next(&db->map_ids, map);
     }
     return 0;
 }
@@ -1098,18 +1319,8 @@ static int cmp_query_maps_by_property(const void *context_data, mapper_map map)
     void *value = *(void**)(context_data + sizeof(int) * 3);
     const char *name = (const char*)(context_data + sizeof(int) * 3
                                      + sizeof(void*));
-    int _length;
-    char _type;
-    const void *_value;
-    if (mapper_map_property(map, name, &_length, &_type, &_value))
-        return (op == MAPPER_OP_DOES_NOT_EXIST);
-    if (op == MAPPER_OP_EXISTS)
-        return 1;
-    if (op == MAPPER_OP_DOES_NOT_EXIST)
-        return 0;
-    if (_type != type || _length != length)
-        return 0;
-    return compare_value(op, length, type, _value, value);
+    return match_property((mapper_property_getter*)mapper_map_property,
+                          map, name, op, length, type, value);
 }
 
 mapper_map *mapper_database_maps_by_property(mapper_database db,
@@ -1121,9 +1332,13 @@ mapper_map *mapper_database_maps_by_property(mapper_database db,
         return 0;
     if (op <= MAPPER_OP_UNDEFINED || op >= NUM_MAPPER_OPS)
         return 0;
+    mapper_property_index idx = find_property_index(db, (void**)&db->maps,
+                                                    name);
     return ((mapper_map *)
-            mapper_list_new_query(db->maps, cmp_query_maps_by_property,
-                                  "iicvs", op, length, type, &value, name));
+            mapper_list_new_indexed_query(idx, op, length, type, value,
+                                          db->maps, cmp_query_maps_by_property,
+                                          "iicvs", op, length, type, &value,
+                                          name));
 }
 
 static int cmp_query_maps_by_slot_property(const void *context_data,
@@ -1182,6 +1397,8 @@ void mapper_database_remove_map(mapper_database db, mapper_map map,
         return;
 
     mapper_list_remove_item((void**)&db->maps, map);
+    mapper_hash_index_remove(&db->map_ids, map);
+    ++db->map_version;
 
     fptr_list cb = db->map_callbacks;
     while (cb) {
@@ -1529,3 +1746,286 @@ void mapper_database_request_devices(mapper_database db)
     mapper_network_set_dest_bus(db->network);
     mapper_network_add_message(db->network, 0, MSG_WHO, msg);
 }
+
+/**** Live queries ****/
+
+static inline int live_query_hash(mapper_live_query q, const void *item)
+{
+    return mapper_id_hash((mapper_id)(uintptr_t)item) & (q->size - 1);
+}
+
+/*! Find the table slot holding a record, or the empty slot where it would
+ *  be inserted. */
+static int live_query_slot(mapper_live_query q, const void *item)
+{
+    int i = live_query_hash(q, item);
+    while (q->keys[i] && q->keys[i] != item)
+        i = (i + 1) & (q->size - 1);
+    return i;
+}
+
+static void live_query_resize(mapper_live_query q, int size)
+{
+    int i;
+    q->size = size;
+    q->keys = (void**)realloc(q->keys, sizeof(void*) * size);
+    q->positions = (int*)realloc(q->positions, sizeof(int) * size);
+    memset(q->keys, 0, sizeof(void*) * size);
+    for (i = 0; i < q->num_results; i++) {
+        int slot = live_query_slot(q, q->results[i]);
+        q->keys[slot] = q->results[i];
+        q->positions[slot] = i;
+    }
+}
+
+static void live_query_add(mapper_live_query q, void *item)
+{
+    int slot = live_query_slot(q, item);
+    if (q->keys[slot])
+        return;
+    if (q->num_results >= q->alloced) {
+        q->alloced = q->alloced ? q->alloced * 2 : 8;
+        q->results = (void**)realloc(q->results, sizeof(void*) * q->alloced);
+    }
+    q->results[q->num_results] = item;
+    // keep the table at most half full
+    if ((q->num_results + 1) * 2 > q->size) {
+        ++q->num_results;
+        live_query_resize(q, q->size * 2);
+        return;
+    }
+    q->keys[slot] = item;
+    q->positions[slot] = q->num_results++;
+}
+
+static void live_query_remove(mapper_live_query q, const void *item)
+{
+    int i = live_query_slot(q, item), j, k, mask = q->size - 1;
+    if (!q->keys[i])
+        return;
+
+    // move the last result into the vacated position
+    int pos = q->positions[i];
+    void *last = q->results[--q->num_results];
+    if (last != item) {
+        q->results[pos] = last;
+        q->positions[live_query_slot(q, last)] = pos;
+    }
+
+    // delete from the table, shifting back entries displaced past the slot
+    q->keys[i] = 0;
+    j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!q->keys[j])
+            break;
+        k = live_query_hash(q, q->keys[j]);
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        q->keys[i] = q->keys[j];
+        q->positions[i] = q->positions[j];
+        q->keys[j] = 0;
+        i = j;
+    }
+}
+
+static int live_query_match(mapper_live_query q, const void *item)
+{
+    if (!q->name)
+        return 1;
+    return match_property(q->get, item, q->name, q->op, q->length,
+                          q->value_type, q->value);
+}
+
+static void live_query_update(mapper_live_query q, void *item,
+                              mapper_record_event event)
+{
+    if (event != MAPPER_REMOVED && live_query_match(q, item))
+        live_query_add(q, item);
+    else
+        live_query_remove(q, item);
+}
+
+static void live_query_device_handler(mapper_database db, mapper_device dev,
+                                      mapper_record_event event,
+                                      const void *user)
+{
+    live_query_update((mapper_live_query)user, dev, event);
+}
+
+static void live_query_signal_handler(mapper_database db, mapper_signal sig,
+                                      mapper_record_event event,
+                                      const void *user)
+{
+    live_query_update((mapper_live_query)user, sig, event);
+}
+
+static void live_query_map_handler(mapper_database db, mapper_map map,
+                                   mapper_record_event event, const void *user)
+{
+    live_query_update((mapper_live_query)user, map, event);
+}
+
+static void live_query_link_handler(mapper_database db, mapper_link link,
+                                    mapper_record_event event, const void *user)
+{
+    live_query_update((mapper_live_query)user, link, event);
+}
+
+static void *copy_query_value(int length, char type, const void *value)
+{
+    int i;
+    if (type != 's') {
+        void *copy = malloc(mapper_type_size(type) * length);
+        memcpy(copy, value, mapper_type_size(type) * length);
+        return copy;
+    }
+    if (length == 1)
+        return strdup((const char*)value);
+    char **copy = (char**)malloc(sizeof(char*) * length);
+    for (i = 0; i < length; i++)
+        copy[i] = strdup(((const char**)value)[i]);
+    return copy;
+}
+
+static void free_query_value(int length, char type, void *value)
+{
+    int i;
+    if (!value)
+        return;
+    if (type == 's' && length > 1) {
+        for (i = 0; i < length; i++)
+            free(((char**)value)[i]);
+    }
+    free(value);
+}
+
+mapper_live_query mapper_database_new_live_query(mapper_database db,
+                                                 mapper_object_type type,
+                                                 const char *name, int length,
+                                                 char value_type,
+                                                 const void *value,
+                                                 mapper_op op)
+{
+    void **query;
+
+    if (!db)
+        return 0;
+    if (name) {
+        if (!check_type(value_type) || length < 1)
+            return 0;
+        if (op <= MAPPER_OP_UNDEFINED || op >= NUM_MAPPER_OPS)
+            return 0;
+        if (!value && op != MAPPER_OP_EXISTS && op != MAPPER_OP_DOES_NOT_EXIST)
+            return 0;
+    }
+
+    mapper_live_query q = ((mapper_live_query)
+                           calloc(1, sizeof(mapper_live_query_t)));
+    q->db = db;
+    q->type = type;
+    if (name) {
+        q->name = strdup(name);
+        q->length = length;
+        q->value_type = value_type;
+        q->value = value ? copy_query_value(length, value_type, value) : 0;
+        q->op = op;
+    }
+    live_query_resize(q, 16);
+
+    // gather the initial results and register for updates
+    switch (type) {
+        case MAPPER_OBJ_DEVICES:
+            q->get = (mapper_property_getter*)mapper_device_property;
+            query = (void**)(name
+                    ? mapper_database_devices_by_property(db, name, length,
+                                                          value_type, value, op)
+                    : mapper_database_devices(db));
+            mapper_database_add_device_callback(db, live_query_device_handler,
+                                                q);
+            break;
+        case MAPPER_OBJ_SIGNALS:
+            q->get = (mapper_property_getter*)mapper_signal_property;
+            query = (void**)(name
+                    ? mapper_database_signals_by_property(db, name, length,
+                                                          value_type, value, op)
+                    : mapper_database_signals(db, MAPPER_DIR_ANY));
+            mapper_database_add_signal_callback(db, live_query_signal_handler,
+                                                q);
+            break;
+        case MAPPER_OBJ_MAPS:
+            q->get = (mapper_property_getter*)mapper_map_property;
+            query = (void**)(name
+                    ? mapper_database_maps_by_property(db, name, length,
+                                                       value_type, value, op)
+                    : mapper_database_maps(db));
+            mapper_database_add_map_callback(db, live_query_map_handler, q);
+            break;
+        case MAPPER_OBJ_LINKS:
+            q->get = (mapper_property_getter*)mapper_link_property;
+            query = (void**)(name
+                    ? mapper_database_links_by_property(db, name, length,
+                                                        value_type, value, op)
+                    : mapper_database_links(db));
+            mapper_database_add_link_callback(db, live_query_link_handler, q);
+            break;
+        default:
+            trace("live queries are not supported for object type %d.\n",
+                  type);
+            mapper_live_query_free(q);
+            return 0;
+    }
+    while (query) {
+        live_query_add(q, *query);
+        query = mapper_list_query_next(query);
+    }
+    return q;
+}
+
+void mapper_live_query_free(mapper_live_query q)
+{
+    if (!q)
+        return;
+    switch (q->type) {
+        case MAPPER_OBJ_DEVICES:
+            mapper_database_remove_device_callback(q->db,
+                                                   live_query_device_handler,
+                                                   q);
+            break;
+        case MAPPER_OBJ_SIGNALS:
+            mapper_database_remove_signal_callback(q->db,
+                                                   live_query_signal_handler,
+                                                   q);
+            break;
+        case MAPPER_OBJ_MAPS:
+            mapper_database_remove_map_callback(q->db, live_query_map_handler,
+                                                q);
+            break;
+        case MAPPER_OBJ_LINKS:
+            mapper_database_remove_link_callback(q->db,
+                                                 live_query_link_handler, q);
+            break;
+        default:
+            break;
+    }
+    if (q->name)
+        free(q->name);
+    free_query_value(q->length, q->value_type, q->value);
+    if (q->results)
+        free(q->results);
+    free(q->keys);
+    free(q->positions);
+    free(q);
+}
+
+int mapper_live_query_num_results(mapper_live_query q)
+{
+    return q ? q->num_results : 0;
+}
+
+void *mapper_live_query_result(mapper_live_query q, int index)
+{
+    if (!q || index < 0 || index >= q->num_results)
+        return 0;
+    return q->results[index];
+}
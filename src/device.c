@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // for recvmmsg() and sendmmsg()
+#endif
+
 #include <lo/lo.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -14,15 +18,173 @@
 #include "config.h"
 #include <mapper/mapper.h>
 
+#ifdef USE_STREAMS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
 
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#elif defined(HAVE_PTHREAD)
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#elif defined(HAVE_POLL_H)
+#define USE_POLL 1
+#include <poll.h>
+#endif
+
 extern const char* network_message_strings[NUM_MSG_STRINGS];
 
+static void close_poller(mapper_local_device ldev);
+static lo_address batch_source(mapper_device dev);
+struct _mapper_update_queue;
+static void free_update_queue(struct _mapper_update_queue *q);
+static void discard_signal_updates(mapper_device dev, mapper_signal sig);
+static int process_update_queue(struct _mapper_update_queue *q);
+static int dispatch_deliveries(mapper_device dev, int block_ms);
+static int drain_shm(mapper_device dev, int budget);
+static void close_streams(mapper_device dev);
+static void flush_streams(mapper_device dev);
+
+/* An incoming stream from a linked device using the "tcp" transport. */
+struct _mapper_stream {
+    int fd;
+#ifdef USE_STREAMS
+    struct sockaddr_storage peer;   /* Address the stream was accepted from. */
+#endif
+    lo_address source;      /* Server of the remote device, which replies are
+                             * sent to, or 0 until its greeting arrives. */
+    char *buffer;           /* Received data not yet dispatched. */
+    size_t length;
+    size_t size;
+    struct _mapper_stream *next;
+};
+
+/* Maximum number of datagrams read from one socket per wakeup, so that a busy
+ * signal socket cannot starve the admin bus. */
+#define POLL_BATCH_SIZE 64
+
+/* Registered devices living in this process, which may receive updates from
+ * each other by direct function call.  The version is incremented whenever a
+ * change could invalidate a destination resolved by
+ * mapper_device_local_destination(). */
+static mapper_device *local_devices = 0;
+static int num_local_devices = 0;
+static uint32_t local_devices_version = 1;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t local_devices_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_LOCAL_DEVICES()    pthread_mutex_lock(&local_devices_lock)
+#define UNLOCK_LOCAL_DEVICES()  pthread_mutex_unlock(&local_devices_lock)
+#else
+#define LOCK_LOCAL_DEVICES()
+#define UNLOCK_LOCAL_DEVICES()
+#endif
+
+/* Only its address is used, to identify the calling thread. */
+static __thread char this_thread;
+
+static void invalidate_local_destinations()
+{
+    __atomic_add_fetch(&local_devices_version, 1, __ATOMIC_RELEASE);
+}
+
+static void add_local_device(mapper_device dev)
+{
+    int i;
+    LOCK_LOCAL_DEVICES();
+    for (i = 0; i < num_local_devices; i++) {
+        if (local_devices[i] == dev)
+            break;
+    }
+    if (i == num_local_devices) {
+        mapper_device *devs = realloc(local_devices, sizeof(mapper_device)
+                                      * (num_local_devices + 1));
+        if (devs) {
+            local_devices = devs;
+            local_devices[num_local_devices++] = dev;
+            invalidate_local_destinations();
+        }
+    }
+    UNLOCK_LOCAL_DEVICES();
+}
+
+static void remove_local_device(mapper_device dev)
+{
+    int i;
+    LOCK_LOCAL_DEVICES();
+    for (i = 0; i < num_local_devices; i++) {
+        if (local_devices[i] == dev)
+            break;
+    }
+    if (i < num_local_devices) {
+        local_devices[i] = local_devices[--num_local_devices];
+        if (!num_local_devices) {
+            free(local_devices);
+            local_devices = 0;
+        }
+        invalidate_local_destinations();
+    }
+    UNLOCK_LOCAL_DEVICES();
+}
+
+uint32_t mapper_device_local_version()
+{
+    return __atomic_load_n(&local_devices_version, __ATOMIC_ACQUIRE);
+}
+
+mapper_signal mapper_device_local_destination(mapper_device dev,
+                                              mapper_signal dst)
+{
+    int i;
+    mapper_signal sig = 0;
+    if (!dev->local->in_process_delivery || dev->local->thread)
+        return 0;
+    if (dst->local)
+        return dst;
+    LOCK_LOCAL_DEVICES();
+    for (i = 0; i < num_local_devices; i++) {
+        mapper_device peer = local_devices[i];
+        if (peer->local->thread || strcmp(peer->name, dst->device->name))
+            continue;
+        sig = mapper_device_signal_by_name(peer, dst->name);
+        if (sig && !sig->local)
+            sig = 0;
+        break;
+    }
+    UNLOCK_LOCAL_DEVICES();
+    return sig;
+}
+
+int mapper_device_accepts_direct_delivery(mapper_signal sig)
+{
+    mapper_local_device ldev = sig->device->local;
+    // the destination must be polled by the calling thread, and must still
+    // have methods registered, i.e. an update handler
+    return (!ldev->thread && ldev->poll_thread == &this_thread
+            && sig->path_link.indexed);
+}
+
 void init_device_prop_table(mapper_device dev)
 {
     dev->props = mapper_table_new();
+    dev->props->version = &dev->database->device_version;
     if (!dev->local)
         dev->staged_props = mapper_table_new();
     int flags = dev->local ? NON_MODIFIABLE : MODIFIABLE;
@@ -85,8 +247,13 @@ mapper_device mapper_device_new(const char *name_prefix, int port,
     dev->database = db;
     dev->local = (mapper_local_device)calloc(1, sizeof(mapper_local_device_t));
     dev->local->own_network = 1 - net->own_network;
+    dev->local->stream_fd = -1;
+    dev->local->wake_fds[0] = dev->local->wake_fds[1] = -1;
+    mapper_hash_index_init(&dev->local->signal_paths,
+                           offsetof(mapper_signal_t, path_link));
 
     init_device_prop_table(dev);
+    mapper_database_index_device(db, dev);
 
     mapper_device_start_server(dev, port);
 
@@ -113,6 +280,8 @@ mapper_device mapper_device_new(const char *name_prefix, int port,
 
     dev->local->active_id_maps = (mapper_id_map *) malloc(sizeof(mapper_id_map *));
     dev->local->active_id_maps[0] = 0;
+    dev->local->id_map_indexes = ((mapper_id_map_index)
+                                  calloc(1, sizeof(mapper_id_map_index_t)));
     dev->local->num_signal_groups = 1;
 
     mapper_network_add_device(net, dev);
@@ -135,6 +304,9 @@ void mapper_device_free(mapper_device dev)
     mapper_database db = dev->database;
     mapper_network net = dev->database->network;
 
+    mapper_device_stop_thread(dev);
+    remove_local_device(dev);
+
     // free any queued outgoing messages without sending
     mapper_network_free_messages(net);
 
@@ -193,7 +365,10 @@ void mapper_device_free(mapper_device dev)
             dev->local->active_id_maps[i] = map->next;
             free(map);
         }
+        free(dev->local->id_map_indexes[i].by_local);
+        free(dev->local->id_map_indexes[i].by_global);
     }
+    free(dev->local->id_map_indexes);
     while (dev->local->reserve_id_maps) {
         map = dev->local->reserve_id_maps;
         dev->local->reserve_id_maps = map->next;
@@ -211,8 +386,16 @@ void mapper_device_free(mapper_device dev)
 
     int own_network = dev->local->own_network;
 
+    close_poller(dev->local);
+    close_streams(dev);
+    mapper_device_set_batch_receive(dev, 0);
+    mapper_device_set_batch_send(dev, 0);
+    free_update_queue(dev->local->update_queue);
     if (dev->local->server)
         lo_server_free(dev->local->server);
+    mapper_hash_index_free(&dev->local->signal_paths);
+    if (dev->local->signal_aliases)
+        free(dev->local->signal_aliases);
     free(dev->local);
 
     if (dev->identifier)
@@ -284,11 +467,16 @@ void mapper_device_registered(mapper_device dev)
                 }
             }
             (*sig)->id |= dev->id;
+            mapper_signal_reindex_id_maps(*sig);
+            mapper_database_index_signal(dev->database, *sig);
         }
         sig = mapper_signal_query_next(sig);
     }
+    // global ids have changed
+    mapper_device_reindex_instance_id_maps(dev);
     dev->local->registered = 1;
     dev->status = STATUS_READY;
+    add_local_device(dev);
 }
 
 static void mapper_device_increment_version(mapper_device dev)
@@ -316,59 +504,51 @@ static int check_types(const char *types, int len, char type, int vector_len)
     return len / vector_len;
 }
 
-/* Notes:
- * - Incoming signal values may be scalars or vectors, but much match the
- *   length of the target signal or mapping slot.
- * - Vectors are of homogeneous type ('i', 'f' or 'd') however individual
- *   elements may have no value (type 'N')
- * - A vector consisting completely of nulls indicates a signal instance release
- *   TODO: use more specific message for release?
- * - Updates to a specific signal instance are indicated using the label
- *   "@instance" followed by two integers which uniquely identify this instance
- *   within the network of libmapper devices
- * - Updates to specific "slots" of a convergent (i.e. multi-source) mapping
- *   are indicated using the label "@slot" followed by a single integer slot #
- * - Multiple "samples" of a signal value may be packed into a single message
- * - In future updates, instance release may be triggered by expression eval
- */
-static int handler_signal(const char *path, const char *types, lo_arg **argv,
-                          int argc, lo_message msg, void *user_data)
+/*! Check that a message matching a cached plan's typetag names the same
+ *  properties at the same positions.  A plan is only built for messages naming
+ *  "@instance" and "@slot" at most once each, so checking those two keys
+ *  covers every property argument. */
+static int decode_plan_keys_match(mapper_decode_plan plan, lo_arg **argv)
 {
-    mapper_signal sig = (mapper_signal)user_data;
-    mapper_device dev;
-    int i = 0, j, k, count = 1, nulls = 0;
-    int id_map_index, slot_index = -1;
-    mapper_id global_id = 0;
-    mapper_id_map id_map;
-    mapper_map map = 0;
-    mapper_slot slot = 0;
-
-    if (!sig || !(dev = sig->device)) {
-#ifdef DEBUG
-        printf("error in handler_signal, cannot retrieve user_data\n");
-#endif
+    if (plan->instance_arg >= 0
+        && strcmp(&argv[plan->instance_arg - 1]->s,
+                  mapper_protocol_string(AT_INSTANCE)))
         return 0;
-    }
+    if (plan->slot_arg >= 0
+        && strcmp(&argv[plan->slot_arg - 1]->s,
+                  mapper_protocol_string(AT_SLOT)))
+        return 0;
+    return 1;
+}
 
-    if (!sig->num_instances) {
+/*! Find the decode plan for a message typetag, building and caching a new
+ *  plan if necessary.  Property names are checked against the cached plan on
+ *  every message, since a matching typetag does not guarantee that they are
+ *  valid.  Returns 0 if the message arguments are malformed. */
+static mapper_decode_plan get_decode_plan(mapper_signal sig, const char *types,
+                                          lo_arg **argv, int argc)
+{
+    int i, value_len = 0, nulls = 0, instance_arg = -1, slot_arg = -1;
+    mapper_local_signal lsig = sig->local;
+    mapper_decode_plan plan;
+
+    for (i = 0; i < NUM_DECODE_PLANS; i++) {
+        plan = &lsig->decode_plans[i];
+        if (plan->types && strcmp(plan->types, types) == 0) {
+            if (decode_plan_keys_match(plan, argv))
+                return plan;
 #ifdef DEBUG
-        printf("signal '%s' has no instances.\n", sig->name);
+            printf("error in handler_signal: unknown property name.\n");
 #endif
-        return 0;
+            return 0;
+        }
     }
 
-    if (!argc)
-        return 0;
-
-    mapper_signal_update_handler *update_h = sig->local->update_handler;
-    mapper_instance_event_handler *event_h = sig->local->instance_event_handler;
-
     // We need to consider that there may be properties appended to the msg
     // check length and find properties if any
-    int value_len = 0;
     while (value_len < argc && types[value_len] != 's' && types[value_len] != 'S') {
         // count nulls here also to save time
-        if (types[i] == 'N')
+        if (types[value_len] == 'N')
             ++nulls;
         ++value_len;
     }
@@ -384,26 +564,26 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
         }
         if (strcmp(&argv[argnum]->s, mapper_protocol_string(AT_INSTANCE)) == 0
             && argc >= argnum + 2) {
-            if (types[argnum+1] != 'h') {
+            if (types[argnum+1] != 'h' || instance_arg >= 0) {
 #ifdef DEBUG
                 printf("error in handler_signal: bad arguments "
                        "for 'instance' property.\n");
 #endif
                 return 0;
             }
-            global_id = argv[argnum+1]->i64;
+            instance_arg = argnum + 1;
             argnum += 2;
         }
         else if (strcmp(&argv[argnum]->s, mapper_protocol_string(AT_SLOT)) == 0
                  && argc >= argnum + 2) {
-            if (types[argnum+1] != 'i') {
+            if (types[argnum+1] != 'i' || slot_arg >= 0) {
 #ifdef DEBUG
                 printf("error in handler_signal: bad arguments "
                        "for 'slot' property.\n");
 #endif
                 return 0;
             }
-            slot_index = argv[argnum+1]->i32;
+            slot_arg = argnum + 1;
             argnum += 2;
         }
         else {
@@ -415,6 +595,94 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
         }
     }
 
+    // replace the least recently built plan
+    plan = &lsig->decode_plans[lsig->next_decode_plan];
+    lsig->next_decode_plan = (lsig->next_decode_plan + 1) % NUM_DECODE_PLANS;
+    if (plan->types)
+        free(plan->types);
+    plan->types = strdup(types);
+    plan->value_len = value_len;
+    plan->nulls = nulls;
+    plan->count = check_types(types, value_len, sig->type, sig->length);
+    plan->instance_arg = instance_arg;
+    plan->slot_arg = slot_arg;
+    plan->slot_count = 0;
+    plan->slot_length = 0;
+    plan->slot_type = 0;
+    return plan;
+}
+
+/*! Number of samples in a message processed for a map slot's signal. */
+static int decode_plan_slot_count(mapper_decode_plan plan, mapper_signal sig)
+{
+    if (plan->slot_type != sig->type || plan->slot_length != sig->length) {
+        plan->slot_count = check_types(plan->types, plan->value_len, sig->type,
+                                       sig->length);
+        plan->slot_type = sig->type;
+        plan->slot_length = sig->length;
+    }
+    return plan->slot_count;
+}
+
+/* Notes:
+ * - Incoming signal values may be scalars or vectors, but much match the
+ *   length of the target signal or mapping slot.
+ * - Vectors are of homogeneous type ('i', 'f' or 'd') however individual
+ *   elements may have no value (type 'N')
+ * - A vector consisting completely of nulls indicates a signal instance release
+ *   TODO: use more specific message for release?
+ * - Updates to a specific signal instance are indicated using the label
+ *   "@instance" followed by two integers which uniquely identify this instance
+ *   within the network of libmapper devices
+ * - Updates to specific "slots" of a convergent (i.e. multi-source) mapping
+ *   are indicated using the label "@slot" followed by a single integer slot #
+ * - Multiple "samples" of a signal value may be packed into a single message
+ * - In future updates, instance release may be triggered by expression eval
+ *
+ * Updates between devices in the same process are passed to
+ * mapper_device_receive_update() directly by the router, without this
+ * message ever being serialised.
+ */
+int mapper_device_receive_update(mapper_signal sig, const char *types,
+                                 lo_arg **argv, int argc, mapper_timetag_t tt)
+{
+    mapper_device dev;
+    int i = 0, j, k, count = 1;
+    int id_map_index, slot_index = -1;
+    mapper_id global_id = 0;
+    mapper_id_map id_map;
+    mapper_map map = 0;
+    mapper_slot slot = 0;
+
+    if (!sig || !(dev = sig->device)) {
+#ifdef DEBUG
+        printf("error in handler_signal, cannot retrieve user_data\n");
+#endif
+        return 0;
+    }
+
+    if (!sig->num_instances) {
+#ifdef DEBUG
+        printf("signal '%s' has no instances.\n", sig->name);
+#endif
+        return 0;
+    }
+
+    if (!argc)
+        return 0;
+
+    mapper_signal_update_handler *update_h = mapper_device_update_handler(sig);
+    mapper_instance_event_handler *event_h = mapper_device_event_handler(sig);
+
+    mapper_decode_plan plan = get_decode_plan(sig, types, argv, argc);
+    if (!plan)
+        return 0;
+    int value_len = plan->value_len, nulls = plan->nulls;
+    if (plan->instance_arg >= 0)
+        global_id = argv[plan->instance_arg]->i64;
+    if (plan->slot_arg >= 0)
+        slot_index = argv[plan->slot_arg]->i32;
+
     if (slot_index >= 0) {
         // retrieve mapping associated with this slot
         slot = mapper_router_slot(dev->local->router, sig, slot_index);
@@ -437,19 +705,16 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
 #endif
             return 0;
         }
-        if (map->process_location == MAPPER_LOC_DESTINATION) {
-            count = check_types(types, value_len, slot->signal->type,
-                                slot->signal->length);
-        }
+        if (map->process_location == MAPPER_LOC_DESTINATION)
+            count = decode_plan_slot_count(plan, slot->signal);
         else {
             // value has already been processed at source device
             map = 0;
-            count = check_types(types, value_len, sig->type, sig->length);
+            count = plan->count;
         }
     }
-    else {
-        count = check_types(types, value_len, sig->type, sig->length);
-    }
+    else
+        count = plan->count;
 
     if (!count)
         return 0;
@@ -458,7 +723,6 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
     // requires timebase sync for many-to-one mappings or local updates
     //    if (sig->discard_out_of_order && out_of_order(si->timetag, tt))
     //        return 0;
-    lo_timetag tt = lo_message_get_timestamp(msg);
 
     if (global_id) {
         id_map_index = mapper_signal_find_instance_with_global_id(sig, global_id,
@@ -487,7 +751,7 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
                 if (count == 1 && nulls == value_len) {
                     // we can clear signal's reference to map
                     id_map = sig->local->id_maps[id_map_index].map;
-                    sig->local->id_maps[id_map_index].map = 0;
+                    mapper_signal_remove_id_map(sig, id_map_index);
                     --id_map->refcount_global;
                     if (id_map->refcount_global <= 0
                         && id_map->refcount_local <= 0) {
@@ -614,10 +878,10 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
                 mapper_history sources[map->num_sources];
                 for (j = 0; j < map->num_sources; j++)
                     sources[j] = &map->sources[j]->local->history[id];
-                if (!mapper_expr_evaluate(map->local->expr, sources,
-                                          &map->local->expr_vars[id],
-                                          &map->destination.local->history[id],
-                                          &tt, typestring)) {
+                if (!mapper_map_evaluate(map, sources,
+                                         &map->local->expr_vars[id],
+                                         &map->destination.local->history[id],
+                                         &tt, typestring)) {
                     continue;
                 }
                 // TODO: check if expression has triggered instance-release
@@ -759,6 +1023,13 @@ static int handler_signal(const char *path, const char *types, lo_arg **argv,
     return 0;
 }
 
+static int handler_signal(const char *path, const char *types, lo_arg **argv,
+                          int argc, lo_message msg, void *user_data)
+{
+    return mapper_device_receive_update((mapper_signal)user_data, types, argv,
+                                        argc, lo_message_get_timestamp(msg));
+}
+
 //static int handler_instance_release_request(const char *path, const char *types,
 //                                            lo_arg **argv, int argc, lo_message msg,
 //                                            const void *user_data)
@@ -850,45 +1121,36 @@ static int handler_query(const char *path, const char *types, lo_arg **argv,
         }
     }
 
-    lo_send_bundle(lo_message_get_source(msg), b);
+    /* Messages dispatched from the receive ring, a shared-memory ring or a
+     * stream do not carry their source address, so look it up separately. */
+    lo_address source = dev->local->dispatch_source, batch = 0;
+    if (!source)
+        source = batch = batch_source(dev);
+    lo_send_bundle(source ? source : lo_message_get_source(msg), b);
     lo_bundle_free_messages(b);
+    if (batch)
+        lo_address_free(batch);
     return 0;
 }
 
 static mapper_id get_unused_signal_id(mapper_device dev)
 {
-    int done = 0;
     mapper_id id;
-    while (!done) {
-        done = 1;
+    // check if a signal already exists with this id
+    do {
         id = mapper_device_generate_unique_id(dev);
-        // check if input signal exists with this id
-        mapper_signal *sig = mapper_device_signals(dev, MAPPER_DIR_ANY);
-        while (sig) {
-            if ((*sig)->id == id) {
-                done = 0;
-                mapper_signal_query_done(sig);
-                break;
-            }
-            sig = mapper_signal_query_next(sig);
-        }
-    }
+    } while (mapper_device_signal_by_id(dev, id));
     return id;
 }
 
 // Add a signal to a mapper device.
-mapper_signal mapper_device_add_signal(mapper_device dev, mapper_direction dir,
-                                       int num_instances, const char *name,
-                                       int length, char type, const char *unit,
-                                       const void *minimum, const void *maximum,
-                                       mapper_signal_update_handler *handler,
-                                       const void *user_data)
+static mapper_signal add_signal(mapper_device dev, mapper_direction dir,
+                                int num_instances, const char *name,
+                                int length, char type, const char *unit,
+                                const void *minimum, const void *maximum,
+                                mapper_signal_update_handler *handler,
+                                const void *user_data)
 {
-    if (!dev || !dev->local)
-        return 0;
-    if (!name || check_signal_length(length) || check_signal_type(type))
-        return 0;
-
     mapper_database db = dev->database;
     mapper_signal sig;
     if ((sig = mapper_device_signal_by_name(dev, name)))
@@ -902,6 +1164,7 @@ mapper_signal mapper_device_add_signal(mapper_device dev, mapper_direction dir,
     sig->id = get_unused_signal_id(dev);
     mapper_signal_init(sig, dir, num_instances, name, length, type, unit,
                        minimum, maximum, handler, user_data);
+    mapper_database_index_signal(db, sig);
 
     if (dir == MAPPER_DIR_INCOMING)
         ++dev->num_inputs;
@@ -925,6 +1188,30 @@ mapper_signal mapper_device_add_signal(mapper_device dev, mapper_direction dir,
     return sig;
 }
 
+mapper_signal mapper_device_add_signal(mapper_device dev, mapper_direction dir,
+                                       int num_instances, const char *name,
+                                       int length, char type, const char *unit,
+                                       const void *minimum, const void *maximum,
+                                       mapper_signal_update_handler *handler,
+                                       const void *user_data)
+{
+    if (!dev || !dev->local)
+        return 0;
+    if (!name || check_signal_length(length) || check_signal_type(type))
+        return 0;
+    if (strncmp(skip_slash(name), "_/", 2) == 0) {
+        // reserved for short paths such as signal aliases
+        trace("signal names beginning with '_/' are reserved.\n");
+        return 0;
+    }
+
+    mapper_device_lock(dev);
+    mapper_signal sig = add_signal(dev, dir, num_instances, name, length, type,
+                                   unit, minimum, maximum, handler, user_data);
+    mapper_device_unlock(dev);
+    return sig;
+}
+
 mapper_signal mapper_device_add_input_signal(mapper_device dev, const char *name,
                                              int length, char type, const char *unit,
                                              const void *minimum, const void *maximum,
@@ -944,40 +1231,130 @@ mapper_signal mapper_device_add_output_signal(mapper_device dev, const char *nam
                                     type, unit, minimum, maximum, 0, 0);
 }
 
+static mapper_signal signal_by_path(mapper_device dev, const char *path)
+{
+    mapper_hash_index idx = &dev->local->signal_paths;
+    mapper_signal sig = mapper_hash_index_find(idx, mapper_hash_string(path));
+    while (sig && strcmp(sig->path, path))
+        sig = mapper_hash_index_next(idx, sig);
+    return sig;
+}
+
+/*! Find the signal addressed by a short path of the form "/_/<alias>". */
+static mapper_signal signal_by_alias(mapper_device dev, const char *path)
+{
+    int alias = 0;
+    if (path[0] != '/' || path[1] != '_' || path[2] != '/' || !path[3])
+        return 0;
+    for (path += 3; *path; path++) {
+        if (*path < '0' || *path > '9')
+            return 0;
+        alias = alias * 10 + (*path - '0');
+        if (alias >= dev->local->num_signal_aliases)
+            return 0;
+    }
+    return dev->local->signal_aliases[alias];
+}
+
+/*! Catch-all liblo method for the device server.  Messages addressed to a
+ *  signal path or alias are passed to handler_signal(), and those addressed
+ *  to the signal path followed by "/get" are passed to handler_query(). */
+static int handler_dispatch(const char *path, const char *types, lo_arg **argv,
+                            int argc, lo_message msg, void *user_data)
+{
+    mapper_device dev = (mapper_device)user_data;
+    mapper_signal sig;
+    int len;
+
+    if (!dev || !dev->local || !path)
+        return 0;
+
+    // aliases cannot shadow signal paths since names starting "_/" are refused
+    if ((sig = signal_by_alias(dev, path)) || (sig = signal_by_path(dev, path)))
+        return handler_signal(path, types, argv, argc, msg, sig);
+
+    if (strcmp(path, "/_/shm") == 0) {
+        // doorbell for data waiting in shared-memory rings
+        drain_shm(dev, POLL_BATCH_SIZE);
+        return 0;
+    }
+
+    len = strlen(path);
+    if (len > 4 && strcmp(path + len - 4, "/get") == 0) {
+        char sig_path[len - 3];
+        memcpy(sig_path, path, len - 4);
+        sig_path[len - 4] = 0;
+        if ((sig = signal_by_path(dev, sig_path)))
+            return handler_query(path, types, argv, argc, msg, sig);
+    }
+
+    trace("device '%s' has no signal for path '%s'\n", dev->name, path);
+    return 0;
+}
+
 void mapper_device_add_signal_methods(mapper_device dev, mapper_signal sig)
 {
     if (!sig || !sig->local)
         return;
 
-    char *path = 0;
-    int len = strlen(sig->path) + 5;
-    path = (char*)realloc(path, len);
-    snprintf(path, len, "%s%s", sig->path, "/get");
-    lo_server_add_method(dev->local->server, path, NULL, handler_query,
-                         (void*)(sig));
-    free(path);
-
-    lo_server_add_method(dev->local->server, sig->path, NULL,
-                         handler_signal, (void*)(sig));
+    mapper_local_device ldev = dev->local;
+    if (!mapper_hash_index_set(&ldev->signal_paths, sig,
+                               mapper_hash_string(sig->path)))
+        return;
+    ++ldev->n_output_callbacks;
 
-    ++dev->local->n_output_callbacks;
+    // signals keep their alias if methods are removed and added again
+    if (!sig->local->alias) {
+        if (!ldev->num_signal_aliases)
+            ldev->num_signal_aliases = 1;
+        sig->local->alias = ldev->num_signal_aliases++;
+        ldev->signal_aliases = realloc(ldev->signal_aliases, sizeof(mapper_signal)
+                                       * ldev->num_signal_aliases);
+        ldev->signal_aliases[0] = 0;
+    }
+    ldev->signal_aliases[sig->local->alias] = sig;
 }
 
 void mapper_device_remove_signal_methods(mapper_device dev, mapper_signal sig)
 {
-    if (!sig || !sig->local)
+    if (!sig || !sig->local || !sig->path_link.indexed)
         return;
 
-    char *path = 0;
-    int len = (int)strlen(sig->path) + 5;
-    path = (char*)realloc(path, len);
-    snprintf(path, len, "%s%s", sig->path, "/get");
-    lo_server_del_method(dev->local->server, path, NULL);
-    free(path);
+    mapper_hash_index_remove(&dev->local->signal_paths, sig);
+    if (sig->local->alias)
+        dev->local->signal_aliases[sig->local->alias] = 0;
+    --dev->local->n_output_callbacks;
+    invalidate_local_destinations();
+}
 
-    lo_server_del_method(dev->local->server, sig->path, NULL);
+int mapper_device_set_path_aliases(mapper_device dev, int enable)
+{
+    if (!dev || !dev->local)
+        return 0;
+    dev->local->no_path_aliases = !enable;
+    return enable ? 1 : 0;
+}
 
-    --dev->local->n_output_callbacks;
+int mapper_device_set_shared_memory(mapper_device dev, int enable)
+{
+    if (!dev || !dev->local)
+        return 0;
+#ifdef HAVE_SHM_OPEN
+    dev->local->use_shm = enable ? 1 : 0;
+    return dev->local->use_shm;
+#else
+    trace("shared memory transport is not available on this platform.\n");
+    return 0;
+#endif
+}
+
+int mapper_device_set_in_process_delivery(mapper_device dev, int enable)
+{
+    if (!dev || !dev->local)
+        return 0;
+    dev->local->in_process_delivery = enable ? 1 : 0;
+    invalidate_local_destinations();
+    return enable ? 1 : 0;
 }
 
 static void send_unmap(mapper_network net, mapper_map map)
@@ -1020,12 +1397,12 @@ void mapper_device_remove_signal(mapper_device dev, mapper_signal sig)
     if (!dev || !sig || !sig->local || sig->device != dev)
         return;
 
+    mapper_device_lock(dev);
     mapper_direction dir = sig->direction;
     mapper_device_remove_signal_methods(dev, sig);
+    discard_signal_updates(dev, sig);
 
-    mapper_router_signal rs = dev->local->router->signals;
-    while (rs && rs->signal != sig)
-        rs = rs->next;
+    mapper_router_signal rs = sig->local->router_sig;
     if (rs) {
         // need to unmap
         for (i = 0; i < rs->num_slots; i++) {
@@ -1049,6 +1426,7 @@ void mapper_device_remove_signal(mapper_device dev, mapper_signal sig)
 
     mapper_database_remove_signal(dev->database, sig, MAPPER_REMOVED);
     mapper_device_increment_version(dev);
+    mapper_device_unlock(dev);
 }
 
 int mapper_device_num_signals(mapper_device dev, mapper_direction dir)
@@ -1082,14 +1460,12 @@ mapper_signal mapper_device_signal_by_id(mapper_device dev, mapper_id id)
 {
     if (!dev)
         return 0;
-    mapper_signal sig = dev->database->signals;
-    if (!sig)
-        return 0;
-
+    mapper_hash_index idx = &dev->database->signal_ids;
+    mapper_signal sig = mapper_hash_index_find(idx, id);
     while (sig) {
         if ((sig->device == dev) && (sig->id == id))
             return sig;
-        sig = mapper_list_next(sig);
+        sig = mapper_hash_index_next(idx, sig);
     }
     return 0;
 }
@@ -1097,16 +1473,16 @@ mapper_signal mapper_device_signal_by_id(mapper_device dev, mapper_id id)
 mapper_signal mapper_device_signal_by_name(mapper_device dev,
                                            const char *sig_name)
 {
-    if (!dev)
-        return 0;
-    mapper_signal sig = dev->database->signals;
-    if (!sig)
+    if (!dev || !sig_name)
         return 0;
-
+    const char *name = skip_slash(sig_name);
+    mapper_hash_index idx = &dev->database->signal_names;
+    mapper_signal sig = mapper_hash_index_find(idx,
+                                               mapper_signal_name_key(dev, name));
     while (sig) {
-        if ((sig->device == dev) && strcmp(sig->name, skip_slash(sig_name))==0)
-        return sig;
-        sig = mapper_list_next(sig);
+        if ((sig->device == dev) && strcmp(sig->name, name)==0)
+            return sig;
+        sig = mapper_hash_index_next(idx, sig);
     }
     return 0;
 }
@@ -1254,96 +1630,773 @@ mapper_link mapper_device_link_by_remote_device(mapper_device dev,
     return 0;
 }
 
-int mapper_device_poll(mapper_device dev, int block_ms)
-{
-    if (!dev || !dev->local)
-        return 0;
-
-    int admin_count = 0, device_count = 0;
-    mapper_network net = dev->database->network;
+/* Sockets watched by mapper_device_poll(), used as indices into poll_fds and
+ * as bits in the mask returned by wait_for_sockets(). */
+enum {
+    POLL_BUS,
+    POLL_MESH,
+    POLL_DEVICE,
+    POLL_TIMER,
+    POLL_STREAM,
+    POLL_WAKE
+};
 
-    if (!block_ms) {
-        device_count = lo_server_recv_noblock(dev->local->server, 0);
-        admin_count = mapper_network_poll(net, 1);
-        net->msgs_recvd += admin_count;
-        return admin_count + device_count;
-    }
+/* Interval between calls to mapper_network_poll() while blocking. */
+#define NETWORK_POLL_INTERVAL_MS 100
 
-    struct timeval start, now, end, wait, elapsed;
-    gettimeofday(&start, NULL);
-    memcpy(&now, &start, sizeof(struct timeval));
-    end.tv_sec = block_ms * 0.001;
-    block_ms -= end.tv_sec * 1000;
-    end.tv_sec += start.tv_sec;
-    end.tv_usec = block_ms * 1000;
-    end.tv_usec += start.tv_usec;
+static void open_poller(mapper_device dev)
+{
+    mapper_local_device ldev = dev->local;
+    mapper_network net = dev->database->network;
 
-    mapper_network_poll(net, 0);
+    ldev->poll_fds[POLL_BUS] = lo_server_get_socket_fd(net->bus_server);
+    ldev->poll_fds[POLL_MESH] = lo_server_get_socket_fd(net->mesh_server);
+    ldev->poll_fds[POLL_DEVICE] = lo_server_get_socket_fd(ldev->server);
+    ldev->epoll_fd = ldev->timer_fd = -1;
+    ldev->poller_open = 1;
 
-    fd_set fdr;
-    int nfds, bus_fd, mesh_fd, dev_fd;
+#ifdef USE_EPOLL
+    int i;
+    struct epoll_event ev;
+    struct itimerspec its;
 
-    while (timercmp(&now, &end, <)) {
-        FD_ZERO(&fdr);
+    ldev->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ldev->epoll_fd < 0) {
+        trace("error: could not create epoll descriptor.\n");
+        return;
+    }
+    ev.events = EPOLLIN;
+    for (i = POLL_BUS; i <= POLL_DEVICE; i++) {
+        ev.data.u32 = i;
+        epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, ldev->poll_fds[i], &ev);
+    }
+    // the stream listener and all incoming streams share one bit
+    ev.data.u32 = POLL_STREAM;
+    if (ldev->stream_fd >= 0)
+        epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, ldev->stream_fd, &ev);
+    struct _mapper_stream *stream = ldev->streams;
+    while (stream) {
+        epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, stream->fd, &ev);
+        stream = stream->next;
+    }
+    if (ldev->wake_fds[0] >= 0) {
+        ev.data.u32 = POLL_WAKE;
+        epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, ldev->wake_fds[0], &ev);
+    }
+
+    ldev->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ldev->timer_fd < 0) {
+        trace("error: could not create timer descriptor.\n");
+        close(ldev->epoll_fd);
+        ldev->epoll_fd = -1;
+        return;
+    }
+    its.it_interval.tv_sec = its.it_value.tv_sec = 0;
+    its.it_interval.tv_nsec = its.it_value.tv_nsec =
+        NETWORK_POLL_INTERVAL_MS * 1000000;
+    timerfd_settime(ldev->timer_fd, 0, &its, NULL);
+    ev.data.u32 = POLL_TIMER;
+    epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, ldev->timer_fd, &ev);
+#endif
+}
+
+static void close_poller(mapper_local_device ldev)
+{
+    if (!ldev->poller_open)
+        return;
+    if (ldev->timer_fd >= 0)
+        close(ldev->timer_fd);
+    if (ldev->epoll_fd >= 0)
+        close(ldev->epoll_fd);
+    ldev->poller_open = 0;
+}
+
+/*! Wait up to timeout_ms for incoming messages, returning a bitmask of the
+ *  sockets that are ready to be read. If the timer descriptor is available,
+ *  bit POLL_TIMER is set when the network housekeeping period elapses. */
+static int wait_for_sockets(mapper_local_device ldev, int timeout_ms)
+{
+    int i, ready = 0;
+
+#ifdef USE_EPOLL
+    if (ldev->epoll_fd >= 0) {
+        struct epoll_event events[8];
+        uint64_t expirations;
+        int n = epoll_wait(ldev->epoll_fd, events, 8, timeout_ms);
+        for (i = 0; i < n; i++) {
+            if (events[i].data.u32 == POLL_TIMER) {
+                if (read(ldev->timer_fd, &expirations, sizeof(uint64_t)) < 0)
+                    continue;
+            }
+            ready |= 1 << events[i].data.u32;
+        }
+        return ready;
+    }
+#endif
+
+    // streams are watched after the three servers, starting with the listener
+    struct _mapper_stream *stream = ldev->streams;
+    int num_streams = ldev->stream_fd >= 0;
+    while (stream) {
+        ++num_streams;
+        stream = stream->next;
+    }
+    int stream_fds[num_streams + 1];
+    num_streams = 0;
+    if (ldev->stream_fd >= 0)
+        stream_fds[num_streams++] = ldev->stream_fd;
+    for (stream = ldev->streams; stream; stream = stream->next)
+        stream_fds[num_streams++] = stream->fd;
+
+#ifdef USE_POLL
+    // the wake descriptor, if any, is watched last
+    int num_fds = 3 + num_streams + (ldev->wake_fds[0] >= 0);
+    struct pollfd pfd[num_fds];
+    for (i = POLL_BUS; i <= POLL_DEVICE; i++)
+        pfd[i].fd = ldev->poll_fds[i];
+    for (i = 0; i < num_streams; i++)
+        pfd[3 + i].fd = stream_fds[i];
+    if (ldev->wake_fds[0] >= 0)
+        pfd[num_fds - 1].fd = ldev->wake_fds[0];
+    for (i = 0; i < num_fds; i++) {
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
+    }
+    if (poll(pfd, num_fds, timeout_ms) > 0) {
+        for (i = POLL_BUS; i <= POLL_DEVICE; i++) {
+            if (pfd[i].revents & POLLIN)
+                ready |= 1 << i;
+        }
+        for (i = 0; i < num_streams; i++) {
+            if (pfd[3 + i].revents & (POLLIN | POLLHUP | POLLERR))
+                ready |= 1 << POLL_STREAM;
+        }
+        if (ldev->wake_fds[0] >= 0 && pfd[num_fds - 1].revents & POLLIN)
+            ready |= 1 << POLL_WAKE;
+    }
+#else
+    fd_set fdr;
+    int nfds = 0;
+    struct timeval wait;
+    FD_ZERO(&fdr);
+    for (i = POLL_BUS; i <= POLL_DEVICE; i++) {
+        FD_SET(ldev->poll_fds[i], &fdr);
+        if (ldev->poll_fds[i] >= nfds)
+            nfds = ldev->poll_fds[i] + 1;
+    }
+    for (i = 0; i < num_streams; i++) {
+        FD_SET(stream_fds[i], &fdr);
+        if (stream_fds[i] >= nfds)
+            nfds = stream_fds[i] + 1;
+    }
+    if (ldev->wake_fds[0] >= 0) {
+        FD_SET(ldev->wake_fds[0], &fdr);
+        if (ldev->wake_fds[0] >= nfds)
+            nfds = ldev->wake_fds[0] + 1;
+    }
+    wait.tv_sec = timeout_ms / 1000;
+    wait.tv_usec = (timeout_ms % 1000) * 1000;
+    if (select(nfds, &fdr, 0, 0, &wait) > 0) {
+        for (i = POLL_BUS; i <= POLL_DEVICE; i++) {
+            if (FD_ISSET(ldev->poll_fds[i], &fdr))
+                ready |= 1 << i;
+        }
+        for (i = 0; i < num_streams; i++) {
+            if (FD_ISSET(stream_fds[i], &fdr))
+                ready |= 1 << POLL_STREAM;
+        }
+        if (ldev->wake_fds[0] >= 0 && FD_ISSET(ldev->wake_fds[0], &fdr))
+            ready |= 1 << POLL_WAKE;
+    }
+#endif
+    return ready;
+}
+
+/*! Read up to 'budget' waiting messages from a server. */
+static int drain_server(lo_server server, int budget)
+{
+    int count = 0;
+    while (count < budget && lo_server_recv_noblock(server, 0))
+        ++count;
+    return count;
+}
 
-        bus_fd = lo_server_get_socket_fd(net->bus_server);
-        FD_SET(bus_fd, &fdr);
-        nfds = bus_fd + 1;
+/* Number of datagrams read per call to recvmmsg(). */
+#define RECV_BATCH_SIZE 16
 
-        mesh_fd = lo_server_get_socket_fd(net->mesh_server);
-        FD_SET(mesh_fd, &fdr);
-        if (mesh_fd >= nfds)
-            nfds = mesh_fd + 1;
+/* Each slot must hold the largest datagram liblo will accept. */
+#define RECV_SLOT_SIZE 65536
 
-        dev_fd = lo_server_get_socket_fd(dev->local->server);
-        FD_SET(dev_fd, &fdr);
-        if (dev_fd >= nfds)
-            nfds = dev_fd + 1;
+typedef struct _mapper_receive_ring {
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr headers[RECV_BATCH_SIZE];
+    struct iovec iovecs[RECV_BATCH_SIZE];
+    struct sockaddr_storage sources[RECV_BATCH_SIZE];
+    struct sockaddr_storage *current_source;
+#endif
+    char *buffers;
+} mapper_receive_ring_t, *mapper_receive_ring;
 
-        timersub(&end, &now, &wait);
-        // set timeout to a maximum of 100ms
-        if (wait.tv_sec || wait.tv_usec > 100000) {
-            wait.tv_sec = 0;
-            wait.tv_usec = 100000;
+int mapper_device_set_batch_receive(mapper_device dev, int enable)
+{
+    if (!dev || !dev->local)
+        return 0;
+    mapper_local_device ldev = dev->local;
+
+    if (!enable) {
+        if (ldev->recv_ring) {
+            free(ldev->recv_ring->buffers);
+            free(ldev->recv_ring);
+            ldev->recv_ring = 0;
         }
+        return 0;
+    }
+#ifdef HAVE_RECVMMSG
+    if (ldev->recv_ring)
+        return 1;
+    mapper_receive_ring ring;
+    ring = (mapper_receive_ring)calloc(1, sizeof(mapper_receive_ring_t));
+    ring->buffers = (char*)malloc(RECV_BATCH_SIZE * RECV_SLOT_SIZE);
+    if (!ring->buffers) {
+        free(ring);
+        return 0;
+    }
+    int i;
+    for (i = 0; i < RECV_BATCH_SIZE; i++) {
+        ring->iovecs[i].iov_base = ring->buffers + i * RECV_SLOT_SIZE;
+        ring->iovecs[i].iov_len = RECV_SLOT_SIZE;
+        ring->headers[i].msg_hdr.msg_iov = &ring->iovecs[i];
+        ring->headers[i].msg_hdr.msg_iovlen = 1;
+        ring->headers[i].msg_hdr.msg_name = &ring->sources[i];
+    }
+    ldev->recv_ring = ring;
+    return 1;
+#else
+    trace("batched receive is not available on this platform.\n");
+    return 0;
+#endif
+}
 
-        timersub(&now, &start, &elapsed);
-        if (elapsed.tv_sec || elapsed.tv_usec >= 100000) {
-            mapper_network_poll(net, 0);
-            start.tv_sec = now.tv_sec;
-            start.tv_usec = now.tv_usec;
+/*! Dispatch up to 'budget' datagrams from each shared-memory ring offered by
+ *  the device, noting whether any ring may still hold data. */
+static int drain_shm(mapper_device dev, int budget)
+{
+    int n, count = 0;
+    if (!dev->local->num_shm_rings)
+        return 0;
+    dev->local->shm_pending = 0;
+    mapper_link link = dev->database->links;
+    while (link) {
+        if (link->local && link->local->shm_in && link->local_device == dev) {
+            n = mapper_link_receive_shm(link, budget);
+            if (n >= budget)
+                dev->local->shm_pending = 1;
+            count += n;
         }
+        link = mapper_list_next(link);
+    }
+    return count;
+}
 
-        if (select(nfds, &fdr, 0, 0, &wait) > 0) {
-            if (FD_ISSET(dev_fd, &fdr)) {
-                lo_server_recv_noblock(dev->local->server, 0);
-                ++device_count;
+/* Incoming streams from linked devices using the "tcp" transport are accepted
+ * on the device's data port number and carry OSC packets framed by a 32-bit
+ * big-endian length, as written by mapper_link_send_stream().  The listener
+ * is only open while a link uses the "tcp" transport, is bound to the
+ * network interface, and only accepts connections from linked devices. */
+
+/* Size of the receive buffer of each stream, enough for the largest frame. */
+#define STREAM_BUFFER_SIZE (STREAM_MAX_FRAME + 4)
+
+#ifdef USE_STREAMS
+static void open_stream_listener(mapper_device dev)
+{
+    mapper_local_device ldev = dev->local;
+    struct sockaddr_in addr;
+    int port = lo_server_get_port(ldev->server);
+    int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+    if (fd < 0)
+        return;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(int));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = *mapper_network_ip4(dev->database->network);
+    if (addr.sin_addr.s_addr == htonl(INADDR_ANY))
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 8)) {
+        trace("couldn't listen for streams on port %d.\n", port);
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    ldev->stream_fd = fd;
+#ifdef USE_EPOLL
+    if (ldev->poller_open && ldev->epoll_fd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = POLL_STREAM;
+        epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+#endif
+}
+#endif
+
+void mapper_device_update_stream_listener(mapper_device dev)
+{
+#ifdef USE_STREAMS
+    mapper_local_device ldev = dev->local;
+    if (ldev->num_stream_links && ldev->stream_fd < 0)
+        open_stream_listener(dev);
+    else if (!ldev->num_stream_links && ldev->stream_fd >= 0) {
+        // streams already accepted are closed by their peers
+        close(ldev->stream_fd);
+        ldev->stream_fd = -1;
+    }
+#endif
+}
+
+static void free_stream(mapper_local_device ldev, struct _mapper_stream *stream)
+{
+    struct _mapper_stream **s = &ldev->streams;
+    while (*s && *s != stream)
+        s = &(*s)->next;
+    if (*s)
+        *s = stream->next;
+    close(stream->fd);
+    if (stream->source)
+        lo_address_free(stream->source);
+    free(stream->buffer);
+    free(stream);
+}
+
+static void close_streams(mapper_device dev)
+{
+    mapper_local_device ldev = dev->local;
+    while (ldev->streams)
+        free_stream(ldev, ldev->streams);
+    if (ldev->stream_fd >= 0)
+        close(ldev->stream_fd);
+    ldev->stream_fd = -1;
+}
+
+#ifdef USE_STREAMS
+/*! Check whether a connection comes from the host of a device linked to 'dev'
+ *  by the "tcp" transport. */
+static int is_stream_peer(mapper_device dev, const struct sockaddr *addr)
+{
+    mapper_link link = dev->database->links;
+    const struct sockaddr *ai;
+    while (link) {
+        if (link->local && link->local->use_stream && link->local_device == dev
+            && link->local->data_addrinfo) {
+            ai = link->local->data_addrinfo->ai_addr;
+            if (ai->sa_family != addr->sa_family)
+                ;
+            else if (addr->sa_family == AF_INET) {
+                if (((struct sockaddr_in*)ai)->sin_addr.s_addr
+                    == ((struct sockaddr_in*)addr)->sin_addr.s_addr)
+                    return 1;
+            }
+            else if (addr->sa_family == AF_INET6) {
+                if (!memcmp(&((struct sockaddr_in6*)ai)->sin6_addr,
+                            &((struct sockaddr_in6*)addr)->sin6_addr,
+                            sizeof(struct in6_addr)))
+                    return 1;
+            }
+        }
+        link = mapper_list_next(link);
+    }
+    return 0;
+}
+
+static void accept_streams(mapper_device dev)
+{
+    mapper_local_device ldev = dev->local;
+    struct _mapper_stream *stream;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd;
+    while ((fd = accept(ldev->stream_fd, (struct sockaddr*)&addr,
+                        &addr_len)) >= 0) {
+        addr_len = sizeof(addr);
+        if (!is_stream_peer(dev, (struct sockaddr*)&addr)) {
+            trace("<%s> refusing stream from unlinked host.\n",
+                  mapper_device_name(dev));
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        stream = (struct _mapper_stream*)calloc(1, sizeof(struct _mapper_stream));
+        stream->fd = fd;
+        memcpy(&stream->peer, &addr, sizeof(addr));
+        stream->size = STREAM_BUFFER_SIZE;
+        stream->buffer = (char*)malloc(stream->size);
+        stream->next = ldev->streams;
+        ldev->streams = stream;
+        trace("<%s> accepted incoming stream.\n", mapper_device_name(dev));
+#ifdef USE_EPOLL
+        if (ldev->poller_open && ldev->epoll_fd >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = POLL_STREAM;
+            epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+#endif
+    }
+}
+
+/*! Read the greeting frame that starts a stream, recording the address of
+ *  the remote device's server. Returns non-zero if the greeting is invalid. */
+static int read_greeting(struct _mapper_stream *stream, const char *frame,
+                         uint32_t len)
+{
+    uint32_t port;
+    char host[NI_MAXHOST], service[16];
+    if (len != 4)
+        return 1;
+    memcpy(&port, frame, 4);
+    if (getnameinfo((struct sockaddr*)&stream->peer,
+                    sizeof(struct sockaddr_storage), host, NI_MAXHOST, 0, 0,
+                    NI_NUMERICHOST))
+        return 1;
+    snprintf(service, 16, "%u", ntohl(port));
+    stream->source = lo_address_new(host, service);
+    return !stream->source;
+}
+
+/*! Dispatch the complete frames held by a stream, returning the number of
+ *  messages or -1 if the stream is corrupt. */
+static int dispatch_frames(mapper_device dev, struct _mapper_stream *stream)
+{
+    uint32_t len;
+    size_t offset = 0;
+    int count = 0;
+    while (stream->length - offset >= 4) {
+        memcpy(&len, stream->buffer + offset, 4);
+        len = ntohl(len);
+        if (len > STREAM_MAX_FRAME)
+            return -1;
+        if (stream->length - offset - 4 < len)
+            break;
+        if (!stream->source) {
+            if (read_greeting(stream, stream->buffer + offset + 4, len))
+                return -1;
+            offset += len + 4;
+            continue;
+        }
+        dev->local->dispatch_source = stream->source;
+        lo_server_dispatch_data(dev->local->server,
+                                stream->buffer + offset + 4, len);
+        dev->local->dispatch_source = 0;
+        offset += len + 4;
+        ++count;
+    }
+    stream->length -= offset;
+    if (stream->length && offset)
+        memmove(stream->buffer, stream->buffer + offset, stream->length);
+    return count;
+}
+#endif
+
+/*! Accept new streams if 'accept' is set, then read and dispatch up to about
+ *  'budget' messages from each incoming stream. */
+static int drain_streams(mapper_device dev, int budget, int accept)
+{
+    int count = 0;
+#ifdef USE_STREAMS
+    mapper_local_device ldev = dev->local;
+    if (accept && ldev->stream_fd >= 0)
+        accept_streams(dev);
+
+    struct _mapper_stream *stream = ldev->streams, *next;
+    int n, stream_count;
+    ssize_t received;
+    while (stream) {
+        next = stream->next;
+        stream_count = 0;
+        while (stream_count < budget) {
+            received = recv(stream->fd, stream->buffer + stream->length,
+                            stream->size - stream->length, 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            n = -1;
+            if (received > 0) {
+                stream->length += received;
+                n = dispatch_frames(dev, stream);
+            }
+            if (n < 0) {
+                trace("<%s> closing incoming stream.\n",
+                      mapper_device_name(dev));
+                free_stream(ldev, stream);
+                break;
             }
-            if (FD_ISSET(bus_fd, &fdr)) {
-                lo_server_recv_noblock(net->bus_server, 0);
-                ++admin_count;
+            stream_count += n;
+        }
+        count += stream_count;
+        stream = next;
+    }
+#endif
+    return count;
+}
+
+/*! Write out the buffered streams of links using the "tcp" transport. */
+static void flush_streams(mapper_device dev)
+{
+    if (!dev->local->num_stream_links)
+        return;
+    mapper_link link = dev->database->links;
+    while (link) {
+        if (link->local && link->local->use_stream && link->local_device == dev)
+            mapper_link_flush_stream(link);
+        link = mapper_list_next(link);
+    }
+}
+
+/*! Read up to 'budget' waiting datagrams from the device server, many per
+ *  system call if batched reception is enabled, and dispatch them to the usual
+ *  liblo method handlers.  Shared-memory rings are drained first. */
+static int drain_device(mapper_device dev, int budget)
+{
+    int shm_count = drain_shm(dev, budget);
+#ifdef HAVE_RECVMMSG
+    mapper_receive_ring ring = dev->local->recv_ring;
+    if (ring) {
+        int i, n, batch, count = 0;
+        int fd = lo_server_get_socket_fd(dev->local->server);
+        while (count < budget) {
+            batch = budget - count;
+            if (batch > RECV_BATCH_SIZE)
+                batch = RECV_BATCH_SIZE;
+            for (i = 0; i < batch; i++) {
+                ring->headers[i].msg_hdr.msg_namelen =
+                    sizeof(struct sockaddr_storage);
+                ring->headers[i].msg_hdr.msg_flags = 0;
             }
-            if (FD_ISSET(mesh_fd, &fdr)) {
-                lo_server_recv_noblock(net->mesh_server, 0);
-                ++admin_count;
+            n = recvmmsg(fd, ring->headers, batch, MSG_DONTWAIT, NULL);
+            if (n <= 0)
+                break;
+            for (i = 0; i < n; i++) {
+                if (ring->headers[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                    trace("dropping truncated datagram.\n");
+                    continue;
+                }
+                ring->current_source = &ring->sources[i];
+                lo_server_dispatch_data(dev->local->server,
+                                        ring->iovecs[i].iov_base,
+                                        ring->headers[i].msg_len);
             }
+            ring->current_source = 0;
+            count += n;
+            if (n < batch)
+                break;
         }
-        gettimeofday(&now, NULL);
+        return shm_count + count;
+    }
+#endif
+    return shm_count + drain_server(dev->local->server, budget);
+}
+
+/*! Return a new address for the sender of the message currently being
+ *  dispatched from the receive ring, or 0 if there is none. */
+static lo_address batch_source(mapper_device dev)
+{
+#ifdef HAVE_RECVMMSG
+    mapper_receive_ring ring = dev->local->recv_ring;
+    if (!ring || !ring->current_source)
+        return 0;
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    if (getnameinfo((struct sockaddr*)ring->current_source,
+                    sizeof(struct sockaddr_storage), host, NI_MAXHOST, port,
+                    NI_MAXSERV, NI_NUMERICHOST | NI_NUMERICSERV))
+        return 0;
+    return lo_address_new(host, port);
+#else
+    return 0;
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+/*! Open the descriptor used to wake the network thread when updates are
+ *  queued, and add it to the poller if that is already open. */
+static int open_wake(mapper_local_device ldev)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        return 1;
+    ldev->wake_fds[0] = ldev->wake_fds[1] = fd;
+#else
+    int i;
+    if (pipe(ldev->wake_fds))
+        return 1;
+    for (i = 0; i < 2; i++)
+        fcntl(ldev->wake_fds[i], F_SETFL, O_NONBLOCK);
+#endif
+    ldev->wake_pending = 0;
+#ifdef USE_EPOLL
+    if (ldev->poller_open && ldev->epoll_fd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = POLL_WAKE;
+        epoll_ctl(ldev->epoll_fd, EPOLL_CTL_ADD, ldev->wake_fds[0], &ev);
+    }
+#endif
+    return 0;
+}
+#endif
+
+static void close_wake(mapper_local_device ldev)
+{
+    if (ldev->wake_fds[0] < 0)
+        return;
+    close(ldev->wake_fds[0]);
+    if (ldev->wake_fds[1] != ldev->wake_fds[0])
+        close(ldev->wake_fds[1]);
+    ldev->wake_fds[0] = ldev->wake_fds[1] = -1;
+}
+
+/*! Wake the network thread, unless it has already been woken and has not
+ *  yet read the update queue. Safe to call from any thread. */
+static void wake_thread(mapper_local_device ldev)
+{
+    int fd = __atomic_load_n(&ldev->wake_fds[1], __ATOMIC_ACQUIRE);
+    if (fd < 0 || __atomic_exchange_n(&ldev->wake_pending, 1, __ATOMIC_ACQ_REL))
+        return;
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(uint64_t)) < 0)
+#else
+    if (write(fd, "", 1) < 0)
+#endif
+        trace("error: could not wake network thread.\n");
+}
+
+/*! Consume wakeups. The update queue must be processed afterwards, so that
+ *  updates queued from here on either are seen or wake the thread again. */
+static void drain_wake(mapper_local_device ldev)
+{
+    uint64_t buffer[8];
+    while (read(ldev->wake_fds[0], buffer, sizeof(buffer)) > 0) {}
+    __atomic_store_n(&ldev->wake_pending, 0, __ATOMIC_RELEASE);
+}
+
+/*! Read from the sockets flagged in 'ready', and service the network if its
+ *  housekeeping period has elapsed.  Message counts are added to 'admin_count'
+ *  and 'device_count', and 'now' is set to the current time. */
+static void service_sockets(mapper_device dev, int ready, struct timeval *now,
+                            struct timeval *last_net_poll, int *admin_count,
+                            int *device_count)
+{
+    struct timeval elapsed;
+    mapper_network net = dev->database->network;
+
+    if (ready & (1 << POLL_WAKE))
+        drain_wake(dev->local);
+    if (ready & (1 << POLL_DEVICE) || dev->local->shm_pending)
+        *device_count += drain_device(dev, POLL_BATCH_SIZE);
+    if (ready & (1 << POLL_STREAM))
+        *device_count += drain_streams(dev, POLL_BATCH_SIZE, 1);
+    if (ready & (1 << POLL_BUS))
+        *admin_count += drain_server(net->bus_server, POLL_BATCH_SIZE);
+    if (ready & (1 << POLL_MESH))
+        *admin_count += drain_server(net->mesh_server, POLL_BATCH_SIZE);
+
+    gettimeofday(now, NULL);
+    if (dev->local->timer_fd >= 0) {
+        if (ready & (1 << POLL_TIMER))
+            mapper_network_poll(net, 0);
+    }
+    else {
+        timersub(now, last_net_poll, &elapsed);
+        if (elapsed.tv_sec
+            || elapsed.tv_usec >= NETWORK_POLL_INTERVAL_MS * 1000) {
+            mapper_network_poll(net, 0);
+            memcpy(last_net_poll, now, sizeof(struct timeval));
+        }
+    }
+}
+
+static int poll_device(mapper_device dev, int block_ms)
+{
+    int admin_count = 0, device_count = 0;
+    mapper_network net = dev->database->network;
+
+    if (dev->local->update_queue)
+        process_update_queue(dev->local->update_queue);
+    flush_streams(dev);
+
+    if (!block_ms) {
+        device_count = drain_device(dev, dev->local->recv_ring
+                                    ? POLL_BATCH_SIZE : 1);
+        device_count += drain_streams(dev, POLL_BATCH_SIZE,
+                                      dev->local->num_stream_links);
+        admin_count = mapper_network_poll(net, 1);
+        flush_streams(dev);
+        net->msgs_recvd += admin_count;
+        return admin_count + device_count;
+    }
+
+    if (!dev->local->poller_open)
+        open_poller(dev);
+
+    struct timeval now, end, last_net_poll, elapsed;
+    int i, ready, timeout_ms = block_ms;
+    gettimeofday(&now, NULL);
+    memcpy(&last_net_poll, &now, sizeof(struct timeval));
+    end.tv_sec = now.tv_sec + block_ms / 1000;
+    end.tv_usec = now.tv_usec + (block_ms % 1000) * 1000;
+    if (end.tv_usec >= 1000000) {
+        ++end.tv_sec;
+        end.tv_usec -= 1000000;
+    }
+
+    mapper_network_poll(net, 0);
+
+    while (timeout_ms > 0) {
+        /* Without a timer descriptor we need to wake up periodically to
+         * service the network. */
+        if (dev->local->timer_fd < 0 && timeout_ms > NETWORK_POLL_INTERVAL_MS)
+            timeout_ms = NETWORK_POLL_INTERVAL_MS;
+
+        // shared-memory rings left holding data will not wake the poller
+        ready = wait_for_sockets(dev->local, dev->local->shm_pending
+                                 ? 0 : timeout_ms);
+        service_sockets(dev, ready, &now, &last_net_poll, &admin_count,
+                        &device_count);
+
+        if (!timercmp(&now, &end, <))
+            break;
+        timersub(&end, &now, &elapsed);
+        timeout_ms = elapsed.tv_sec * 1000 + (elapsed.tv_usec + 999) / 1000;
     }
 
     /* When done, or if non-blocking, check for remaining messages up to a
      * proportion of the number of input signals. Arbitrarily choosing 1 for
      * now, but perhaps could be a heuristic based on a recent number of
      * messages per channel per poll. */
-    while (device_count < (dev->num_inputs + dev->local->n_output_callbacks)*1
-           && lo_server_recv_noblock(dev->local->server, 0)) {
-        ++device_count;
-    }
+    i = (dev->num_inputs + dev->local->n_output_callbacks) * 1 - device_count;
+    if (i > 0)
+        device_count += drain_device(dev, i);
+    flush_streams(dev);
 
     net->msgs_recvd += admin_count;
     return admin_count + device_count;
 }
 
+int mapper_device_poll(mapper_device dev, int block_ms)
+{
+    if (!dev || !dev->local)
+        return 0;
+    // the network thread services the device itself
+    if (dev->local->thread)
+        return dispatch_deliveries(dev, block_ms);
+    dev->local->poll_thread = &this_thread;
+    return poll_device(dev, block_ms);
+}
+
 int mapper_device_num_fds(mapper_device dev)
 {
     // Two for the admin inputs (bus and mesh), and one for the signal input.
@@ -1416,18 +2469,186 @@ void mapper_device_start_queue(mapper_device dev, mapper_timetag_t tt)
     }
 }
 
+typedef struct _mapper_send_batch {
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr *headers;
+    struct iovec *iovecs;
+#endif
+    int num_slots;
+    char *buffer;
+    size_t buffer_size;
+} mapper_send_batch_t, *mapper_send_batch;
+
+int mapper_device_set_batch_send(mapper_device dev, int enable)
+{
+    if (!dev || !dev->local)
+        return 0;
+    mapper_local_device ldev = dev->local;
+
+    if (!enable) {
+        if (ldev->send_batch) {
+#ifdef HAVE_SENDMMSG
+            free(ldev->send_batch->headers);
+            free(ldev->send_batch->iovecs);
+#endif
+            free(ldev->send_batch->buffer);
+            free(ldev->send_batch);
+            ldev->send_batch = 0;
+        }
+        return 0;
+    }
+#ifdef HAVE_SENDMMSG
+    if (!ldev->send_batch)
+        ldev->send_batch = ((mapper_send_batch)
+                            calloc(1, sizeof(mapper_send_batch_t)));
+    return 1;
+#else
+    trace("batched send is not available on this platform.\n");
+    return 0;
+#endif
+}
+
+#ifdef HAVE_SENDMMSG
+/*! Grow the batch buffer and message slots to hold 'used' bytes and 'n'
+ *  messages.  Returns non-zero if memory could not be allocated, in which case
+ *  the batch is left unchanged. */
+static int reserve_send_batch(mapper_send_batch sb, size_t used, int n)
+{
+    if (used > sb->buffer_size) {
+        char *buffer = realloc(sb->buffer, used * 2);
+        if (!buffer)
+            return 1;
+        sb->buffer = buffer;
+        sb->buffer_size = used * 2;
+    }
+    if (n > sb->num_slots) {
+        int num_slots = sb->num_slots ? sb->num_slots * 2 : 8;
+        struct mmsghdr *headers;
+        struct iovec *iovecs;
+        headers = realloc(sb->headers, sizeof(struct mmsghdr) * num_slots);
+        if (!headers)
+            return 1;
+        sb->headers = headers;
+        iovecs = realloc(sb->iovecs, sizeof(struct iovec) * num_slots);
+        if (!iovecs)
+            return 1;
+        sb->iovecs = iovecs;
+        sb->num_slots = num_slots;
+    }
+    return 0;
+}
+
+/*! Send the bundles queued for all links.  Those of this device's UDP links
+ *  are serialised into one buffer and sent with a single call to sendmmsg();
+ *  buffers are kept between calls, so once they have grown to fit a frame no
+ *  further allocation is needed.  Returns non-zero if the batch could not be
+ *  allocated or some bundles could not be sent. */
+static int send_queues_batched(mapper_device dev, mapper_timetag_t tt)
+{
+    mapper_send_batch sb = dev->local->send_batch;
+    mapper_link link = dev->database->links;
+    lo_bundle bundle;
+    struct addrinfo *ai;
+    size_t len, used = 0;
+    int i, n = 0, sent = 0, error = 0;
+
+    while (link) {
+        if (!link->local)
+            goto next;
+        if (link->local_device != dev || !link->local->data_addrinfo
+            || link->local->shm_out || link->local->use_stream) {
+            /* fall back to sending through liblo, shared memory or a stream,
+             * and from the server of the link's own device */
+            mapper_link_send_queue(link, tt);
+            goto next;
+        }
+        if (!(bundle = mapper_link_pop_queue(link, tt)))
+            goto next;
+#ifdef HAVE_LIBLO_BUNDLE_COUNT
+        if (!lo_bundle_count(bundle)) {
+            lo_bundle_free_messages(bundle);
+            goto next;
+        }
+#endif
+        len = lo_bundle_length(bundle);
+        if (reserve_send_batch(sb, used + len, n + 1)) {
+            trace("couldn't grow send batch, sending bundle individually.\n");
+            mapper_link_send_bundle(link, bundle);
+            lo_bundle_free_messages(bundle);
+            error = 1;
+            goto next;
+        }
+        lo_bundle_serialise(bundle, sb->buffer + used, &len);
+        lo_bundle_free_messages(bundle);
+
+        // store the offset for now since the buffer may still move
+        sb->iovecs[n].iov_base = (void*)used;
+        sb->iovecs[n].iov_len = len;
+        ai = link->local->data_addrinfo;
+        memset(&sb->headers[n], 0, sizeof(struct mmsghdr));
+        sb->headers[n].msg_hdr.msg_name = ai->ai_addr;
+        sb->headers[n].msg_hdr.msg_namelen = ai->ai_addrlen;
+        used += len;
+        ++n;
+      next:
+        link = mapper_list_next(link);
+    }
+    if (!n)
+        return error;
+
+    for (i = 0; i < n; i++) {
+        sb->iovecs[i].iov_base = sb->buffer + (size_t)sb->iovecs[i].iov_base;
+        sb->headers[i].msg_hdr.msg_iov = &sb->iovecs[i];
+        sb->headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int fd = lo_server_get_socket_fd(dev->local->server);
+    while (sent < n) {
+        i = sendmmsg(fd, sb->headers + sent, n - sent, 0);
+        if (i <= 0)
+            break;
+        sent += i;
+    }
+    if (sent == n)
+        return error;
+
+    // send the remaining bundles one at a time, counting those dropped
+    int dropped = 0;
+    for (i = sent; i < n; i++) {
+        struct msghdr *h = &sb->headers[i].msg_hdr;
+        if (sendto(fd, h->msg_iov->iov_base, h->msg_iov->iov_len, 0,
+                   h->msg_name, h->msg_namelen) < 0)
+            ++dropped;
+    }
+    if (dropped)
+        trace("error sending batched updates, %d of %d bundles dropped.\n",
+              dropped, n);
+    return dropped || error;
+}
+#endif
+
 // Function to send a signal update queue
 void mapper_device_send_queue(mapper_device dev, mapper_timetag_t tt)
 {
     if (!dev)
         return;
 
+#ifdef HAVE_SENDMMSG
+    if (dev->local && dev->local->send_batch) {
+        send_queues_batched(dev, tt);
+        flush_streams(dev);
+        return;
+    }
+#endif
+
     mapper_link link = dev->database->links;
     while (link) {
         if (link->local)
             mapper_link_send_queue(link, tt);
         link = mapper_list_next(link);
     }
+    if (dev->local)
+        flush_streams(dev);
 }
 
 int mapper_device_route_query(mapper_device dev, mapper_signal sig,
@@ -1436,6 +2657,459 @@ int mapper_device_route_query(mapper_device dev, mapper_signal sig,
     return mapper_router_send_query(dev->local->router, sig, tt);
 }
 
+/* A bounded multi-producer queue after D. Vyukov: each slot carries a sequence
+ * number telling producers and the consumer whose turn it is, so producers
+ * only contend on the enqueue position and never wait for each other. Each
+ * queue has a single consumer: the thread servicing the device for the update
+ * queue, or the application thread for handler calls deferred by the network
+ * thread. */
+enum {
+    QUEUED_UPDATE,
+    QUEUED_INSTANCE_UPDATE,
+    QUEUED_HANDLER_CALL,
+    QUEUED_EVENT_CALL       // instance event is stored in count
+};
+
+typedef struct _mapper_queued_update {
+    size_t sequence;
+    mapper_signal sig;
+    mapper_id instance;
+    mapper_timetag_t tt;
+    int kind;
+    int count;
+    int has_value;
+    int padding;
+    char value[];
+} mapper_queued_update_t, *mapper_queued_update;
+
+typedef struct _mapper_update_queue {
+    char *slots;
+    size_t mask;
+    size_t stride;
+    int value_size;
+    char pad1[64];          // keep producer and consumer positions apart
+    size_t enqueue_pos;
+    char pad2[64];
+    size_t dequeue_pos;
+} mapper_update_queue_t, *mapper_update_queue;
+
+#define QUEUED_UPDATE(q, pos) \
+    ((mapper_queued_update)((q)->slots + ((pos) & (q)->mask) * (q)->stride))
+
+static mapper_update_queue new_update_queue(int num_slots, int value_size)
+{
+    size_t i, size = 1;
+    while (size < num_slots)
+        size <<= 1;
+
+    mapper_update_queue q;
+    q = (mapper_update_queue)calloc(1, sizeof(mapper_update_queue_t));
+    q->mask = size - 1;
+    q->value_size = value_size;
+    q->stride = (sizeof(mapper_queued_update_t) + value_size + 7) & ~7;
+    q->slots = (char*)calloc(size, q->stride);
+    if (!q->slots) {
+        free(q);
+        return 0;
+    }
+    for (i = 0; i < size; i++)
+        QUEUED_UPDATE(q, i)->sequence = i;
+    return q;
+}
+
+static void free_update_queue(mapper_update_queue q)
+{
+    if (!q)
+        return;
+    free(q->slots);
+    free(q);
+}
+
+/*! Copy an update into the next free slot, returning non-zero if the queue is
+ *  full or the value does not fit. Safe to call from any thread. */
+static int enqueue_update(mapper_update_queue q, int kind, mapper_signal sig,
+                          mapper_id instance, const void *value, int count,
+                          mapper_timetag_t tt)
+{
+    int size = 0;
+    if (value) {
+        size = mapper_signal_vector_bytes(sig) * (count > 1 ? count : 1);
+        if (size > q->value_size)
+            return 1;
+    }
+
+    mapper_queued_update u;
+    size_t seq, pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    while (1) {
+        u = QUEUED_UPDATE(q, pos);
+        seq = __atomic_load_n(&u->sequence, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if ((long)(seq - pos) < 0)
+            return 1;   // queue is full
+        else
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    }
+
+    u->sig = sig;
+    u->instance = instance;
+    u->kind = kind;
+    u->count = count;
+    u->has_value = value != 0;
+    if (value)
+        memcpy(u->value, value, size);
+    if (memcmp(&tt, &MAPPER_NOW, sizeof(mapper_timetag_t))==0)
+        mapper_timetag_now(&u->tt);
+    else
+        u->tt = tt;
+
+    __atomic_store_n(&u->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*! Process all updates that have been published to a queue so far. */
+static int process_update_queue(mapper_update_queue q)
+{
+    mapper_queued_update u;
+    mapper_signal_update_handler *h;
+    mapper_instance_event_handler *eh;
+    size_t pos = q->dequeue_pos;
+    int count = 0;
+
+    while (1) {
+        u = QUEUED_UPDATE(q, pos);
+        if (__atomic_load_n(&u->sequence, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+        if (!u->sig)
+            ;   // signal was removed
+        else if (u->kind == QUEUED_UPDATE)
+            mapper_signal_update(u->sig, u->value, u->count, u->tt);
+        else if (u->kind == QUEUED_INSTANCE_UPDATE) {
+            if (u->has_value)
+                mapper_signal_instance_update(u->sig, u->instance, u->value,
+                                              u->count, u->tt);
+            else
+                mapper_signal_instance_release(u->sig, u->instance, u->tt);
+        }
+        else if (u->kind == QUEUED_EVENT_CALL) {
+            if ((eh = u->sig->local->instance_event_handler))
+                eh(u->sig, u->instance, u->count, &u->tt);
+        }
+        else if ((h = u->sig->local->update_handler))
+            h(u->sig, u->instance, u->has_value ? u->value : 0, u->count,
+              &u->tt);
+        __atomic_store_n(&u->sequence, pos + q->mask + 1, __ATOMIC_RELEASE);
+        ++pos;
+        ++count;
+    }
+    q->dequeue_pos = pos;
+    return count;
+}
+
+/*! Neutralise queued updates for a signal that is being removed. Updates
+ *  queued after this point are the responsibility of the caller. */
+static void discard_queued_updates(mapper_update_queue q, mapper_signal sig)
+{
+    if (!q)
+        return;
+    mapper_queued_update u;
+    size_t pos = q->dequeue_pos;
+    while (1) {
+        u = QUEUED_UPDATE(q, pos);
+        if (__atomic_load_n(&u->sequence, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+        if (u->sig == sig)
+            u->sig = 0;
+        ++pos;
+    }
+}
+
+int mapper_device_reserve_update_queue(mapper_device dev, int num_slots,
+                                       int value_size)
+{
+    if (!dev || !dev->local || dev->local->update_queue || num_slots <= 0
+        || value_size < 0)
+        return 1;
+    mapper_update_queue q = new_update_queue(num_slots, value_size);
+    if (!q)
+        return 1;
+    __atomic_store_n(&dev->local->update_queue, q, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int mapper_device_enqueue_update(mapper_device dev, mapper_signal sig,
+                                 mapper_id instance, int use_instance,
+                                 const void *value, int count,
+                                 mapper_timetag_t tt)
+{
+    mapper_update_queue q = __atomic_load_n(&dev->local->update_queue,
+                                            __ATOMIC_ACQUIRE);
+    if (!q)
+        return 1;
+    if (enqueue_update(q, use_instance ? QUEUED_INSTANCE_UPDATE : QUEUED_UPDATE,
+                       sig, instance, value, count, tt))
+        return 1;
+    wake_thread(dev->local);
+    return 0;
+}
+
+/* Default number of slots for queues created by mapper_device_start_thread(). */
+#define THREAD_QUEUE_SIZE 1024
+
+/* While a network thread runs, the device, its database and everything they
+ * own are protected by a recursive mutex.  The thread holds it while handling
+ * messages but not while waiting for them; the application must hold it,
+ * using mapper_device_lock(), for any other call into the library. */
+typedef struct _mapper_device_thread {
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_mutex_t wake_lock;          /*!< Protects wake for deliveries. */
+    pthread_cond_t wake;                /*!< Signalled when a handler call is
+                                         *   deferred. */
+#endif
+    int running;
+    mapper_update_queue deliveries;     /*!< Deferred handler calls, if any. */
+} mapper_device_thread_t, *mapper_device_thread;
+
+void mapper_device_lock(mapper_device dev)
+{
+#ifdef HAVE_PTHREAD
+    if (dev && dev->local && dev->local->thread)
+        pthread_mutex_lock(&dev->local->thread->lock);
+#endif
+}
+
+void mapper_device_unlock(mapper_device dev)
+{
+#ifdef HAVE_PTHREAD
+    if (dev && dev->local && dev->local->thread)
+        pthread_mutex_unlock(&dev->local->thread->lock);
+#endif
+}
+
+static int handlers_deferred(mapper_device dev)
+{
+    return dev->local->thread && dev->local->thread->deliveries;
+}
+
+/*! Discard queued and deferred updates for a signal that is being removed. */
+static void discard_signal_updates(mapper_device dev, mapper_signal sig)
+{
+    discard_queued_updates(dev->local->update_queue, sig);
+    if (handlers_deferred(dev))
+        discard_queued_updates(dev->local->thread->deliveries, sig);
+}
+
+/*! Size of the largest value any signal of a device may need to queue. */
+static int max_value_size(mapper_device dev)
+{
+    int size = 64;
+    mapper_signal *sig = mapper_device_signals(dev, MAPPER_DIR_ANY);
+    while (sig) {
+        if (mapper_signal_vector_bytes(*sig) > size)
+            size = mapper_signal_vector_bytes(*sig);
+        sig = mapper_signal_query_next(sig);
+    }
+    return size;
+}
+
+/*! Copy a handler call to the deliveries queue and wake the application
+ *  thread if it is waiting in mapper_device_poll(). */
+static void defer_call(mapper_signal sig, int kind, mapper_id instance,
+                       const void *value, int count, mapper_timetag_t *tt)
+{
+    mapper_device_thread t = sig->device->local->thread;
+    if (enqueue_update(t->deliveries, kind, sig, instance, value, count, *tt)) {
+        trace("dropping deferred %s for signal '%s'\n",
+              kind == QUEUED_EVENT_CALL ? "event" : "update", sig->name);
+        return;
+    }
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&t->wake_lock);
+    pthread_cond_signal(&t->wake);
+    pthread_mutex_unlock(&t->wake_lock);
+#endif
+}
+
+/*! Update handler used while the network thread defers handlers to the
+ *  application thread. */
+static void defer_update_handler(mapper_signal sig, mapper_id instance,
+                                 const void *value, int count,
+                                 mapper_timetag_t *tt)
+{
+    defer_call(sig, QUEUED_HANDLER_CALL, instance, value, count, tt);
+}
+
+/*! Instance event handler used while the network thread defers handlers to
+ *  the application thread. */
+static void defer_event_handler(mapper_signal sig, mapper_id instance,
+                                mapper_instance_event event,
+                                mapper_timetag_t *tt)
+{
+    defer_call(sig, QUEUED_EVENT_CALL, instance, 0, event, tt);
+}
+
+mapper_signal_update_handler *mapper_device_update_handler(mapper_signal sig)
+{
+    mapper_signal_update_handler *h = sig->local->update_handler;
+    return h && handlers_deferred(sig->device) ? defer_update_handler : h;
+}
+
+mapper_instance_event_handler *mapper_device_event_handler(mapper_signal sig)
+{
+    mapper_instance_event_handler *h = sig->local->instance_event_handler;
+    return h && handlers_deferred(sig->device) ? defer_event_handler : h;
+}
+
+#ifdef HAVE_PTHREAD
+static void *device_thread_func(void *data)
+{
+    mapper_device dev = (mapper_device)data;
+    mapper_local_device ldev = dev->local;
+    mapper_device_thread t = ldev->thread;
+    mapper_network net = dev->database->network;
+    struct timeval now, last_net_poll;
+    int ready, admin_count, device_count;
+
+    gettimeofday(&last_net_poll, NULL);
+    while (__atomic_load_n(&t->running, __ATOMIC_ACQUIRE)) {
+        // wait without the lock so that the application may use the device
+        ready = wait_for_sockets(ldev, ldev->shm_pending
+                                 ? 0 : NETWORK_POLL_INTERVAL_MS);
+        pthread_mutex_lock(&t->lock);
+        admin_count = device_count = 0;
+        service_sockets(dev, ready, &now, &last_net_poll, &admin_count,
+                        &device_count);
+        net->msgs_recvd += admin_count;
+        // after draining the wake descriptor, so no update is left waiting
+        if (ldev->update_queue)
+            process_update_queue(ldev->update_queue);
+        flush_streams(dev);
+        pthread_mutex_unlock(&t->lock);
+    }
+    return 0;
+}
+#endif
+
+int mapper_device_start_thread(mapper_device dev, int defer_handlers)
+{
+    if (!dev || !dev->local || dev->local->thread)
+        return 1;
+#ifdef HAVE_PTHREAD
+    // the application must now queue its updates
+    if (!dev->local->update_queue)
+        mapper_device_reserve_update_queue(dev, THREAD_QUEUE_SIZE,
+                                           max_value_size(dev));
+    if (open_wake(dev->local))
+        trace("error: could not open wake descriptor, queued updates will "
+              "wait for the next message.\n");
+    if (!dev->local->poller_open)
+        open_poller(dev);
+
+    mapper_device_thread t;
+    pthread_mutexattr_t attr;
+    t = (mapper_device_thread)calloc(1, sizeof(mapper_device_thread_t));
+    if (defer_handlers)
+        t->deliveries = new_update_queue(THREAD_QUEUE_SIZE,
+                                         max_value_size(dev));
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&t->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&t->wake_lock, 0);
+    pthread_cond_init(&t->wake, 0);
+    t->running = 1;
+    dev->local->thread = t;
+    invalidate_local_destinations();
+    if (pthread_create(&t->thread, 0, device_thread_func, dev)) {
+        trace("error: could not start network thread.\n");
+        pthread_mutex_destroy(&t->lock);
+        pthread_mutex_destroy(&t->wake_lock);
+        pthread_cond_destroy(&t->wake);
+        free_update_queue(t->deliveries);
+        free(t);
+        dev->local->thread = 0;
+        close_wake(dev->local);
+        return 1;
+    }
+    return 0;
+#else
+    trace("network thread is not available on this platform.\n");
+    return 1;
+#endif
+}
+
+void mapper_device_stop_thread(mapper_device dev)
+{
+    if (!dev || !dev->local || !dev->local->thread)
+        return;
+    mapper_device_thread t = dev->local->thread;
+#ifdef HAVE_PTHREAD
+    __atomic_store_n(&t->running, 0, __ATOMIC_RELEASE);
+    pthread_join(t->thread, 0);
+    pthread_mutex_destroy(&t->lock);
+    pthread_mutex_destroy(&t->wake_lock);
+    pthread_cond_destroy(&t->wake);
+#endif
+    dev->local->thread = 0;
+    close_wake(dev->local);
+    if (t->deliveries) {
+        // deliver anything still waiting
+        process_update_queue(t->deliveries);
+        free_update_queue(t->deliveries);
+    }
+    free(t);
+    invalidate_local_destinations();
+}
+
+/*! Return non-zero if an entry is waiting at the head of a queue. */
+static int queue_pending(mapper_update_queue q)
+{
+    mapper_queued_update u = QUEUED_UPDATE(q, q->dequeue_pos);
+    return __atomic_load_n(&u->sequence, __ATOMIC_ACQUIRE) == q->dequeue_pos + 1;
+}
+
+/*! Call deferred handlers on the application thread, holding the device lock
+ *  so that handlers may use the library, and waiting up to block_ms for some
+ *  to arrive. */
+static int dispatch_deliveries(mapper_device dev, int block_ms)
+{
+    mapper_device_thread t = dev->local->thread;
+    mapper_update_queue q = t->deliveries;
+    int count;
+    if (!q) {
+        if (block_ms)
+            usleep(block_ms * 1000);
+        return 0;
+    }
+#ifdef HAVE_PTHREAD
+    if (block_ms > 0 && !queue_pending(q)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += block_ms / 1000;
+        deadline.tv_nsec += (block_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_mutex_lock(&t->wake_lock);
+        while (!queue_pending(q)) {
+            if (pthread_cond_timedwait(&t->wake, &t->wake_lock, &deadline))
+                break;
+        }
+        pthread_mutex_unlock(&t->wake_lock);
+    }
+#endif
+    mapper_device_lock(dev);
+    count = process_update_queue(q);
+    mapper_device_unlock(dev);
+    return count;
+}
+
 void mapper_device_reserve_instance_id_map(mapper_device dev)
 {
     mapper_id_map map;
@@ -1444,6 +3118,57 @@ void mapper_device_reserve_instance_id_map(mapper_device dev)
     dev->local->reserve_id_maps = map;
 }
 
+/* Chains are kept in the same order as the active list, newest first, so that
+ * lookups return the same id map as a scan of the list would. */
+static void index_instance_id_map(mapper_id_map_index idx, mapper_id_map map,
+                                  int append)
+{
+    mapper_id_map *m = &idx->by_local[mapper_id_hash(map->local)
+                                      & (idx->size - 1)];
+    if (append) {
+        while (*m)
+            m = &(*m)->next_by_local;
+    }
+    map->next_by_local = *m;
+    *m = map;
+
+    m = &idx->by_global[mapper_id_hash(map->global) & (idx->size - 1)];
+    if (append) {
+        while (*m)
+            m = &(*m)->next_by_global;
+    }
+    map->next_by_global = *m;
+    *m = map;
+}
+
+static void reindex_group(mapper_device dev, int group_index)
+{
+    mapper_id_map_index idx = &dev->local->id_map_indexes[group_index];
+    mapper_id_map map = dev->local->active_id_maps[group_index];
+
+    int size = idx->size ? idx->size : 16;
+    while (size < idx->count)
+        size *= 2;
+    if (size != idx->size) {
+        idx->size = size;
+        idx->by_local = realloc(idx->by_local, sizeof(mapper_id_map) * size);
+        idx->by_global = realloc(idx->by_global, sizeof(mapper_id_map) * size);
+    }
+    memset(idx->by_local, 0, sizeof(mapper_id_map) * size);
+    memset(idx->by_global, 0, sizeof(mapper_id_map) * size);
+    while (map) {
+        index_instance_id_map(idx, map, 1);
+        map = map->next;
+    }
+}
+
+void mapper_device_reindex_instance_id_maps(mapper_device dev)
+{
+    int i;
+    for (i = 0; i < dev->local->num_signal_groups; i++)
+        reindex_group(dev, i);
+}
+
 mapper_id_map mapper_device_add_instance_id_map(mapper_device dev,
                                                 int group_index,
                                                 mapper_id local_id,
@@ -1460,9 +3185,32 @@ mapper_id_map mapper_device_add_instance_id_map(mapper_device dev,
     dev->local->reserve_id_maps = map->next;
     map->next = dev->local->active_id_maps[group_index];
     dev->local->active_id_maps[group_index] = map;
+
+    mapper_id_map_index idx = &dev->local->id_map_indexes[group_index];
+    if (++idx->count > idx->size)
+        reindex_group(dev, group_index);
+    else
+        index_instance_id_map(idx, map, 0);
     return map;
 }
 
+static void unindex_instance_id_map(mapper_id_map_index idx, mapper_id_map map)
+{
+    mapper_id_map *m = &idx->by_local[mapper_id_hash(map->local)
+                                      & (idx->size - 1)];
+    while (*m && *m != map)
+        m = &(*m)->next_by_local;
+    if (*m)
+        *m = map->next_by_local;
+
+    m = &idx->by_global[mapper_id_hash(map->global) & (idx->size - 1)];
+    while (*m && *m != map)
+        m = &(*m)->next_by_global;
+    if (*m)
+        *m = map->next_by_global;
+    --idx->count;
+}
+
 void mapper_device_remove_instance_id_map(mapper_device dev, int group_index,
                                           mapper_id_map map)
 {
@@ -1470,6 +3218,8 @@ void mapper_device_remove_instance_id_map(mapper_device dev, int group_index,
     while (*id_map) {
         if ((*id_map) == map) {
             *id_map = (*id_map)->next;
+            unindex_instance_id_map(&dev->local->id_map_indexes[group_index],
+                                    map);
             map->next = dev->local->reserve_id_maps;
             dev->local->reserve_id_maps = map;
             break;
@@ -1482,11 +3232,15 @@ mapper_id_map mapper_device_find_instance_id_map_by_local(mapper_device dev,
                                                           int group_index,
                                                           mapper_id local_id)
 {
-    mapper_id_map map = dev->local->active_id_maps[group_index];
+    mapper_id_map_index idx = &dev->local->id_map_indexes[group_index];
+    if (!idx->size)
+        return 0;
+    mapper_id_map map = idx->by_local[mapper_id_hash(local_id)
+                                      & (idx->size - 1)];
     while (map) {
         if (map->local == local_id)
             return map;
-        map = map->next;
+        map = map->next_by_local;
     }
     return 0;
 }
@@ -1495,11 +3249,15 @@ mapper_id_map mapper_device_find_instance_id_map_by_global(mapper_device dev,
                                                            int group_index,
                                                            mapper_id global_id)
 {
-    mapper_id_map map = dev->local->active_id_maps[group_index];
+    mapper_id_map_index idx = &dev->local->id_map_indexes[group_index];
+    if (!idx->size)
+        return 0;
+    mapper_id_map map = idx->by_global[mapper_id_hash(global_id)
+                                       & (idx->size - 1)];
     while (map) {
         if (map->global == global_id)
             return map;
-        map = map->next;
+        map = map->next_by_global;
     }
     return 0;
 }
@@ -1524,8 +3282,7 @@ void mapper_device_start_server(mapper_device dev, int starting_port)
     if (dev->local->server)
         return;
 
-    int len;
-    char port[16], *pport = port, *path = 0;
+    char port[16], *pport = port;
 
     if (starting_port)
         sprintf(port, "%d", starting_port);
@@ -1544,21 +3301,9 @@ void mapper_device_start_server(mapper_device dev, int starting_port)
                             NON_MODIFIABLE);
     trace("bound to port %i\n", portnum);
 
-    // add signal methods
-    mapper_signal *sig = mapper_device_signals(dev, MAPPER_DIR_ANY);
-    while (sig) {
-        if ((*sig)->local->update_handler)
-            lo_server_add_method(dev->local->server, (*sig)->path, NULL,
-                                 handler_signal, (void*)(*sig));
-
-        len = (int)strlen((*sig)->path) + 5;
-        path = (char*)realloc(path, len);
-        snprintf(path, len, "%s%s", (*sig)->path, "/get");
-        lo_server_add_method(dev->local->server, path, NULL, handler_query,
-                             (void*)(*sig));
-        sig = mapper_signal_query_next(sig);
-    }
-    free(path);
+    // signal paths are resolved by a single method
+    lo_server_add_method(dev->local->server, NULL, NULL, handler_dispatch,
+                         (void*)dev);
 }
 
 const char *mapper_device_name(mapper_device dev)
@@ -1573,6 +3318,7 @@ const char *mapper_device_name(mapper_device dev)
     dev->name = (char*)malloc(len);
     dev->name[0] = 0;
     snprintf(dev->name, len, "%s.%d", dev->identifier, dev->local->ordinal.value);
+    mapper_database_index_device(dev->database, dev);
     return dev->name;
 }
 
@@ -1810,7 +3556,10 @@ int mapper_device_set_from_message(mapper_device dev, mapper_message msg)
 {
     if (!msg)
         return 0;
-    return mapper_table_set_from_message(dev->props, msg, REMOTE_MODIFY);
+    int updated = mapper_table_set_from_message(dev->props, msg, REMOTE_MODIFY);
+    if (updated)
+        mapper_database_index_device(dev->database, dev);
+    return updated;
 }
 
 void mapper_device_send_inputs(mapper_device dev, int min, int max)
@@ -1986,6 +3735,11 @@ mapper_signal_group mapper_device_add_signal_group(mapper_device dev)
                                          dev->local->num_signal_groups
                                          * sizeof(mapper_id_map*));
     dev->local->active_id_maps[dev->local->num_signal_groups-1] = 0;
+    dev->local->id_map_indexes = realloc(dev->local->id_map_indexes,
+                                         dev->local->num_signal_groups
+                                         * sizeof(mapper_id_map_index_t));
+    memset(&dev->local->id_map_indexes[dev->local->num_signal_groups-1], 0,
+           sizeof(mapper_id_map_index_t));
 
     return dev->local->num_signal_groups-1;
 }
@@ -1997,13 +3751,19 @@ void mapper_device_remove_signal_group(mapper_device dev,
         return;
 
     int i = (int)group + 1;
+    free(dev->local->id_map_indexes[group].by_local);
+    free(dev->local->id_map_indexes[group].by_global);
     for (; i < dev->local->num_signal_groups; i++) {
         dev->local->active_id_maps[i-1] = dev->local->active_id_maps[i];
+        dev->local->id_map_indexes[i-1] = dev->local->id_map_indexes[i];
     }
     --dev->local->num_signal_groups;
     dev->local->active_id_maps = realloc(dev->local->active_id_maps,
                                          dev->local->num_signal_groups
                                          * sizeof(mapper_id_map *));
+    dev->local->id_map_indexes = realloc(dev->local->id_map_indexes,
+                                         dev->local->num_signal_groups
+                                         * sizeof(mapper_id_map_index_t));
 }
 
 void mapper_device_print(mapper_device dev)
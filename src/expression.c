@@ -120,7 +120,7 @@ static int alli(mapper_value_t *val, int length) {
     return 1;
 }
 
-static int allf(mapper_value_t *val, int length) {
+static float allf(mapper_value_t *val, int length) {
     int i;
     for (i = 0; i < length; i++) {
         if (val[i].f == 0) {
@@ -130,7 +130,7 @@ static int allf(mapper_value_t *val, int length) {
     return 1;
 }
 
-static int alld(mapper_value_t *val, int length) {
+static double alld(mapper_value_t *val, int length) {
     int i;
     for (i = 0; i < length; i++) {
         if (val[i].d == 0) {
@@ -441,6 +441,7 @@ typedef enum {
     OP_CONDITIONAL_IF_THEN,
     OP_CONDITIONAL_IF_ELSE,
     OP_CONDITIONAL_IF_THEN_ELSE,
+    N_OPS
 } expr_op_t;
 
 #define NONE        0x0
@@ -912,6 +913,45 @@ static int expr_lex(const char *str, int index, mapper_token_t *tok)
     return 1;
 }
 
+/*! Instruction types for compiled expressions. */
+typedef enum {
+    INSTR_CONST,            //!< Fill register with a constant.
+    INSTR_LOAD_INPUT,       //!< Load from an input history.
+    INSTR_LOAD_OUTPUT,      //!< Load from the output history.
+    INSTR_LOAD_VAR,         //!< Load from a user-defined variable history.
+    INSTR_KERNEL,           //!< Apply an operator, function or typecast kernel.
+    INSTR_VFUNC,            //!< Apply a reducing vector function.
+    INSTR_MOVE,             //!< Copy elements between registers.
+    INSTR_STORE_OUTPUT,     //!< Store register contents to the output history.
+    INSTR_STORE_VAR,        //!< Store register contents to a user variable.
+} expr_instr_t;
+
+/*! Kernels operate in place on a run of registers; operand n of the kernel is
+ *  found at a + n * stride. */
+typedef void mapper_kernel(mapper_value_t *a, int stride, void *f, int len);
+
+/*! Copy functions move typed history values in and out of registers. */
+typedef void mapper_copy(void *dst, const void *src, int len);
+
+/*! A single instruction of a compiled expression.  All types, vector lengths,
+ *  register offsets and function pointers are resolved at compile time. */
+typedef struct _instruction {
+    expr_instr_t instr;
+    mapper_kernel *kernel;      //!< Kernel for INSTR_KERNEL and INSTR_VFUNC.
+    mapper_copy *copy;          //!< Copy function for loads and stores.
+    void *func;                 //!< Function pointer passed to the kernel.
+    mapper_value_t value;       //!< Constant value for INSTR_CONST.
+    int reg;                    //!< Offset of the destination register.
+    int src;                    //!< Offset of the source register for moves.
+    int length;                 //!< Vector length of the result.
+    int in_length;              //!< Vector length of INSTR_VFUNC argument.
+    int vector_index;           //!< Vector index for loads and stores.
+    int offset;                 //!< Assignment offset for stores.
+    int var;                    //!< Input slot or user variable index.
+    int history_index;
+    char datatype;
+} mapper_instruction_t, *mapper_instruction;
+
 struct _mapper_expr
 {
     mapper_token tokens;
@@ -924,6 +964,17 @@ struct _mapper_expr
     int output_history_size;
     int num_variables;
     int constant_output;
+
+    /* Compiled form of the token stack, or null if the expression can only be
+     * evaluated by the token interpreter. */
+    mapper_instruction instructions;
+    mapper_value_t *registers;
+    int num_instructions;
+    int start_instruction;
+    int register_stride;
+    int result_register;
+    int use_compiled;
+    char output_type;
 };
 
 void mapper_expr_free(mapper_expr expr)
@@ -931,6 +982,10 @@ void mapper_expr_free(mapper_expr expr)
     int i;
     if (expr->tokens)
         free(expr->tokens);
+    if (expr->instructions)
+        free(expr->instructions);
+    if (expr->registers)
+        free(expr->registers);
     if (expr->num_variables && expr->variables) {
         for (i = 0; i < expr->num_variables; i++) {
             free(expr->variables[i].name);
@@ -1138,6 +1193,7 @@ static int precompute(mapper_token_t *stack, int length, int vector_length)
     e.vector_size = vector_length;
     e.variables = 0;
     e.num_variables = 0;
+    e.instructions = 0;
     mapper_history_t h;
 
     void *v = malloc(mapper_type_size(stack[length-1].datatype) * vector_length);
@@ -1490,6 +1546,1023 @@ static int find_variable_by_name(mapper_variable_t *variables, int num_variables
     return -1;
 }
 
+/**** Compiled expressions ****/
+
+/* Since the depth of the evaluation stack is known at every token once parsing
+ * is finished, each stack position can be mapped to a fixed register and the
+ * token stack lowered to a flat array of instructions.  Kernels below are
+ * specialised by datatype and chosen once at compile time, so evaluation does
+ * not need to dispatch on token or data types. */
+
+#define KERNEL_UNARY(NAME, T, EXPR)                                 \
+static void NAME(mapper_value_t *a, int stride, void *f, int len)   \
+{                                                                   \
+    int i;                                                          \
+    for (i = 0; i < len; i++)                                       \
+        a[i].T = EXPR;                                              \
+}
+#define KERNEL_BINARY(NAME, T, EXPR)                                \
+static void NAME(mapper_value_t *a, int stride, void *f, int len)   \
+{                                                                   \
+    int i;                                                          \
+    mapper_value_t *b = a + stride;                                 \
+    for (i = 0; i < len; i++)                                       \
+        a[i].T = EXPR;                                              \
+}
+#define KERNEL_TERNARY(NAME, T, EXPR)                               \
+static void NAME(mapper_value_t *a, int stride, void *f, int len)   \
+{                                                                   \
+    int i;                                                          \
+    mapper_value_t *b = a + stride, *c = b + stride;                \
+    for (i = 0; i < len; i++)                                       \
+        a[i].T = EXPR;                                              \
+}
+
+#define KERNELS_ARITHMETIC(T, S)                                    \
+KERNEL_UNARY(k_not_##S,     T, !a[i].T)                             \
+KERNEL_BINARY(k_mul_##S,    T, a[i].T * b[i].T)                     \
+KERNEL_BINARY(k_div_##S,    T, a[i].T / b[i].T)                     \
+KERNEL_BINARY(k_add_##S,    T, a[i].T + b[i].T)                     \
+KERNEL_BINARY(k_sub_##S,    T, a[i].T - b[i].T)                     \
+KERNEL_BINARY(k_gt_##S,     T, a[i].T > b[i].T)                     \
+KERNEL_BINARY(k_gte_##S,    T, a[i].T >= b[i].T)                    \
+KERNEL_BINARY(k_lt_##S,     T, a[i].T < b[i].T)                     \
+KERNEL_BINARY(k_lte_##S,    T, a[i].T <= b[i].T)                    \
+KERNEL_BINARY(k_eq_##S,     T, a[i].T == b[i].T)                    \
+KERNEL_BINARY(k_neq_##S,    T, a[i].T != b[i].T)                    \
+KERNEL_BINARY(k_and_##S,    T, a[i].T && b[i].T)                    \
+KERNEL_BINARY(k_or_##S,     T, a[i].T || b[i].T)                    \
+KERNEL_BINARY(k_else_##S,   T, a[i].T ? a[i].T : b[i].T)            \
+KERNEL_TERNARY(k_ifelse_##S, T, a[i].T ? b[i].T : c[i].T)
+
+KERNELS_ARITHMETIC(i32, i)
+KERNELS_ARITHMETIC(f, f)
+KERNELS_ARITHMETIC(d, d)
+
+KERNEL_BINARY(k_mod_i,      i32, a[i].i32 % b[i].i32)
+KERNEL_BINARY(k_mod_f,      f, fmod(a[i].f, b[i].f))
+KERNEL_BINARY(k_mod_d,      d, fmod(a[i].d, b[i].d))
+KERNEL_BINARY(k_lshift_i,   i32, a[i].i32 << b[i].i32)
+KERNEL_BINARY(k_rshift_i,   i32, a[i].i32 >> b[i].i32)
+KERNEL_BINARY(k_bitand_i,   i32, a[i].i32 & b[i].i32)
+KERNEL_BINARY(k_bitxor_i,   i32, a[i].i32 ^ b[i].i32)
+KERNEL_BINARY(k_bitor_i,    i32, a[i].i32 | b[i].i32)
+
+/* Typecasts, named k_<from>_to_<to>. */
+KERNEL_UNARY(k_f_to_i,      i32, (int)a[i].f)
+KERNEL_UNARY(k_d_to_i,      i32, (int)a[i].d)
+KERNEL_UNARY(k_i_to_f,      f, (float)a[i].i32)
+KERNEL_UNARY(k_d_to_f,      f, (float)a[i].d)
+KERNEL_UNARY(k_i_to_d,      d, (double)a[i].i32)
+KERNEL_UNARY(k_f_to_d,      d, (double)a[i].f)
+
+/* Function calls, one kernel per datatype and arity. */
+KERNEL_UNARY(k_func0_i,     i32, ((func_int32_arity0*)f)())
+KERNEL_UNARY(k_func1_i,     i32, ((func_int32_arity1*)f)(a[i].i32))
+KERNEL_BINARY(k_func2_i,    i32, ((func_int32_arity2*)f)(a[i].i32, b[i].i32))
+KERNEL_UNARY(k_func0_f,     f, ((func_float_arity0*)f)())
+KERNEL_UNARY(k_func1_f,     f, ((func_float_arity1*)f)(a[i].f))
+KERNEL_BINARY(k_func2_f,    f, ((func_float_arity2*)f)(a[i].f, b[i].f))
+KERNEL_TERNARY(k_func3_f,   f, ((func_float_arity3*)f)(a[i].f, b[i].f, c[i].f))
+KERNEL_UNARY(k_func0_d,     d, ((func_double_arity0*)f)())
+KERNEL_UNARY(k_func1_d,     d, ((func_double_arity1*)f)(a[i].d))
+KERNEL_BINARY(k_func2_d,    d, ((func_double_arity2*)f)(a[i].d, b[i].d))
+KERNEL_TERNARY(k_func3_d,   d, ((func_double_arity3*)f)(a[i].d, b[i].d, c[i].d))
+
+static void k_func4_f(mapper_value_t *a, int stride, void *f, int len)
+{
+    int i;
+    mapper_value_t *b = a + stride, *c = b + stride, *d = c + stride;
+    for (i = 0; i < len; i++)
+        a[i].f = ((func_float_arity4*)f)(a[i].f, b[i].f, c[i].f, d[i].f);
+}
+
+static void k_func4_d(mapper_value_t *a, int stride, void *f, int len)
+{
+    int i;
+    mapper_value_t *b = a + stride, *c = b + stride, *d = c + stride;
+    for (i = 0; i < len; i++)
+        a[i].d = ((func_double_arity4*)f)(a[i].d, b[i].d, c[i].d, d[i].d);
+}
+
+/* Reducing vector functions store their result in the first element. */
+static void k_vfunc_i(mapper_value_t *a, int stride, void *f, int len)
+{
+    a[0].i32 = ((vfunc_int32_arity1*)f)(a, len);
+}
+
+static void k_vfunc_f(mapper_value_t *a, int stride, void *f, int len)
+{
+    a[0].f = ((vfunc_float_arity1*)f)(a, len);
+}
+
+static void k_vfunc_d(mapper_value_t *a, int stride, void *f, int len)
+{
+    a[0].d = ((vfunc_double_arity1*)f)(a, len);
+}
+
+/* Loads and stores between typed history buffers and registers. */
+static void load_i(void *dst, const void *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        ((mapper_value_t*)dst)[i].i32 = ((int*)src)[i];
+}
+
+static void load_f(void *dst, const void *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        ((mapper_value_t*)dst)[i].f = ((float*)src)[i];
+}
+
+static void load_d(void *dst, const void *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        ((mapper_value_t*)dst)[i].d = ((double*)src)[i];
+}
+
+static void store_i(void *dst, const void *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        ((int*)dst)[i] = ((mapper_value_t*)src)[i].i32;
+}
+
+static void store_f(void *dst, const void *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        ((float*)dst)[i] = ((mapper_value_t*)src)[i].f;
+}
+
+static void store_d(void *dst, const void *src, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        ((double*)dst)[i] = ((mapper_value_t*)src)[i].d;
+}
+
+/* Kernel tables are indexed by [operator][datatype] where datatype is the
+ * index returned by type_index(). */
+static mapper_kernel *op_kernels[][3] = {
+    { k_not_i,      k_not_f,    k_not_d     },  // OP_LOGICAL_NOT
+    { k_mul_i,      k_mul_f,    k_mul_d     },  // OP_MULTIPLY
+    { k_div_i,      k_div_f,    k_div_d     },  // OP_DIVIDE
+    { k_mod_i,      k_mod_f,    k_mod_d     },  // OP_MODULO
+    { k_add_i,      k_add_f,    k_add_d     },  // OP_ADD
+    { k_sub_i,      k_sub_f,    k_sub_d     },  // OP_SUBTRACT
+    { k_lshift_i,   0,          0           },  // OP_LEFT_BIT_SHIFT
+    { k_rshift_i,   0,          0           },  // OP_RIGHT_BIT_SHIFT
+    { k_gt_i,       k_gt_f,     k_gt_d      },  // OP_IS_GREATER_THAN
+    { k_gte_i,      k_gte_f,    k_gte_d     },  // OP_IS_GREATER_THAN_OR_EQUAL
+    { k_lt_i,       k_lt_f,     k_lt_d      },  // OP_IS_LESS_THAN
+    { k_lte_i,      k_lte_f,    k_lte_d     },  // OP_IS_LESS_THAN_OR_EQUAL
+    { k_eq_i,       k_eq_f,     k_eq_d      },  // OP_IS_EQUAL
+    { k_neq_i,      k_neq_f,    k_neq_d     },  // OP_IS_NOT_EQUAL
+    { k_bitand_i,   0,          0           },  // OP_BITWISE_AND
+    { k_bitxor_i,   0,          0           },  // OP_BITWISE_XOR
+    { k_bitor_i,    0,          0           },  // OP_BITWISE_OR
+    { k_and_i,      k_and_f,    k_and_d     },  // OP_LOGICAL_AND
+    { k_or_i,       k_or_f,     k_or_d      },  // OP_LOGICAL_OR
+    { 0,            0,          0           },  // OP_CONDITIONAL_IF_THEN
+    { k_else_i,     k_else_f,   k_else_d    },  // OP_CONDITIONAL_IF_ELSE
+    { k_ifelse_i,   k_ifelse_f, k_ifelse_d  },  // OP_CONDITIONAL_IF_THEN_ELSE
+};
+
+static mapper_kernel *func_kernels[][3] = {
+    { k_func0_i,    k_func0_f,  k_func0_d   },
+    { k_func1_i,    k_func1_f,  k_func1_d   },
+    { k_func2_i,    k_func2_f,  k_func2_d   },
+    { 0,            k_func3_f,  k_func3_d   },
+    { 0,            k_func4_f,  k_func4_d   },
+};
+
+static mapper_kernel *vfunc_kernels[3] = { k_vfunc_i, k_vfunc_f, k_vfunc_d };
+
+static mapper_kernel *cast_kernels[][3] = {
+    { 0,            k_i_to_f,   k_i_to_d    },  // from 'i'
+    { k_f_to_i,     0,          k_f_to_d    },  // from 'f'
+    { k_d_to_i,     k_d_to_f,   0           },  // from 'd'
+};
+
+static mapper_copy *load_functions[3] = { load_i, load_f, load_d };
+static mapper_copy *store_functions[3] = { store_i, store_f, store_d };
+
+static int type_index(char type)
+{
+    switch (type) {
+        case 'i':   return 0;
+        case 'f':   return 1;
+        case 'd':   return 2;
+        default:    return -1;
+    }
+}
+
+/**** SIMD kernels ****/
+
+/* Vectorised variants of the float and double kernels are selected at compile
+ * time when the host supports them.  Registers hold mapper_value_t unions, so
+ * doubles are contiguous while floats occupy every other 32-bit lane; float
+ * kernels pack the even lanes on load and zero the odd lanes on store.  AVX
+ * shuffles and unpacks work within each 128-bit half, so packed floats are
+ * permuted across halves to keep registers in natural element order. */
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_SIMD_KERNELS 1
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define SSE_LOAD_F(p)                                               \
+    _mm_shuffle_ps(_mm_loadu_ps(&(p)[0].f), _mm_loadu_ps(&(p)[2].f), 0x88)
+#define SSE_STORE_F(p, r) {                                         \
+    _mm_storeu_ps(&(p)[0].f, _mm_unpacklo_ps(r, _mm_setzero_ps())); \
+    _mm_storeu_ps(&(p)[2].f, _mm_unpackhi_ps(r, _mm_setzero_ps())); \
+}
+#define SSE_LOAD_D(p) _mm_loadu_pd(&(p)[0].d)
+#define SSE_STORE_D(p, r) _mm_storeu_pd(&(p)[0].d, r)
+
+/* Swaps elements 2,3 with 4,5; this is its own inverse. */
+#define AVX_CROSS_F _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7)
+#define AVX_LOAD_F(p)                                               \
+    _mm256_permutevar8x32_ps(                                       \
+        _mm256_shuffle_ps(_mm256_loadu_ps(&(p)[0].f),               \
+                          _mm256_loadu_ps(&(p)[4].f), 0x88), AVX_CROSS_F)
+#define AVX_STORE_F(p, r) {                                         \
+    __m256 _c = _mm256_permutevar8x32_ps(r, AVX_CROSS_F);           \
+    _mm256_storeu_ps(&(p)[0].f, _mm256_unpacklo_ps(_c, _mm256_setzero_ps())); \
+    _mm256_storeu_ps(&(p)[4].f, _mm256_unpackhi_ps(_c, _mm256_setzero_ps())); \
+}
+#define AVX_LOAD_D(p) _mm256_loadu_pd(&(p)[0].d)
+#define AVX_STORE_D(p, r) _mm256_storeu_pd(&(p)[0].d, r)
+
+/* Comparisons yield all-ones masks, convert to 1.0 or 0.0. */
+#define SSE_CMP_F(OP, x, y) _mm_and_ps(_mm_##OP##_ps(x, y), _mm_set1_ps(1.f))
+#define SSE_CMP_D(OP, x, y) _mm_and_pd(_mm_##OP##_pd(x, y), _mm_set1_pd(1.))
+#define AVX_CMP_F(P, x, y)                                          \
+    _mm256_and_ps(_mm256_cmp_ps(x, y, P), _mm256_set1_ps(1.f))
+#define AVX_CMP_D(P, x, y)                                          \
+    _mm256_and_pd(_mm256_cmp_pd(x, y, P), _mm256_set1_pd(1.))
+
+#define SIMD_UNARY(NAME, ATTR, T, VT, W, LOAD, STORE, VEXPR, EXPR)  \
+static ATTR void NAME(mapper_value_t *a, int stride, void *f, int len) \
+{                                                                   \
+    int i;                                                          \
+    for (i = 0; i + W <= len; i += W) {                             \
+        VT x = LOAD(a + i);                                         \
+        STORE(a + i, VEXPR);                                        \
+    }                                                               \
+    for (; i < len; i++)                                            \
+        a[i].T = EXPR;                                              \
+}
+#define SIMD_BINARY(NAME, ATTR, T, VT, W, LOAD, STORE, VEXPR, EXPR) \
+static ATTR void NAME(mapper_value_t *a, int stride, void *f, int len) \
+{                                                                   \
+    int i;                                                          \
+    mapper_value_t *b = a + stride;                                 \
+    for (i = 0; i + W <= len; i += W) {                             \
+        VT x = LOAD(a + i), y = LOAD(b + i);                        \
+        STORE(a + i, VEXPR);                                        \
+    }                                                               \
+    for (; i < len; i++)                                            \
+        a[i].T = EXPR;                                              \
+}
+
+#define SSE_KERNELS(T, S, VT, W, P)                                             \
+SIMD_BINARY(sse_add_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            _mm_add_p##S(x, y), a[i].T + b[i].T)                                \
+SIMD_BINARY(sse_sub_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            _mm_sub_p##S(x, y), a[i].T - b[i].T)                                \
+SIMD_BINARY(sse_mul_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            _mm_mul_p##S(x, y), a[i].T * b[i].T)                                \
+SIMD_BINARY(sse_div_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            _mm_div_p##S(x, y), a[i].T / b[i].T)                                \
+SIMD_BINARY(sse_gt_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,                \
+            SSE_CMP_##P(cmpgt, x, y), a[i].T > b[i].T)                          \
+SIMD_BINARY(sse_gte_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            SSE_CMP_##P(cmpge, x, y), a[i].T >= b[i].T)                         \
+SIMD_BINARY(sse_lt_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,                \
+            SSE_CMP_##P(cmplt, x, y), a[i].T < b[i].T)                          \
+SIMD_BINARY(sse_lte_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            SSE_CMP_##P(cmple, x, y), a[i].T <= b[i].T)                         \
+SIMD_BINARY(sse_eq_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,                \
+            SSE_CMP_##P(cmpeq, x, y), a[i].T == b[i].T)                         \
+SIMD_BINARY(sse_neq_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            SSE_CMP_##P(cmpneq, x, y), a[i].T != b[i].T)                        \
+SIMD_BINARY(sse_min_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            _mm_min_p##S(y, x), b[i].T < a[i].T ? b[i].T : a[i].T)              \
+SIMD_BINARY(sse_max_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+            _mm_max_p##S(y, x), b[i].T > a[i].T ? b[i].T : a[i].T)              \
+SIMD_UNARY(sse_sqrt_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,               \
+           _mm_sqrt_p##S(x), sqrt(a[i].T))                                      \
+SIMD_UNARY(sse_abs_##S, , T, VT, W, SSE_LOAD_##P, SSE_STORE_##P,                \
+           _mm_andnot_p##S(_mm_set1_p##S(-0.), x), fabs(a[i].T))
+
+#define AVX_KERNELS(T, S, VT, W, P)                                             \
+SIMD_BINARY(avx_add_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            _mm256_add_p##S(x, y), a[i].T + b[i].T)                             \
+SIMD_BINARY(avx_sub_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            _mm256_sub_p##S(x, y), a[i].T - b[i].T)                             \
+SIMD_BINARY(avx_mul_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            _mm256_mul_p##S(x, y), a[i].T * b[i].T)                             \
+SIMD_BINARY(avx_div_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            _mm256_div_p##S(x, y), a[i].T / b[i].T)                             \
+SIMD_BINARY(avx_gt_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,            \
+            AVX_CMP_##P(_CMP_GT_OQ, x, y), a[i].T > b[i].T)                     \
+SIMD_BINARY(avx_gte_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            AVX_CMP_##P(_CMP_GE_OQ, x, y), a[i].T >= b[i].T)                    \
+SIMD_BINARY(avx_lt_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,            \
+            AVX_CMP_##P(_CMP_LT_OQ, x, y), a[i].T < b[i].T)                     \
+SIMD_BINARY(avx_lte_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            AVX_CMP_##P(_CMP_LE_OQ, x, y), a[i].T <= b[i].T)                    \
+SIMD_BINARY(avx_eq_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,            \
+            AVX_CMP_##P(_CMP_EQ_OQ, x, y), a[i].T == b[i].T)                    \
+SIMD_BINARY(avx_neq_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            AVX_CMP_##P(_CMP_NEQ_UQ, x, y), a[i].T != b[i].T)                   \
+SIMD_BINARY(avx_min_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            _mm256_min_p##S(y, x), b[i].T < a[i].T ? b[i].T : a[i].T)           \
+SIMD_BINARY(avx_max_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+            _mm256_max_p##S(y, x), b[i].T > a[i].T ? b[i].T : a[i].T)           \
+SIMD_UNARY(avx_sqrt_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+           _mm256_sqrt_p##S(x), sqrt(a[i].T))                                   \
+SIMD_UNARY(avx_abs_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,            \
+           _mm256_andnot_p##S(_mm256_set1_p##S(-0.), x), fabs(a[i].T))          \
+SIMD_UNARY(avx_floor_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,          \
+           _mm256_round_p##S(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC),     \
+           floor(a[i].T))                                                       \
+SIMD_UNARY(avx_ceil_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,           \
+           _mm256_round_p##S(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC),     \
+           ceil(a[i].T))                                                        \
+SIMD_UNARY(avx_trunc_##S, AVX2, T, VT, W, AVX_LOAD_##P, AVX_STORE_##P,          \
+           _mm256_round_p##S(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC),        \
+           trunc(a[i].T))
+
+SSE_KERNELS(f, s, __m128, 4, F)
+SSE_KERNELS(d, d, __m128d, 2, D)
+AVX_KERNELS(f, s, __m256, 8, F)
+AVX_KERNELS(d, d, __m256d, 4, D)
+
+/* Vector functions.  Reductions accumulate one partial result per lane and
+ * combine the lanes before handling any remaining elements. */
+#define SIMD_VFUNCS(PRE, ATTR, T, RT, S, VT, W, LOAD, V)                        \
+static ATTR RT PRE##_sum##S(mapper_value_t *val, int length)                    \
+{                                                                               \
+    int i, j;                                                                   \
+    RT lanes[W], aggregate = 0;                                                 \
+    VT acc = V##_setzero_p##S();                                                \
+    for (i = 0; i + W <= length; i += W)                                        \
+        acc = V##_add_p##S(acc, LOAD(val + i));                                 \
+    V##_storeu_p##S(lanes, acc);                                                \
+    for (j = 0; j < W; j++)                                                     \
+        aggregate += lanes[j];                                                  \
+    for (; i < length; i++)                                                     \
+        aggregate += val[i].T;                                                  \
+    return aggregate;                                                           \
+}                                                                               \
+static ATTR RT PRE##_mean##S(mapper_value_t *val, int length)                   \
+{                                                                               \
+    return PRE##_sum##S(val, length) / (RT)length;                              \
+}                                                                               \
+static ATTR RT PRE##_max##S(mapper_value_t *val, int length)                    \
+{                                                                               \
+    int i, j;                                                                   \
+    RT lanes[W], max = val[0].T;                                                \
+    VT acc = V##_set1_p##S(max);                                                \
+    for (i = 0; i + W <= length; i += W)                                        \
+        acc = V##_max_p##S(LOAD(val + i), acc);                                 \
+    V##_storeu_p##S(lanes, acc);                                                \
+    for (j = 0; j < W; j++) {                                                   \
+        if (lanes[j] > max)                                                     \
+            max = lanes[j];                                                     \
+    }                                                                           \
+    for (; i < length; i++) {                                                   \
+        if (val[i].T > max)                                                     \
+            max = val[i].T;                                                     \
+    }                                                                           \
+    return max;                                                                 \
+}                                                                               \
+static ATTR RT PRE##_min##S(mapper_value_t *val, int length)                    \
+{                                                                               \
+    int i, j;                                                                   \
+    RT lanes[W], min = val[0].T;                                                \
+    VT acc = V##_set1_p##S(min);                                                \
+    for (i = 0; i + W <= length; i += W)                                        \
+        acc = V##_min_p##S(LOAD(val + i), acc);                                 \
+    V##_storeu_p##S(lanes, acc);                                                \
+    for (j = 0; j < W; j++) {                                                   \
+        if (lanes[j] < min)                                                     \
+            min = lanes[j];                                                     \
+    }                                                                           \
+    for (; i < length; i++) {                                                   \
+        if (val[i].T < min)                                                     \
+            min = val[i].T;                                                     \
+    }                                                                           \
+    return min;                                                                 \
+}                                                                               \
+static ATTR RT PRE##_all##S(mapper_value_t *val, int length)                    \
+{                                                                               \
+    int i;                                                                      \
+    VT zero = V##_setzero_p##S();                                               \
+    for (i = 0; i + W <= length; i += W) {                                      \
+        if (V##_movemask_p##S(PRE##_cmpeq_p##S(LOAD(val + i), zero)))           \
+            return 0;                                                           \
+    }                                                                           \
+    for (; i < length; i++) {                                                   \
+        if (val[i].T == 0)                                                      \
+            return 0;                                                           \
+    }                                                                           \
+    return 1;                                                                   \
+}                                                                               \
+static ATTR RT PRE##_any##S(mapper_value_t *val, int length)                    \
+{                                                                               \
+    int i;                                                                      \
+    VT zero = V##_setzero_p##S();                                               \
+    for (i = 0; i + W <= length; i += W) {                                      \
+        if (V##_movemask_p##S(PRE##_cmpneq_p##S(LOAD(val + i), zero)))          \
+            return 1;                                                           \
+    }                                                                           \
+    for (; i < length; i++) {                                                   \
+        if (val[i].T != 0)                                                      \
+            return 1;                                                           \
+    }                                                                           \
+    return 0;                                                                   \
+}
+
+#define sse_cmpeq_ps _mm_cmpeq_ps
+#define sse_cmpeq_pd _mm_cmpeq_pd
+#define sse_cmpneq_ps _mm_cmpneq_ps
+#define sse_cmpneq_pd _mm_cmpneq_pd
+#define avx_cmpeq_ps(x, y) _mm256_cmp_ps(x, y, _CMP_EQ_OQ)
+#define avx_cmpeq_pd(x, y) _mm256_cmp_pd(x, y, _CMP_EQ_OQ)
+#define avx_cmpneq_ps(x, y) _mm256_cmp_ps(x, y, _CMP_NEQ_UQ)
+#define avx_cmpneq_pd(x, y) _mm256_cmp_pd(x, y, _CMP_NEQ_UQ)
+
+SIMD_VFUNCS(sse, , f, float, s, __m128, 4, SSE_LOAD_F, _mm)
+SIMD_VFUNCS(sse, , d, double, d, __m128d, 2, SSE_LOAD_D, _mm)
+SIMD_VFUNCS(avx, AVX2, f, float, s, __m256, 8, AVX_LOAD_F, _mm256)
+SIMD_VFUNCS(avx, AVX2, d, double, d, __m256d, 4, AVX_LOAD_D, _mm256)
+
+/* Loads and stores between history buffers and registers. */
+#define SIMD_COPIES(PRE, ATTR, T, RT, S, W, LOAD, STORE, V)                     \
+static ATTR void PRE##_load_##S(void *dst, const void *src, int len)            \
+{                                                                               \
+    int i;                                                                      \
+    mapper_value_t *d = (mapper_value_t*)dst;                                   \
+    const RT *s = (const RT*)src;                                               \
+    for (i = 0; i + W <= len; i += W)                                           \
+        STORE(d + i, V##_loadu_p##S(s + i));                                    \
+    for (; i < len; i++)                                                        \
+        d[i].T = s[i];                                                          \
+}                                                                               \
+static ATTR void PRE##_store_##S(void *dst, const void *src, int len)           \
+{                                                                               \
+    int i;                                                                      \
+    RT *d = (RT*)dst;                                                           \
+    const mapper_value_t *s = (const mapper_value_t*)src;                       \
+    for (i = 0; i + W <= len; i += W)                                           \
+        V##_storeu_p##S(d + i, LOAD(s + i));                                    \
+    for (; i < len; i++)                                                        \
+        d[i] = s[i].T;                                                          \
+}
+
+SIMD_COPIES(sse, , f, float, s, 4, SSE_LOAD_F, SSE_STORE_F, _mm)
+SIMD_COPIES(sse, , d, double, d, 2, SSE_LOAD_D, SSE_STORE_D, _mm)
+SIMD_COPIES(avx, AVX2, f, float, s, 8, AVX_LOAD_F, AVX_STORE_F, _mm256)
+SIMD_COPIES(avx, AVX2, d, double, d, 4, AVX_LOAD_D, AVX_STORE_D, _mm256)
+
+/* Tables are indexed by [simd_level-1][operator or function][float/double]. */
+static mapper_kernel *simd_op_kernels[2][N_OPS][2] = {
+    {
+        [OP_MULTIPLY]                   = { sse_mul_s,  sse_mul_d   },
+        [OP_DIVIDE]                     = { sse_div_s,  sse_div_d   },
+        [OP_ADD]                        = { sse_add_s,  sse_add_d   },
+        [OP_SUBTRACT]                   = { sse_sub_s,  sse_sub_d   },
+        [OP_IS_GREATER_THAN]            = { sse_gt_s,   sse_gt_d    },
+        [OP_IS_GREATER_THAN_OR_EQUAL]   = { sse_gte_s,  sse_gte_d   },
+        [OP_IS_LESS_THAN]               = { sse_lt_s,   sse_lt_d    },
+        [OP_IS_LESS_THAN_OR_EQUAL]      = { sse_lte_s,  sse_lte_d   },
+        [OP_IS_EQUAL]                   = { sse_eq_s,   sse_eq_d    },
+        [OP_IS_NOT_EQUAL]               = { sse_neq_s,  sse_neq_d   },
+    },
+    {
+        [OP_MULTIPLY]                   = { avx_mul_s,  avx_mul_d   },
+        [OP_DIVIDE]                     = { avx_div_s,  avx_div_d   },
+        [OP_ADD]                        = { avx_add_s,  avx_add_d   },
+        [OP_SUBTRACT]                   = { avx_sub_s,  avx_sub_d   },
+        [OP_IS_GREATER_THAN]            = { avx_gt_s,   avx_gt_d    },
+        [OP_IS_GREATER_THAN_OR_EQUAL]   = { avx_gte_s,  avx_gte_d   },
+        [OP_IS_LESS_THAN]               = { avx_lt_s,   avx_lt_d    },
+        [OP_IS_LESS_THAN_OR_EQUAL]      = { avx_lte_s,  avx_lte_d   },
+        [OP_IS_EQUAL]                   = { avx_eq_s,   avx_eq_d    },
+        [OP_IS_NOT_EQUAL]               = { avx_neq_s,  avx_neq_d   },
+    },
+};
+
+static mapper_kernel *simd_func_kernels[2][N_FUNCS][2] = {
+    {
+        [FUNC_ABS]                      = { sse_abs_s,  sse_abs_d   },
+        [FUNC_MAX]                      = { sse_max_s,  sse_max_d   },
+        [FUNC_MIN]                      = { sse_min_s,  sse_min_d   },
+        [FUNC_SQRT]                     = { sse_sqrt_s, sse_sqrt_d  },
+    },
+    {
+        [FUNC_ABS]                      = { avx_abs_s,  avx_abs_d   },
+        [FUNC_CEIL]                     = { avx_ceil_s, avx_ceil_d  },
+        [FUNC_FLOOR]                    = { avx_floor_s, avx_floor_d },
+        [FUNC_MAX]                      = { avx_max_s,  avx_max_d   },
+        [FUNC_MIN]                      = { avx_min_s,  avx_min_d   },
+        [FUNC_SQRT]                     = { avx_sqrt_s, avx_sqrt_d  },
+        [FUNC_TRUNC]                    = { avx_trunc_s, avx_trunc_d },
+    },
+};
+
+static void *simd_vfunctions[2][N_VFUNCS][2] = {
+    {
+        [VFUNC_ALL]                     = { sse_alls,   sse_alld    },
+        [VFUNC_ANY]                     = { sse_anys,   sse_anyd    },
+        [VFUNC_MEAN]                    = { sse_means,  sse_meand   },
+        [VFUNC_SUM]                     = { sse_sums,   sse_sumd    },
+        [VFUNC_MAX]                     = { sse_maxs,   sse_maxd    },
+        [VFUNC_MIN]                     = { sse_mins,   sse_mind    },
+    },
+    {
+        [VFUNC_ALL]                     = { avx_alls,   avx_alld    },
+        [VFUNC_ANY]                     = { avx_anys,   avx_anyd    },
+        [VFUNC_MEAN]                    = { avx_means,  avx_meand   },
+        [VFUNC_SUM]                     = { avx_sums,   avx_sumd    },
+        [VFUNC_MAX]                     = { avx_maxs,   avx_maxd    },
+        [VFUNC_MIN]                     = { avx_mins,   avx_mind    },
+    },
+};
+
+static mapper_copy *simd_loads[2][2] = {
+    { sse_load_s,   sse_load_d  },
+    { avx_load_s,   avx_load_d  },
+};
+
+static mapper_copy *simd_stores[2][2] = {
+    { sse_store_s,  sse_store_d },
+    { avx_store_s,  avx_store_d },
+};
+#endif /* HAVE_SIMD_KERNELS */
+
+/* Shorter vectors are faster with the portable kernels. */
+#define SIMD_MIN_LENGTH 8
+
+static int simd_level = -1;
+static int simd_enabled = 1;
+
+/*! Returns 2 if AVX2 kernels may be used, 1 for SSE2 kernels, or 0 if only
+ *  the portable kernels are available. */
+static int get_simd_level()
+{
+    if (simd_level < 0) {
+#ifdef HAVE_SIMD_KERNELS
+        __builtin_cpu_init();
+        simd_level = __builtin_cpu_supports("avx2") ? 2 : 1;
+#else
+        simd_level = 0;
+#endif
+    }
+    return simd_enabled ? simd_level : 0;
+}
+
+int mapper_expr_enable_simd(int enable)
+{
+    simd_enabled = enable ? 1 : 0;
+    return get_simd_level();
+}
+
+static mapper_kernel *simd_op_kernel(int op, char type, int length)
+{
+#ifdef HAVE_SIMD_KERNELS
+    int level = get_simd_level();
+    if (level && length >= SIMD_MIN_LENGTH && (type == 'f' || type == 'd'))
+        return simd_op_kernels[level-1][op][type == 'd'];
+#endif
+    return 0;
+}
+
+static mapper_kernel *simd_func_kernel(int func, char type, int length)
+{
+#ifdef HAVE_SIMD_KERNELS
+    int level = get_simd_level();
+    if (level && length >= SIMD_MIN_LENGTH && (type == 'f' || type == 'd'))
+        return simd_func_kernels[level-1][func][type == 'd'];
+#endif
+    return 0;
+}
+
+static mapper_copy *load_function(char type, int length)
+{
+#ifdef HAVE_SIMD_KERNELS
+    int level = get_simd_level();
+    if (level && length >= SIMD_MIN_LENGTH && (type == 'f' || type == 'd'))
+        return simd_loads[level-1][type == 'd'];
+#endif
+    return load_functions[type_index(type)];
+}
+
+static mapper_copy *store_function(char type, int length)
+{
+#ifdef HAVE_SIMD_KERNELS
+    int level = get_simd_level();
+    if (level && length >= SIMD_MIN_LENGTH && (type == 'f' || type == 'd'))
+        return simd_stores[level-1][type == 'd'];
+#endif
+    return store_functions[type_index(type)];
+}
+
+static void *simd_vfunction(int vfunc, char type, int length)
+{
+#ifdef HAVE_SIMD_KERNELS
+    int level = get_simd_level();
+    if (level && length >= SIMD_MIN_LENGTH && (type == 'f' || type == 'd'))
+        return simd_vfunctions[level-1][vfunc][type == 'd'];
+#endif
+    return 0;
+}
+
+static void *typed_function(void *func_int32, void *func_float,
+                            void *func_double, char type)
+{
+    switch (type) {
+        case 'i':   return func_int32;
+        case 'f':   return func_float;
+        case 'd':   return func_double;
+        default:    return 0;
+    }
+}
+
+/* Cast a constant at compile time, mirroring the runtime cast kernels. */
+static int cast_constant(mapper_value_t *value, char from, char to)
+{
+    mapper_kernel *k = cast_kernels[type_index(from)][type_index(to)];
+    if (!k)
+        return 1;
+    k(value, 0, 0, 1);
+    return 0;
+}
+
+/*! Lower the parsed token stack to a flat instruction array.  Returns non-zero
+ *  if the expression uses features that are only supported by the token
+ *  interpreter, in which case the expression is left uncompiled. */
+static int compile_expr(mapper_expr expr, const char *input_types,
+                        char output_type)
+{
+    mapper_token_t *tok = expr->tokens;
+    int i, j, k, top = -1, num_regs = 0, count = 0, stride = expr->vector_size;
+    int dims[expr->length];
+
+    for (i = 0; i < expr->length; i++) {
+        if (tok[i].vector_length > stride)
+            stride = tok[i].vector_length;
+    }
+
+    // every token produces at most one instruction plus one typecast, except
+    // vectorizers which produce one move per appended operand
+    int max_instr = expr->length * 2;
+    for (i = 0; i < expr->length; i++) {
+        if (tok[i].toktype == TOK_VECTORIZE)
+            max_instr += tok[i].arity;
+    }
+    mapper_instruction_t *instr = calloc(1, sizeof(mapper_instruction_t)
+                                         * max_instr);
+    mapper_instruction ins;
+    int t, start_instruction = 0;
+
+    for (i = 0; i < expr->length && tok->toktype != TOK_END; i++, tok++) {
+        ins = &instr[count];
+        t = type_index(tok->datatype);
+        if (t < 0)
+            goto fail;
+        switch (tok->toktype) {
+            case TOK_CONST:
+                ++top;
+                ins->instr = INSTR_CONST;
+                switch (tok->datatype) {
+                    case 'i':   ins->value.i32 = tok->i;    break;
+                    case 'f':   ins->value.f = tok->f;      break;
+                    case 'd':   ins->value.d = tok->d;      break;
+                }
+                ins->datatype = tok->datatype;
+                if (tok->casttype) {
+                    // fold typecast of constants at compile time
+                    if (cast_constant(&ins->value, tok->datatype, tok->casttype))
+                        goto fail;
+                    ins->datatype = tok->casttype;
+                }
+                break;
+            case TOK_VAR:
+                ++top;
+                if (tok->var == VAR_Y) {
+                    ins->instr = INSTR_LOAD_OUTPUT;
+                    ins->copy = load_function(output_type, tok->vector_length);
+                    ins->datatype = output_type;
+                }
+                else if (tok->var >= VAR_X) {
+                    ins->instr = INSTR_LOAD_INPUT;
+                    ins->var = tok->var - VAR_X;
+                    ins->datatype = input_types[ins->var];
+                    if (type_index(ins->datatype) < 0)
+                        goto fail;
+                    ins->copy = load_function(ins->datatype, tok->vector_length);
+                }
+                else {
+                    ins->instr = INSTR_LOAD_VAR;
+                    ins->var = tok->var;
+                    ins->copy = load_d;
+                    ins->datatype = 'd';
+                }
+                ins->history_index = tok->history_index;
+                ins->vector_index = tok->vector_index;
+                break;
+            case TOK_OP:
+                top -= op_table[tok->op].arity - 1;
+                ins->instr = INSTR_KERNEL;
+                ins->kernel = simd_op_kernel(tok->op, tok->datatype,
+                                             tok->vector_length);
+                if (!ins->kernel)
+                    ins->kernel = op_kernels[tok->op][t];
+                if (!ins->kernel)
+                    goto fail;
+                break;
+            case TOK_FUNC:
+                top -= function_table[tok->func].arity - 1;
+                ins->instr = INSTR_KERNEL;
+                ins->kernel = simd_func_kernel(tok->func, tok->datatype,
+                                               tok->vector_length);
+                if (!ins->kernel)
+                    ins->kernel = func_kernels[(int)function_table[tok->func].arity][t];
+                ins->func = typed_function(function_table[tok->func].func_int32,
+                                           function_table[tok->func].func_float,
+                                           function_table[tok->func].func_double,
+                                           tok->datatype);
+                if (!ins->kernel || !ins->func)
+                    goto fail;
+                break;
+            case TOK_VFUNC:
+                if (top < 0)
+                    goto fail;
+                ins->instr = INSTR_VFUNC;
+                ins->kernel = vfunc_kernels[t];
+                ins->func = simd_vfunction(tok->func, tok->datatype, dims[top]);
+                if (!ins->func)
+                    ins->func = typed_function(vfunction_table[tok->func].func_int32,
+                                               vfunction_table[tok->func].func_float,
+                                               vfunction_table[tok->func].func_double,
+                                               tok->datatype);
+                ins->in_length = dims[top];
+                if (!ins->func)
+                    goto fail;
+                break;
+            case TOK_VECTORIZE:
+                top -= tok->arity - 1;
+                if (top < 0)
+                    goto fail;
+                k = dims[top];
+                // append remaining operands to the first register
+                for (j = 1; j < tok->arity; j++) {
+                    ins = &instr[count++];
+                    ins->instr = INSTR_MOVE;
+                    ins->reg = top * stride + k;
+                    ins->src = (top + j) * stride;
+                    ins->length = dims[top + j];
+                    k += dims[top + j];
+                }
+                dims[top] = tok->vector_length;
+                if (tok->casttype) {
+                    ins = &instr[count++];
+                    ins->instr = INSTR_KERNEL;
+                    ins->kernel = cast_kernels[t][type_index(tok->casttype)];
+                    ins->reg = top * stride;
+                    ins->length = tok->vector_length;
+                    if (!ins->kernel)
+                        goto fail;
+                }
+                continue;
+            case TOK_ASSIGNMENT:
+            case TOK_ASSIGN_USE:
+                if (top < 0)
+                    goto fail;
+                if (tok->var == VAR_Y) {
+                    ins->instr = INSTR_STORE_OUTPUT;
+                    ins->copy = store_function(output_type, tok->vector_length);
+                }
+                else if (tok->var >= 0 && tok->var < N_USER_VARS) {
+                    ins->instr = INSTR_STORE_VAR;
+                    ins->copy = store_d;
+                }
+                else
+                    goto fail;
+                ins->var = tok->var;
+                ins->history_index = tok->history_index;
+                ins->vector_index = tok->vector_index;
+                ins->offset = tok->assignment_offset;
+                ins->datatype = tok->datatype;
+                ins->reg = top * stride;
+                ins->length = tok->vector_length;
+                ++count;
+                // history initialisation is only evaluated once
+                if (tok->history_index != 0)
+                    start_instruction = count;
+                continue;
+            default:
+                goto fail;
+        }
+        if (top < 0 || top >= expr->length)
+            goto fail;
+        if (top + 1 > num_regs)
+            num_regs = top + 1;
+        ins->reg = top * stride;
+        ins->length = tok->vector_length;
+        dims[top] = tok->vector_length;
+        ++count;
+
+        if (tok->casttype && tok->toktype != TOK_CONST) {
+            ins = &instr[count++];
+            ins->instr = INSTR_KERNEL;
+            ins->kernel = cast_kernels[t][type_index(tok->casttype)];
+            ins->reg = top * stride;
+            ins->length = tok->vector_length;
+            if (!ins->kernel)
+                goto fail;
+        }
+    }
+    if (top < 0)
+        goto fail;
+
+    expr->instructions = instr;
+    expr->num_instructions = count;
+    expr->start_instruction = start_instruction;
+    expr->register_stride = stride;
+    expr->result_register = top * stride;
+    expr->registers = calloc(1, sizeof(mapper_value_t) * num_regs * stride);
+    expr->output_type = output_type;
+    expr->use_compiled = 1;
+    return 0;
+
+  fail:
+    trace("expression will be evaluated by token interpreter.\n");
+    free(instr);
+    return 1;
+}
+
+static int evaluate_compiled(mapper_expr expr, mapper_history *input,
+                             mapper_history *expr_vars, mapper_history output,
+                             mapper_timetag_t *tt, char *typestring)
+{
+    mapper_instruction ins = expr->instructions;
+    mapper_value_t *regs = expr->registers;
+    mapper_history h;
+    int i, idx, count = expr->num_instructions, updated = 0;
+    int stride = expr->register_stride;
+    int out_size = mapper_type_size(expr->output_type);
+
+    if (output->position >= 0) {
+        ins += expr->start_instruction;
+        count -= expr->start_instruction;
+    }
+
+    // init typestring
+    if (typestring)
+        memset(typestring, 'N', output->length);
+
+    /* Increment index position of output data structure. */
+    output->position = (output->position + 1) % output->size;
+
+    for (i = 0; i < expr->num_variables; i++)
+        expr->variables[i].assigned = 0;
+
+    for (; count > 0; count--, ins++) {
+        mapper_value_t *a = regs + ins->reg;
+        switch (ins->instr) {
+            case INSTR_CONST:
+                for (i = 0; i < ins->length; i++)
+                    a[i] = ins->value;
+                break;
+            case INSTR_LOAD_INPUT:
+                h = input[ins->var];
+                idx = ((ins->history_index + h->position + h->size) % h->size);
+                ins->copy(a, h->value + (idx * h->length + ins->vector_index)
+                          * mapper_type_size(ins->datatype), ins->length);
+                break;
+            case INSTR_LOAD_OUTPUT:
+                idx = ((ins->history_index + output->position + output->size)
+                       % output->size);
+                ins->copy(a, output->value + (idx * output->length
+                                              + ins->vector_index) * out_size,
+                          ins->length);
+                break;
+            case INSTR_LOAD_VAR: {
+                if (!expr_vars)
+                    goto error;
+                mapper_variable var = &expr->variables[ins->var];
+                h = *expr_vars + ins->var;
+                idx = ((ins->history_index + h->position + var->history_size)
+                       % var->history_size);
+                ins->copy(a, (double*)h->value + idx * var->vector_length
+                          + ins->vector_index, ins->length);
+                break;
+            }
+            case INSTR_KERNEL:
+                ins->kernel(a, stride, ins->func, ins->length);
+                break;
+            case INSTR_VFUNC:
+                ins->kernel(a, stride, ins->func, ins->in_length);
+                for (i = 1; i < ins->length; i++)
+                    a[i] = a[0];
+                break;
+            case INSTR_MOVE:
+                memcpy(a, regs + ins->src, sizeof(mapper_value_t) * ins->length);
+                break;
+            case INSTR_STORE_OUTPUT:
+                updated++;
+                idx = (ins->history_index + output->position + output->size);
+                if (idx < 0)
+                    idx = output->size - idx;
+                else
+                    idx %= output->size;
+                ins->copy(output->value + (idx * output->length
+                                           + ins->vector_index) * out_size,
+                          a + ins->offset, ins->length);
+                if (typestring)
+                    memset(typestring + ins->vector_index, ins->datatype,
+                           ins->length);
+                break;
+            case INSTR_STORE_VAR: {
+                if (!expr_vars)
+                    goto error;
+                updated++;
+                h = *expr_vars + ins->var;
+
+                // increment position
+                h->position = (h->position + 1) % h->size;
+
+                mapper_variable var = &expr->variables[ins->var];
+                idx = (ins->history_index + h->position
+                       + var->history_size) % var->history_size;
+                ins->copy((double*)h->value + idx * var->vector_length
+                          + ins->vector_index, a + ins->offset, ins->length);
+
+                // Also copy timetag from input
+                if (tt) {
+                    mapper_timetag_t *ttvar = mapper_history_tt_ptr(*h);
+                    memcpy(ttvar, tt, sizeof(mapper_timetag_t));
+                }
+                var->assigned = 1;
+                break;
+            }
+        }
+    }
+
+    if (!typestring) {
+        /* Evaluation without typestring expects the result to be copied to
+         * the output as well, see mapper_expr_evaluate(). */
+        output->position = (output->position + 1) % output->size;
+        store_functions[type_index(expr->output_type)]
+            (mapper_history_value_ptr(*output), regs + expr->result_register,
+             output->length);
+        return 1;
+    }
+
+    /* Undo position increment if nothing was updated. */
+    if (!updated) {
+        --output->position;
+        if (output->position < 0)
+            output->position = output->size - 1;
+        return 0;
+    }
+    else if (tt) {
+        // Also copy timetag from input
+        mapper_timetag_t *ttto = mapper_history_tt_ptr(*output);
+        memcpy(ttto, tt, sizeof(mapper_timetag_t));
+    }
+
+    for (i = 0; i < expr->num_variables; i++) {
+        if (expr->variables[i].assigned) {
+            // increment position
+            h = *expr_vars + i;
+            h->position = (h->position + 1) % h->size;
+        }
+    }
+    return 1;
+
+  error:
+    trace("Unexpected instruction in compiled expression.");
+    return 0;
+}
+
+int mapper_expr_use_compiled(mapper_expr expr, int enable)
+{
+    if (!expr || !expr->instructions)
+        return 0;
+    expr->use_compiled = enable ? 1 : 0;
+    return 1;
+}
+
 /* Macros to help express stack operations in parser. */
 #define FAIL(msg) {                                                 \
     parse_error("%s\n", msg);                                       \
@@ -2085,6 +3158,12 @@ mapper_expr mapper_expr_new_from_string(const char *str, int num_inputs,
     }
     expr->num_variables = num_variables;
 
+    // lower token stack to instructions, or fall back to interpreter
+    expr->instructions = 0;
+    expr->registers = 0;
+    expr->use_compiled = 0;
+    compile_expr(expr, input_types, output_type);
+
     return expr;
 }
 
@@ -2203,6 +3282,10 @@ int mapper_expr_evaluate(mapper_expr expr, mapper_history *input,
 #endif
         return 0;
     }
+    if (expr->instructions && expr->use_compiled
+        && output->type == expr->output_type)
+        return evaluate_compiled(expr, input, expr_vars, output, tt, typestring);
+
     mapper_token_t *tok = expr->start;
     int length = expr->length;
     if (output->position >= 0) {
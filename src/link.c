@@ -6,16 +6,628 @@
 #include <limits.h>
 #include <zlib.h>
 
+#include "config.h"
+
+#ifdef HAVE_ARPA_INET_H
+ #include <arpa/inet.h>
+ #include <netdb.h>
+ #include <sys/socket.h>
+#else
+ #ifdef HAVE_WINSOCK2_H
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+ #endif
+#endif
+
+#ifdef HAVE_SHM_OPEN
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+#endif
+
 #include "mapper_internal.h"
 #include "types_internal.h"
 #include <mapper/mapper.h>
 
+#ifdef USE_STREAMS
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+ #endif
+#endif
+
+/* Resolve the data address once so that pre-serialised updates can be sent
+ * directly from the device socket.  Each result is tried in turn and the
+ * first with the same address family as the socket is used; if there is none
+ * updates are sent through liblo instead. */
+static void resolve_data_addr(mapper_link link)
+{
+    struct addrinfo hints, *ai;
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    mapper_local_link llink = link->local;
+
+    if (llink->data_addrinfo_list) {
+        freeaddrinfo(llink->data_addrinfo_list);
+        llink->data_addrinfo_list = 0;
+    }
+    llink->data_addrinfo = 0;
+    if (!llink->data_addr)
+        return;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(lo_address_get_hostname(llink->data_addr),
+                    lo_address_get_port(llink->data_addr), &hints,
+                    &llink->data_addrinfo_list)) {
+        trace("couldn't resolve data address for link.\n");
+        llink->data_addrinfo_list = 0;
+        return;
+    }
+    int fd = lo_server_get_socket_fd(link->local_device->local->server);
+    if (getsockname(fd, (struct sockaddr*)&local, &local_len))
+        return;
+    for (ai = llink->data_addrinfo_list; ai; ai = ai->ai_next) {
+        if (ai->ai_family == local.ss_family) {
+            llink->data_addrinfo = ai;
+            return;
+        }
+    }
+    trace("no data address for link matches the device socket.\n");
+}
+
+/* Datagrams between devices on the same host may be passed through a ring in
+ * shared memory rather than the loopback interface.  Each device offering a
+ * ring creates it when a link is connected and announces its name in /linked;
+ * the remote device then writes updates for this link into the ring.  Rings
+ * have a single producer and a single consumer.  Records are a 32-bit length
+ * followed by the datagram padded to 4 bytes, and never wrap: a record that
+ * does not fit before the end of the ring is preceded by a padding marker.
+ * When the consumer has run out of data it sets 'waiting', and the producer
+ * then sends a small doorbell datagram to the consumer's data port so that a
+ * device blocked in mapper_device_poll() is woken up. */
+
+#define SHM_MAGIC       0x6D617072  /* "mapr" */
+#define SHM_RING_SIZE   (1 << 18)
+#define SHM_PAD         0xFFFFFFFF
+
+typedef struct _mapper_shm_header {
+    uint32_t magic;
+    uint32_t size;              /* Size of the data area, a power of two. */
+    uint32_t generation;        /* Identifies this ring among any with the
+                                 * same name, and is part of the name. */
+    uint32_t head;              /* Bytes written, updated by the producer. */
+    char pad1[48];
+    uint32_t tail;              /* Bytes read, updated by the consumer. */
+    uint32_t waiting;           /* Set if the consumer wants a doorbell. */
+    char pad2[56];
+} mapper_shm_header_t, *mapper_shm_header;
+
+typedef struct _mapper_shm_ring {
+    mapper_shm_header header;
+    char *data;
+    char *name;                 /* Name the ring was created or opened with. */
+    int created;                /* Non-zero if the name must be unlinked. */
+    char *peer;                 /* Data address of the consumer ringing the
+                                 * doorbell, for rings we write to. */
+    uint32_t reserved;          /* Producer head after the pending record. */
+    char *buffer;               /* Consumer copy of the current record. */
+    uint32_t buffer_size;
+} mapper_shm_ring_t, *mapper_shm_ring;
+
+/* An empty OSC message addressed to the doorbell path. */
+static const char shm_doorbell[12] = "/_/shm\0\0,\0\0";
+
+#ifdef HAVE_SHM_OPEN
+static mapper_shm_ring shm_ring_map(const char *name, int fd, int create,
+                                    uint32_t generation)
+{
+    size_t len = sizeof(mapper_shm_header_t) + SHM_RING_SIZE;
+    if (create && ftruncate(fd, len)) {
+        close(fd);
+        return 0;
+    }
+    void *mem = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        return 0;
+
+    mapper_shm_ring ring = (mapper_shm_ring)calloc(1, sizeof(mapper_shm_ring_t));
+    ring->header = (mapper_shm_header)mem;
+    ring->data = (char*)mem + sizeof(mapper_shm_header_t);
+    if (create) {
+        ring->header->size = SHM_RING_SIZE;
+        ring->header->generation = generation;
+        __atomic_store_n(&ring->header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+        ring->created = 1;
+    }
+    else if (__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC
+             || ring->header->size != SHM_RING_SIZE
+             || ring->header->generation != generation) {
+        munmap(mem, len);
+        free(ring);
+        return 0;
+    }
+    ring->name = strdup(name);
+    return ring;
+}
+#endif
+
+static void shm_ring_free(mapper_shm_ring ring)
+{
+    if (!ring)
+        return;
+#ifdef HAVE_SHM_OPEN
+    munmap(ring->header, sizeof(mapper_shm_header_t) + SHM_RING_SIZE);
+    if (ring->name) {
+        if (ring->created)
+            shm_unlink(ring->name);
+        free(ring->name);
+    }
+#endif
+    if (ring->peer)
+        free(ring->peer);
+    if (ring->buffer)
+        free(ring->buffer);
+    free(ring);
+}
+
+#ifdef HAVE_SHM_OPEN
+/*! Check whether a link's remote device reported an address on this host. */
+static int is_same_host(mapper_link link, const char *host)
+{
+    struct in_addr addr;
+    if (!host || !inet_aton(host, &addr))
+        return 0;
+    if ((ntohl(addr.s_addr) >> 24) == 127)
+        return 1;
+    const struct in_addr *ip = mapper_network_ip4(link->local_device->database
+                                                  ->network);
+    return ip && ip->s_addr == addr.s_addr;
+}
+#endif
+
+/*! Create a ring for receiving data from the remote device of a link. */
+static void open_shm_in(mapper_link link)
+{
+#ifdef HAVE_SHM_OPEN
+    static int count = 0;
+    char name[64];
+    mapper_timetag_t tt;
+    mapper_timetag_now(&tt);
+    // a restarted process may reuse the pid and count, but not the generation
+    uint32_t generation = tt.sec ^ tt.frac ^ ((uint32_t)getpid() << 16);
+    snprintf(name, 64, "/libmapper.%d.%d.%08x", (int)getpid(), ++count,
+             generation);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        trace("couldn't create shared memory ring '%s'.\n", name);
+        return;
+    }
+    if ((link->local->shm_in = shm_ring_map(name, fd, 1, generation)))
+        ++link->local_device->local->num_shm_rings;
+    else
+        shm_unlink(name);
+#endif
+}
+
+#ifdef HAVE_SHM_OPEN
+/*! Return the data address of a link's remote device as "host:port", or 0
+ *  if it is not known yet.  The result must be freed by the caller. */
+static char *data_peer(mapper_link link)
+{
+    lo_address a = link->local->data_addr;
+    if (!a || !lo_address_get_hostname(a) || !lo_address_get_port(a))
+        return 0;
+    char *peer = malloc(strlen(lo_address_get_hostname(a))
+                        + strlen(lo_address_get_port(a)) + 2);
+    sprintf(peer, "%s:%s", lo_address_get_hostname(a), lo_address_get_port(a));
+    return peer;
+}
+#endif
+
+/*! Open a ring offered by the remote device of a link for sending it data.
+ *  A ring opened earlier is kept only if the remote device offers the same
+ *  ring again and its data address has not changed, otherwise the remote
+ *  device has restarted: the old ring is released, and updates are sent over
+ *  UDP until the new one is attached.  Fails harmlessly if the remote device
+ *  is on another host. */
+static void open_shm_out(mapper_link link, const char *name)
+{
+#ifdef HAVE_SHM_OPEN
+    mapper_shm_ring ring = link->local->shm_out;
+    char *peer = data_peer(link);
+    if (ring) {
+        if (!strcmp(ring->name, name)
+            && (!peer || !ring->peer || !strcmp(ring->peer, peer))) {
+            if (!ring->peer)
+                ring->peer = peer;
+            else if (peer)
+                free(peer);
+            return;
+        }
+        trace("shared memory ring '%s' was replaced, reopening.\n", ring->name);
+        shm_ring_free(ring);
+        link->local->shm_out = 0;
+    }
+    const char *dot = strrchr(name, '.');
+    if (name[0] != '/' || !dot) {
+        if (peer)
+            free(peer);
+        return;
+    }
+    uint32_t generation = strtoul(dot + 1, 0, 16);
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        trace("couldn't open shared memory ring '%s', using UDP.\n", name);
+        free(peer);
+        return;
+    }
+    if ((ring = shm_ring_map(name, fd, 0, generation)))
+        ring->peer = peer;
+    else if (peer)
+        free(peer);
+    link->local->shm_out = ring;
+#endif
+}
+
+/*! Reserve space for a record of 'len' bytes in a ring, returning a pointer
+ *  to write it to or 0 if the ring is full. */
+static void *shm_reserve(mapper_shm_ring ring, uint32_t len)
+{
+    mapper_shm_header h = ring->header;
+    uint32_t head = h->head, tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+    uint32_t size = h->size, offset = head & (size - 1);
+    uint32_t record = 4 + ((len + 3) & ~3), contiguous = size - offset;
+    uint32_t needed = record + (record > contiguous ? contiguous : 0);
+
+    if (record > size / 2 || needed > size - (head - tail))
+        return 0;
+    if (record > contiguous) {
+        *(uint32_t*)(ring->data + offset) = SHM_PAD;
+        head += contiguous;
+        offset = 0;
+    }
+    *(uint32_t*)(ring->data + offset) = len;
+    ring->reserved = head + record;
+    return ring->data + offset + 4;
+}
+
+/*! Publish the record reserved last and ring the doorbell if needed. */
+static void shm_commit(mapper_link link, mapper_shm_ring ring)
+{
+    mapper_shm_header h = ring->header;
+    __atomic_store_n(&h->head, ring->reserved, __ATOMIC_SEQ_CST);
+    if (!__atomic_exchange_n(&h->waiting, 0, __ATOMIC_SEQ_CST))
+        return;
+    struct addrinfo *ai = link->local->data_addrinfo;
+    if (!ai)
+        return;
+    int fd = lo_server_get_socket_fd(link->local_device->local->server);
+    if (sendto(fd, shm_doorbell, sizeof(shm_doorbell), 0, ai->ai_addr,
+               ai->ai_addrlen) != sizeof(shm_doorbell))
+        trace("error sending shared memory doorbell.\n");
+}
+
+/* Links using the "tcp" transport send their updates over a TCP connection
+ * to the remote device's data port, framed like liblo's own TCP messages by
+ * a 32-bit big-endian length.  Messages are appended to a buffer which is
+ * written once per call to mapper_device_poll() or mapper_device_send_queue(),
+ * or as soon as it grows beyond STREAM_FLUSH_SIZE.  Until the connection is
+ * established, or while it is being re-established, updates are sent over
+ * UDP instead. */
+
+/* Buffered bytes that cause a stream to be written immediately.  Messages
+ * stay buffered until written in full, and a message interrupted by a lost
+ * connection is written again from its start once reconnected. */
+#define STREAM_FLUSH_SIZE   (1 << 16)
+
+/* Buffered bytes beyond which messages to a stream are dropped. */
+#define STREAM_MAX_BUFFER   (1 << 24)
+
+/* Seconds to wait before retrying a failed stream connection. */
+#define STREAM_RETRY_SEC    1
+
+#ifdef USE_STREAMS
+/*! Close the stream of a link, keeping any buffered messages for the next
+ *  connection if 'retry' is set and discarding them otherwise. */
+static void close_stream(mapper_link link, int retry)
+{
+    mapper_local_link llink = link->local;
+    if (llink->stream_state != STREAM_CLOSED)
+        close(llink->stream_fd);
+    llink->stream_state = STREAM_CLOSED;
+    llink->stream_sent = 0;
+    if (!retry)
+        llink->stream_length = 0;
+    llink->stream_retry = retry ? time(0) + STREAM_RETRY_SEC : 0;
+}
+
+/*! Put a greeting at the head of the stream buffer, ahead of any messages
+ *  kept from a previous connection. It is a four-byte frame holding the port
+ *  of the local device's server, which the remote device replies to. */
+static int stream_greet(mapper_link link)
+{
+    mapper_local_link llink = link->local;
+    size_t needed = llink->stream_length + 8;
+    if (needed > llink->stream_size) {
+        char *buffer = realloc(llink->stream_buffer, needed * 2);
+        if (!buffer)
+            return 1;
+        llink->stream_buffer = buffer;
+        llink->stream_size = needed * 2;
+    }
+    uint32_t greeting[2];
+    greeting[0] = htonl(4);
+    greeting[1] = htonl(lo_server_get_port(link->local_device->local->server));
+    memmove(llink->stream_buffer + 8, llink->stream_buffer,
+            llink->stream_length);
+    memcpy(llink->stream_buffer, greeting, 8);
+    llink->stream_length = needed;
+    return 0;
+}
+
+/*! Start or advance a non-blocking connection to the remote device, returning
+ *  non-zero once the stream is connected. */
+static int stream_connected(mapper_link link)
+{
+    mapper_local_link llink = link->local;
+    struct addrinfo *ai = llink->data_addrinfo;
+    if (llink->stream_state == STREAM_CONNECTED)
+        return 1;
+    if (!llink->use_stream || !ai)
+        return 0;
+    if (llink->stream_state == STREAM_CLOSED) {
+        if (time(0) < llink->stream_retry)
+            return 0;
+        int fd = socket(ai->ai_family, SOCK_STREAM, 0), one = 1;
+        if (fd < 0) {
+            llink->stream_retry = time(0) + STREAM_RETRY_SEC;
+            return 0;
+        }
+        // messages are already coalesced per poll
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(int));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(int));
+#endif
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        llink->stream_fd = fd;
+        llink->stream_state = STREAM_CONNECTING;
+    }
+    // calling connect() again reports the progress of the connection
+    if (connect(llink->stream_fd, ai->ai_addr, ai->ai_addrlen) == 0
+        || errno == EISCONN) {
+        trace("<%s> connected stream to '%s'.\n", link->local_device->name,
+              link->remote_device->name);
+        llink->stream_state = STREAM_CONNECTED;
+        if (stream_greet(link)) {
+            close_stream(link, 1);
+            return 0;
+        }
+        return 1;
+    }
+    if (errno != EINPROGRESS && errno != EALREADY && errno != EINTR) {
+        trace("<%s> couldn't connect stream to '%s', using UDP.\n",
+              link->local_device->name, link->remote_device->name);
+        close_stream(link, 1);
+    }
+    return 0;
+}
+
+/*! Append a length frame to the stream buffer and return a pointer to write
+ *  'len' bytes of message to, or 0 if the buffer is full. */
+static char *stream_reserve(mapper_local_link llink, size_t len)
+{
+    size_t needed = llink->stream_length + 4 + len;
+    if (len > STREAM_MAX_FRAME || needed > STREAM_MAX_BUFFER)
+        return 0;
+    if (needed > llink->stream_size) {
+        char *buffer = realloc(llink->stream_buffer, needed * 2);
+        if (!buffer)
+            return 0;
+        llink->stream_buffer = buffer;
+        llink->stream_size = needed * 2;
+    }
+    char *ptr = llink->stream_buffer + llink->stream_length;
+    uint32_t frame = htonl(len);
+    memcpy(ptr, &frame, 4);
+    llink->stream_length = needed;
+    return ptr + 4;
+}
+#endif
+
+void mapper_link_flush_stream(mapper_link link)
+{
+#ifdef USE_STREAMS
+    mapper_local_link llink = link->local;
+    size_t sent, done = 0;
+    uint32_t frame;
+    ssize_t n;
+    int lost = 0;
+    if (!llink || !llink->stream_length
+        || llink->stream_state != STREAM_CONNECTED)
+        return;
+    sent = llink->stream_sent;
+    while (sent < llink->stream_length) {
+        n = send(llink->stream_fd, llink->stream_buffer + sent,
+                 llink->stream_length - sent, MSG_NOSIGNAL);
+        if (n > 0)
+            sent += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else {
+            trace("<%s> lost stream to '%s', reconnecting.\n",
+                  link->local_device->name, link->remote_device->name);
+            lost = 1;
+            break;
+        }
+    }
+    // only discard whole messages, so that they can be resent if the
+    // connection is lost part way through one
+    while (done + 4 <= sent) {
+        memcpy(&frame, llink->stream_buffer + done, 4);
+        if (done + 4 + ntohl(frame) > sent)
+            break;
+        done += 4 + ntohl(frame);
+    }
+    llink->stream_length -= done;
+    llink->stream_sent = sent - done;
+    if (llink->stream_length && done)
+        memmove(llink->stream_buffer, llink->stream_buffer + done,
+                llink->stream_length);
+    if (lost)
+        close_stream(link, 1);
+#endif
+}
+
+int mapper_link_send_stream(mapper_link link, const void *data, size_t len)
+{
+#ifdef USE_STREAMS
+    if (!link->local->use_stream || !stream_connected(link))
+        return 1;
+    char *ptr = stream_reserve(link->local, len);
+    if (!ptr) {
+        trace("<%s> dropping message, stream to '%s' is full.\n",
+              link->local_device->name, link->remote_device->name);
+        return 0;
+    }
+    memcpy(ptr, data, len);
+    if (link->local->stream_length >= STREAM_FLUSH_SIZE)
+        mapper_link_flush_stream(link);
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*! Switch a local link between the "udp" and "tcp" transports. */
+static void set_transport(mapper_link link, const char *transport)
+{
+    mapper_local_link llink = link->local;
+    int use_stream = strcmp(transport, "tcp") == 0;
+    if (use_stream == llink->use_stream)
+        return;
+    llink->use_stream = use_stream;
+    if (link->local_device->local) {
+        link->local_device->local->num_stream_links += use_stream ? 1 : -1;
+        mapper_device_update_stream_listener(link->local_device);
+    }
+#ifdef USE_STREAMS
+    if (!use_stream) {
+        mapper_link_flush_stream(link);
+        close_stream(link, 0);
+    }
+#endif
+}
+
+int mapper_link_send_shm(mapper_link link, const void *data, size_t len)
+{
+    mapper_shm_ring ring = link->local->shm_out;
+    void *ptr;
+    if (!ring || !(ptr = shm_reserve(ring, len)))
+        return 1;
+    memcpy(ptr, data, len);
+    shm_commit(link, ring);
+    return 0;
+}
+
+void mapper_link_send_bundle(mapper_link link, lo_bundle bundle)
+{
+#ifdef USE_STREAMS
+    if (link->local->use_stream && stream_connected(link)) {
+        size_t len = lo_bundle_length(bundle);
+        void *ptr = stream_reserve(link->local, len);
+        if (!ptr) {
+            trace("<%s> dropping bundle, stream to '%s' is full.\n",
+                  link->local_device->name, link->remote_device->name);
+            return;
+        }
+        lo_bundle_serialise(bundle, ptr, &len);
+        if (link->local->stream_length >= STREAM_FLUSH_SIZE)
+            mapper_link_flush_stream(link);
+        return;
+    }
+#endif
+    mapper_shm_ring ring = link->local->shm_out;
+    if (ring) {
+        size_t len = lo_bundle_length(bundle);
+        void *ptr = shm_reserve(ring, len);
+        if (ptr) {
+            lo_bundle_serialise(bundle, ptr, &len);
+            shm_commit(link, ring);
+            return;
+        }
+    }
+    lo_send_bundle_from(link->local->data_addr,
+                        link->local_device->local->server, bundle);
+}
+
+int mapper_link_receive_shm(mapper_link link, int budget)
+{
+    mapper_shm_ring ring = link->local ? link->local->shm_in : 0;
+    if (!ring)
+        return 0;
+    mapper_shm_header h = ring->header;
+    uint32_t size = h->size, tail = h->tail, head, offset, len;
+    int count = 0;
+
+    while (count < budget) {
+        head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            // ask for a doorbell, then check nothing arrived in the meantime
+            __atomic_store_n(&h->waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&h->head, __ATOMIC_SEQ_CST) == tail)
+                return count;
+            continue;
+        }
+        offset = tail & (size - 1);
+        len = *(uint32_t*)(ring->data + offset);
+        if (len == SHM_PAD) {
+            tail += size - offset;
+            __atomic_store_n(&h->tail, tail, __ATOMIC_RELEASE);
+            continue;
+        }
+        // the record, its length word and padding must lie within the data
+        // written so far and within the mapping
+        if (len > size / 2 || 4 + ((len + 3) & ~3) > head - tail
+            || offset + 4 + len > size) {
+            trace("discarding corrupt shared memory ring.\n");
+            __atomic_store_n(&h->tail, head, __ATOMIC_RELEASE);
+            return count;
+        }
+        // copy the record out so the producer cannot modify it while parsed
+        if (len > ring->buffer_size) {
+            ring->buffer_size = len;
+            ring->buffer = realloc(ring->buffer, len);
+        }
+        memcpy(ring->buffer, ring->data + offset + 4, len);
+        tail += 4 + ((len + 3) & ~3);
+        __atomic_store_n(&h->tail, tail, __ATOMIC_RELEASE);
+        link->local_device->local->dispatch_source = link->local->data_addr;
+        lo_server_dispatch_data(link->local_device->local->server,
+                                ring->buffer, len);
+        link->local_device->local->dispatch_source = 0;
+        ++count;
+    }
+    // more data may be waiting; make sure the next write rings the doorbell
+    __atomic_store_n(&h->waiting, 1, __ATOMIC_SEQ_CST);
+    return count;
+}
+
 void mapper_link_init(mapper_link link, int is_local)
 {
     if (!link->num_maps)
         link->num_maps = (int*)calloc(1, sizeof(int) * 2);
     if (!link->props) {
         link->props = mapper_table_new();
+        link->props->version = &link->local_device->database->link_version;
         mapper_table_link_value(link->props, AT_ID, 1, 'h', &link->id,
                                 NON_MODIFIABLE);
         mapper_table_link_value(link->props, AT_NUM_MAPS, 2, 'i',
@@ -34,8 +646,10 @@ void mapper_link_init(mapper_link link, int is_local)
     link->local = ((mapper_local_link)
                    calloc(1, sizeof(struct _mapper_local_link)));
 
-    if (!link->id && link->local_device->local)
+    if (!link->id && link->local_device->local) {
         link->id = mapper_device_generate_unique_id(link->local_device);
+        mapper_database_index_link(link->local_device->database, link);
+    }
 
     if (link->local_device == link->remote_device) {
         /* Add data_addr for use by self-connections. In the future we may
@@ -47,6 +661,7 @@ void mapper_link_init(mapper_link link, int is_local)
         char str[16];
         snprintf(str, 16, "%d", mapper_device_port(link->local_device));
         link->local->data_addr = lo_address_new("localhost", str);
+        resolve_data_addr(link);
     }
 
     link->local->clock.new = 1;
@@ -79,8 +694,36 @@ void mapper_link_connect(mapper_link link, const char *host, int admin_port,
                             &data_port, REMOTE_MODIFY);
     sprintf(str, "%d", data_port);
     link->local->data_addr = lo_address_new(host, str);
+    resolve_data_addr(link);
+#ifdef HAVE_SHM_OPEN
+    // a ring belongs to the consumer it was offered by, use UDP until the
+    // consumer at the new address offers its own
+    if (link->local->shm_out) {
+        char *peer = data_peer(link);
+        mapper_shm_ring ring = link->local->shm_out;
+        if (!ring->peer) {
+            // the ring was offered before we knew the consumer's address
+            ring->peer = peer;
+        }
+        else {
+            if (!peer || strcmp(peer, ring->peer)) {
+                shm_ring_free(ring);
+                link->local->shm_out = 0;
+            }
+            if (peer)
+                free(peer);
+        }
+    }
+#endif
     sprintf(str, "%d", admin_port);
     link->local->admin_addr = lo_address_new(host, str);
+
+#ifdef HAVE_SHM_OPEN
+    if (link->local_device->local && link->local_device->local->use_shm
+        && link->remote_device != link->local_device && !link->local->shm_in
+        && is_same_host(link, host))
+        open_shm_in(link);
+#endif
 }
 
 void mapper_link_free(mapper_link link)
@@ -96,6 +739,16 @@ void mapper_link_free(mapper_link link)
             lo_address_free(link->local->admin_addr);
         if (link->local->data_addr)
             lo_address_free(link->local->data_addr);
+        if (link->local->data_addrinfo_list)
+            freeaddrinfo(link->local->data_addrinfo_list);
+        if (link->local->shm_in) {
+            shm_ring_free(link->local->shm_in);
+            --link->local_device->local->num_shm_rings;
+        }
+        shm_ring_free(link->local->shm_out);
+        set_transport(link, "udp");
+        if (link->local->stream_buffer)
+            free(link->local->stream_buffer);
         while (link->local->queues) {
             mapper_queue queue = link->local->queues;
             lo_bundle_free_messages(queue->bundle);
@@ -125,28 +778,51 @@ void mapper_link_start_queue(mapper_link link, mapper_timetag_t tt)
     link->local->queues = queue;
 }
 
-void mapper_link_send_queue(mapper_link link, mapper_timetag_t tt)
+/*! Check whether a link has a queue for timetag 'tt'. */
+int mapper_link_has_queue(mapper_link link, mapper_timetag_t tt)
 {
     if (!link || !link->local)
-        return;
+        return 0;
+    mapper_queue queue = link->local->queues;
+    while (queue) {
+        if (memcmp(&queue->tt, &tt, sizeof(mapper_timetag_t))==0)
+            return 1;
+        queue = queue->next;
+    }
+    return 0;
+}
+
+/*! Remove the queue for timetag 'tt' from a link and return its bundle, which
+ *  the caller must free. Returns 0 if there is no such queue. */
+lo_bundle mapper_link_pop_queue(mapper_link link, mapper_timetag_t tt)
+{
+    if (!link || !link->local)
+        return 0;
     mapper_queue *queue = &link->local->queues;
     while (*queue) {
         if (memcmp(&(*queue)->tt, &tt, sizeof(mapper_timetag_t))==0)
             break;
         queue = &(*queue)->next;
     }
-    if (*queue) {
+    if (!*queue)
+        return 0;
+    lo_bundle bundle = (*queue)->bundle;
+    mapper_queue temp = *queue;
+    *queue = (*queue)->next;
+    free(temp);
+    return bundle;
+}
+
+void mapper_link_send_queue(mapper_link link, mapper_timetag_t tt)
+{
+    lo_bundle bundle = mapper_link_pop_queue(link, tt);
+    if (!bundle)
+        return;
 #ifdef HAVE_LIBLO_BUNDLE_COUNT
-        if (lo_bundle_count((*queue)->bundle))
+    if (lo_bundle_count(bundle))
 #endif
-            lo_send_bundle_from(link->local->data_addr,
-                                link->local_device->local->server,
-                                (*queue)->bundle);
-        lo_bundle_free_messages((*queue)->bundle);
-        mapper_queue temp = *queue;
-        *queue = (*queue)->next;
-        free(temp);
-    }
+        mapper_link_send_bundle(link, bundle);
+    lo_bundle_free_messages(bundle);
 }
 
 mapper_device mapper_link_device(mapper_link link, int idx)
@@ -247,7 +923,20 @@ int mapper_link_set_from_message(mapper_link link, mapper_message msg,
         return 0;
     
     for (i = 0; i < msg->num_atoms; i++) {
-        if (msg->atoms[i].index == AT_ID) {
+        if (msg->atoms[i].index == AT_SHM) {
+            // ring offered by the remote end of a local link
+            if (link->local && reversed && msg->atoms[i].types[0] == 's')
+                open_shm_out(link, &msg->atoms[i].values[0]->s);
+        }
+        else if (msg->atoms[i].index == AT_TRANSPORT && link->local) {
+            if (msg->atoms[i].types[0] != 's')
+                continue;
+            updated += mapper_table_set_record_from_atom(link->props,
+                                                         &msg->atoms[i],
+                                                         REMOTE_MODIFY);
+            set_transport(link, &msg->atoms[i].values[0]->s);
+        }
+        else if (msg->atoms[i].index == AT_ID) {
             // choose lowest id
             if (!link->id || link->id > (*msg->atoms[i].values)->h) {
                 mapper_id id = msg->atoms[i].values[0]->h;
@@ -272,6 +961,8 @@ int mapper_link_set_from_message(mapper_link link, mapper_message msg,
                                                          REMOTE_MODIFY);
         }
     }
+    if (updated)
+        mapper_database_index_link(link->local_device->database, link);
     return updated;
 }
 
@@ -306,6 +997,10 @@ void mapper_link_send_state(mapper_link link, network_message_t cmd, int staged)
         mapper_table_add_to_message(0, staged ? link->staged_props : link->props,
                                     msg);
     }
+    if (cmd == MSG_LINKED && link->local && link->local->shm_in) {
+        lo_message_add_string(msg, mapper_protocol_string(AT_SHM));
+        lo_message_add_string(msg, link->local->shm_in->name);
+    }
     mapper_network_add_message(link->devices[0]->database->network, 0, cmd, msg);
 }
 
@@ -62,6 +62,10 @@ typedef struct _query_info {
     unsigned int size;
     query_compare_func_t *query_compare;
     query_free_func_t *query_free;
+    void **candidates;      /*!< Items selected by a property index, evaluated
+                             *   in place of the full list, or zero. */
+    int num_candidates;
+    int position;           //!< Next candidate to evaluate.
     int data[0]; // stub
 } query_info_t;
 
@@ -176,11 +180,24 @@ void mapper_list_free_item(void *item)
 
 void **mapper_list_query_continuation(mapper_list_header_t *lh)
 {
-    void *item = mapper_list_header_by_data(lh->self)->next;
-    while (item) {
-        if (lh->query_context->query_compare(&lh->query_context->data, item))
-            break;
-        item = mapper_list_next(item);
+    query_info_t *qi = lh->query_context;
+    void *item = 0;
+    if (qi->candidates) {
+        while (qi->position < qi->num_candidates) {
+            void *candidate = qi->candidates[qi->position++];
+            if (qi->query_compare(&qi->data, candidate)) {
+                item = candidate;
+                break;
+            }
+        }
+    }
+    else {
+        item = mapper_list_header_by_data(lh->self)->next;
+        while (item) {
+            if (qi->query_compare(&qi->data, item))
+                break;
+            item = mapper_list_next(item);
+        }
     }
 
     if (item) {
@@ -204,24 +221,30 @@ static void free_query_single_context(mapper_list_header_t *lh)
         free_query_single_context(lh1);
         free_query_single_context(lh2);
     }
+    if (lh->query_context->candidates)
+        free(lh->query_context->candidates);
     free(lh->query_context);
     free(lh);
 }
 
 /* We need to be careful of memory alignment here - for now we will just ensure
  * that string arguments are always passed last. */
-void **mapper_list_new_query(const void *list, const void *compare_func,
-                             const char *types, ...)
+static void **new_query_internal(const void *list, void **candidates,
+                                 int num_candidates, const void *compare_func,
+                                 const char *types, va_list args)
 {
-    if (!list || !compare_func || !types)
+    if (!list || !compare_func || !types) {
+        if (candidates)
+            free(candidates);
         return 0;
+    }
 
     mapper_list_header_t *lh = (mapper_list_header_t*)malloc(LIST_HEADER_SIZE);
     lh->next = mapper_list_query_continuation;
     lh->query_type = QUERY_DYNAMIC;
 
     va_list aq;
-    va_start(aq, types);
+    va_copy(aq, args);
 
     int i = 0, j, size = 0, num_args;
     while (types[i]) {
@@ -280,6 +303,8 @@ void **mapper_list_new_query(const void *list, const void *compare_func,
             default:
                 va_end(aq);
                 free(lh);
+                if (candidates)
+                    free(candidates);
                 return 0;
         }
         i++;
@@ -290,7 +315,7 @@ void **mapper_list_new_query(const void *list, const void *compare_func,
 
     char *d = (char*)&lh->query_context->data;
     int offset = 0;
-    va_start(aq, types);
+    va_copy(aq, args);
     i = 0;
     while (types[i]) {
         switch (types[i]) {
@@ -361,6 +386,8 @@ void **mapper_list_new_query(const void *list, const void *compare_func,
                 va_end(aq);
                 free(lh->query_context);
                 free(lh);
+                if (candidates)
+                    free(candidates);
                 return 0;
         }
         i++;
@@ -370,16 +397,30 @@ void **mapper_list_new_query(const void *list, const void *compare_func,
     lh->query_context->size = sizeof(query_info_t)+size;
     lh->query_context->query_compare = (query_compare_func_t*)compare_func;
     lh->query_context->query_free = (query_free_func_t*)free_query_single_context;
+    lh->query_context->candidates = candidates;
+    lh->query_context->num_candidates = num_candidates;
+    lh->query_context->position = 0;
 
     lh->self = lh->start = (void*)list;
 
     // try evaluating the first item
-    if (lh->query_context->query_compare(&lh->query_context->data, list))
+    if (!candidates
+        && lh->query_context->query_compare(&lh->query_context->data, list))
         return &lh->self;
 
     return mapper_list_query_continuation(lh);
 }
 
+void **mapper_list_new_query(const void *list, const void *compare_func,
+                             const char *types, ...)
+{
+    va_list args;
+    va_start(args, types);
+    void **query = new_query_internal(list, 0, 0, compare_func, types, args);
+    va_end(args);
+    return query;
+}
+
 void **mapper_list_query_next(void **query)
 {
     if (!query) {
@@ -427,6 +468,18 @@ void *mapper_list_query_index(void **query, int index)
 
     mapper_list_header_t *lh = mapper_list_header_by_self(query);
 
+    if (lh->query_type == QUERY_DYNAMIC && lh->query_context->candidates) {
+        // restart evaluation of the index candidates
+        lh->query_context->position = 0;
+        int i = 0;
+        while ((query = mapper_list_query_next(query))) {
+            if (i == index)
+                return *query;
+            ++i;
+        }
+        return 0;
+    }
+
     if (index == 0)
         return lh->start;
 
@@ -477,6 +530,13 @@ static mapper_list_header_t *mapper_list_header_copy(mapper_list_header_t *lh)
     copy->query_context = (query_info_t*)malloc(lh->query_context->size);
     memcpy(copy->query_context, lh->query_context, lh->query_context->size);
 
+    if (lh->query_context->candidates) {
+        size_t size = sizeof(void*) * lh->query_context->num_candidates;
+        copy->query_context->candidates = (void**)malloc(size);
+        memcpy(copy->query_context->candidates, lh->query_context->candidates,
+               size);
+    }
+
     if (copy->query_context->query_compare == cmp_compound_query) {
         // this is a compound query – we need to copy components
         void *data = &copy->query_context->data;
@@ -538,3 +598,421 @@ void **mapper_list_query_difference(void **query1, void **query2)
     return mapper_list_new_query(lh1->start, cmp_compound_query, "vvi", &lh1,
                                  &lh2, OP_DIFFERENCE);
 }
+
+/**** Hash indexes ****/
+
+#define HASH_INDEX_INITIAL_SIZE 64
+
+#define HASH_LINK(idx, item) \
+    ((mapper_hash_link_t*)((char*)(item) + (idx)->offset))
+
+#define HASH_BUCKET(idx, key) \
+    (&(idx)->buckets[mapper_id_hash(key) & ((idx)->size - 1)])
+
+void mapper_hash_index_init(mapper_hash_index idx, size_t offset)
+{
+    idx->buckets = 0;
+    idx->size = idx->count = 0;
+    idx->offset = offset;
+}
+
+void mapper_hash_index_free(mapper_hash_index idx)
+{
+    if (idx->buckets)
+        free(idx->buckets);
+    idx->buckets = 0;
+    idx->size = idx->count = 0;
+}
+
+/*! Double the number of buckets, keeping records with equal keys in the same
+ *  relative order. */
+static int hash_index_grow(mapper_hash_index idx)
+{
+    int i, old_size = idx->size;
+    void **old_buckets = idx->buckets, **bucket, *item;
+    mapper_hash_link_t *link;
+
+    idx->size = old_size ? old_size * 2 : HASH_INDEX_INITIAL_SIZE;
+    idx->buckets = (void**)calloc(idx->size, sizeof(void*));
+    if (!idx->buckets) {
+        idx->buckets = old_buckets;
+        idx->size = old_size;
+        return 1;
+    }
+    for (i = 0; i < old_size; i++) {
+        while ((item = old_buckets[i])) {
+            link = HASH_LINK(idx, item);
+            old_buckets[i] = link->next;
+            bucket = HASH_BUCKET(idx, link->key);
+            while (*bucket)
+                bucket = &HASH_LINK(idx, *bucket)->next;
+            link->next = 0;
+            *bucket = item;
+        }
+    }
+    free(old_buckets);
+    return 0;
+}
+
+int mapper_hash_index_set(mapper_hash_index idx, void *item, uint64_t key)
+{
+    mapper_hash_link_t *link = HASH_LINK(idx, item);
+    if (link->indexed) {
+        if (link->key == key)
+            return 0;
+        mapper_hash_index_remove(idx, item);
+    }
+    if (idx->count >= idx->size && hash_index_grow(idx))
+        return 1;
+
+    void **bucket = HASH_BUCKET(idx, key);
+    link->key = key;
+    link->next = *bucket;
+    link->indexed = 1;
+    *bucket = item;
+    ++idx->count;
+    return 1;
+}
+
+void mapper_hash_index_remove(mapper_hash_index idx, void *item)
+{
+    mapper_hash_link_t *link = HASH_LINK(idx, item);
+    if (!link->indexed)
+        return;
+
+    void **bucket = HASH_BUCKET(idx, link->key);
+    while (*bucket && *bucket != item)
+        bucket = &HASH_LINK(idx, *bucket)->next;
+    if (*bucket) {
+        *bucket = link->next;
+        --idx->count;
+    }
+    link->next = 0;
+    link->indexed = 0;
+}
+
+void *mapper_hash_index_find(mapper_hash_index idx, uint64_t key)
+{
+    if (!idx->count)
+        return 0;
+    void *item = *HASH_BUCKET(idx, key);
+    while (item && HASH_LINK(idx, item)->key != key)
+        item = HASH_LINK(idx, item)->next;
+    return item;
+}
+
+void *mapper_hash_index_next(mapper_hash_index idx, void *item)
+{
+    mapper_hash_link_t *link = HASH_LINK(idx, item);
+    uint64_t key = link->key;
+    item = link->next;
+    while (item && HASH_LINK(idx, item)->key != key)
+        item = HASH_LINK(idx, item)->next;
+    return item;
+}
+
+uint64_t mapper_hash_string(const char *str)
+{
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**** Property indexes ****/
+
+mapper_property_index mapper_property_index_new(const char *name, void **list,
+                                                uint32_t *version,
+                                                mapper_property_getter *get)
+{
+    if (!name || !list || !version || !get)
+        return 0;
+    mapper_property_index idx = ((mapper_property_index)
+                                 calloc(1, sizeof(mapper_property_index_t)));
+    idx->name = strdup(name);
+    idx->list = list;
+    idx->version = version;
+    idx->get = get;
+    return idx;
+}
+
+void mapper_property_index_free(mapper_property_index idx)
+{
+    if (!idx)
+        return;
+    if (idx->entries)
+        free(idx->entries);
+    free(idx->name);
+    free(idx);
+}
+
+/*! Compare two property values element by element.  Floating-point NaN values
+ *  are ordered after all other values. */
+static int compare_elements(char type, int length, const void *l, const void *r)
+{
+    int i, c = 0;
+    for (i = 0; i < length && !c; i++) {
+        switch (type) {
+            case 's':
+                if (length == 1)
+                    c = strcmp((const char*)l, (const char*)r);
+                else
+                    c = strcmp(((const char**)l)[i], ((const char**)r)[i]);
+                break;
+            case 'i': {
+                int a = ((int*)l)[i], b = ((int*)r)[i];
+                c = (a > b) - (a < b);
+                break;
+            }
+            case 'f': {
+                float a = ((float*)l)[i], b = ((float*)r)[i];
+                c = (a > b) - (a < b);
+                if (!c)
+                    c = (a != a) - (b != b);
+                break;
+            }
+            case 'd': {
+                double a = ((double*)l)[i], b = ((double*)r)[i];
+                c = (a > b) - (a < b);
+                if (!c)
+                    c = (a != a) - (b != b);
+                break;
+            }
+            case 'c': {
+                char a = ((char*)l)[i], b = ((char*)r)[i];
+                c = (a > b) - (a < b);
+                break;
+            }
+            case 'h':
+            case 't': {
+                uint64_t a = ((uint64_t*)l)[i], b = ((uint64_t*)r)[i];
+                c = (a > b) - (a < b);
+                break;
+            }
+            default:
+                return 0;
+        }
+    }
+    return c;
+}
+
+/*! Order index entries by type, then length, then value. */
+static int compare_entry_keys(char ltype, int llength, const void *lvalue,
+                              char rtype, int rlength, const void *rvalue)
+{
+    if (ltype != rtype)
+        return ltype < rtype ? -1 : 1;
+    if (llength != rlength)
+        return llength < rlength ? -1 : 1;
+    if (!lvalue || !rvalue)
+        return 0;
+    return compare_elements(ltype, llength, lvalue, rvalue);
+}
+
+static int compare_entries(const void *l, const void *r)
+{
+    const mapper_property_index_entry_t *a = l, *b = r;
+    return compare_entry_keys(a->type, a->length, a->value,
+                              b->type, b->length, b->value);
+}
+
+static void property_index_rebuild(mapper_property_index idx)
+{
+    int length, count = 0;
+    char type;
+    const void *value;
+    void *item = *idx->list;
+
+    while (item) {
+        if (   !idx->get(item, idx->name, &length, &type, &value)
+            && value && length > 0 && strchr("ifdscth", type)) {
+            if (count >= idx->alloced) {
+                idx->alloced = idx->alloced ? idx->alloced * 2 : 64;
+                idx->entries = realloc(idx->entries, idx->alloced
+                                       * sizeof(mapper_property_index_entry_t));
+            }
+            idx->entries[count].item = item;
+            idx->entries[count].value = value;
+            idx->entries[count].length = length;
+            idx->entries[count].type = type;
+            ++count;
+        }
+        item = mapper_list_next(item);
+    }
+    qsort(idx->entries, count, sizeof(mapper_property_index_entry_t),
+          compare_entries);
+    idx->num_entries = count;
+    idx->built_version = *idx->version;
+    idx->built = 1;
+}
+
+/*! Find the first entry in [lo, hi) not ordered before the given key, or if
+ *  'upper' is set the first entry ordered after it. */
+static int property_index_bound(mapper_property_index idx, int lo, int hi,
+                                char type, int length, const void *value,
+                                int upper)
+{
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        mapper_property_index_entry_t *e = &idx->entries[mid];
+        int c = compare_entry_keys(e->type, e->length, e->value, type, length,
+                                   value);
+        if (c < 0 || (upper && c == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int is_nan(char type, const void *value)
+{
+    if (type == 'f')
+        return *(float*)value != *(float*)value;
+    return *(double*)value != *(double*)value;
+}
+
+/*! Select the range of index entries that may satisfy a property query.
+ *  Returns 0 if the index cannot be used for this operator. */
+static int property_index_plan(mapper_property_index idx, int op, int length,
+                               char type, const void *value, int *start,
+                               int *end)
+{
+    int n, block_start, block_end, lo, hi;
+
+    if (op == MAPPER_OP_EXISTS) {
+        *start = 0;
+        *end = idx->num_entries;
+        return 1;
+    }
+    if (op != MAPPER_OP_EQUAL && op != MAPPER_OP_GREATER_THAN
+        && op != MAPPER_OP_GREATER_THAN_OR_EQUAL && op != MAPPER_OP_LESS_THAN
+        && op != MAPPER_OP_LESS_THAN_OR_EQUAL)
+        return 0;
+
+    // values of other types or lengths never match
+    n = idx->num_entries;
+    block_start = property_index_bound(idx, 0, n, type, length, 0, 0);
+    block_end = property_index_bound(idx, block_start, n, type, length, 0, 1);
+
+    if (length > 1 && (op != MAPPER_OP_EQUAL || type == 'f' || type == 'd')) {
+        // vector ordering used by queries is not lexicographic
+        *start = block_start;
+        *end = block_end;
+        return 1;
+    }
+    if (type == 'f' || type == 'd') {
+        // NaN compares equal to every value in queries; fall back to a scan
+        if (is_nan(type, value))
+            return 0;
+        if (block_end > block_start
+            && is_nan(type, idx->entries[block_end - 1].value))
+            return 0;
+    }
+
+    lo = property_index_bound(idx, block_start, block_end, type, length, value,
+                              0);
+    hi = property_index_bound(idx, lo, block_end, type, length, value, 1);
+    switch (op) {
+        case MAPPER_OP_EQUAL:
+            *start = lo;
+            *end = hi;
+            break;
+        case MAPPER_OP_GREATER_THAN:
+            *start = hi;
+            *end = block_end;
+            break;
+        case MAPPER_OP_GREATER_THAN_OR_EQUAL:
+            *start = lo;
+            *end = block_end;
+            break;
+        case MAPPER_OP_LESS_THAN:
+            *start = block_start;
+            *end = lo;
+            break;
+        case MAPPER_OP_LESS_THAN_OR_EQUAL:
+            *start = block_start;
+            *end = hi;
+            break;
+    }
+    return 1;
+}
+
+void **mapper_list_new_indexed_query(mapper_property_index idx, int op,
+                                     int length, char type, const void *value,
+                                     const void *list, const void *compare_func,
+                                     const char *types, ...)
+{
+    void **candidates = 0, **query;
+    int i, start, end;
+    va_list args;
+
+    if (idx && list) {
+        if (!idx->built || idx->built_version != *idx->version)
+            property_index_rebuild(idx);
+        if (property_index_plan(idx, op, length, type, value, &start, &end)) {
+            if (start >= end)
+                return 0;
+            candidates = (void**)malloc(sizeof(void*) * (end - start));
+            for (i = start; i < end; i++)
+                candidates[i - start] = idx->entries[i].item;
+        }
+    }
+
+    va_start(args, types);
+    query = new_query_internal(list, candidates, candidates ? end - start : 0,
+                               compare_func, types, args);
+    va_end(args);
+    return query;
+}
+
+/*! Find the first string entry in [lo, hi) whose first 'length' characters
+ *  are not ordered before the prefix, or if 'upper' is set are ordered after
+ *  it. */
+static int prefix_bound(mapper_property_index idx, int lo, int hi,
+                        const char *prefix, int length, int upper)
+{
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = strncmp((const char*)idx->entries[mid].value, prefix, length);
+        if (c < 0 || (upper && c == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void **mapper_list_new_prefix_query(mapper_property_index idx,
+                                    const char *prefix, const void *list,
+                                    const void *compare_func,
+                                    const char *types, ...)
+{
+    void **candidates = 0, **query;
+    int i, start = 0, end = 0, length = prefix ? strlen(prefix) : 0;
+    va_list args;
+
+    if (idx && list && length) {
+        if (!idx->built || idx->built_version != *idx->version)
+            property_index_rebuild(idx);
+        // restrict the search to single string values
+        start = property_index_bound(idx, 0, idx->num_entries, 's', 1, 0, 0);
+        end = property_index_bound(idx, start, idx->num_entries, 's', 1, 0, 1);
+        start = prefix_bound(idx, start, end, prefix, length, 0);
+        end = prefix_bound(idx, start, end, prefix, length, 1);
+        if (start >= end)
+            return 0;
+        candidates = (void**)malloc(sizeof(void*) * (end - start));
+        for (i = start; i < end; i++)
+            candidates[i - start] = idx->entries[i].item;
+    }
+
+    va_start(args, types);
+    query = new_query_internal(list, candidates, end - start, compare_func,
+                               types, args);
+    va_end(args);
+    return query;
+}
@@ -39,9 +39,24 @@ static int alphabetise_signals(int num, mapper_signal *sigs, int *order)
     return 0;
 }
 
+void mapper_map_modified(mapper_map map)
+{
+    ++(*map->props->version);
+}
+
+/*! Change the mode of a map outside of its property table. */
+static void set_mode(mapper_map map, mapper_mode mode)
+{
+    if (map->mode != mode) {
+        map->mode = mode;
+        mapper_map_modified(map);
+    }
+}
+
 void mapper_map_init(mapper_map map)
 {
     map->props = mapper_table_new();
+    map->props->version = &map->database->map_version;
     map->staged_props = mapper_table_new();
 
     // these properties need to be added in alphabetical order
@@ -153,9 +168,11 @@ mapper_map mapper_map_new(int num_sources, mapper_signal *sources,
             if (!sig->id) {
                 sig->id = sources[order[i]]->id;
                 sig->direction = sources[order[i]]->direction;
+                mapper_database_index_signal(db, sig);
             }
             if (!sig->device->id) {
                 sig->device->id = sources[order[i]]->device->id;
+                mapper_database_index_device(db, sig->device);
             }
         }
         map->sources[i]->signal = sig;
@@ -171,6 +188,7 @@ mapper_map mapper_map_new(int num_sources, mapper_signal *sources,
         map->id = mapper_device_generate_unique_id(destination->device);
 
     mapper_map_init(map);
+    mapper_database_index_map(db, map);
 
     map->status = STATUS_STAGED;
 
@@ -734,186 +752,453 @@ int mapper_map_perform(mapper_map map, mapper_slot slot, int instance,
     mapper_history sources[map->num_sources];
     for (i = 0; i < map->num_sources; i++)
         sources[i] = &map->sources[i]->local->history[instance];
-    return (mapper_expr_evaluate(map->local->expr, sources,
-                                 &map->local->expr_vars[instance],
-                                 &to[instance],
-                                 mapper_history_tt_ptr(from[instance]),
-                                 typestring));
+    return (mapper_map_evaluate(map, sources, &map->local->expr_vars[instance],
+                                &to[instance],
+                                mapper_history_tt_ptr(from[instance]),
+                                typestring));
 }
 
-int mapper_boundary_perform(mapper_history history, mapper_slot slot,
-                            char *typestring)
+/**** Linear kernel ****/
+
+/* Maps in linear mode store their scale and offset vectors so that the
+ * common case of y=x*a+b can skip the expression engine.  The kernel must give
+ * exactly the values of the expression string, which is what remote peers
+ * evaluate, so its constants are rounded as they are when the string is
+ * printed and parsed, and values are computed in the expression's precision:
+ * double if either signal is double and float otherwise. */
+
+static int linear_kernel_enabled = 1;
+
+int mapper_map_enable_linear_kernel(int enable)
 {
-    int i, muted = 0;
+    int previous = linear_kernel_enabled;
+    linear_kernel_enabled = enable ? 1 : 0;
+    return previous;
+}
 
-    double value;
-    double dest_min, dest_max, swap, total_range, difference, modulo_difference;
-    mapper_boundary_action bound_min, bound_max;
+#define LINEAR_LOOP(TI, TC, TO)                                             \
+{                                                                           \
+    const TI *x = (const TI*)src;                                           \
+    const TC *a = (const TC*)lmap->linear_scale;                            \
+    const TC *b = (const TC*)lmap->linear_offset;                           \
+    TO *y = (TO*)dst;                                                       \
+    for (; i < n; i++)                                                      \
+        y[i] = (TO)((TC)x[i] * a[i] + b[i]);                                \
+}
 
-    if (   slot->bound_min == MAPPER_BOUND_NONE
-        && slot->bound_max == MAPPER_BOUND_NONE) {
-        return 0;
-    }
-    if (!slot->minimum && (   slot->bound_min != MAPPER_BOUND_NONE
-                           || slot->bound_max == MAPPER_BOUND_WRAP)) {
-        return 0;
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+
+static int linear_sse_f(const float *x, float *y, const float *a,
+                        const float *b, int n)
+{
+    int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(a + i));
+        _mm_storeu_ps(y + i, _mm_add_ps(v, _mm_loadu_ps(b + i)));
     }
-    if (!slot->maximum && (   slot->bound_max != MAPPER_BOUND_NONE
-                           || slot->bound_min == MAPPER_BOUND_WRAP)) {
-        return 0;
+    return i;
+}
+
+static int linear_sse_d(const double *x, double *y, const double *a,
+                        const double *b, int n)
+{
+    int i;
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128d v = _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(a + i));
+        _mm_storeu_pd(y + i, _mm_add_pd(v, _mm_loadu_pd(b + i)));
     }
+    return i;
+}
+#endif
 
-    for (i = 0; i < history->length; i++) {
-        if (typestring[i] == 'N') {
-            ++muted;
-            continue;
-        }
-        value = propval_double(mapper_history_value_ptr(*history),
-                               slot->signal->type, i);
-        dest_min = propval_double(slot->minimum, slot->signal->type, i);
-        dest_max = propval_double(slot->maximum, slot->signal->type, i);
-        if (dest_min < dest_max) {
-            bound_min = slot->bound_min;
-            bound_max = slot->bound_max;
+static int evaluate_linear(mapper_local_map lmap, mapper_history from,
+                           mapper_history to, mapper_timetag_t *tt,
+                           char *typestring)
+{
+    int i = 0, n = lmap->linear_length;
+
+    to->position = (to->position + 1) % to->size;
+    const void *src = mapper_history_value_ptr(*from);
+    void *dst = mapper_history_value_ptr(*to);
+
+    if (lmap->linear_type == 'f') {
+        // neither signal is double
+        switch (from->type) {
+            case 'i':
+                switch (to->type) {
+                    case 'i':   LINEAR_LOOP(int, float, int);       break;
+                    default:    LINEAR_LOOP(int, float, float);     break;
+                }
+                break;
+            default:
+                switch (to->type) {
+                    case 'i':   LINEAR_LOOP(float, float, int);     break;
+                    default:
+#if defined(__GNUC__) && defined(__SSE2__)
+                        i = linear_sse_f(src, dst, lmap->linear_scale,
+                                         lmap->linear_offset, n);
+#endif
+                        LINEAR_LOOP(float, float, float);
+                        break;
+                }
+                break;
         }
-        else {
-            bound_min = slot->bound_max;
-            bound_max = slot->bound_min;
-            swap = dest_max;
-            dest_max = dest_min;
-            dest_min = swap;
+    }
+    else {
+        switch (from->type) {
+            case 'i':   LINEAR_LOOP(int, double, double);           break;
+            case 'f':   LINEAR_LOOP(float, double, double);         break;
+            default:
+                switch (to->type) {
+                    case 'i':   LINEAR_LOOP(double, double, int);   break;
+                    case 'f':   LINEAR_LOOP(double, double, float); break;
+                    default:
+#if defined(__GNUC__) && defined(__SSE2__)
+                        i = linear_sse_d(src, dst, lmap->linear_scale,
+                                         lmap->linear_offset, n);
+#endif
+                        LINEAR_LOOP(double, double, double);
+                        break;
+                }
+                break;
         }
-        total_range = fabs(dest_max - dest_min);
-        if (value < dest_min) {
-            switch (bound_min) {
-                case MAPPER_BOUND_MUTE:
-                    // need to prevent value from being sent at all
-                    typestring[i] = 'N';
-                    ++muted;
-                    break;
-                case MAPPER_BOUND_CLAMP:
-                    // clamp value to range minimum
-                    value = dest_min;
-                    break;
-                case MAPPER_BOUND_FOLD:
-                    // fold value around range minimum
-                    difference = fabs(value - dest_min);
-                    value = dest_min + difference;
-                    if (value > dest_max) {
-                        // value now exceeds range maximum!
-                        switch (bound_max) {
-                            case MAPPER_BOUND_MUTE:
-                                // need to prevent value from being sent at all
-                                typestring[i] = 'N';
-                                ++muted;
-                                break;
-                            case MAPPER_BOUND_CLAMP:
-                                // clamp value to range minimum
-                                value = dest_max;
-                                break;
-                            case MAPPER_BOUND_FOLD:
-                                // both boundary actions are set to fold!
-                                difference = fabs(value - dest_max);
-                                modulo_difference = difference
-                                    - ((int)(difference / total_range)
-                                       * total_range);
-                                if ((int)(difference / total_range) % 2 == 0) {
-                                    value = dest_max - modulo_difference;
-                                }
-                                else
-                                    value = dest_min + modulo_difference;
-                                break;
-                            case MAPPER_BOUND_WRAP:
-                                // wrap value back from range minimum
-                                difference = fabs(value - dest_max);
-                                modulo_difference = difference
-                                    - ((int)(difference / total_range)
-                                       * total_range);
+    }
+
+    if (typestring)
+        memset(typestring, to->type, n);
+    if (tt)
+        memcpy(mapper_history_tt_ptr(*to), tt, sizeof(mapper_timetag_t));
+    return 1;
+}
+
+int mapper_map_evaluate(mapper_map map, mapper_history *sources,
+                        mapper_history *expr_vars, mapper_history to,
+                        mapper_timetag_t *tt, char *typestring)
+{
+    if (linear_kernel_enabled && map->mode == MAPPER_MODE_LINEAR
+        && map->local->linear_length && typestring)
+        return evaluate_linear(map->local, sources[0], to, tt, typestring);
+    return mapper_expr_evaluate(map->local->expr, sources, expr_vars, to, tt,
+                                typestring);
+}
+
+/**** Boundary kernels ****/
+
+/* Most updates are already within the slot's range, and the most common
+ * boundary action is clamping at both ends, so typed whole-vector kernels
+ * handle these cases before falling back to per-element processing. */
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SSE_BOUND_F(NAME, BODY)                                             \
+static int NAME##_sse_f(float *v, const float *mn, const float *mx, int n)  \
+{                                                                           \
+    int i, out = 0;                                                         \
+    for (i = 0; i + 4 <= n; i += 4) {                                       \
+        __m128 a = _mm_loadu_ps(mn + i), b = _mm_loadu_ps(mx + i);          \
+        __m128 lo = _mm_min_ps(a, b), hi = _mm_max_ps(a, b);                \
+        __m128 x = _mm_loadu_ps(v + i);                                     \
+        BODY(ps)                                                            \
+    }                                                                       \
+    return out ? -1 : i;                                                    \
+}
+#define SSE_BOUND_D(NAME, BODY)                                             \
+static int NAME##_sse_d(double *v, const double *mn, const double *mx,      \
+                        int n)                                              \
+{                                                                           \
+    int i, out = 0;                                                         \
+    for (i = 0; i + 2 <= n; i += 2) {                                       \
+        __m128d a = _mm_loadu_pd(mn + i), b = _mm_loadu_pd(mx + i);         \
+        __m128d lo = _mm_min_pd(a, b), hi = _mm_max_pd(a, b);               \
+        __m128d x = _mm_loadu_pd(v + i);                                    \
+        BODY(pd)                                                            \
+    }                                                                       \
+    return out ? -1 : i;                                                    \
+}
+
+#define SSE_IN_RANGE(P)                                                     \
+    out |= _mm_movemask_##P(_mm_or_##P(_mm_cmplt_##P(x, lo),                \
+                                       _mm_cmpgt_##P(x, hi)));
+/* Operand order leaves NaN values unchanged, as in the scalar kernel. */
+#define SSE_CLAMP(P)                                                        \
+    _mm_storeu_##P(v + i, _mm_min_##P(hi, _mm_max_##P(lo, x)));
+
+SSE_BOUND_F(in_range, SSE_IN_RANGE)
+SSE_BOUND_D(in_range, SSE_IN_RANGE)
+SSE_BOUND_F(clamp, SSE_CLAMP)
+SSE_BOUND_D(clamp, SSE_CLAMP)
+#define SIMD_BOUND(NAME, S, v, mn, mx, n) NAME##_sse_##S(v, mn, mx, n)
+#else
+#define SIMD_BOUND(NAME, S, v, mn, mx, n) 0
+#endif
+
+/* Each kernel starts from the first element left unprocessed by the SIMD
+ * variant, if any.  in_range kernels return non-zero if every element is
+ * within the range. */
+#define BOUNDARY_KERNELS(T, S, SIMD)                                        \
+static int in_range_##S(T *v, const T *mn, const T *mx, int n)              \
+{                                                                           \
+    int i = SIMD(in_range, S, v, mn, mx, n), out = 0;                       \
+    if (i < 0)                                                              \
+        return 0;                                                           \
+    for (; i < n; i++) {                                                    \
+        T lo = mn[i] < mx[i] ? mn[i] : mx[i];                               \
+        T hi = mn[i] < mx[i] ? mx[i] : mn[i];                               \
+        out |= (v[i] < lo) | (v[i] > hi);                                   \
+    }                                                                       \
+    return !out;                                                            \
+}                                                                           \
+static void clamp_##S(T *v, const T *mn, const T *mx, int n)                \
+{                                                                           \
+    int i = SIMD(clamp, S, v, mn, mx, n);                                   \
+    for (; i < n; i++) {                                                    \
+        T lo = mn[i] < mx[i] ? mn[i] : mx[i];                               \
+        T hi = mn[i] < mx[i] ? mx[i] : mn[i];                               \
+        v[i] = v[i] < lo ? lo : v[i] > hi ? hi : v[i];                      \
+    }                                                                       \
+}
+
+#define NO_SIMD_BOUND(NAME, S, v, mn, mx, n) 0
+BOUNDARY_KERNELS(int, i, NO_SIMD_BOUND)
+BOUNDARY_KERNELS(float, f, SIMD_BOUND)
+BOUNDARY_KERNELS(double, d, SIMD_BOUND)
+
+/*! Try the whole-vector kernels, returning 1 if the vector was handled. */
+static int boundary_fast_path(mapper_history history, mapper_slot slot,
+                              const char *typestring)
+{
+    void *v = mapper_history_value_ptr(*history);
+    int n = history->length;
+    int clamp = (slot->bound_min == MAPPER_BOUND_CLAMP
+                 && slot->bound_max == MAPPER_BOUND_CLAMP
+                 && !memchr(typestring, 'N', n));
+
+    switch (slot->signal->type) {
+        case 'i':
+            if (in_range_i(v, slot->minimum, slot->maximum, n))
+                return 1;
+            if (clamp)
+                clamp_i(v, slot->minimum, slot->maximum, n);
+            return clamp;
+        case 'f':
+            if (in_range_f(v, slot->minimum, slot->maximum, n))
+                return 1;
+            if (clamp)
+                clamp_f(v, slot->minimum, slot->maximum, n);
+            return clamp;
+        case 'd':
+            if (in_range_d(v, slot->minimum, slot->maximum, n))
+                return 1;
+            if (clamp)
+                clamp_d(v, slot->minimum, slot->maximum, n);
+            return clamp;
+        default:
+            return 0;
+    }
+}
+
+/*! Apply boundary actions to a single value outside the range, returning
+ *  non-zero if the value should be muted. */
+static int bound_value(double *valuep, double dest_min, double dest_max,
+                       mapper_boundary_action bound_min,
+                       mapper_boundary_action bound_max)
+{
+    int muted = 0;
+    double value = *valuep;
+    double swap, total_range, difference, modulo_difference;
+
+    if (dest_min >= dest_max) {
+        mapper_boundary_action swap_action = bound_min;
+        bound_min = bound_max;
+        bound_max = swap_action;
+        swap = dest_max;
+        dest_max = dest_min;
+        dest_min = swap;
+    }
+    total_range = fabs(dest_max - dest_min);
+    if (value < dest_min) {
+        switch (bound_min) {
+            case MAPPER_BOUND_MUTE:
+                // need to prevent value from being sent at all
+                muted = 1;
+                break;
+            case MAPPER_BOUND_CLAMP:
+                // clamp value to range minimum
+                value = dest_min;
+                break;
+            case MAPPER_BOUND_FOLD:
+                // fold value around range minimum
+                difference = fabs(value - dest_min);
+                value = dest_min + difference;
+                if (value > dest_max) {
+                    // value now exceeds range maximum!
+                    switch (bound_max) {
+                        case MAPPER_BOUND_MUTE:
+                            // need to prevent value from being sent at all
+                            muted = 1;
+                            break;
+                        case MAPPER_BOUND_CLAMP:
+                            // clamp value to range minimum
+                            value = dest_max;
+                            break;
+                        case MAPPER_BOUND_FOLD:
+                            // both boundary actions are set to fold!
+                            difference = fabs(value - dest_max);
+                            modulo_difference = difference
+                                - ((int)(difference / total_range)
+                                   * total_range);
+                            if ((int)(difference / total_range) % 2 == 0) {
+                                value = dest_max - modulo_difference;
+                            }
+                            else
                                 value = dest_min + modulo_difference;
-                                break;
-                            default:
-                                break;
-                        }
+                            break;
+                        case MAPPER_BOUND_WRAP:
+                            // wrap value back from range minimum
+                            difference = fabs(value - dest_max);
+                            modulo_difference = difference
+                                - ((int)(difference / total_range)
+                                   * total_range);
+                            value = dest_min + modulo_difference;
+                            break;
+                        default:
+                            break;
                     }
-                    break;
-                case MAPPER_BOUND_WRAP:
-                    // wrap value back from range maximum
-                    difference = fabs(value - dest_min);
-                    modulo_difference = difference
-                        - (int)(difference / total_range) * total_range;
-                    value = dest_max - modulo_difference;
-                    break;
-                default:
-                    // leave the value unchanged
-                    break;
-            }
+                }
+                break;
+            case MAPPER_BOUND_WRAP:
+                // wrap value back from range maximum
+                difference = fabs(value - dest_min);
+                modulo_difference = difference
+                    - (int)(difference / total_range) * total_range;
+                value = dest_max - modulo_difference;
+                break;
+            default:
+                // leave the value unchanged
+                break;
         }
-        else if (value > dest_max) {
-            switch (bound_max) {
-                case MAPPER_BOUND_MUTE:
-                    // need to prevent value from being sent at all
-                    typestring[i] = 'N';
-                    ++muted;
-                    break;
-                case MAPPER_BOUND_CLAMP:
-                    // clamp value to range maximum
-                    value = dest_max;
-                    break;
-                case MAPPER_BOUND_FOLD:
-                    // fold value around range maximum
-                    difference = fabs(value - dest_max);
-                    value = dest_max - difference;
-                    if (value < dest_min) {
-                        // value now exceeds range minimum!
-                        switch (bound_min) {
-                            case MAPPER_BOUND_MUTE:
-                                // need to prevent value from being sent at all
-                                typestring[i] = 'N';
-                                ++muted;
-                                break;
-                            case MAPPER_BOUND_CLAMP:
-                                // clamp value to range minimum
-                                value = dest_min;
-                                break;
-                            case MAPPER_BOUND_FOLD:
-                                // both boundary actions are set to fold!
-                                difference = fabs(value - dest_min);
-                                modulo_difference = difference
-                                    - ((int)(difference / total_range)
-                                       * total_range);
-                                if ((int)(difference / total_range) % 2 == 0) {
-                                    value = dest_max + modulo_difference;
-                                }
-                                else
-                                    value = dest_min - modulo_difference;
-                                break;
-                            case MAPPER_BOUND_WRAP:
-                                // wrap value back from range maximum
-                                difference = fabs(value - dest_min);
-                                modulo_difference = difference
-                                    - ((int)(difference / total_range)
-                                       * total_range);
+    }
+    else if (value > dest_max) {
+        switch (bound_max) {
+            case MAPPER_BOUND_MUTE:
+                // need to prevent value from being sent at all
+                muted = 1;
+                break;
+            case MAPPER_BOUND_CLAMP:
+                // clamp value to range maximum
+                value = dest_max;
+                break;
+            case MAPPER_BOUND_FOLD:
+                // fold value around range maximum
+                difference = fabs(value - dest_max);
+                value = dest_max - difference;
+                if (value < dest_min) {
+                    // value now exceeds range minimum!
+                    switch (bound_min) {
+                        case MAPPER_BOUND_MUTE:
+                            // need to prevent value from being sent at all
+                            muted = 1;
+                            break;
+                        case MAPPER_BOUND_CLAMP:
+                            // clamp value to range minimum
+                            value = dest_min;
+                            break;
+                        case MAPPER_BOUND_FOLD:
+                            // both boundary actions are set to fold!
+                            difference = fabs(value - dest_min);
+                            modulo_difference = difference
+                                - ((int)(difference / total_range)
+                                   * total_range);
+                            if ((int)(difference / total_range) % 2 == 0) {
+                                value = dest_min + modulo_difference;
+                            }
+                            else
                                 value = dest_max - modulo_difference;
-                                break;
-                            default:
-                                break;
-                        }
+                            break;
+                        case MAPPER_BOUND_WRAP:
+                            // wrap value back from range maximum
+                            difference = fabs(value - dest_min);
+                            modulo_difference = difference
+                                - ((int)(difference / total_range)
+                                   * total_range);
+                            value = dest_max - modulo_difference;
+                            break;
+                        default:
+                            break;
                     }
-                    break;
-                case MAPPER_BOUND_WRAP:
-                    // wrap value back from range minimum
-                    difference = fabs(value - dest_max);
-                    modulo_difference = difference
-                        - (int)(difference / total_range) * total_range;
-                    value = dest_min + modulo_difference;
-                    break;
-                default:
-                    break;
-            }
+                }
+                break;
+            case MAPPER_BOUND_WRAP:
+                // wrap value back from range minimum
+                difference = fabs(value - dest_max);
+                modulo_difference = difference
+                    - (int)(difference / total_range) * total_range;
+                value = dest_min + modulo_difference;
+                break;
+            default:
+                break;
+        }
+    }
+    *valuep = value;
+    return muted;
+}
+
+/* Values within the range are skipped; ranges may be given in either order. */
+#define BOUND_LOOP(T)                                                       \
+{                                                                           \
+    T *v = (T*)mapper_history_value_ptr(*history);                          \
+    const T *mn = (const T*)slot->minimum, *mx = (const T*)slot->maximum;   \
+    for (i = 0; i < history->length; i++) {                                 \
+        if (typestring[i] == 'N') {                                         \
+            ++muted;                                                        \
+            continue;                                                       \
+        }                                                                   \
+        if ((v[i] >= mn[i] && v[i] <= mx[i])                                \
+            || (v[i] <= mn[i] && v[i] >= mx[i]))                            \
+            continue;                                                       \
+        value = v[i];                                                       \
+        if (bound_value(&value, mn[i], mx[i], slot->bound_min,              \
+                        slot->bound_max)) {                                 \
+            typestring[i] = 'N';                                            \
+            ++muted;                                                        \
+        }                                                                   \
+        v[i] = (T)value;                                                    \
+    }                                                                       \
+}
+
+int mapper_boundary_perform(mapper_history history, mapper_slot slot,
+                            char *typestring)
+{
+    int i, muted = 0;
+    double value;
+
+    if (   slot->bound_min == MAPPER_BOUND_NONE
+        && slot->bound_max == MAPPER_BOUND_NONE) {
+        return 0;
+    }
+    if (!slot->minimum || !slot->maximum) {
+        return 0;
+    }
+
+    if (!boundary_fast_path(history, slot, typestring)) {
+        switch (slot->signal->type) {
+            case 'i':
+                BOUND_LOOP(int);
+                break;
+            case 'f':
+                BOUND_LOOP(float);
+                break;
+            case 'd':
+                BOUND_LOOP(double);
+                break;
+            default:
+                break;
         }
-        propval_set_double(mapper_history_value_ptr(*history),
-                           slot->signal->type, i, value);
+        return (muted == history->length);
     }
+
+    for (i = 0; i < history->length; i++)
+        muted += (typestring[i] == 'N');
     return (muted == history->length);
 }
 
@@ -1002,6 +1287,7 @@ static int replace_expression_string(mapper_map map, const char *expr_str)
     int output_history_size = mapper_expr_output_history_size(expr);
     if (output_history_size > 1 && map->process_location == MAPPER_LOC_SOURCE) {
         map->process_location = MAPPER_LOC_DESTINATION;
+        mapper_map_modified(map);
         if (!map->destination.signal->local) {
             // copy expression string but do not execute it
             mapper_table_set_record(map->props, AT_EXPRESSION, NULL, 1, 's',
@@ -1027,10 +1313,49 @@ static int replace_expression_string(mapper_map map, const char *expr_str)
 
 static void mapper_map_set_mode_raw(mapper_map map)
 {
-    map->mode = MAPPER_MODE_RAW;
+    set_mode(map, MAPPER_MODE_RAW);
     reallocate_map_histories(map);
 }
 
+/*! Round a constant as the expression engine sees it: printed with "%g" and
+ *  parsed back as a float. */
+static double expression_constant(double value)
+{
+    char str[32];
+    snprintf(str, 32, "%g", value);
+    return (float)atof(str);
+}
+
+/* The linear kernel is only used when the expression assigns the whole
+ * output vector from a single source. */
+static void set_linear_kernel(mapper_map map, double *scale, double *offset,
+                              int length)
+{
+    int i;
+    mapper_local_map lmap = map->local;
+    if (!lmap->expr || map->sources[0]->signal->length != length
+        || map->destination.signal->length != length) {
+        lmap->linear_length = 0;
+        return;
+    }
+    lmap->linear_type = (map->sources[0]->signal->type == 'd'
+                         || map->destination.signal->type == 'd') ? 'd' : 'f';
+    size_t size = lmap->linear_type == 'd' ? sizeof(double) : sizeof(float);
+    lmap->linear_scale = realloc(lmap->linear_scale, size * length);
+    lmap->linear_offset = realloc(lmap->linear_offset, size * length);
+    for (i = 0; i < length; i++) {
+        if (lmap->linear_type == 'd') {
+            ((double*)lmap->linear_scale)[i] = expression_constant(scale[i]);
+            ((double*)lmap->linear_offset)[i] = expression_constant(offset[i]);
+        }
+        else {
+            ((float*)lmap->linear_scale)[i] = expression_constant(scale[i]);
+            ((float*)lmap->linear_offset)[i] = expression_constant(offset[i]);
+        }
+    }
+    lmap->linear_length = length;
+}
+
 static int mapper_map_set_mode_linear(mapper_map map)
 {
     if (map->num_sources > 1)
@@ -1071,29 +1396,36 @@ static int mapper_map_set_mode_linear(mapper_map map)
         snprintf(expr+len, 256-len, "[");
     }
 
+    double scale[min_length], offset[min_length];
     for (i = 0; i < min_length; i++) {
-        // get multiplier
         src_min = propval_double(map->sources[0]->minimum,
                                  map->sources[0]->signal->type, i);
         src_max = propval_double(map->sources[0]->maximum,
                                  map->sources[0]->signal->type, i);
-        len = strlen(expr);
-        if (src_min == src_max)
-            snprintf(expr+len, 256-len, "0,");
+        dest_min = propval_double(map->destination.minimum,
+                                  map->destination.signal->type, i);
+        dest_max = propval_double(map->destination.maximum,
+                                  map->destination.signal->type, i);
+        if (src_min == src_max) {
+            scale[i] = 0;
+            offset[i] = dest_min;
+        }
+        else if ((src_min == dest_min) && (src_max == dest_max)) {
+            scale[i] = 1;
+            offset[i] = 0;
+        }
         else {
-            dest_min = propval_double(map->destination.minimum,
-                                      map->destination.signal->type, i);
-            dest_max = propval_double(map->destination.maximum,
-                                      map->destination.signal->type, i);
-            if ((src_min == dest_min) && (src_max == dest_max)) {
-                snprintf(expr+len, 256-len, "1,");
-            }
-            else {
-                double scale = ((dest_min - dest_max) / (src_min - src_max));
-                snprintf(expr+len, 256-len, "%g,", scale);
-            }
+            scale[i] = ((dest_min - dest_max) / (src_min - src_max));
+            offset[i] = ((dest_max * src_min - dest_min * src_max)
+                         / (src_min - src_max));
         }
     }
+
+    // get multiplier
+    for (i = 0; i < min_length; i++) {
+        len = strlen(expr);
+        snprintf(expr+len, 256-len, "%g,", scale[i]);
+    }
     len = strlen(expr);
     if (min_length > 1)
         snprintf(expr+len-1, 256-len+1, "]+[");
@@ -1102,28 +1434,8 @@ static int mapper_map_set_mode_linear(mapper_map map)
 
     // add offset
     for (i = 0; i < min_length; i++) {
-        src_min = propval_double(map->sources[0]->minimum,
-                                 map->sources[0]->signal->type, i);
-        src_max = propval_double(map->sources[0]->maximum,
-                                 map->sources[0]->signal->type, i);
-
         len = strlen(expr);
-        if (src_min == src_max)
-            snprintf(expr+len, 256-len, "%g,", dest_min);
-        else {
-            dest_min = propval_double(map->destination.minimum,
-                                      map->destination.signal->type, i);
-            dest_max = propval_double(map->destination.maximum,
-                                      map->destination.signal->type, i);
-            if ((src_min == dest_min) && (src_max == dest_max)) {
-                snprintf(expr+len, 256-len, "0,");
-            }
-            else {
-                double offset = ((dest_max * src_min - dest_min * src_max)
-                                 / (src_min - src_max));
-                snprintf(expr+len, 256-len, "%g,", offset);
-            }
-        }
+        snprintf(expr+len, 256-len, "%g,", offset[i]);
     }
     len = strlen(expr);
     if (min_length > 1)
@@ -1148,14 +1460,17 @@ static int mapper_map_set_mode_linear(mapper_map map)
             }
         }
         if (should_compile) {
-            if (!replace_expression_string(map, e))
+            // the kernel must match the expression in use
+            if (!replace_expression_string(map, e)) {
                 reallocate_map_histories(map);
+                set_linear_kernel(map, scale, offset, min_length);
+            }
         }
         else {
             mapper_table_set_record(map->props, AT_EXPRESSION, NULL, 1, 's',
                                     e, REMOTE_MODIFY);
         }
-        map->mode = MAPPER_MODE_LINEAR;
+        set_mode(map, MAPPER_MODE_LINEAR);
         return 0;
     }
     return 1;
@@ -1183,7 +1498,7 @@ static void mapper_map_set_mode_expression(mapper_map map, const char *expr)
     if (should_compile) {
         if (!replace_expression_string(map, expr)) {
             reallocate_map_histories(map);
-            map->mode = MAPPER_MODE_EXPRESSION;
+            set_mode(map, MAPPER_MODE_EXPRESSION);
         }
         else
             return;
@@ -1191,7 +1506,7 @@ static void mapper_map_set_mode_expression(mapper_map map, const char *expr)
     else {
         if (mapper_table_set_record(map->props, AT_EXPRESSION, NULL, 1, 's',
                                     expr, REMOTE_MODIFY)) {
-            map->mode = MAPPER_MODE_EXPRESSION;
+            set_mode(map, MAPPER_MODE_EXPRESSION);
         }
         return;
     }
@@ -1228,22 +1543,10 @@ static void mapper_map_set_mode_expression(mapper_map map, const char *expr)
 // TODO: move to slot.c?
 static void init_slot_history(mapper_slot slot)
 {
-    int i;
     if (slot->local->history) {
         return;
     }
-    slot->local->history = malloc(sizeof(struct _mapper_history)
-                                  * slot->num_instances);
-    slot->local->history_size = 1;
-    for (i = 0; i < slot->num_instances; i++) {
-        slot->local->history[i].type = slot->signal->type;
-        slot->local->history[i].length = slot->signal->length;
-        slot->local->history[i].size = 1;
-        slot->local->history[i].value = calloc(1, mapper_type_size(slot->signal->type)
-                                               * slot->signal->length);
-        slot->local->history[i].timetag = calloc(1, sizeof(mapper_timetag_t));
-        slot->local->history[i].position = -1;
-    }
+    mapper_slot_realloc_history(slot, slot->num_instances, 1, 0);
 }
 
 static void apply_mode(mapper_map map)
@@ -1548,12 +1851,28 @@ int mapper_map_set_from_message(mapper_map map, mapper_message msg, int override
                                                    1, 'i', &mode, REMOTE_MODIFY);
                 break;
             }
+            case AT_ALIAS: {
+                // only used by the source device to address the destination
+                if (!map->local || map->destination.signal->local
+                    || atom->types[0] != 'i')
+                    break;
+                char alias_path[16];
+                snprintf(alias_path, 16, "/_/%d", (atom->values[0])->i32);
+                if (map->local->alias_path) {
+                    if (!strcmp(map->local->alias_path, alias_path))
+                        break;
+                    free(map->local->alias_path);
+                }
+                map->local->alias_path = strdup(alias_path);
+                break;
+            }
             case AT_EXTRA:
                 if (!atom->key)
                     break;
             case AT_ID:
             case AT_DESCRIPTION:
             case AT_MUTED:
+            case AT_TRANSPORT:
             case AT_VERSION:
                 updated += mapper_table_set_record_from_atom(map->props, atom,
                                                              REMOTE_MODIFY);
@@ -1563,6 +1882,9 @@ int mapper_map_set_from_message(mapper_map map, mapper_message msg, int override
         }
     }
 
+    if (updated)
+        mapper_database_index_map(map->database, map);
+
     if (map->local) {
         if (map->status < STATUS_READY) {
             // check if mapping is now "ready"
@@ -1594,11 +1916,8 @@ void reallocate_map_histories(mapper_map map)
 
         history_size = mapper_expr_input_history_size(map->local->expr, i);
         if (history_size > slot_loc->history_size) {
-            size_t sample_size = mapper_type_size(slot->signal->type) * slot->signal->length;;
-            for (j = 0; j < slot->num_instances; j++) {
-                mhist_realloc(&slot_loc->history[j], history_size, sample_size, 1);
-            }
-            slot_loc->history_size = history_size;
+            mapper_slot_realloc_history(slot, slot->num_instances, history_size,
+                                        1);
         }
         else if (history_size < slot_loc->history_size) {
             // Do nothing for now...
@@ -1611,11 +1930,7 @@ void reallocate_map_histories(mapper_map map)
 
     // reallocate output histories
     if (history_size > slot_loc->history_size) {
-        int sample_size = mapper_type_size(slot->signal->type) * slot->signal->length;
-        for (i = 0; i < slot->num_instances; i++) {
-            mhist_realloc(&slot_loc->history[i], history_size, sample_size, 0);
-        }
-        slot_loc->history_size = history_size;
+        mapper_slot_realloc_history(slot, slot->num_instances, history_size, 0);
     }
     else if (history_size < slot_loc->history_size) {
         // Do nothing for now...
@@ -1838,6 +2153,15 @@ int mapper_map_send_state(mapper_map map, int slot, network_message_t cmd)
     /* destination properties */
     mapper_slot_add_props_to_message(msg, &map->destination, 1, staged);
 
+    /* offer a short path alias for addressing the local destination */
+    mapper_signal dst = map->destination.signal;
+    if ((cmd == MSG_MAP_TO || cmd == MSG_MAPPED) && dst->local
+        && dst->local->alias && !dst->device->local->no_path_aliases
+        && map->local && !map->local->is_local_only) {
+        lo_message_add_string(msg, mapper_protocol_string(AT_ALIAS));
+        lo_message_add_int32(msg, dst->local->alias);
+    }
+
     mapper_network_add_message(map->database->network, 0, cmd, msg);
 
     return i-1;
@@ -71,6 +71,35 @@ void mapper_device_remove_signal_methods(mapper_device dev, mapper_signal sig);
 void mapper_device_num_instances_changed(mapper_device dev, mapper_signal sig,
                                          int size);
 
+void mapper_device_reindex_instance_id_maps(mapper_device dev);
+
+int mapper_device_receive_update(mapper_signal sig, const char *types,
+                                 lo_arg **argv, int argc, mapper_timetag_t tt);
+
+uint32_t mapper_device_local_version(void);
+
+/*! Open or close the listener accepting streams, depending on whether any of
+ *  the device's links use the "tcp" transport. */
+void mapper_device_update_stream_listener(mapper_device dev);
+
+/*! Return the handlers to call for a signal: its own, or ones deferring the
+ *  call to the application thread if the device's network thread requires. */
+mapper_signal_update_handler *mapper_device_update_handler(mapper_signal sig);
+
+mapper_instance_event_handler *mapper_device_event_handler(mapper_signal sig);
+
+/*! Find the local signal corresponding to the destination of a map from 'dev'
+ *  if it may receive updates by direct function call, i.e. if 'dev' has
+ *  in-process delivery enabled, the signal belongs to a device in this
+ *  process and neither device is serviced by a network thread.  The result
+ *  remains valid until mapper_device_local_version() changes. */
+mapper_signal mapper_device_local_destination(mapper_device dev,
+                                              mapper_signal dst);
+
+/*! Return non-zero if a signal found by mapper_device_local_destination() can
+ *  be updated by direct function call from the calling thread right now. */
+int mapper_device_accepts_direct_delivery(mapper_signal sig);
+
 void mapper_device_route_signal(mapper_device dev, mapper_signal sig,
                                 int instance_index, const void *value,
                                 int count, mapper_timetag_t tt);
@@ -78,6 +107,11 @@ void mapper_device_route_signal(mapper_device dev, mapper_signal sig,
 int mapper_device_route_query(mapper_device dev, mapper_signal sig,
                               mapper_timetag_t tt);
 
+int mapper_device_enqueue_update(mapper_device dev, mapper_signal sig,
+                                 mapper_id instance, int use_instance,
+                                 const void *value, int count,
+                                 mapper_timetag_t tt);
+
 void mapper_device_release_scope(mapper_device dev, const char *scope);
 
 void mapper_device_start_server(mapper_device dev, int port);
@@ -228,6 +262,12 @@ void mapper_signal_instance_release_internal(mapper_signal sig,
                                              int instance_index,
                                              mapper_timetag_t timetag);
 
+/*! Clear the device id map referenced by a signal id map. */
+void mapper_signal_remove_id_map(mapper_signal sig, int index);
+
+/*! Rebuild a signal's id map index, e.g. after instance ids have changed. */
+void mapper_signal_reindex_id_maps(mapper_signal sig);
+
 /**** Links ****/
 
 void mapper_link_init(mapper_link link, int is_local);
@@ -237,7 +277,30 @@ void mapper_link_free(mapper_link link);
 int mapper_link_set_from_message(mapper_link link, mapper_message msg, int rev);
 void mapper_link_send_state(mapper_link link, network_message_t cmd, int staged);
 void mapper_link_start_queue(mapper_link link, mapper_timetag_t tt);
+int mapper_link_has_queue(mapper_link link, mapper_timetag_t tt);
 void mapper_link_send_queue(mapper_link link, mapper_timetag_t tt);
+lo_bundle mapper_link_pop_queue(mapper_link link, mapper_timetag_t tt);
+
+/*! Send a bundle to the remote device of a link, through its shared-memory
+ *  ring if one was offered and has room, otherwise over UDP. */
+void mapper_link_send_bundle(mapper_link link, lo_bundle bundle);
+
+/*! Write a serialised datagram to the shared-memory ring offered by the
+ *  remote device of a link.  Returns non-zero if there is no such ring or it
+ *  is full, in which case the datagram must be sent over UDP. */
+int mapper_link_send_shm(mapper_link link, const void *data, size_t len);
+
+/*! Append a serialised datagram to the stream of a link using the "tcp"
+ *  transport.  Returns non-zero if the stream is not connected, in which case
+ *  the datagram must be sent over UDP. */
+int mapper_link_send_stream(mapper_link link, const void *data, size_t len);
+
+/*! Write as much of a link's buffered stream data as the socket accepts. */
+void mapper_link_flush_stream(mapper_link link);
+
+/*! Dispatch up to 'budget' datagrams waiting in the shared-memory ring a link
+ *  offered to its remote device.  Returns the number dispatched. */
+int mapper_link_receive_shm(mapper_link link, int budget);
 
 mapper_link mapper_database_add_or_update_link(mapper_database db,
                                                mapper_device dev1,
@@ -259,6 +322,18 @@ void mhist_realloc(mapper_history history, int history_size,
 int mapper_map_perform(mapper_map map, mapper_slot slot, int instance,
                        char *typestring);
 
+/*! Evaluate a map for one instance, using the precomputed linear kernel if
+ *  possible and the map's expression otherwise.  Arguments are as for
+ *  mapper_expr_evaluate(). */
+int mapper_map_evaluate(mapper_map map, mapper_history *sources,
+                        mapper_history *expr_vars, mapper_history to,
+                        mapper_timetag_t *tt, char *typestring);
+
+/*! Enable or disable the linear kernel for maps in linear mode.
+ *  \param enable   Non-zero to bypass the expression engine for linear maps.
+ *  \return         The previous setting. */
+int mapper_map_enable_linear_kernel(int enable);
+
 int mapper_boundary_perform(mapper_history history, mapper_slot slot,
                             char *typestring);
 
@@ -266,6 +341,11 @@ lo_message mapper_map_build_message(mapper_map map, mapper_slot slot,
                                     const void *value, int length,
                                     char *typestring, mapper_id_map id_map);
 
+/*! Record a change to a map's properties made without using its property
+ *  table, e.g. by assigning map->mode or map->process_location directly, so
+ *  that database property indexes are rebuilt. */
+void mapper_map_modified(mapper_map map);
+
 /*! Set a mapping's properties based on message parameters. */
 int mapper_map_set_from_message(mapper_map map, mapper_message_t *msg,
                                 int override);
@@ -313,6 +393,19 @@ void mapper_slot_add_props_to_message(lo_message msg, mapper_slot slot,
 
 void mapper_slot_upgrade_extrema_memory(mapper_slot slot);
 
+/*! Reallocate the value histories of a local slot.  The values and timetags
+ *  of all instances are stored contiguously, and the newest samples of existing
+ *  instances are kept if the slot is an input or the history size is
+ *  unchanged.
+ *  \param slot             The local slot to operate on.
+ *  \param num_instances    The number of instance histories required.
+ *  \param history_size     The number of samples in each history.
+ *  \param is_input         1 if the slot is a map input, 0 otherwise. */
+void mapper_slot_realloc_history(mapper_slot slot, int num_instances,
+                                 int history_size, int is_input);
+
+void mapper_slot_free_history(mapper_slot slot);
+
 int mapper_slot_match_full_name(mapper_slot slot, const char *full_name);
 
 /**** Database ****/
@@ -413,6 +506,23 @@ int mapper_database_subscribed_by_device_name(mapper_database db,
 int mapper_database_subscribed_by_signal_name(mapper_database db,
                                               const char *name);
 
+/*! Prepare the database id and name indexes. */
+void mapper_database_init_indexes(mapper_database db);
+
+/*! Free memory used by the database id and name indexes. */
+void mapper_database_free_indexes(mapper_database db);
+
+/*! Update the database indexes after a record's id, name or other properties
+ *  may have changed.  These must be called whenever a record is added to the
+ *  database or its properties are written without using its table. */
+void mapper_database_index_device(mapper_database db, mapper_device dev);
+
+void mapper_database_index_signal(mapper_database db, mapper_signal sig);
+
+void mapper_database_index_map(mapper_database db, mapper_map map);
+
+void mapper_database_index_link(mapper_database db, mapper_link link);
+
 /**** Messages ****/
 /*! Parse the device and signal names from an OSC path. */
 int mapper_parse_names(const char *string, char **devnameptr, char **signameptr);
@@ -489,6 +599,18 @@ int mapper_expr_evaluate(mapper_expr expr, mapper_history *sources,
                          mapper_history *expr_vars, mapper_history result,
                          mapper_timetag_t *tt, char *typestring);
 
+/*! Enable or disable evaluation of the compiled form of an expression.  The
+ *  token interpreter is used if disabled or if compilation was not possible.
+ *  \param expr     The expression to configure.
+ *  \param enable   Non-zero to use the compiled form.
+ *  \return         Non-zero if the expression has a compiled form. */
+int mapper_expr_use_compiled(mapper_expr expr, int enable);
+
+/*! Enable or disable SIMD kernels for expressions compiled from now on.
+ *  \param enable   Non-zero to use SIMD kernels when supported by the host.
+ *  \return         The SIMD level in use: 0 if none, 1 for SSE2, 2 for AVX2. */
+int mapper_expr_enable_simd(int enable);
+
 int mapper_expr_constant_output(mapper_expr expr);
 
 int mapper_expr_num_input_slots(mapper_expr expr);
@@ -604,6 +726,54 @@ void **mapper_list_query_copy(void **query);
 
 void mapper_list_query_done(void **query);
 
+/*! Prepare an empty hash index for records containing a mapper_hash_link_t
+ *  at the given offset. */
+void mapper_hash_index_init(mapper_hash_index idx, size_t offset);
+
+void mapper_hash_index_free(mapper_hash_index idx);
+
+/*! Add a record to a hash index under the given key, or move it if it is
+ *  already indexed under a different key.  Returns non-zero if the index was
+ *  changed. */
+int mapper_hash_index_set(mapper_hash_index idx, void *item, uint64_t key);
+
+void mapper_hash_index_remove(mapper_hash_index idx, void *item);
+
+/*! Find the first record indexed under the given key.  Records sharing a key
+ *  are returned most recently indexed first. */
+void *mapper_hash_index_find(mapper_hash_index idx, uint64_t key);
+
+/*! Find the next record indexed under the same key as the given record. */
+void *mapper_hash_index_next(mapper_hash_index idx, void *item);
+
+/*! Helper to hash a string for use as a hash index key. */
+uint64_t mapper_hash_string(const char *str);
+
+/*! Create a sorted index over a named property of the records in a list.
+ *  The index is rebuilt lazily whenever the counter pointed to by 'version'
+ *  differs from the value it was built at. */
+mapper_property_index mapper_property_index_new(const char *name, void **list,
+                                                uint32_t *version,
+                                                mapper_property_getter *get);
+
+void mapper_property_index_free(mapper_property_index idx);
+
+/*! Start a query like mapper_list_new_query(), using the property index (if
+ *  not NULL) to limit the records visited to those that may satisfy the given
+ *  operator and value.  Each candidate is still checked by the compare
+ *  function.  Queries answered from the index return records in value order. */
+void **mapper_list_new_indexed_query(mapper_property_index idx, int op,
+                                     int length, char type, const void *value,
+                                     const void *list, const void *f,
+                                     const char *types, ...);
+
+/*! Start a query like mapper_list_new_query(), using a property index over
+ *  string values to limit the records visited to those whose value begins
+ *  with the given prefix.  An empty prefix visits every record. */
+void **mapper_list_new_prefix_query(mapper_property_index idx,
+                                    const char *prefix, const void *list,
+                                    const void *f, const char *types, ...);
+
 /**** Time ****/
 
 /*! Get the current time. */
@@ -636,6 +806,20 @@ static void die_unless(...) {};
 #endif
 #endif
 
+/*! Helper to hash instance ids for the id map indexes. */
+inline static uint32_t mapper_id_hash(mapper_id id)
+{
+    return (uint32_t)((id ^ (id >> 32)) * 0x9E3779B97F4A7C15ULL >> 32);
+}
+
+/*! Helper to build the database name index key for a signal. */
+inline static uint64_t mapper_signal_name_key(mapper_device dev,
+                                              const char *name)
+{
+    return mapper_hash_string(name) ^ ((uint64_t)(uintptr_t)dev
+                                       * 0x9E3779B97F4A7C15ULL);
+}
+
 /*! Helper to find size of signal value types. */
 inline static int mapper_type_size(char type)
 {
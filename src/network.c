@@ -421,6 +421,7 @@ mapper_network mapper_network_new(const char *iface, const char *group, int port
     net->own_network = 1;
     net->database.network = net;
     net->database.timeout_sec = TIMEOUT_SEC;
+    mapper_database_init_indexes(&net->database);
     net->interface_name = 0;
 
     /* Default standard ip and port is group 224.0.1.3, port 7570 */
@@ -617,6 +618,7 @@ void mapper_network_free(mapper_network net)
     if (net->bus_addr)
         lo_address_free(net->bus_addr);
 
+    mapper_database_free_indexes(&net->database);
     free(net);
 }
 
@@ -636,6 +638,7 @@ static void mapper_network_probe_device_name(mapper_network net,
 
     /* Calculate an id from the name and store it in id.value */
     dev->id = (mapper_id)crc32(0L, (const Bytef *)name, strlen(name)) << 32;
+    mapper_database_index_device(dev->database, dev);
 
     /* For the same reason, we can't use mapper_network_send() here. */
     lo_send(net->bus_addr, network_message_strings[MSG_NAME_PROBE], "si",
@@ -2294,6 +2297,7 @@ static int handler_map_modify(const char *path, const char *types, lo_arg **argv
 
     mapper_message_atom atom = mapper_message_property(props, AT_PROCESS_LOCATION);
     if (atom) {
+        mapper_location orig_loc = map->process_location;
         map->process_location = mapper_location_from_string(&(atom->values[0])->s);
         if (!map->local->one_source) {
             /* if map has sources from different remote devices, processing must
@@ -2308,6 +2312,8 @@ static int handler_map_modify(const char *path, const char *types, lo_arg **argv
         else if (map->expression && strstr(map->expression, "y{-")) {
             map->process_location = MAPPER_LOC_DESTINATION;
         }
+        if (map->process_location != orig_loc)
+            mapper_map_modified(map);
     }
 
     // do not continue if we are not in charge of processing
@@ -22,6 +22,7 @@ typedef struct {
 } static_property_t;
 
 const static_property_t static_properties[] = {
+    { "@alias",             1, 'i', 'i' },  /* AT_ALIAS */
     { "@bound_max",         1, 'i', 's' },  /* AT_BOUND_MAX */
     { "@bound_min",         1, 'i', 's' },  /* AT_BOUND_MIN */
     { "@calibrating",       1, 'b', 'b' },  /* AT_CALIBRATING */
@@ -51,9 +52,11 @@ const static_property_t static_properties[] = {
     { "@process_location",  1, 'i', 's' },  /* AT_PROCESS */
     { "@rate",              1, 'f', 'f' },  /* AT_RATE */
     { "@scope",             0, 'D', 's' },  /* AT_SCOPE */
+    { "@shm",               1, 's', 's' },  /* AT_SHM */
     { "@slot",              0, 'i', 'i' },  /* AT_SLOT */
     { "@status",            1, 'i', 'i' },  /* AT_STATUS */
     { "@synced",            1, 't', 't' },  /* AT_SYNCED */
+    { "@transport",         1, 's', 's' },  /* AT_TRANSPORT */
     { "@type",              1, 'c', 'c' },  /* AT_TYPE */
     { "@unit",              1, 's', 's' },  /* AT_UNIT */
     { "@use_instances",     1, 'b', 'b' },  /* AT_USE_INSTANCES */
@@ -3,6 +3,19 @@
 #include <string.h>
 #include <zlib.h>
 
+#include "config.h"
+
+#ifdef HAVE_ARPA_INET_H
+ #include <arpa/inet.h>
+ #include <netdb.h>
+ #include <sys/socket.h>
+#else
+ #ifdef HAVE_WINSOCK2_H
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+ #endif
+#endif
+
 #include <lo/lo.h>
 
 #include "mapper_internal.h"
@@ -23,22 +36,273 @@ static int map_in_scope(mapper_map map, mapper_id id)
     return 0;
 }
 
-static void reallocate_slot_instances(mapper_slot slot, int size)
+/* Size of an OSC string including its terminator and padding. */
+#define OSC_STRING_SIZE(len) (((len) + 4) & ~3)
+
+static void write_string(char *buffer, int *offset, const char *str)
+{
+    int len = strlen(str);
+    memcpy(buffer + *offset, str, len);
+    *offset += OSC_STRING_SIZE(len);
+}
+
+static void write_int32(char *buffer, int offset, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(buffer + offset, &value, sizeof(uint32_t));
+}
+
+static void write_int64(char *buffer, int offset, uint64_t value)
+{
+    write_int32(buffer, offset, (uint32_t)(value >> 32));
+    write_int32(buffer, offset + 4, (uint32_t)value);
+}
+
+/*! Serialise a bundle containing one update message with placeholder values.
+ *  Returns non-zero if the buffer could not be allocated. */
+static int build_message_template(mapper_message_template t, const char *path,
+                                  char type, int length, int use_instance,
+                                  int slot_id)
+{
+    int i, size, typetag_len, offset;
+    int value_size = (type == 'd') ? 8 : 4;
+
+    typetag_len = 1 + length + (use_instance ? 2 : 0) + (slot_id >= 0 ? 2 : 0);
+    char typetag[typetag_len + 1];
+    typetag[0] = ',';
+    memset(typetag + 1, type, length);
+    i = length + 1;
+    if (use_instance) {
+        typetag[i++] = 's';
+        typetag[i++] = 'h';
+    }
+    if (slot_id >= 0) {
+        typetag[i++] = 's';
+        typetag[i++] = 'i';
+    }
+    typetag[i] = 0;
+
+    // bundle header, timetag and element size precede the message
+    size = 20 + OSC_STRING_SIZE(strlen(path)) + OSC_STRING_SIZE(typetag_len)
+           + value_size * length;
+    if (use_instance)
+        size += OSC_STRING_SIZE(9) + 8;
+    if (slot_id >= 0)
+        size += OSC_STRING_SIZE(5) + 4;
+
+    char *buffer = realloc(t->buffer, size);
+    if (!buffer)
+        return 1;
+    memset(buffer, 0, size);
+    t->buffer = buffer;
+    t->size = size;
+    t->type = type;
+    t->length = length;
+    t->slot_id = slot_id;
+
+    memcpy(buffer, "#bundle", 8);
+    write_int32(buffer, 16, size - 20);
+    offset = 20;
+    write_string(buffer, &offset, path);
+    write_string(buffer, &offset, typetag);
+    t->value_offset = offset;
+    offset += value_size * length;
+    if (use_instance) {
+        write_string(buffer, &offset, "@instance");
+        t->instance_offset = offset;
+        offset += 8;
+    }
+    else
+        t->instance_offset = 0;
+    if (slot_id >= 0) {
+        write_string(buffer, &offset, "@slot");
+        write_int32(buffer, offset, slot_id);
+    }
+    return 0;
+}
+
+/*! Return the OSC path used to address the destination of an outgoing map:
+ *  the short alias offered by the destination device if there is one,
+ *  otherwise the full signal path. */
+static const char *destination_path(mapper_map map)
+{
+    if (map->local && map->local->alias_path)
+        return map->local->alias_path;
+    return map->destination.signal->path;
+}
+
+/* Non-zero while this thread is delivering an update by direct function
+ * call.  Updates caused by handlers called during a direct delivery are sent
+ * over the network instead, so that feedback between devices cannot recurse. */
+static __thread int in_direct_delivery = 0;
+
+/*! Return the destination signal of an outgoing map if it can receive updates
+ *  from 'dev' by direct function call, or 0 otherwise. */
+static mapper_signal direct_destination(mapper_map map, mapper_device dev)
+{
+    mapper_local_map lmap = map->local;
+    if (in_direct_delivery)
+        return 0;
+    // open queues are bundled and sent over the network as a whole
+    mapper_link link = map->destination.link;
+    if (link && link->local && link->local->queues)
+        return 0;
+    uint32_t version = mapper_device_local_version();
+    if (lmap->local_destination_version != version) {
+        lmap->local_destination = mapper_device_local_destination(dev,
+                                                                  map->destination.signal);
+        lmap->local_destination_version = version;
+    }
+    mapper_signal dst = lmap->local_destination;
+    return (dst && mapper_device_accepts_direct_delivery(dst)) ? dst : 0;
+}
+
+static void deliver_direct(mapper_signal sig, const char *types, lo_arg **argv,
+                           int argc, mapper_timetag_t tt)
+{
+    in_direct_delivery = 1;
+    mapper_device_receive_update(sig, types, argv, argc, tt);
+    in_direct_delivery = 0;
+}
+
+/*! Send an update message to the destination of an outgoing map, or pass its
+ *  arguments directly to the destination signal if it lives in this process.
+ *  Takes ownership of the message. */
+static void send_to_destination(mapper_map map, mapper_device dev,
+                                lo_message msg, mapper_timetag_t tt)
+{
+    mapper_signal dst = direct_destination(map, dev);
+    if (!dst) {
+        send_or_bundle_message(map->destination.link, destination_path(map),
+                               msg, tt);
+        return;
+    }
+    deliver_direct(dst, lo_message_get_types(msg), lo_message_get_argv(msg),
+                   lo_message_get_argc(msg), tt);
+    lo_message_free(msg);
+}
+
+/*! Send a single-sample update from the slot's pre-serialised message
+ *  template, avoiding allocation of an lo_message.  Returns non-zero if the
+ *  update must instead be sent using mapper_map_build_message(), e.g. if it
+ *  is being queued or contains null values. */
+static int send_from_template(mapper_map map, mapper_slot slot,
+                              const void *value, const char *typestring,
+                              mapper_id_map id_map, mapper_timetag_t tt)
 {
     int i;
-    if (slot->num_instances < size) {
-        slot->local->history = realloc(slot->local->history,
-                                       sizeof(struct _mapper_history) * size);
-        for (i = slot->num_instances; i < size; i++) {
-            slot->local->history[i].type = slot->signal->type;
-            slot->local->history[i].length = slot->signal->length;
-            slot->local->history[i].size = slot->local->history_size;
-            slot->local->history[i].value = calloc(1, mapper_type_size(slot->signal->type)
-                                                   * slot->local->history_size);
-            slot->local->history[i].timetag = calloc(1, sizeof(mapper_timetag_t)
-                                                     * slot->local->history_size);
-            slot->local->history[i].position = -1;
+    mapper_link link = map->destination.link;
+    if (!link || !link->local || !link->local->data_addrinfo || !slot->local)
+        return 1;
+
+    // updates to queued timetags are added to the queue's bundle
+    mapper_queue q = link->local->queues;
+    while (q) {
+        if (memcmp(&q->tt, &tt, sizeof(mapper_timetag_t))==0)
+            return 1;
+        q = q->next;
+    }
+
+    int length = ((map->process_location == MAPPER_LOC_SOURCE)
+                  ? map->destination.signal->length : slot->signal->length);
+    char type = typestring[0];
+    if (type != 'i' && type != 'f' && type != 'd')
+        return 1;
+    for (i = 1; i < length; i++) {
+        if (typestring[i] != type)
+            return 1;
+    }
+    int slot_id = (map->process_location == MAPPER_LOC_DESTINATION
+                   ? slot->id : -1);
+
+    mapper_signal dst = direct_destination(map, slot->signal->device);
+    if (dst) {
+        // pass the same arguments the template would carry
+        char types[length + 5];
+        lo_arg *argv[length + 4];
+        int argc = length, size = mapper_type_size(type);
+        for (i = 0; i < length; i++) {
+            types[i] = type;
+            argv[i] = (lo_arg*)((char*)value + i * size);
         }
+        if (id_map) {
+            types[argc] = 's';
+            argv[argc++] = (lo_arg*)"@instance";
+            types[argc] = 'h';
+            argv[argc++] = (lo_arg*)&id_map->global;
+        }
+        if (slot_id >= 0) {
+            types[argc] = 's';
+            argv[argc++] = (lo_arg*)"@slot";
+            types[argc] = 'i';
+            argv[argc++] = (lo_arg*)&slot_id;
+        }
+        types[argc] = 0;
+        deliver_direct(dst, types, argv, argc, tt);
+        return 0;
+    }
+
+    // rebuild the template if the message layout has changed
+    mapper_message_template t = &slot->local->msg_template;
+    const char *path = destination_path(map);
+    if (!t->buffer || t->type != type || t->length != length
+        || t->slot_id != slot_id || !t->instance_offset != !id_map
+        || strcmp(t->buffer + 20, path)) {
+        if (build_message_template(t, path, type, length, id_map != 0, slot_id))
+            return 1;
+    }
+
+    write_int32(t->buffer, 8, tt.sec);
+    write_int32(t->buffer, 12, tt.frac);
+    switch (type) {
+        case 'd': {
+            uint64_t v;
+            for (i = 0; i < length; i++) {
+                memcpy(&v, (double*)value + i, sizeof(uint64_t));
+                write_int64(t->buffer, t->value_offset + i * 8, v);
+            }
+            break;
+        }
+        default: {
+            uint32_t v;
+            for (i = 0; i < length; i++) {
+                memcpy(&v, (uint32_t*)value + i, sizeof(uint32_t));
+                write_int32(t->buffer, t->value_offset + i * 4, v);
+            }
+            break;
+        }
+    }
+    if (id_map)
+        write_int64(t->buffer, t->instance_offset, id_map->global);
+
+    if (link->local->use_stream
+        && !mapper_link_send_stream(link, t->buffer, t->size))
+        return 0;
+    if (link->local->shm_out && !mapper_link_send_shm(link, t->buffer, t->size))
+        return 0;
+
+    int fd = lo_server_get_socket_fd(link->local_device->local->server);
+    struct addrinfo *ai = link->local->data_addrinfo;
+    return sendto(fd, t->buffer, t->size, 0, ai->ai_addr,
+                  ai->ai_addrlen) != t->size;
+}
+
+static mapper_router_signal find_router_signal(mapper_router rtr,
+                                               mapper_signal sig)
+{
+    // router_signals are cached on the local signal structure
+    if (!sig || !sig->local)
+        return 0;
+    mapper_router_signal rs = sig->local->router_sig;
+    return (rs && rs->link == rtr) ? rs : 0;
+}
+
+static void reallocate_slot_instances(mapper_slot slot, int size)
+{
+    if (slot->num_instances < size) {
+        int history_size = slot->local->history_size;
+        mapper_slot_realloc_history(slot, size, history_size ? history_size : 1,
+                                    1);
         slot->num_instances = size;
     }
 }
@@ -91,13 +355,7 @@ void mapper_router_num_instances_changed(mapper_router rtr, mapper_signal sig,
 {
     int i;
     // check if we have a reference to this signal
-    mapper_router_signal rs = rtr->signals;
-    while (rs) {
-        if (rs->signal == sig)
-            break;
-        rs = rs->next;
-    }
-
+    mapper_router_signal rs = find_router_signal(rtr, sig);
     if (!rs) {
         // The signal is not mapped through this router.
         return;
@@ -119,12 +377,7 @@ void mapper_router_process_signal(mapper_router rtr, mapper_signal sig,
     lo_message msg;
 
     // find the router signal
-    mapper_router_signal rs = rtr->signals;
-    while (rs) {
-        if (rs->signal == sig)
-            break;
-        rs = rs->next;
-    }
+    mapper_router_signal rs = find_router_signal(rtr, sig);
     if (!rs)
         return;
 
@@ -177,8 +430,7 @@ void mapper_router_process_signal(mapper_router rtr, mapper_signal sig,
                 else if (map_in_scope(map, id_map->global))
                     msg = mapper_map_build_message(map, slot, 0, 1, 0, id_map);
                 if (msg)
-                    send_or_bundle_message(dst_slot->link,
-                                           dst_slot->signal->path, msg, tt);
+                    send_to_destination(map, rtr->device, msg, tt);
             }
 
             for (j = 0; j < map->num_sources; j++) {
@@ -291,12 +543,13 @@ void mapper_router_process_signal(mapper_router rtr, mapper_signal sig,
             if (count > 1) {
                 memcpy((char*)out_value_p + to_size * j, result, to_size);
             }
-            else {
+            else if (send_from_template(map, slot, result, dst_types
+                                        + to->signal->length * k,
+                                        slot->use_instances ? id_map : 0, tt)) {
                 msg = mapper_map_build_message(map, slot, result, 1, dst_types,
                                                slot->use_instances ? id_map : 0);
                 if (msg)
-                    send_or_bundle_message(map->destination.link,
-                                           dst_slot->signal->path, msg, tt);
+                    send_to_destination(map, rtr->device, msg, tt);
             }
             ++k;
         }
@@ -305,8 +558,7 @@ void mapper_router_process_signal(mapper_router rtr, mapper_signal sig,
             msg = mapper_map_build_message(map, slot, out_value_p, k, dst_types,
                                            slot->use_instances ? id_map : 0);
             if (msg)
-                send_or_bundle_message(map->destination.link,
-                                       dst_slot->signal->path, msg, tt);
+                send_to_destination(map, rtr->device, msg, tt);
         }
     }
 }
@@ -319,9 +571,7 @@ int mapper_router_send_query(mapper_router rtr, mapper_signal sig,
         return 0;
     }
     // find the corresponding router_signal
-    mapper_router_signal rs = rtr->signals;
-    while (rs && rs->signal != sig)
-        rs = rs->next;
+    mapper_router_signal rs = find_router_signal(rtr, sig);
 
     // exit without failure if signal is not mapped
     if (!rs)
@@ -383,7 +633,7 @@ void send_or_bundle_message(mapper_link link, const char *path, lo_message msg,
         // Send message immediately
         lo_bundle b = lo_bundle_new(tt);
         lo_bundle_add_message(b, path, msg);
-        lo_send_bundle_from(llink->data_addr, link->local_device->local->server, b);
+        mapper_link_send_bundle(link, b);
         lo_bundle_free_messages(b);
     }
 }
@@ -392,15 +642,15 @@ static mapper_router_signal find_or_add_router_signal(mapper_router rtr,
                                                       mapper_signal sig)
 {
     // find signal in router_signal list
-    mapper_router_signal rs = rtr->signals;
-    while (rs && rs->signal != sig)
-        rs = rs->next;
+    mapper_router_signal rs = find_router_signal(rtr, sig);
 
     // if not found, create a new list entry
     if (!rs) {
         rs = ((mapper_router_signal)
               calloc(1, sizeof(struct _mapper_router_signal)));
+        rs->link = rtr;
         rs->signal = sig;
+        sig->local->router_sig = rs;
         rs->num_slots = 1;
         rs->slots = malloc(sizeof(mapper_local_slot *));
         rs->slots[0] = 0;
@@ -593,16 +843,21 @@ void mapper_router_add_map(mapper_router rtr, mapper_map map)
     }
 
     // default to processing at source device unless heterogeneous sources
-    if (lmap->one_source)
-        map->process_location = MAPPER_LOC_SOURCE;
-    else
-        map->process_location = MAPPER_LOC_DESTINATION;
+    mapper_location loc = (lmap->one_source ? MAPPER_LOC_SOURCE
+                           : MAPPER_LOC_DESTINATION);
+    if (map->process_location != loc) {
+        map->process_location = loc;
+        mapper_map_modified(map);
+    }
 
     if (local_dst && (local_src == map->num_sources)) {
         // all reference signals are local
         lmap->is_local_only = 1;
         map->destination.link = map->sources[0]->link;
     }
+
+    // map id and processing location may have changed
+    mapper_database_index_map(rtr->device->database, map);
 }
 
 static void check_link(mapper_router rtr, mapper_link link)
@@ -647,6 +902,8 @@ void mapper_router_remove_signal(mapper_router rtr, mapper_router_signal rs)
         while (*rstemp) {
             if (*rstemp == rs) {
                 *rstemp = rs->next;
+                if (rs->signal->local && rs->signal->local->router_sig == rs)
+                    rs->signal->local->router_sig = 0;
                 free(rs->slots);
                 free(rs);
                 break;
@@ -658,19 +915,11 @@ void mapper_router_remove_signal(mapper_router rtr, mapper_router_signal rs)
 
 static void free_slot_memory(mapper_slot slot)
 {
-    int i;
     if (!slot->local)
         return;
-    // TODO: use router_signal for holding memory of local slots for effiency
-//    if (!slot->local->router_sig) {
-        if (slot->local->history) {
-            for (i = 0; i < slot->num_instances; i++) {
-                free(slot->local->history[i].value);
-                free(slot->local->history[i].timetag);
-            }
-            free(slot->local->history);
-        }
-//    }
+    mapper_slot_free_history(slot);
+    if (slot->local->msg_template.buffer)
+        free(slot->local->msg_template.buffer);
     free(slot->local);
 }
 
@@ -727,6 +976,12 @@ int mapper_router_remove_map(mapper_router rtr, mapper_map map)
     }
     if (map->local->expr)
         mapper_expr_free(map->local->expr);
+    if (map->local->linear_scale)
+        free(map->local->linear_scale);
+    if (map->local->linear_offset)
+        free(map->local->linear_offset);
+    if (map->local->alias_path)
+        free(map->local->alias_path);
 
     free(map->local);
     return 0;
@@ -739,9 +994,7 @@ mapper_map mapper_router_outgoing_map(mapper_router rtr,
                                       const char *dest_name)
 {
     // find associated router_signal
-    mapper_router_signal rs = rtr->signals;
-    while (rs && rs->signal != local_src)
-        rs = rs->next;
+    mapper_router_signal rs = find_router_signal(rtr, local_src);
     if (!rs)
         return 0;
 
@@ -780,9 +1033,7 @@ mapper_map mapper_router_incoming_map(mapper_router rtr,
                                       const char **src_names)
 {
     // find associated router_signal
-    mapper_router_signal rs = rtr->signals;
-    while (rs && rs->signal != local_dst)
-        rs = rs->next;
+    mapper_router_signal rs = find_router_signal(rtr, local_dst);
     if (!rs)
         return 0;
 
@@ -811,9 +1062,7 @@ mapper_map mapper_router_map_by_id(mapper_router router, mapper_signal local_sig
                                    mapper_id id, mapper_direction dir)
 {
     int i;
-    mapper_router_signal rs = router->signals;
-    while (rs && rs->signal != local_sig)
-        rs = rs->next;
+    mapper_router_signal rs = find_router_signal(router, local_sig);
     if (!rs)
         return 0;
 
@@ -830,9 +1079,7 @@ mapper_slot mapper_router_slot(mapper_router router, mapper_signal signal,
                                int slot_id)
 {
     // only interested in incoming slots
-    mapper_router_signal rs = router->signals;
-    while (rs && rs->signal != signal)
-        rs = rs->next;
+    mapper_router_signal rs = find_router_signal(router, signal);
     if (!rs)
         return NULL; // no associated router_signal
 
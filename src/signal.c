@@ -9,7 +9,7 @@
 #include "types_internal.h"
 #include <mapper/mapper.h>
 
-#define MAX_INSTANCES 128
+#define MAX_INSTANCES 1024
 
 /* Function prototypes */
 static void mapper_signal_update_internal(mapper_signal sig, int instance_index,
@@ -96,12 +96,14 @@ void mapper_signal_init(mapper_signal sig, mapper_direction direction,
         // Reserve one instance id map
         sig->local->id_map_length = 1;
         sig->local->id_maps = calloc(1, sizeof(struct _mapper_signal_id_map));
+        mapper_signal_reindex_id_maps(sig);
     }
     else {
         sig->staged_props = mapper_table_new();
     }
 
     sig->props = mapper_table_new();
+    sig->props->version = &sig->device->database->signal_version;
     int flags = sig->local ? NON_MODIFIABLE : MODIFIABLE;
 
     // these properties need to be added in alphabetical order
@@ -171,6 +173,7 @@ void mapper_signal_free(mapper_signal sig)
             }
         }
         free(sig->local->id_maps);
+        free(sig->local->id_map_index);
         for (i = 0; i < sig->num_instances; i++) {
             if (sig->local->instances[i]->value)
                 free(sig->local->instances[i]->value);
@@ -181,6 +184,10 @@ void mapper_signal_free(mapper_signal sig)
         free(sig->local->instances);
         if (sig->local->has_complete_value)
             free(sig->local->has_complete_value);
+        for (i = 0; i < NUM_DECODE_PLANS; i++) {
+            if (sig->local->decode_plans[i].types)
+                free(sig->local->decode_plans[i].types);
+        }
         free(sig->local);
     }
 
@@ -363,49 +370,164 @@ static void mapper_signal_init_instance(mapper_signal_instance si)
     mapper_timetag_now(&si->created);
 }
 
-static int mapper_signal_find_instance_with_local_id(mapper_signal sig,
-                                                     mapper_id id, int flags)
+/* Each instance is linked into either the active list, which is kept in order
+ * of activation so that the oldest and newest instances are at its ends, or
+ * the reserve list of instances available for activation. */
+static void unlink_instance(mapper_signal sig, mapper_signal_instance si)
 {
-    int i;
-    for (i = 0; i < sig->local->id_map_length; i++) {
-        if (   sig->local->id_maps[i].instance
-            && sig->local->id_maps[i].map->local == id) {
-            if (sig->local->id_maps[i].status & ~flags)
-                return -1;
-            else
-                return i;
+    if (si->prev)
+        si->prev->next = si->next;
+    else if (si->is_active)
+        sig->local->active_head = si->next;
+    else
+        sig->local->reserve = si->next;
+    if (si->next)
+        si->next->prev = si->prev;
+    else if (si->is_active)
+        sig->local->active_tail = si->prev;
+    si->prev = si->next = 0;
+}
+
+static void activate_instance(mapper_signal sig, mapper_signal_instance si)
+{
+    unlink_instance(sig, si);
+    si->is_active = 1;
+    mapper_signal_init_instance(si);
+    si->prev = sig->local->active_tail;
+    if (si->prev)
+        si->prev->next = si;
+    else
+        sig->local->active_head = si;
+    sig->local->active_tail = si;
+}
+
+static void add_reserved_instance(mapper_signal sig, mapper_signal_instance si);
+
+static void deactivate_instance(mapper_signal sig, mapper_signal_instance si)
+{
+    unlink_instance(sig, si);
+    si->is_active = 0;
+    si->id_map_index = -1;
+    add_reserved_instance(sig, si);
+}
+
+/* Reserved instances are kept in id order so that they are activated lowest
+ * id first. */
+static void add_reserved_instance(mapper_signal sig, mapper_signal_instance si)
+{
+    mapper_signal_instance *si2 = &sig->local->reserve, prev = 0;
+    while (*si2 && (*si2)->id < si->id) {
+        prev = *si2;
+        si2 = &(*si2)->next;
+    }
+    si->prev = prev;
+    si->next = *si2;
+    if (si->next)
+        si->next->prev = si;
+    *si2 = si;
+}
+
+/* The id map index chains signal id maps by the hashes of their local and
+ * global ids. Since id_map_length is always a power of two it doubles as the
+ * number of buckets. */
+#define LOCAL_INDEX 0
+#define GLOBAL_INDEX 1
+
+static void index_id_map(mapper_signal sig, int i)
+{
+    int len = sig->local->id_map_length, *idx = sig->local->id_map_index;
+    mapper_id_map map = sig->local->id_maps[i].map;
+    int h = mapper_id_hash(map->local) & (len - 1);
+    idx[2 * len + i] = idx[h];
+    idx[h] = i;
+    h = mapper_id_hash(map->global) & (len - 1);
+    idx[3 * len + i] = idx[len + h];
+    idx[len + h] = i;
+}
+
+static void unindex_chain(int *head, int *next, int i)
+{
+    while (*head >= 0) {
+        if (*head == i) {
+            *head = next[i];
+            return;
         }
+        head = &next[*head];
     }
-    return -1;
+}
+
+static void unindex_id_map(mapper_signal sig, int i)
+{
+    int len = sig->local->id_map_length, *idx = sig->local->id_map_index;
+    mapper_id_map map = sig->local->id_maps[i].map;
+    unindex_chain(&idx[mapper_id_hash(map->local) & (len - 1)],
+                  idx + 2 * len, i);
+    unindex_chain(&idx[len + (mapper_id_hash(map->global) & (len - 1))],
+                  idx + 3 * len, i);
+}
+
+void mapper_signal_reindex_id_maps(mapper_signal sig)
+{
+    int i, len = sig->local->id_map_length;
+    sig->local->id_map_index = realloc(sig->local->id_map_index,
+                                       sizeof(int) * len * 4);
+    memset(sig->local->id_map_index, 0xFF, sizeof(int) * len * 4);
+    for (i = len - 1; i >= 0; i--) {
+        if (sig->local->id_maps[i].map)
+            index_id_map(sig, i);
+    }
+}
+
+void mapper_signal_remove_id_map(mapper_signal sig, int index)
+{
+    if (!sig->local->id_maps[index].map)
+        return;
+    unindex_id_map(sig, index);
+    sig->local->id_maps[index].map = 0;
+}
+
+/*! Find the first id map with a given local or global id, optionally
+ *  skipping those without an active instance. */
+static int find_id_map(mapper_signal sig, mapper_id id, int which, int active)
+{
+    int len = sig->local->id_map_length, *idx = sig->local->id_map_index;
+    int *next = idx + (2 + which) * len, found = -1;
+    int i = idx[which * len + (mapper_id_hash(id) & (len - 1))];
+    mapper_signal_id_map_t *maps = sig->local->id_maps;
+    for (; i >= 0; i = next[i]) {
+        if (!maps[i].map || (active && !maps[i].instance))
+            continue;
+        if ((which == GLOBAL_INDEX ? maps[i].map->global
+             : maps[i].map->local) != id)
+            continue;
+        if (found < 0 || i < found)
+            found = i;
+    }
+    return found;
+}
+
+static int mapper_signal_find_instance_with_local_id(mapper_signal sig,
+                                                     mapper_id id, int flags)
+{
+    int i = find_id_map(sig, id, LOCAL_INDEX, 1);
+    if (i < 0 || sig->local->id_maps[i].status & ~flags)
+        return -1;
+    return i;
 }
 
 int mapper_signal_find_instance_with_global_id(mapper_signal sig,
                                                mapper_id global_id,
                                                int flags)
 {
-    int i;
-    for (i = 0; i < sig->local->id_map_length; i++) {
-        if (!sig->local->id_maps[i].map)
-            continue;
-        if (sig->local->id_maps[i].map->global == global_id) {
-            if (sig->local->id_maps[i].status & ~flags)
-                return -1;
-            else
-                return i;
-        }
-    }
-    return -1;
+    int i = find_id_map(sig, global_id, GLOBAL_INDEX, 0);
+    if (i < 0 || sig->local->id_maps[i].status & ~flags)
+        return -1;
+    return i;
 }
 
 static mapper_signal_instance reserved_instance(mapper_signal sig)
 {
-    int i;
-    for (i = 0; i < sig->num_instances; i++) {
-        if (!sig->local->instances[i]->is_active) {
-            return sig->local->instances[i];
-        }
-    }
-    return 0;
+    return sig->local->reserve;
 }
 
 int mapper_signal_instance_with_local_id(mapper_signal sig, mapper_id id,
@@ -415,20 +537,13 @@ int mapper_signal_instance_with_local_id(mapper_signal sig, mapper_id id,
         return -1;
 
     mapper_signal_id_map_t *maps = sig->local->id_maps;
-    mapper_signal_update_handler *update_h = sig->local->update_handler;
-    mapper_instance_event_handler *event_h = sig->local->instance_event_handler;
+    mapper_signal_update_handler *update_h = mapper_device_update_handler(sig);
+    mapper_instance_event_handler *event_h = mapper_device_event_handler(sig);
 
     mapper_signal_instance si;
-    int i;
-    for (i = 0; i < sig->local->id_map_length; i++) {
-        if (maps[i].instance && maps[i].map->local == id) {
-            if (maps[i].status & ~flags)
-                return -1;
-            else {
-                return i;
-            }
-        }
-    }
+    int i = find_id_map(sig, id, LOCAL_INDEX, 1);
+    if (i >= 0)
+        return (maps[i].status & ~flags) ? -1 : i;
 
     // check if device has record of id map
     mapper_id_map map = mapper_device_find_instance_id_map_by_local(sig->device,
@@ -449,8 +564,7 @@ int mapper_signal_instance_with_local_id(mapper_signal sig, mapper_id id,
         }
 
         // store pointer to device map in a new signal map
-        si->is_active = 1;
-        mapper_signal_init_instance(si);
+        activate_instance(sig, si);
         i = mapper_signal_add_id_map(sig, si, map);
         if (event_h && (sig->local->instance_event_flags & MAPPER_NEW_INSTANCE)) {
             event_h(sig, id, MAPPER_NEW_INSTANCE, tt);
@@ -492,8 +606,7 @@ int mapper_signal_instance_with_local_id(mapper_signal sig, mapper_id id,
         else {
             ++map->refcount_local;
         }
-        si->is_active = 1;
-        mapper_signal_init_instance(si);
+        activate_instance(sig, si);
         i = mapper_signal_add_id_map(sig, si, map);
         if (event_h && (sig->local->instance_event_flags & MAPPER_NEW_INSTANCE)) {
             event_h(sig, id, MAPPER_NEW_INSTANCE, tt);
@@ -510,20 +623,13 @@ int mapper_signal_instance_with_global_id(mapper_signal sig, mapper_id global_id
         return -1;
 
     mapper_signal_id_map_t *maps = sig->local->id_maps;
-    mapper_signal_update_handler *update_h = sig->local->update_handler;
-    mapper_instance_event_handler *event_h = sig->local->instance_event_handler;
+    mapper_signal_update_handler *update_h = mapper_device_update_handler(sig);
+    mapper_instance_event_handler *event_h = mapper_device_event_handler(sig);
 
     mapper_signal_instance si;
-    int i;
-    for (i = 0; i < sig->local->id_map_length; i++) {
-        if (maps[i].instance && maps[i].map->global == global_id) {
-            if (maps[i].status & ~flags)
-                return -1;
-            else {
-                return i;
-            }
-        }
-    }
+    int i = find_id_map(sig, global_id, GLOBAL_INDEX, 1);
+    if (i >= 0)
+        return (maps[i].status & ~flags) ? -1 : i;
 
     // check if the device already has a map for this global id
     mapper_id_map map = mapper_device_find_instance_id_map_by_global(sig->device,
@@ -543,8 +649,7 @@ int mapper_signal_instance_with_global_id(mapper_signal sig, mapper_id global_id
                                                     si->id, global_id);
             map->refcount_global = 1;
 
-            si->is_active = 1;
-            mapper_signal_init_instance(si);
+            activate_instance(sig, si);
             i = mapper_signal_add_id_map(sig, si, map);
             if (event_h && (sig->local->instance_event_flags & MAPPER_NEW_INSTANCE)) {
                 event_h(sig, si->id, MAPPER_NEW_INSTANCE, tt);
@@ -562,8 +667,7 @@ int mapper_signal_instance_with_global_id(mapper_signal sig, mapper_id global_id
             return -1;
         }
         else if (!si->is_active) {
-            si->is_active = 1;
-            mapper_signal_init_instance(si);
+            activate_instance(sig, si);
             i = mapper_signal_add_id_map(sig, si, map);
             ++map->refcount_local;
             ++map->refcount_global;
@@ -606,8 +710,7 @@ int mapper_signal_instance_with_global_id(mapper_signal sig, mapper_id global_id
                                                     si->id, global_id);
             map->refcount_global = 1;
 
-            si->is_active = 1;
-            mapper_signal_init_instance(si);
+            activate_instance(sig, si);
             i = mapper_signal_add_id_map(sig, si, map);
             if (event_h && (sig->local->instance_event_flags & MAPPER_NEW_INSTANCE)) {
                 event_h(sig, si->id, MAPPER_NEW_INSTANCE, tt);
@@ -626,8 +729,7 @@ int mapper_signal_instance_with_global_id(mapper_signal sig, mapper_id global_id
             if (si->is_active) {
                 return -1;
             }
-            si->is_active = 1;
-            mapper_signal_init_instance(si);
+            activate_instance(sig, si);
             i = mapper_signal_add_id_map(sig, si, map);
             ++map->refcount_local;
             ++map->refcount_global;
@@ -647,7 +749,7 @@ static int reserve_instance_internal(mapper_signal sig, mapper_id *id,
     if (sig->num_instances >= MAX_INSTANCES)
         return -1;
 
-    int i, lowest_index, cont;
+    int i, n = sig->num_instances;
     mapper_signal_instance si;
 
     // check if instance with this id already exists! If so, stop here.
@@ -664,42 +766,33 @@ static int reserve_instance_internal(mapper_signal sig, mapper_id *id,
     si->value = calloc(1, mapper_signal_vector_bytes(sig));
     si->has_value_flags = calloc(1, sig->length / 8 + 1);
     si->has_value = 0;
+    si->id_map_index = -1;
 
+    /* With n existing instances the lowest unused id and index are at most n,
+     * so mark those in use and take the first gap. */
+    char used[n + 1];
     if (id)
         si->id = *id;
     else {
-        // find lowest unused id
-        mapper_id lowest_id = 0;
-        cont = 1;
-        while (cont) {
-            cont = 0;
-            for (i = 0; i < sig->num_instances; i++) {
-                if (sig->local->instances[i]->id == lowest_id) {
-                    cont = 1;
-                    break;
-                }
-            }
-            lowest_id += cont;
+        memset(used, 0, n + 1);
+        for (i = 0; i < n; i++) {
+            if (sig->local->instances[i]->id <= n)
+                used[sig->local->instances[i]->id] = 1;
         }
-        si->id = lowest_id;
+        for (i = 0; used[i]; i++) {}
+        si->id = i;
     }
-    // find lowest unused positive index
-    lowest_index = 0;
-    cont = 1;
-    while (cont) {
-        cont = 0;
-        for (i = 0; i < sig->num_instances; i++) {
-            if (sig->local->instances[i]->index == lowest_index) {
-                cont = 1;
-                break;
-            }
-        }
-        lowest_index += cont;
+    memset(used, 0, n + 1);
+    for (i = 0; i < n; i++) {
+        if (sig->local->instances[i]->index <= n)
+            used[sig->local->instances[i]->index] = 1;
     }
-    si->index = lowest_index;
+    for (i = 0; used[i]; i++) {}
+    si->index = i;
 
     mapper_signal_init_instance(si);
     si->user_data = user_data;
+    add_reserved_instance(sig, si);
 
     ++sig->num_instances;
     qsort(sig->local->instances, sig->num_instances,
@@ -762,6 +855,67 @@ void mapper_signal_instance_update(mapper_signal sig, mapper_id id,
         mapper_signal_update_internal(sig, index, value, count, timetag);
 }
 
+void mapper_signal_instances_update(mapper_signal sig,
+                                    const mapper_id *instances,
+                                    const void *values, int num,
+                                    mapper_timetag_t tt)
+{
+    if (!sig || !sig->local || !instances || !values || num <= 0)
+        return;
+
+    int i, index, num_links = 0, num_started = 0;
+    size_t n = mapper_signal_vector_bytes(sig);
+    mapper_device dev = sig->device;
+    mapper_link link;
+
+    if (memcmp(&tt, &MAPPER_NOW, sizeof(mapper_timetag_t))==0)
+        mapper_timetag_now(&tt);
+
+    for (link = dev->database->links; link; link = mapper_list_next(link))
+        ++num_links;
+
+    // bundle the updates, leaving queues started by the caller to be sent by
+    // the caller
+    mapper_link started[num_links ? num_links : 1];
+    for (link = dev->database->links; link; link = mapper_list_next(link)) {
+        if (link->local && link->local_device == dev
+            && !mapper_link_has_queue(link, tt)) {
+            mapper_link_start_queue(link, tt);
+            started[num_started++] = link;
+        }
+    }
+
+    for (i = 0; i < num; i++) {
+        index = mapper_signal_instance_with_local_id(sig, instances[i], 0, &tt);
+        if (index >= 0)
+            mapper_signal_update_internal(sig, index, values + n * i, 1, tt);
+    }
+
+    for (i = 0; i < num_started; i++) {
+        mapper_link_send_queue(started[i], tt);
+        mapper_link_flush_stream(started[i]);
+    }
+}
+
+int mapper_signal_enqueue_update(mapper_signal sig, const void *value,
+                                 int count, mapper_timetag_t tt)
+{
+    if (!sig || !sig->local || !value)
+        return 1;
+    return mapper_device_enqueue_update(sig->device, sig, 0, 0, value, count,
+                                        tt);
+}
+
+int mapper_signal_instance_enqueue_update(mapper_signal sig, mapper_id id,
+                                          const void *value, int count,
+                                          mapper_timetag_t tt)
+{
+    if (!sig || !sig->local)
+        return 1;
+    return mapper_device_enqueue_update(sig->device, sig, id, 1, value, count,
+                                        tt);
+}
+
 int mapper_signal_instance_is_active(mapper_signal sig, mapper_id id)
 {
     if (!sig)
@@ -787,26 +941,11 @@ mapper_id mapper_signal_oldest_active_instance(mapper_signal sig)
 
 int mapper_signal_oldest_active_instance_internal(mapper_signal sig)
 {
-    int i;
-    mapper_signal_instance si;
-    for (i = 0; i < sig->local->id_map_length; i++) {
-        if (sig->local->id_maps[i].instance)
-            break;
-    }
-    if (i == sig->local->id_map_length) {
-        // no active instances to steal!
-        return -1;
-    }
-    int oldest = i;
-    for (i = oldest+1; i < sig->local->id_map_length; i++) {
-        if (!(si = sig->local->id_maps[i].instance))
-            continue;
-        if ((si->created.sec < sig->local->id_maps[oldest].instance->created.sec) ||
-            (si->created.sec == sig->local->id_maps[oldest].instance->created.sec &&
-             si->created.frac < sig->local->id_maps[oldest].instance->created.frac))
-            oldest = i;
-    }
-    return oldest;
+    mapper_signal_instance si = sig->local->active_head;
+    while (si && si->id_map_index < 0)
+        si = si->next;
+    // no active instances to steal!
+    return si ? si->id_map_index : -1;
 }
 
 mapper_id mapper_signal_newest_active_instance(mapper_signal sig)
@@ -824,26 +963,11 @@ mapper_id mapper_signal_newest_active_instance(mapper_signal sig)
 
 int mapper_signal_newest_active_instance_internal(mapper_signal sig)
 {
-    int i;
-    mapper_signal_instance si;
-    for (i = 0; i < sig->local->id_map_length; i++) {
-        if (sig->local->id_maps[i].instance)
-            break;
-    }
-    if (i == sig->local->id_map_length) {
-        // no active instances to steal!
-        return -1;
-    }
-    int newest = i;
-    for (i = newest+1; i < sig->local->id_map_length; i++) {
-        if (!(si = sig->local->id_maps[i].instance))
-            continue;
-        if ((si->created.sec > sig->local->id_maps[newest].instance->created.sec) ||
-            (si->created.sec == sig->local->id_maps[newest].instance->created.sec &&
-             si->created.frac > sig->local->id_maps[newest].instance->created.frac))
-            newest = i;
-    }
-    return newest;
+    mapper_signal_instance si = sig->local->active_tail;
+    while (si && si->id_map_index < 0)
+        si = si->prev;
+    // no active instances to steal!
+    return si ? si->id_map_index : -1;
 }
 
 static void mapper_signal_update_internal(mapper_signal sig, int instance_index,
@@ -908,12 +1032,12 @@ void mapper_signal_instance_release_internal(mapper_signal sig,
     if (smap->map->refcount_local <= 0 && smap->map->refcount_global <= 0) {
         mapper_device_remove_instance_id_map(sig->device, sig->local->group,
                                              smap->map);
-        smap->map = 0;
+        mapper_signal_remove_id_map(sig, instance_index);
     }
     else if ((sig->direction & MAPPER_DIR_OUTGOING)
              || smap->status & RELEASED_REMOTELY) {
         // TODO: consider multiple upstream source instances?
-        smap->map = 0;
+        mapper_signal_remove_id_map(sig, instance_index);
     }
     else {
         // mark map as locally-released but do not remove it
@@ -921,7 +1045,7 @@ void mapper_signal_instance_release_internal(mapper_signal sig,
     }
 
     // Put instance back in reserve list
-    smap->instance->is_active = 0;
+    deactivate_instance(sig, smap->instance);
     smap->instance = 0;
 }
 
@@ -931,14 +1055,18 @@ void mapper_signal_remove_instance(mapper_signal sig, mapper_id id)
         return;
 
     int i;
+    mapper_signal_instance si;
     for (i = 0; i < sig->num_instances; i++) {
         if (sig->local->instances[i]->id == id) {
-            if (sig->local->instances[i]->is_active) {
+            si = sig->local->instances[i];
+            if (si->is_active && si->id_map_index >= 0) {
                 // First release instance
                 mapper_timetag_t tt;
                 mapper_timetag_now(&tt);
-                mapper_signal_instance_release_internal(sig, i, tt);
+                mapper_signal_instance_release_internal(sig, si->id_map_index,
+                                                        tt);
             }
+            unlink_instance(sig, si);
             break;
         }
     }
@@ -1414,6 +1542,7 @@ static int mapper_signal_add_id_map(mapper_signal sig, mapper_signal_instance si
         // need more memory
         if (sig->local->id_map_length >= MAX_INSTANCES) {
             // Arbitrary limit to number of tracked id_maps
+            deactivate_instance(sig, si);
             return -1;
         }
         sig->local->id_map_length *= 2;
@@ -1423,10 +1552,13 @@ static int mapper_signal_add_id_map(mapper_signal sig, mapper_signal_instance si
         memset(sig->local->id_maps + i, 0,
                (sig->local->id_map_length - i)
                * sizeof(struct _mapper_signal_id_map));
+        mapper_signal_reindex_id_maps(sig);
     }
     sig->local->id_maps[i].map = map;
     sig->local->id_maps[i].instance = si;
     sig->local->id_maps[i].status = 0;
+    index_id_map(sig, i);
+    si->id_map_index = i;
 
     return i;
 }
@@ -1626,6 +1758,8 @@ int mapper_signal_set_from_message(mapper_signal sig, mapper_message_t *msg)
             maps = mapper_map_query_next(maps);
         }
     }
+    if (updated)
+        mapper_database_index_signal(sig->device->database, sig);
     return updated + len_type_diff;
 }
 
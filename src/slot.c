@@ -272,6 +272,67 @@ void mapper_slot_upgrade_extrema_memory(mapper_slot slot)
     }
 }
 
+void mapper_slot_realloc_history(mapper_slot slot, int num_instances,
+                                 int history_size, int is_input)
+{
+    int i, j, keep;
+    mapper_local_slot lslot = slot->local;
+    int old_num = lslot->history ? slot->num_instances : 0;
+    int old_size = lslot->history_size;
+    size_t sample_size = (mapper_type_size(slot->signal->type)
+                          * slot->signal->length);
+    size_t stride = sample_size * history_size;
+
+    void *values = calloc(num_instances, stride);
+    mapper_timetag_t *timetags = calloc(num_instances * history_size,
+                                        sizeof(mapper_timetag_t));
+    lslot->history = realloc(lslot->history,
+                             sizeof(struct _mapper_history) * num_instances);
+
+    for (i = 0; i < num_instances; i++) {
+        mapper_history h = &lslot->history[i];
+        mapper_history_t old = *h;
+        h->value = values + stride * i;
+        h->timetag = timetags + history_size * i;
+        h->type = slot->signal->type;
+        h->length = slot->signal->length;
+        h->size = history_size;
+        h->position = -1;
+
+        if (i >= old_num || old.position < 0
+            || (!is_input && history_size != old_size))
+            continue;
+
+        // copy the newest samples, oldest first
+        keep = old_size < history_size ? old_size : history_size;
+        for (j = 0; j < keep; j++) {
+            int from = (old.position - j + old_size) % old_size;
+            memcpy(h->value + sample_size * (keep - 1 - j),
+                   old.value + sample_size * from, sample_size);
+            h->timetag[keep - 1 - j] = old.timetag[from];
+        }
+        h->position = keep - 1;
+    }
+
+    free(lslot->history_values);
+    free(lslot->history_timetags);
+    lslot->history_values = values;
+    lslot->history_timetags = timetags;
+    lslot->history_size = history_size;
+}
+
+void mapper_slot_free_history(mapper_slot slot)
+{
+    if (!slot->local->history)
+        return;
+    free(slot->local->history_values);
+    free(slot->local->history_timetags);
+    free(slot->local->history);
+    slot->local->history = 0;
+    slot->local->history_values = 0;
+    slot->local->history_timetags = 0;
+}
+
 int mapper_slot_set_from_message(mapper_slot slot, mapper_message msg, int mask,
                                  int *status)
 {
@@ -34,9 +34,17 @@ mapper_table mapper_table_new()
     tab->num_records = 0;
     tab->alloced = 1;
     tab->records = (mapper_table_record_t*)malloc(sizeof(mapper_table_record_t));
+    tab->version = 0;
     return tab;
 }
 
+/*! Note a change to a record value for any property indexes. */
+static inline void table_modified(mapper_table tab)
+{
+    if (tab->version)
+        ++(*tab->version);
+}
+
 void mapper_table_clear(mapper_table tab)
 {
     int i, j, free_values = 1;
@@ -65,6 +73,7 @@ void mapper_table_clear(mapper_table tab)
     tab->num_records = 0;
     tab->records = realloc(tab->records, sizeof(mapper_table_record_t));
     tab->alloced = 1;
+    table_modified(tab);
 }
 
 void mapper_table_free(mapper_table tab)
@@ -196,6 +205,7 @@ int mapper_table_remove_record(mapper_table tab, mapper_property_t index,
                 *rec->value = 0;
             }
             rec->index |= PROPERTY_REMOVE;
+            table_modified(tab);
             return 1;
         }
         else {
@@ -220,6 +230,7 @@ int mapper_table_remove_record(mapper_table tab, mapper_property_t index,
     }
 
     rec->index |= PROPERTY_REMOVE;
+    table_modified(tab);
     return 1;
 }
 
@@ -463,6 +474,7 @@ int set_record_internal(mapper_table tab, mapper_property_t index,
         if (!is_value_different(rec, length, type, value))
             return 0;
         update_value_elements(rec, length, type, value);
+        table_modified(tab);
         return 1;
     }
     else {
@@ -470,6 +482,7 @@ int set_record_internal(mapper_table tab, mapper_property_t index,
         rec = mapper_table_add(tab, index, key, 0, type, 0, flags | PROP_OWNED);
         update_value_elements(rec, length, type, value);
         table_sort(tab);
+        table_modified(tab);
         return 1;
     }
     return 0;
@@ -703,6 +716,7 @@ int mapper_table_set_record_from_atom(mapper_table tab,
             return 0;
         update_value_elements_osc(rec, atom->length, atom->types, atom->values,
                                   rec->flags & INDIRECT);
+        table_modified(tab);
         return 1;
     }
     else {
@@ -713,6 +727,7 @@ int mapper_table_set_record_from_atom(mapper_table tab,
         update_value_elements_osc(rec, atom->length, atom->types,
                                   atom->values, 0);
         table_sort(tab);
+        table_modified(tab);
         return 1;
     }
     return 0;
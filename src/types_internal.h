@@ -3,6 +3,7 @@
 #define __MAPPER_TYPES_H__
 
 #include <lo/lo_lowlevel.h>
+#include <time.h>
 
 #include "config.h"
 
@@ -16,6 +17,11 @@
 
 #include <mapper/mapper_constants.h>
 
+/* Links may use the "tcp" transport where BSD sockets are available. */
+#if defined(HAVE_ARPA_INET_H) && defined(HAVE_FCNTL_H)
+#define USE_STREAMS 1
+#endif
+
 #ifdef HAVE_INTTYPES_H
 #include <inttypes.h>
 #define PR_MAPPER_ID PRIu64
@@ -48,45 +54,48 @@ typedef int mapper_signal_group;
 
 /*! Symbolic representation of recognized properties. */
 typedef enum {
-    AT_BOUND_MAX,           /* 0x00 */
-    AT_BOUND_MIN,           /* 0x01 */
-    AT_CALIBRATING,         /* 0x02 */
-    AT_CAUSES_UPDATE,       /* 0x03 */
-    AT_DESCRIPTION,         /* 0x04 */
-    AT_DIRECTION,           /* 0x05 */
-    AT_EXPRESSION,          /* 0x06 */
-    AT_HOST,                /* 0x07 */
-    AT_ID,                  /* 0x08 */
-    AT_INSTANCE,            /* 0x09 */
-    AT_IS_LOCAL,            /* 0x0A */
-    AT_LENGTH,              /* 0x0B */
-    AT_LIB_VERSION,         /* 0x0C */
-    AT_MAX,                 /* 0x0D */
-    AT_MIN,                 /* 0x0E */
-    AT_MODE,                /* 0x0F */
-    AT_MUTED,               /* 0x10 */
-    AT_NAME,                /* 0x11 */
-    AT_NUM_INCOMING_MAPS,   /* 0x12 */
-    AT_NUM_INPUTS,          /* 0x13 */
-    AT_NUM_INSTANCES,       /* 0x14 */
-    AT_NUM_LINKS,           /* 0x15 */
-    AT_NUM_MAPS,            /* 0x16 */
-    AT_NUM_OUTGOING_MAPS,   /* 0x17 */
-    AT_NUM_OUTPUTS,         /* 0x18 */
-    AT_PORT,                /* 0x19 */
-    AT_PROCESS_LOCATION,    /* 0x1A */
-    AT_RATE,                /* 0x1B */
-    AT_SCOPE,               /* 0x1C */
-    AT_SLOT,                /* 0x1D */
-    AT_STATUS,              /* 0x1E */
-    AT_SYNCED,              /* 0x1F */
-    AT_TYPE,                /* 0x20 */
-    AT_UNIT,                /* 0x21 */
-    AT_USE_INSTANCES,       /* 0x22 */
-    AT_USER_DATA,           /* 0x23 */
-    AT_VERSION,             /* 0x24 */
-    AT_EXTRA,               /* 0x25 */
-    NUM_AT_PROPERTIES       /* 0x26 */
+    AT_ALIAS,               /* 0x00 */
+    AT_BOUND_MAX,           /* 0x01 */
+    AT_BOUND_MIN,           /* 0x02 */
+    AT_CALIBRATING,         /* 0x03 */
+    AT_CAUSES_UPDATE,       /* 0x04 */
+    AT_DESCRIPTION,         /* 0x05 */
+    AT_DIRECTION,           /* 0x06 */
+    AT_EXPRESSION,          /* 0x07 */
+    AT_HOST,                /* 0x08 */
+    AT_ID,                  /* 0x09 */
+    AT_INSTANCE,            /* 0x0A */
+    AT_IS_LOCAL,            /* 0x0B */
+    AT_LENGTH,              /* 0x0C */
+    AT_LIB_VERSION,         /* 0x0D */
+    AT_MAX,                 /* 0x0E */
+    AT_MIN,                 /* 0x0F */
+    AT_MODE,                /* 0x10 */
+    AT_MUTED,               /* 0x11 */
+    AT_NAME,                /* 0x12 */
+    AT_NUM_INCOMING_MAPS,   /* 0x13 */
+    AT_NUM_INPUTS,          /* 0x14 */
+    AT_NUM_INSTANCES,       /* 0x15 */
+    AT_NUM_LINKS,           /* 0x16 */
+    AT_NUM_MAPS,            /* 0x17 */
+    AT_NUM_OUTGOING_MAPS,   /* 0x18 */
+    AT_NUM_OUTPUTS,         /* 0x19 */
+    AT_PORT,                /* 0x1A */
+    AT_PROCESS_LOCATION,    /* 0x1B */
+    AT_RATE,                /* 0x1C */
+    AT_SCOPE,               /* 0x1D */
+    AT_SHM,                 /* 0x1E */
+    AT_SLOT,                /* 0x1F */
+    AT_STATUS,              /* 0x20 */
+    AT_SYNCED,              /* 0x21 */
+    AT_TRANSPORT,           /* 0x22 */
+    AT_TYPE,                /* 0x23 */
+    AT_UNIT,                /* 0x24 */
+    AT_USE_INSTANCES,       /* 0x25 */
+    AT_USER_DATA,           /* 0x26 */
+    AT_VERSION,             /* 0x27 */
+    AT_EXTRA,               /* 0x28 */
+    NUM_AT_PROPERTIES       /* 0x29 */
 } mapper_property_t;
 
 /**** String tables ****/
@@ -116,6 +125,8 @@ typedef struct {
 /*! Used to hold look-up tables. */
 typedef struct _mapper_table {
     mapper_table_record_t *records;
+    uint32_t *version;      /*!< Counter incremented whenever a record value
+                             *   changes, or zero. */
     int num_records;
     int alloced;
     char dirty;
@@ -123,6 +134,49 @@ typedef struct _mapper_table {
 
 /**** Database ****/
 
+/*! Intrusive link embedded in records that are stored in a hash index. */
+typedef struct _mapper_hash_link {
+    void *next;                 //!< Next record in the same bucket.
+    uint64_t key;               //!< Key this record is currently indexed by.
+    int indexed;                //!< Non-zero if the record is in the index.
+} mapper_hash_link_t;
+
+/*! A hash index over records kept in a mapper_list, chained through a
+ *  mapper_hash_link_t stored at a fixed offset in each record. */
+typedef struct _mapper_hash_index {
+    void **buckets;
+    int size;                   //!< Number of buckets, always a power of two.
+    int count;                  //!< Number of indexed records.
+    size_t offset;              //!< Offset of the hash link in each record.
+} mapper_hash_index_t, *mapper_hash_index;
+
+/*! Function used to retrieve a named property from a record. */
+typedef int mapper_property_getter(const void *item, const char *name,
+                                   int *length, char *type, const void **value);
+
+typedef struct {
+    void *item;
+    const void *value;
+    int length;
+    char type;
+} mapper_property_index_entry_t;
+
+/*! A secondary index over one named property of the records in a list,
+ *  sorted by property type, length and value.  The index is rebuilt lazily
+ *  when the modification counter for the list has changed. */
+typedef struct _mapper_property_index {
+    struct _mapper_property_index *next;
+    char *name;                         //!< The indexed property.
+    void **list;                        //!< The list of indexed records.
+    uint32_t *version;                  //!< Modification counter for list.
+    uint32_t built_version;             //!< Counter value at last rebuild.
+    int built;
+    mapper_property_getter *get;
+    mapper_property_index_entry_t *entries;
+    int num_entries;
+    int alloced;
+} mapper_property_index_t, *mapper_property_index;
+
 /*! A list of function and context pointers. */
 typedef struct _fptr_list {
     void *f;
@@ -149,6 +203,28 @@ typedef struct _mapper_database {
     fptr_list link_callbacks;           //<! List of link record callbacks.
     fptr_list map_callbacks;            //<! List of mapping record callbacks.
 
+    mapper_hash_index_t device_ids;     //<! Devices indexed by id.
+    mapper_hash_index_t device_names;   //<! Devices indexed by name.
+    mapper_hash_index_t signal_ids;     //<! Signals indexed by id.
+    mapper_hash_index_t signal_names;   //<! Signals indexed by device and name.
+    mapper_hash_index_t map_ids;        //<! Maps indexed by id.
+    mapper_hash_index_t link_ids;       //<! Links indexed by id.
+
+    /*! Modification counters used to invalidate property indexes. */
+    uint32_t device_version;
+    uint32_t signal_version;
+    uint32_t map_version;
+    uint32_t link_version;
+    uint32_t device_name_version;
+    uint32_t signal_name_version;
+
+    /*! Sorted name indexes used for pattern queries. */
+    mapper_property_index device_name_index;
+    mapper_property_index signal_name_index;
+
+    /*! Linked-list of optional property indexes. */
+    mapper_property_index property_indexes;
+
     /*! Linked-list of autorenewing device subscriptions. */
     mapper_subscription subscriptions;
 
@@ -163,6 +239,28 @@ typedef struct _mapper_database {
     int own_network;
 } mapper_database_t, *mapper_database;
 
+/*! A database query whose results are stored and updated incrementally from
+ *  the database record callbacks. */
+typedef struct _mapper_live_query {
+    mapper_database db;
+    mapper_object_type type;            //!< The type of records queried.
+    mapper_property_getter *get;
+    char *name;                         //!< The property to compare, or 0.
+    void *value;                        //!< Copy of the comparison value.
+    int length;
+    char value_type;
+    mapper_op op;
+
+    void **results;                     //!< Records matching the query.
+    int num_results;
+    int alloced;
+
+    /*! Open-addressed table mapping records to their position in results. */
+    void **keys;
+    int *positions;
+    int size;
+} mapper_live_query_t, *mapper_live_query;
+
 /**** Messages ****/
 
 /*! Some useful strings for sending administrative messages. */
@@ -312,8 +410,13 @@ typedef struct _mapper_signal_instance
     mapper_timetag_t timetag;   //!< The timetag for the current value.
 
     int index;                  //!< Index for accessing value history.
+    int id_map_index;           //!< Index of the id map of an active instance.
     uint8_t has_value;          //!< Indicates whether this instance has a value.
     uint8_t is_active;          //!< Status of this instance.
+
+    /*! Links in the signal's active or reserve instance list. */
+    struct _mapper_signal_instance *prev;
+    struct _mapper_signal_instance *next;
 } mapper_signal_instance_t, *mapper_signal_instance;
 
 typedef struct _mapper_signal_id_map
@@ -325,6 +428,23 @@ typedef struct _mapper_signal_id_map
                                                  MAPPER_RELEASED_REMOTELY. */
 } mapper_signal_id_map_t;
 
+#define NUM_DECODE_PLANS 4
+
+/*! A cached decoding of the typetag of incoming signal updates, so that
+ *  values and properties can be found without rescanning the message. */
+typedef struct _mapper_decode_plan {
+    char *types;                        //!< Typetag described by this plan.
+    int value_len;                      //!< Number of value arguments.
+    int nulls;                          //!< Number of null value arguments.
+    int count;                          /*!< Number of samples for the parent
+                                         *   signal, or 0 if invalid. */
+    int instance_arg;                   //!< Index of instance id, or -1.
+    int slot_arg;                       //!< Index of slot id, or -1.
+    int slot_count;                     //!< Number of samples for slot signal.
+    int slot_length;                    //!< Slot signal length for slot_count.
+    char slot_type;                     //!< Slot signal type for slot_count.
+} mapper_decode_plan_t, *mapper_decode_plan;
+
 typedef struct _mapper_local_signal
 {
     /*! The device associated with this signal. */
@@ -334,9 +454,21 @@ typedef struct _mapper_local_signal
     struct _mapper_signal_id_map *id_maps;
     int id_map_length;
 
+    /*! Hash chains indexing id_maps by local and global instance id. Holds
+     *  local bucket heads, global bucket heads, then the local and global
+     *  chain links, each id_map_length long; -1 ends a chain. */
+    int *id_map_index;
+
     /*! Array of pointers to the signal instances. */
     struct _mapper_signal_instance **instances;
 
+    /*! Active instances in order of activation, oldest first. */
+    struct _mapper_signal_instance *active_head;
+    struct _mapper_signal_instance *active_tail;
+
+    /*! Inactive instances available for activation. */
+    struct _mapper_signal_instance *reserve;
+
     /*! Bitflag value when entire signal vector is known. */
     char *has_complete_value;
 
@@ -354,6 +486,16 @@ typedef struct _mapper_local_signal
     int instance_event_flags;
 
     mapper_signal_group group;
+
+    /*! The router_signal holding maps for this signal, or 0 if unmapped. */
+    struct _mapper_router_signal *router_sig;
+
+    /*! Decode plans for recently received message typetags. */
+    mapper_decode_plan_t decode_plans[NUM_DECODE_PLANS];
+    int next_decode_plan;
+
+    /*! Index of this signal in the device alias table, or 0 if none. */
+    int alias;
 } mapper_local_signal_t, *mapper_local_signal;
 
 /*! A record that describes properties of a signal. */
@@ -363,6 +505,9 @@ struct _mapper_signal {
     char *path;         //! OSC path.  Must start with '/'.
     char *name;         //! The name of this signal (path+1).
     mapper_id id;       //!< Unique id identifying this signal.
+    mapper_hash_link_t id_link;     //!< Link in the database id index.
+    mapper_hash_link_t name_link;   //!< Link in the database name index.
+    mapper_hash_link_t path_link;   //!< Link in the local device path index.
 
     char *unit;         //!< The unit of this signal, or NULL for N/A.
     void *minimum;      //!< The minimum of this signal, or NULL for N/A.
@@ -395,17 +540,49 @@ typedef struct _mapper_queue {
 
 /*! The link structure is a linked list of links each associated
  *  with a destination address that belong to a controller device. */
+struct addrinfo;
+
 typedef struct _mapper_local_link {
     lo_address admin_addr;              //!< Network address of remote endpoint
     lo_address data_addr;               //!< Network address of remote endpoint
+    struct addrinfo *data_addrinfo;     /*!< Resolved data address for sending
+                                         *   pre-serialised updates, matching
+                                         *   the device socket's family. */
+    struct addrinfo *data_addrinfo_list;/*!< All resolved data addresses. */
     mapper_queue queues;                /*!< Linked-list of message queues
                                          *   waiting to be sent. */
     mapper_sync_clock_t clock;
+    struct _mapper_shm_ring *shm_in;    /*!< Shared-memory ring offered to the
+                                         *   remote device, if any. */
+    struct _mapper_shm_ring *shm_out;   /*!< Shared-memory ring offered by the
+                                         *   remote device, if any. */
+    int use_stream;                     /*!< Non-zero if the link transport is
+                                         *   "tcp". */
+    int stream_fd;                      //!< Outgoing stream socket.
+    int stream_state;                   //!< One of the STREAM_* states.
+    time_t stream_retry;                //!< Earliest time to reconnect.
+    char *stream_buffer;                /*!< Length-framed messages waiting to
+                                         *   be written to the stream. */
+    size_t stream_length;
+    size_t stream_size;
+    size_t stream_sent;                 /*!< Bytes at the start of the buffer
+                                         *   already written to the current
+                                         *   connection. */
 } *mapper_local_link;
 
+/* States of the outgoing stream of a link using the "tcp" transport. */
+#define STREAM_CLOSED       0
+#define STREAM_CONNECTING   1
+#define STREAM_CONNECTED    2
+
+/* Largest OSC packet carried by a stream, which is the largest UDP datagram
+ * so that a link can always fall back to UDP. */
+#define STREAM_MAX_FRAME    65507
+
 typedef struct _mapper_link {
     mapper_local_link local;
     mapper_id id;
+    mapper_hash_link_t id_link;         //!< Link in the database id index.
     struct _mapper_table *props;
     struct _mapper_table *staged_props;
     void *user_data;
@@ -431,11 +608,28 @@ typedef struct _mapper_link {
 #define STATUS_READY        0x0F
 #define STATUS_ACTIVE       0x1F
 
+/*! A pre-serialised OSC bundle holding a single value update.  Only the
+ *  timetag, values and instance id are rewritten for each update. */
+typedef struct _mapper_message_template {
+    char *buffer;
+    int size;                           //!< Size of the serialised bundle.
+    int value_offset;                   //!< Offset of the first value.
+    int instance_offset;                //!< Offset of instance id, or 0.
+    int length;                         //!< Number of values.
+    int slot_id;                        //!< Slot id argument, or -1.
+    char type;                          //!< Type of the values.
+} mapper_message_template_t, *mapper_message_template;
+
 typedef struct _mapper_local_slot {
     // each slot can point to local signal or a remote link structure
     struct _mapper_router_signal *router_sig;    //!< Parent signal if local
     mapper_history history;                 /*!< Array of value histories for
                                              *   each signal instance. */
+    void *history_values;                   /*!< Arena holding the history
+                                             *   values of every instance. */
+    mapper_timetag_t *history_timetags;     /*!< Arena holding the history
+                                             *   timetags of every instance. */
+    mapper_message_template_t msg_template; //!< Outgoing update template.
     int history_size;                       //!< History size.
     char status;
 } mapper_local_slot_t, *mapper_local_slot;
@@ -476,6 +670,25 @@ typedef struct _mapper_local_map {
     int num_expr_vars;                  //!< Number of user variables.
     int num_var_instances;
 
+    /*! Per-element scale and offset used in place of the expression for
+     *  linear maps, or 0 if the expression must be evaluated.  They are
+     *  stored as floats or doubles according to linear_type. */
+    void *linear_scale;
+    void *linear_offset;
+    int linear_length;
+    char linear_type;
+
+    /*! Short OSC path advertised by a remote destination device, used in
+     *  place of the destination signal path, or 0 if none. */
+    char *alias_path;
+
+    /*! Destination signal belonging to a device in this process, which
+     *  receives updates by direct function call, or 0 if updates must be
+     *  sent over the network.  Only valid while local_destination_version
+     *  matches mapper_device_local_version(). */
+    mapper_signal local_destination;
+    uint32_t local_destination_version;
+
     uint8_t is_local_only;
     uint8_t one_source;
 } mapper_local_map_t, *mapper_local_map;
@@ -488,6 +701,7 @@ typedef struct _mapper_map {
     mapper_slot *sources;
     mapper_slot_t destination;
     mapper_id id;                       //!< Unique id identifying this map
+    mapper_hash_link_t id_link;         //!< Link in the database id index.
 
     mapper_device *scopes;
 
@@ -509,8 +723,9 @@ typedef struct _mapper_map {
 } mapper_map_t, *mapper_map;
 
 /*! The router_signal is a linked list containing a signal and a list of
- *  mappings.  TODO: This should be replaced with a more efficient approach
- *  such as a hash table or search tree. */
+ *  mappings.  The list is only walked when iterating over all mapped signals;
+ *  lookups for a specific signal use the pointer cached in the signal's
+ *  mapper_local_signal structure. */
 typedef struct _mapper_router_signal {
     struct _mapper_router_signal *next; //!< The next router_signal in the list.
 
@@ -533,6 +748,8 @@ typedef struct _mapper_router {
  *  remote and local instances. */
 typedef struct _mapper_id_map {
     struct _mapper_id_map *next;    //!< The next id map in the list.
+    struct _mapper_id_map *next_by_local;   //!< Next in local id hash chain.
+    struct _mapper_id_map *next_by_global;  //!< Next in global id hash chain.
 
     mapper_id global;               //!< Hash for originating device.
     mapper_id local;                //!< Local instance id to map.
@@ -540,6 +757,14 @@ typedef struct _mapper_id_map {
     int refcount_global;
 } mapper_id_map_t, *mapper_id_map;
 
+/*! Hash chains of a signal group's active id maps by local and global id. */
+typedef struct _mapper_id_map_index {
+    mapper_id_map *by_local;
+    mapper_id_map *by_global;
+    int size;                       //!< Number of buckets, a power of two.
+    int count;                      //!< Number of indexed id maps.
+} mapper_id_map_index_t, *mapper_id_map_index;
+
 /**** Device ****/
 
 typedef struct _mapper_local_device {
@@ -562,18 +787,68 @@ typedef struct _mapper_local_device {
     /*! The list of active instance id maps. */
     struct _mapper_id_map **active_id_maps;
 
+    /*! Hash indexes of the active instance id maps, one per signal group. */
+    struct _mapper_id_map_index *id_map_indexes;
+
     /*! The list of reserve instance id maps. */
     struct _mapper_id_map *reserve_id_maps;
 
     /*! Server used to handle incoming messages. */
     lo_server server;
 
+    /*! Local signals receiving messages, indexed by OSC path. */
+    mapper_hash_index_t signal_paths;
+
+    /*! Local signals receiving messages, indexed by the alias used in short
+     *  OSC paths of the form "/_/<alias>".  Entry 0 is unused and aliases are
+     *  not reused after their signal is removed. */
+    mapper_signal *signal_aliases;
+    int num_signal_aliases;
+    int no_path_aliases;    /* Non-zero if aliases should not be offered. */
+    int in_process_delivery;    /* Non-zero if updates to devices in this
+                                 * process may be delivered directly. */
+    const void *poll_thread;    /* Identifies the thread which last called
+                                 * mapper_device_poll(), if any. */
+    int use_shm;            /* Non-zero if shared-memory rings should be
+                             * offered to links on the same host. */
+    int num_shm_rings;      /* Number of rings offered to linked devices. */
+    int stream_fd;          /* Socket accepting streams from linked devices
+                             * using the "tcp" transport, or -1. */
+    struct _mapper_stream *streams; /* Incoming streams. */
+    int num_stream_links;   /* Number of links using the "tcp" transport. */
+    int shm_pending;        /* Non-zero if a ring was left holding data. */
+    lo_address dispatch_source; /* Sender of the message being dispatched
+                                 * from a ring or stream, which liblo does
+                                 * not know, or 0. */
+
     // TODO: move to network
     int link_timeout_sec;   /* Number of seconds after which unresponsive
                              * links will be removed, or 0 for never. */
 
     int own_network;
     int num_signal_groups;
+
+    /*! Sockets watched by mapper_device_poll(), registered on first use. */
+    int poll_fds[3];
+    int epoll_fd;           /* Event descriptor, if epoll is available. */
+    int timer_fd;           /* Timer for periodic network housekeeping. */
+    int wake_fds[2];        /* Read and write ends of the descriptor used to
+                             * wake the network thread, or -1. */
+    int wake_pending;       /* Non-zero if the network thread has been woken
+                             * and has not yet read the update queue. */
+    int poller_open;
+
+    /*! Buffers for batched reception of signal updates, if enabled. */
+    struct _mapper_receive_ring *recv_ring;
+
+    /*! Buffers for batched sending of queued updates, if enabled. */
+    struct _mapper_send_batch *send_batch;
+
+    /*! Lock-free queue of updates submitted from other threads, if reserved. */
+    struct _mapper_update_queue *update_queue;
+
+    /*! Network thread servicing this device, if started. */
+    struct _mapper_device_thread *thread;
 } mapper_local_device_t, *mapper_local_device;
 
 
@@ -591,6 +866,8 @@ struct _mapper_device {
     struct _mapper_table *staged_props;
 
     mapper_id id;               //!< Unique id identifying this device.
+    mapper_hash_link_t id_link;     //!< Link in the database id index.
+    mapper_hash_link_t name_link;   //!< Link in the database name index.
 
     mapper_timetag_t synced;    //!< Timestamp of last sync.
 
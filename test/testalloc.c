@@ -0,0 +1,230 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+
+mapper_device source = 0;
+mapper_device destination = 0;
+mapper_signal sendsig[2] = {0, 0};
+mapper_signal recvsig[2] = {0, 0};
+
+int iterations = 200;
+int received = 0;
+double last_value = 0;
+
+/* Count heap allocations made by this process while 'counting' is set.  The
+ * definitions below interpose the allocator used by libmapper. */
+int counting = 0;
+int num_allocs = 0;
+
+#ifdef __GLIBC__
+#define CAN_COUNT_ALLOCS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    if (counting)
+        ++num_allocs;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    if (counting)
+        ++num_allocs;
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+        ++num_allocs;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+void handler(mapper_signal sig, mapper_id instance, const void *value,
+             int count, mapper_timetag_t *timetag)
+{
+    if (!value)
+        return;
+    ++received;
+    if (sig == recvsig[1])
+        last_value = *(double*)value;
+}
+
+int setup_devices()
+{
+    float mnf[] = {0, 0, 0}, mxf[] = {1, 1, 1};
+    double mnd = 0, mxd = 1000;
+
+    source = mapper_device_new("testalloc-send", 0, 0);
+    destination = mapper_device_new("testalloc-recv", 0, 0);
+    if (!source || !destination)
+        return 1;
+
+    sendsig[0] = mapper_device_add_output_signal(source, "outsig1", 3, 'f', 0,
+                                                 mnf, mxf);
+    sendsig[1] = mapper_device_add_output_signal(source, "outsig2", 1, 'i', 0,
+                                                 0, 0);
+    recvsig[0] = mapper_device_add_input_signal(destination, "insig1", 3, 'f',
+                                                0, mnf, mxf, handler, 0);
+    recvsig[1] = mapper_device_add_input_signal(destination, "insig2", 1, 'd',
+                                                0, &mnd, &mxd, handler, 0);
+
+    while (!done && !(mapper_device_ready(source)
+                      && mapper_device_ready(destination))) {
+        mapper_device_poll(source, 25);
+        mapper_device_poll(destination, 25);
+    }
+    eprintf("devices ready.\n");
+    return 0;
+}
+
+void cleanup_devices()
+{
+    if (destination) {
+        eprintf("Freeing destination.. ");
+        fflush(stdout);
+        mapper_device_free(destination);
+        eprintf("ok\n");
+    }
+    if (source) {
+        eprintf("Freeing source.. ");
+        fflush(stdout);
+        mapper_device_free(source);
+        eprintf("ok\n");
+    }
+}
+
+int setup_maps()
+{
+    mapper_map maps[2];
+    maps[0] = mapper_map_new(1, &sendsig[0], 1, &recvsig[0]);
+    mapper_map_push(maps[0]);
+    maps[1] = mapper_map_new(1, &sendsig[1], 1, &recvsig[1]);
+    mapper_map_set_mode(maps[1], MAPPER_MODE_EXPRESSION);
+    mapper_map_set_expression(maps[1], "y=x*2");
+    mapper_map_push(maps[1]);
+
+    // wait until mappings have been established
+    while (!done && !(mapper_map_ready(maps[0]) && mapper_map_ready(maps[1]))) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+    }
+    eprintf("maps ready.\n");
+    return done;
+}
+
+int send_burst()
+{
+    int i, j;
+    float vec[3];
+
+    // first update may need to build message templates
+    vec[0] = vec[1] = vec[2] = 0.5f;
+    i = 0;
+    mapper_signal_update(sendsig[0], vec, 1, MAPPER_NOW);
+    mapper_signal_update(sendsig[1], &i, 1, MAPPER_NOW);
+
+    counting = 1;
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < 3; j++)
+            vec[j] = (float)((i + j) % 100) * 0.01f;
+        mapper_signal_update(sendsig[0], vec, 1, MAPPER_NOW);
+        mapper_signal_update(sendsig[1], &i, 1, MAPPER_NOW);
+    }
+    counting = 0;
+
+    eprintf("%d allocations during %d updates\n", num_allocs, iterations * 2);
+    return num_allocs;
+}
+
+void ctrlc(int sig)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testalloc.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    if (setup_devices()) {
+        eprintf("Error initializing devices.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (setup_maps()) {
+        eprintf("Error initializing maps.\n");
+        result = 1;
+        goto done;
+    }
+
+#ifndef CAN_COUNT_ALLOCS
+    eprintf("Allocation counting not supported on this platform.\n");
+#endif
+    if (send_burst()) {
+        eprintf("Expected no allocations on the send path.\n");
+        result = 1;
+    }
+
+    // check that the updates were received intact; some may be dropped
+    for (i = 0; i < 10 && received < iterations * 2 + 2; i++) {
+        mapper_device_poll(destination, 10);
+    }
+    eprintf("received %d of %d updates, last value %g\n", received,
+            iterations * 2 + 2, last_value);
+    if (!received || (int)last_value % 2 || last_value > (iterations - 1) * 2) {
+        eprintf("Expected an even value up to %d.\n", (iterations - 1) * 2);
+        result = 1;
+    }
+
+  done:
+    cleanup_devices();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
@@ -0,0 +1,175 @@
+#include <../src/mapper_internal.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define LENGTH 64
+
+int verbose = 1;
+int terminate = 0;
+int iterations = 200000;
+
+const char *action_names[] = { "none", "mute", "clamp", "fold", "wrap" };
+mapper_boundary_action actions[] = {
+    MAPPER_BOUND_NONE,
+    MAPPER_BOUND_MUTE,
+    MAPPER_BOUND_CLAMP,
+    MAPPER_BOUND_FOLD,
+    MAPPER_BOUND_WRAP
+};
+int num_actions = sizeof(actions) / sizeof(actions[0]);
+
+double minimum[LENGTH], maximum[LENGTH], value[LENGTH], input[LENGTH];
+char typestring[LENGTH];
+
+mapper_signal_t sig;
+mapper_slot_t slot;
+mapper_timetag_t tt = {0, 0};
+mapper_history_t history;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*! Fill the extrema and input for the given type, with inputs spanning twice
+ *  the range if 'out_of_range' is set. */
+void setup(char type, int out_of_range)
+{
+    int i;
+    for (i = 0; i < LENGTH; i++) {
+        double in = (double)(i % 10) * 0.1;
+        if (out_of_range)
+            in = in * 4. - 1.5;
+        propval_set_double(minimum, type, i, 0.);
+        propval_set_double(maximum, type, i, 1.);
+        propval_set_double(input, type, i, in);
+    }
+    sig.type = history.type = type;
+    sig.length = history.length = LENGTH;
+    history.size = 1;
+    history.position = 0;
+    history.value = value;
+    history.timetag = &tt;
+    slot.signal = &sig;
+    slot.minimum = minimum;
+    slot.maximum = maximum;
+}
+
+/*! Time boundary processing, returning nanoseconds per vector. */
+double time_action(mapper_boundary_action action)
+{
+    int i;
+    size_t size = mapper_type_size(sig.type) * LENGTH;
+    double then, elapsed = 0;
+    slot.bound_min = slot.bound_max = action;
+
+    for (i = 0; i < iterations; i++) {
+        // restore the input, since boundary processing works in place
+        memcpy(value, input, size);
+        memset(typestring, sig.type, LENGTH);
+        then = current_time();
+        mapper_boundary_perform(&history, &slot, typestring);
+        elapsed += current_time() - then;
+    }
+    return elapsed * 1000000000. / iterations;
+}
+
+/*! Check that values left unmuted are within range after processing. */
+int check(mapper_boundary_action action)
+{
+    int i;
+    for (i = 0; i < LENGTH; i++) {
+        double v = propval_double(value, sig.type, i);
+        double in = propval_double(input, sig.type, i);
+        if (typestring[i] == 'N') {
+            if (action != MAPPER_BOUND_MUTE || (in >= 0. && in <= 1.)) {
+                eprintf("element %d muted unexpectedly\n", i);
+                return 1;
+            }
+        }
+        else if (action == MAPPER_BOUND_NONE) {
+            if (v != in) {
+                eprintf("element %d changed: %g != %g\n", i, v, in);
+                return 1;
+            }
+        }
+        else if (v < 0. || v > 1.) {
+            eprintf("element %d out of range: %g\n", i, v);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int run_tests()
+{
+    int i, j, k;
+    char types[] = {'i', 'f', 'd'};
+    double ns[2];
+
+    for (i = 0; i < 3; i++) {
+        eprintf("\n%s, length %d\n", types[i] == 'i' ? "int"
+                : types[i] == 'f' ? "float" : "double", LENGTH);
+        eprintf("  action    in range ns    out of range ns\n");
+        for (j = 0; j < num_actions; j++) {
+            for (k = 0; k < 2; k++) {
+                setup(types[i], k);
+                ns[k] = time_action(actions[j]);
+                if (check(actions[j]))
+                    return 1;
+            }
+            eprintf("%8s  %13.1f  %17.1f\n", action_names[j], ns[0], ns[1]);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testboundary.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    // use a shorter run when terminating automatically
+    if (terminate)
+        iterations = 10000;
+
+    result = run_tests();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
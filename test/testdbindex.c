@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <lo/lo_lowlevel.h>
+#include "../src/mapper_internal.h"
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define SIGNALS_PER_DEVICE 100
+
+int verbose = 1;
+int terminate = 0;
+
+int sizes[] = {10000, 40000, 100000};
+int num_sizes = sizeof(sizes) / sizeof(int);
+
+mapper_network net = 0;
+mapper_database db = 0;
+mapper_device *devices = 0;
+mapper_signal *signals = 0;
+mapper_map *maps = 0;
+mapper_link *links = 0;
+int num_devices, num_signals, num_maps, num_links;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*! Build a parsed property message containing an id and an optional
+ *  direction.  The lo_message must be freed after the parsed message. */
+static mapper_message id_props(lo_message *lom, mapper_id id, const char *dir)
+{
+    *lom = lo_message_new();
+    lo_message_add_string(*lom, "@id");
+    lo_message_add_int64(*lom, id);
+    if (dir) {
+        lo_message_add_string(*lom, "@direction");
+        lo_message_add_string(*lom, dir);
+    }
+    return mapper_message_parse_properties(lo_message_get_argc(*lom),
+                                           lo_message_get_types(*lom),
+                                           lo_message_get_argv(*lom));
+}
+
+static mapper_id signal_id(int i)
+{
+    return ((mapper_id)(i / SIGNALS_PER_DEVICE + 1) << 32) | (i + 1);
+}
+
+static mapper_id map_id(int i)
+{
+    return 0x8000000000000000ULL | (i + 1);
+}
+
+static mapper_id link_id(int i)
+{
+    return 0x4000000000000000ULL | (i + 1);
+}
+
+/*! Populate the database with 'count' signals spread across devices, one map
+ *  from each output to the input on the next device, and one link per pair
+ *  of neighbouring devices. */
+int populate(int count)
+{
+    int i;
+    char devname[32], signame[32], srcname[64], dstname[64];
+    const char *src = srcname;
+    lo_message lom;
+    mapper_message msg;
+
+    net = mapper_network_new(0, 0, 0);
+    if (!net)
+        return 1;
+    db = &net->database;
+
+    num_signals = count;
+    num_devices = count / SIGNALS_PER_DEVICE;
+    num_maps = count / 2;
+    num_links = num_devices - 1;
+
+    devices = (mapper_device*)malloc(sizeof(mapper_device) * num_devices);
+    signals = (mapper_signal*)malloc(sizeof(mapper_signal) * num_signals);
+    maps = (mapper_map*)malloc(sizeof(mapper_map) * num_maps);
+    links = (mapper_link*)malloc(sizeof(mapper_link) * num_links);
+
+    for (i = 0; i < num_devices; i++) {
+        snprintf(devname, 32, "testdbindex.%d", i + 1);
+        devices[i] = mapper_database_add_or_update_device(db, devname, 0);
+        if (!devices[i])
+            return 1;
+    }
+
+    for (i = 0; i < num_signals; i++) {
+        snprintf(devname, 32, "testdbindex.%d", i / SIGNALS_PER_DEVICE + 1);
+        snprintf(signame, 32, "%s%d", i % 2 ? "in" : "out",
+                 i % SIGNALS_PER_DEVICE);
+        msg = id_props(&lom, signal_id(i), i % 2 ? "input" : "output");
+        signals[i] = mapper_database_add_or_update_signal(db, signame, devname,
+                                                          msg);
+        mapper_message_free(msg);
+        lo_message_free(lom);
+        if (!signals[i])
+            return 1;
+    }
+
+    for (i = 0; i < num_links; i++) {
+        msg = id_props(&lom, link_id(i), 0);
+        links[i] = mapper_database_add_or_update_link(db, devices[i],
+                                                      devices[i + 1], msg);
+        mapper_message_free(msg);
+        lo_message_free(lom);
+        if (!links[i])
+            return 1;
+    }
+
+    for (i = 0; i < num_maps; i++) {
+        int s = i * 2, d = (s + 1 + SIGNALS_PER_DEVICE) % num_signals;
+        snprintf(srcname, 64, "/%s/%s", signals[s]->device->name,
+                 signals[s]->name);
+        snprintf(dstname, 64, "/%s/%s", signals[d]->device->name,
+                 signals[d]->name);
+        msg = id_props(&lom, map_id(i), 0);
+        maps[i] = mapper_database_add_or_update_map(db, 1, &src, dstname, msg);
+        mapper_message_free(msg);
+        lo_message_free(lom);
+        if (!maps[i])
+            return 1;
+    }
+    return 0;
+}
+
+void depopulate()
+{
+    if (net)
+        mapper_network_free(net);
+    net = 0;
+    db = 0;
+    free(devices);
+    free(signals);
+    free(maps);
+    free(links);
+    devices = 0;
+    signals = 0;
+    maps = 0;
+    links = 0;
+}
+
+/*! Look up every record by id and by name, returning the number of records
+ *  that could not be found. */
+int lookup_all(double *elapsed)
+{
+    int i, errors = 0;
+    double then;
+    char name[32];
+
+    then = current_time();
+    for (i = 0; i < num_devices; i++) {
+        if (mapper_database_device_by_id(db, devices[i]->id) != devices[i])
+            ++errors;
+    }
+    elapsed[0] = (current_time() - then) * 1000000000. / num_devices;
+
+    then = current_time();
+    for (i = 0; i < num_devices; i++) {
+        if (mapper_database_device_by_name(db, devices[i]->name) != devices[i])
+            ++errors;
+    }
+    elapsed[1] = (current_time() - then) * 1000000000. / num_devices;
+
+    then = current_time();
+    for (i = 0; i < num_signals; i++) {
+        if (mapper_database_signal_by_id(db, signal_id(i)) != signals[i])
+            ++errors;
+    }
+    elapsed[2] = (current_time() - then) * 1000000000. / num_signals;
+
+    then = current_time();
+    for (i = 0; i < num_signals; i++) {
+        snprintf(name, 32, "%s%d", i % 2 ? "in" : "out", i % SIGNALS_PER_DEVICE);
+        if (mapper_device_signal_by_name(signals[i]->device, name) != signals[i])
+            ++errors;
+    }
+    elapsed[3] = (current_time() - then) * 1000000000. / num_signals;
+
+    then = current_time();
+    for (i = 0; i < num_maps; i++) {
+        if (mapper_database_map_by_id(db, map_id(i)) != maps[i])
+            ++errors;
+    }
+    elapsed[4] = (current_time() - then) * 1000000000. / num_maps;
+
+    then = current_time();
+    for (i = 0; i < num_links; i++) {
+        if (mapper_database_link_by_id(db, link_id(i)) != links[i])
+            ++errors;
+    }
+    elapsed[5] = (current_time() - then) * 1000000000. / num_links;
+
+    return errors;
+}
+
+/*! Count the records matching a prefix pattern, and compare with a scan of
+ *  the whole database. */
+static int count_devices(const char *pattern, int length)
+{
+    int count = 0;
+    mapper_device *devs = mapper_database_devices_by_name(db, pattern);
+    while (devs) {
+        if (strncmp((*devs)->name, pattern, length))
+            return -1;
+        ++count;
+        devs = mapper_device_query_next(devs);
+    }
+    return count;
+}
+
+static int count_signals(const char *pattern, int length)
+{
+    int count = 0;
+    mapper_signal *sigs = mapper_database_signals_by_name(db, pattern);
+    while (sigs) {
+        if (strncmp((*sigs)->name, pattern, length))
+            return -1;
+        ++count;
+        sigs = mapper_signal_query_next(sigs);
+    }
+    return count;
+}
+
+/*! Query devices and signals by name pattern, comparing patterns with a
+ *  literal prefix against patterns beginning with a wildcard, which must
+ *  visit every record.  Returns the number of incorrect results. */
+int match_all(double *elapsed)
+{
+    int i, expected, errors = 0, iterations = 100;
+    double then;
+
+    // devices "testdbindex.1*": 1, 10-19, 100-199, ...
+    for (i = 1, expected = 0; i <= num_devices; i++) {
+        char name[32];
+        snprintf(name, 32, "%d", i);
+        expected += name[0] == '1';
+    }
+    then = current_time();
+    for (i = 0; i < iterations; i++) {
+        if (count_devices("testdbindex.1*", 13) != expected)
+            ++errors;
+    }
+    elapsed[0] = (current_time() - then) * 1000000. / iterations;
+
+    then = current_time();
+    for (i = 0; i < iterations; i++) {
+        if (count_devices("*dbindex.1*", 0) != expected)
+            ++errors;
+    }
+    elapsed[1] = (current_time() - then) * 1000000. / iterations;
+
+    // signals "in1*": in1, in11, in13, ... on every device
+    expected = num_devices * 6;
+    then = current_time();
+    for (i = 0; i < iterations; i++) {
+        if (count_signals("in1*", 3) != expected)
+            ++errors;
+    }
+    elapsed[2] = (current_time() - then) * 1000000. / iterations;
+
+    then = current_time();
+    for (i = 0; i < iterations; i++) {
+        if (count_signals("*n1*", 0) != expected)
+            ++errors;
+    }
+    elapsed[3] = (current_time() - then) * 1000000. / iterations;
+
+    return errors;
+}
+
+/*! Check that lookups follow records whose ids change and that removed
+ *  records can no longer be found. */
+int check_updates()
+{
+    lo_message lom;
+    mapper_message msg;
+    mapper_signal sig = signals[0];
+    mapper_id old_id = sig->id, new_id = 0x2000000000000001ULL;
+
+    msg = id_props(&lom, new_id, 0);
+    mapper_database_add_or_update_signal(db, sig->name, sig->device->name, msg);
+    mapper_message_free(msg);
+    lo_message_free(lom);
+
+    if (mapper_database_signal_by_id(db, new_id) != sig) {
+        eprintf("Signal not found by updated id.\n");
+        return 1;
+    }
+    if (mapper_database_signal_by_id(db, old_id)) {
+        eprintf("Signal still found by previous id.\n");
+        return 1;
+    }
+
+    mapper_device dev = devices[num_devices - 1];
+    mapper_id dev_id = dev->id;
+    char name[32];
+    snprintf(name, 32, "%s", dev->name);
+    mapper_database_remove_device(db, dev, MAPPER_REMOVED, 1);
+    if (mapper_database_device_by_id(db, dev_id)
+        || mapper_database_device_by_name(db, name)) {
+        eprintf("Removed device still found.\n");
+        return 1;
+    }
+    if (mapper_database_signal_by_id(db, signal_id(num_signals - 1))) {
+        eprintf("Signal of removed device still found.\n");
+        return 1;
+    }
+    if (mapper_database_link_by_id(db, link_id(num_links - 1))) {
+        eprintf("Link of removed device still found.\n");
+        return 1;
+    }
+    --num_devices;
+    return 0;
+}
+
+int run_tests()
+{
+    int i;
+    double then, build, elapsed[6], matched[3][4];
+
+    eprintf("records   build ms  dev id  dev name  sig id  sig name  map id  "
+            "link id (ns)\n");
+    for (i = 0; i < num_sizes; i++) {
+        then = current_time();
+        if (populate(sizes[i])) {
+            eprintf("Error populating database.\n");
+            return 1;
+        }
+        build = (current_time() - then) * 1000.;
+
+        if (lookup_all(elapsed)) {
+            eprintf("Lookups returned the wrong records.\n");
+            return 1;
+        }
+        eprintf("%7d  %9.1f  %6.0f  %8.0f  %6.0f  %8.0f  %6.0f  %7.0f\n",
+                sizes[i], build, elapsed[0], elapsed[1], elapsed[2], elapsed[3],
+                elapsed[4], elapsed[5]);
+
+        if (match_all(matched[i])) {
+            eprintf("Pattern queries returned the wrong records.\n");
+            return 1;
+        }
+
+        if (check_updates())
+            return 1;
+        depopulate();
+    }
+
+    eprintf("\nrecords  dev prefix  dev scan  sig prefix  sig scan (us)\n");
+    for (i = 0; i < num_sizes; i++) {
+        eprintf("%7d  %10.1f  %8.1f  %10.1f  %8.1f\n", sizes[i],
+                matched[i][0], matched[i][1], matched[i][2], matched[i][3]);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testdbindex.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    // use only the smallest database when terminating automatically
+    if (terminate)
+        num_sizes = 1;
+
+    result = run_tests();
+    depopulate();
+
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
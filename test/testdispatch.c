@@ -0,0 +1,199 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <lo/lo.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define NUM_MESSAGES 1000
+
+int verbose = 1;
+int terminate = 0;
+
+int sizes[] = {10, 100, 1000, 3000};
+int num_sizes = sizeof(sizes) / sizeof(int);
+int iterations = 200;
+
+int received = 0;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mapper_signal sig, mapper_id instance, const void *value,
+             int count, mapper_timetag_t *timetag)
+{
+    if (value)
+        ++received;
+}
+
+/*! Create a device with 'num_signals' inputs and dispatch serialised updates
+ *  addressed to randomly chosen signals directly through its server, without
+ *  network transport.  Returns the dispatch cost per message in nanoseconds,
+ *  or a negative value on error. */
+double run_size(int num_signals)
+{
+    int i, j;
+    char name[32];
+    float mn = 0, mx = 1, value = 0.5;
+    void *data[NUM_MESSAGES];
+    size_t lengths[NUM_MESSAGES];
+    double elapsed;
+
+    mapper_device dev = mapper_device_new("testdispatch", 0, 0);
+    if (!dev)
+        return -1;
+
+    for (i = 0; i < num_signals; i++) {
+        snprintf(name, 32, "in%d", i);
+        if (!mapper_device_add_input_signal(dev, name, 1, 'f', 0, &mn, &mx,
+                                            handler, 0)) {
+            mapper_device_free(dev);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < NUM_MESSAGES; i++) {
+        lo_message msg = lo_message_new();
+        lo_message_add_float(msg, value);
+        snprintf(name, 32, "/in%d", rand() % num_signals);
+        data[i] = lo_message_serialise(msg, name, NULL, &lengths[i]);
+        lo_message_free(msg);
+    }
+
+    received = 0;
+    elapsed = current_time();
+    for (j = 0; j < iterations; j++) {
+        for (i = 0; i < NUM_MESSAGES; i++)
+            lo_server_dispatch_data(dev->local->server, data[i], lengths[i]);
+    }
+    elapsed = (current_time() - elapsed) * 1000000000.
+              / (iterations * NUM_MESSAGES);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+        free(data[i]);
+    mapper_device_free(dev);
+
+    if (received != iterations * NUM_MESSAGES) {
+        eprintf("Received %d of %d updates.\n", received,
+                iterations * NUM_MESSAGES);
+        return -1;
+    }
+    return elapsed;
+}
+
+/*! Dispatch an update to '/in' carrying an instance id under the property
+ *  name 'key'. */
+static void dispatch_with_key(mapper_device dev, const char *key)
+{
+    size_t len;
+    lo_message msg = lo_message_new();
+    lo_message_add_float(msg, 0.5);
+    lo_message_add_string(msg, key);
+    lo_message_add_int64(msg, 1234);
+    void *data = lo_message_serialise(msg, "/in", NULL, &len);
+    lo_message_free(msg);
+    lo_server_dispatch_data(dev->local->server, data, len);
+    free(data);
+}
+
+/*! Check that a malformed property name is rejected even when the message
+ *  typetag matches a cached decode plan, and that a signal name which could
+ *  shadow an alias is refused. */
+int check_malformed()
+{
+    float mn = 0, mx = 1;
+    int result = 0;
+
+    mapper_device dev = mapper_device_new("testdispatch", 0, 0);
+    if (!dev)
+        return 1;
+    if (!mapper_device_add_input_signal(dev, "in", 1, 'f', 0, &mn, &mx,
+                                        handler, 0)) {
+        mapper_device_free(dev);
+        return 1;
+    }
+    // names that could shadow a signal alias are reserved
+    if (mapper_device_add_input_signal(dev, "_/1", 1, 'f', 0, &mn, &mx,
+                                       handler, 0)) {
+        eprintf("Signal with reserved name '_/1' was added.\n");
+        result = 1;
+    }
+
+    received = 0;
+    dispatch_with_key(dev, "@instance");
+    dispatch_with_key(dev, "@bogus");
+    if (received != 1) {
+        eprintf("Update with property '@bogus' was accepted.\n");
+        result = 1;
+    }
+    dispatch_with_key(dev, "@instance");
+    if (received != 2) {
+        eprintf("Valid update was rejected after a malformed one.\n");
+        result = 1;
+    }
+
+    mapper_device_free(dev);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+    double elapsed;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testdispatch.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    if (terminate)
+        iterations = 10;
+
+    eprintf("signals  dispatch (ns/msg)\n");
+    for (i = 0; i < num_sizes; i++) {
+        elapsed = run_size(sizes[i]);
+        if (elapsed < 0) {
+            result = 1;
+            break;
+        }
+        eprintf("%7d  %17.0f\n", sizes[i], elapsed);
+    }
+
+    if (!result)
+        result = check_malformed();
+
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
@@ -0,0 +1,231 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <signal.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define MAX_DESTINATIONS 64
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+
+mapper_device source = 0;
+mapper_signal sendsig = 0;
+mapper_device destinations[MAX_DESTINATIONS];
+mapper_signal recvsigs[MAX_DESTINATIONS];
+int num_destinations = 0;
+
+int max_destinations = MAX_DESTINATIONS;
+int iterations = 2000;
+int received = 0;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mapper_signal sig, mapper_id instance, const void *value,
+             int count, mapper_timetag_t *timetag)
+{
+    if (value)
+        ++received;
+}
+
+void poll_all(int block_ms)
+{
+    int i;
+    mapper_device_poll(source, block_ms);
+    for (i = 0; i < num_destinations; i++)
+        mapper_device_poll(destinations[i], 0);
+}
+
+int setup_source()
+{
+    source = mapper_device_new("testfanout-send", 0, 0);
+    if (!source)
+        return 1;
+    sendsig = mapper_device_add_output_signal(source, "outsig", 1, 'f', 0, 0, 0);
+    while (!done && !mapper_device_ready(source))
+        mapper_device_poll(source, 25);
+    eprintf("source ready.\n");
+    return 0;
+}
+
+void cleanup_devices()
+{
+    int i;
+    for (i = 0; i < num_destinations; i++) {
+        if (destinations[i])
+            mapper_device_free(destinations[i]);
+    }
+    if (source) {
+        eprintf("Freeing source.. ");
+        fflush(stdout);
+        mapper_device_free(source);
+        eprintf("ok\n");
+    }
+}
+
+/*! Add and map destination devices until we have 'count' of them. */
+int add_destinations(int count)
+{
+    int i, ready, first = num_destinations;
+    mapper_map maps[MAX_DESTINATIONS];
+
+    for (i = first; i < count; i++) {
+        destinations[i] = mapper_device_new("testfanout-recv", 0, 0);
+        if (!destinations[i])
+            return 1;
+        recvsigs[i] = mapper_device_add_input_signal(destinations[i], "insig",
+                                                     1, 'f', 0, 0, 0, handler,
+                                                     0);
+        ++num_destinations;
+    }
+
+    // wait until all devices are ready
+    do {
+        poll_all(10);
+        ready = 0;
+        for (i = first; i < count; i++)
+            ready += mapper_device_ready(destinations[i]);
+    } while (!done && ready < count - first);
+
+    for (i = first; i < count; i++) {
+        maps[i] = mapper_map_new(1, &sendsig, 1, &recvsigs[i]);
+        mapper_map_push(maps[i]);
+    }
+
+    // wait until all maps have been established
+    do {
+        poll_all(10);
+        ready = 0;
+        for (i = first; i < count; i++)
+            ready += mapper_map_ready(maps[i]);
+    } while (!done && ready < count - first);
+    return done;
+}
+
+/*! Time queued updates to every destination, returning usec per frame. */
+double time_frames()
+{
+    int i;
+    float value;
+    mapper_timetag_t now;
+    double elapsed = 0, then;
+
+    for (i = 0; i < iterations && !done; i++) {
+        value = (float)i;
+        mapper_timetag_now(&now);
+        then = current_time();
+        mapper_device_start_queue(source, now);
+        mapper_signal_update(sendsig, &value, 1, now);
+        mapper_device_send_queue(source, now);
+        elapsed += current_time() - then;
+
+        // drain destination sockets periodically
+        if (i % 10 == 0)
+            poll_all(0);
+    }
+    return elapsed * 1000000. / iterations;
+}
+
+int loop()
+{
+    int count = 1, batched;
+    double single, batch;
+
+    batched = mapper_device_set_batch_send(source, 1);
+    if (!batched)
+        eprintf("Batched send not available, timing default mode only.\n");
+    eprintf("destinations    default usec    batched usec\n");
+
+    while (!done && count <= max_destinations) {
+        if (add_destinations(count))
+            return 1;
+
+        mapper_device_set_batch_send(source, 0);
+        single = time_frames();
+
+        received = 0;
+        mapper_device_set_batch_send(source, batched);
+        batch = time_frames();
+        poll_all(10);
+        if (!received) {
+            eprintf("No updates received.\n");
+            return 1;
+        }
+
+        eprintf("%12d  %14.2f  %14.2f\n", count, single, batch);
+        count *= 2;
+    }
+    return 0;
+}
+
+void ctrlc(int sig)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testfanout.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    // use a smaller run when terminating automatically
+    if (terminate) {
+        max_destinations = 16;
+        iterations = 200;
+    }
+
+    if (setup_source()) {
+        eprintf("Error initializing source.\n");
+        result = 1;
+        goto done;
+    }
+
+    result = loop();
+
+  done:
+    cleanup_devices();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
@@ -0,0 +1,272 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <signal.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define MAX_ACTIVE 1024
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+
+mapper_device source = 0;
+mapper_device destination = 0;
+mapper_signal sendsig = 0;
+mapper_signal recvsig = 0;
+
+int max_active = MAX_ACTIVE;
+int iterations = 20;
+int received = 0;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mapper_signal sig, mapper_id instance, const void *value,
+             int count, mapper_timetag_t *timetag)
+{
+    if (value)
+        ++received;
+}
+
+int setup_devices()
+{
+    float mn = 0, mx = 1;
+
+    source = mapper_device_new("testinstanceids-send", 0, 0);
+    destination = mapper_device_new("testinstanceids-recv", 0, 0);
+    if (!source || !destination)
+        return 1;
+
+    sendsig = mapper_device_add_output_signal(source, "outsig", 1, 'f', 0,
+                                              &mn, &mx);
+    recvsig = mapper_device_add_input_signal(destination, "insig", 1, 'f', 0,
+                                             &mn, &mx, handler, 0);
+    if (!sendsig || !recvsig)
+        return 1;
+
+    // reserve enough instances on both sides to avoid stealing
+    mapper_signal_reserve_instances(sendsig, MAX_ACTIVE - 1, 0, 0);
+    mapper_signal_reserve_instances(recvsig, MAX_ACTIVE - 1, 0, 0);
+
+    while (!done && !(mapper_device_ready(source)
+                      && mapper_device_ready(destination))) {
+        mapper_device_poll(source, 25);
+        mapper_device_poll(destination, 25);
+    }
+    eprintf("devices ready.\n");
+    return 0;
+}
+
+void cleanup_devices()
+{
+    if (destination) {
+        eprintf("Freeing destination.. ");
+        fflush(stdout);
+        mapper_device_free(destination);
+        eprintf("ok\n");
+    }
+    if (source) {
+        eprintf("Freeing source.. ");
+        fflush(stdout);
+        mapper_device_free(source);
+        eprintf("ok\n");
+    }
+}
+
+int setup_maps()
+{
+    mapper_map map = mapper_map_new(1, &sendsig, 1, &recvsig);
+    // read the input history so that every update touches the slot histories
+    mapper_map_set_mode(map, MAPPER_MODE_EXPRESSION);
+    mapper_map_set_expression(map, "y=(x+x{-1})*0.5");
+    mapper_map_push(map);
+
+    // wait until mapping has been established
+    while (!done && !mapper_map_ready(map)) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+    }
+    eprintf("map ready.\n");
+    return done;
+}
+
+/*! Time updates to 'num_active' instances, returning usec per update.  The
+ *  source looks up each instance by local id and the destination by global
+ *  id, so both lookups scale with the number of active instances. */
+double time_updates(int num_active)
+{
+    int i, j;
+    float value;
+    double elapsed = 0, then;
+
+    for (i = 0; i < iterations && !done; i++) {
+        then = current_time();
+        for (j = 0; j < num_active; j++) {
+            value = (float)j / num_active;
+            mapper_signal_instance_update(sendsig, j, &value, 1, MAPPER_NOW);
+        }
+        elapsed += current_time() - then;
+
+        then = current_time();
+        while (mapper_device_poll(destination, 0)) {}
+        elapsed += current_time() - then;
+    }
+    return elapsed * 1000000. / (iterations * num_active);
+}
+
+/*! As time_updates(), but updating all instances with a single call to
+ *  mapper_signal_instances_update(). */
+double time_batched_updates(int num_active)
+{
+    int i, j;
+    mapper_id ids[MAX_ACTIVE];
+    float values[MAX_ACTIVE];
+    double elapsed = 0, then;
+
+    for (j = 0; j < num_active; j++) {
+        ids[j] = j;
+        values[j] = (float)j / num_active;
+    }
+
+    for (i = 0; i < iterations && !done; i++) {
+        then = current_time();
+        mapper_signal_instances_update(sendsig, ids, values, num_active,
+                                       MAPPER_NOW);
+        elapsed += current_time() - then;
+
+        then = current_time();
+        while (mapper_device_poll(destination, 0)) {}
+        elapsed += current_time() - then;
+    }
+    return elapsed * 1000000. / (iterations * num_active);
+}
+
+/*! Time releasing and reactivating each of 'num_active' instances, as with
+ *  short-lived voices, returning usec per release and reactivation. */
+double time_churn(int num_active)
+{
+    int i, j;
+    float value = 0.5f;
+    double then = current_time();
+
+    for (i = 0; i < iterations && !done; i++) {
+        for (j = 0; j < num_active; j++) {
+            mapper_signal_instance_release(sendsig, j, MAPPER_NOW);
+            mapper_signal_instance_update(sendsig, j, &value, 1, MAPPER_NOW);
+        }
+        while (mapper_device_poll(destination, 0)) {}
+    }
+    return (current_time() - then) * 1000000. / (iterations * num_active);
+}
+
+void release_all(int num_active)
+{
+    int i;
+    for (i = 0; i < num_active; i++)
+        mapper_signal_instance_release(sendsig, i, MAPPER_NOW);
+    for (i = 0; i < 10; i++)
+        mapper_device_poll(destination, 10);
+}
+
+int loop()
+{
+    int num_active = 1, active;
+    double usec, batched, churn;
+
+    eprintf("instances    usec per update    batched    usec per churn    "
+            "received\n");
+    while (!done && num_active <= max_active) {
+        received = 0;
+        usec = time_updates(num_active);
+        batched = time_batched_updates(num_active);
+        churn = time_churn(num_active);
+        active = mapper_signal_num_active_instances(recvsig);
+        eprintf("%9d  %17.3f  %9.3f  %16.3f  %10d\n", num_active, usec,
+                batched, churn, received);
+        if (!received || active != num_active) {
+            eprintf("Expected %d active instances at destination, found %d.\n",
+                    num_active, active);
+            return 1;
+        }
+        release_all(num_active);
+        num_active *= 2;
+    }
+    return 0;
+}
+
+void ctrlc(int sig)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testinstanceids.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    // use a smaller run when terminating automatically
+    if (terminate) {
+        max_active = 256;
+        iterations = 5;
+    }
+
+    if (setup_devices()) {
+        eprintf("Error initializing devices.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (setup_maps()) {
+        eprintf("Error initializing maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    result = loop();
+
+  done:
+    cleanup_devices();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
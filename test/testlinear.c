@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/time.h>
 
 #ifdef WIN32
 #define usleep(x) Sleep(x/1000)
@@ -25,9 +26,23 @@ mapper_device source = 0;
 mapper_device destination = 0;
 mapper_signal sendsig = 0;
 mapper_signal recvsig = 0;
+mapper_signal sendvec = 0;
+mapper_signal recvvec = 0;
+mapper_map vecmap = 0;
+
+#define VEC_LENGTH 64
 
 int sent = 0;
 int received = 0;
+int iterations = 100000;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
 
 int setup_source(char *iface)
 {
@@ -39,6 +54,8 @@ int setup_source(char *iface)
     int mn=0, mx=1;
     sendsig = mapper_device_add_output_signal(source, "outsig", 1, 'i', 0,
                                               &mn, &mx);
+    sendvec = mapper_device_add_output_signal(source, "outvec", VEC_LENGTH,
+                                              'f', 0, 0, 0);
 
     eprintf("Output signal 'outsig' registered.\n");
     eprintf("Number of outputs: %d\n",
@@ -78,6 +95,8 @@ int setup_destination(char *iface)
     float mn=0, mx=1;
     recvsig = mapper_device_add_input_signal(destination, "insig", 1, 'f', 0,
                                              &mn, &mx, insig_handler, 0);
+    recvvec = mapper_device_add_input_signal(destination, "invec", VEC_LENGTH,
+                                             'f', 0, 0, 0, 0, 0);
 
     eprintf("Input signal 'insig' registered.\n");
     eprintf("Number of inputs: %d\n",
@@ -100,6 +119,7 @@ void cleanup_destination()
 
 int setup_maps()
 {
+    int i;
     float src_min = 0.f, src_max = 100.f, dest_min = -10.f, dest_max = 10.f;
 
     mapper_map map = mapper_map_new(1, &sendsig, 1, &recvsig);
@@ -116,8 +136,27 @@ int setup_maps()
 
     mapper_map_push(map);
 
+    // a wide linear map for timing the linear kernel
+    float vec_src_min[VEC_LENGTH], vec_src_max[VEC_LENGTH];
+    float vec_dest_min[VEC_LENGTH], vec_dest_max[VEC_LENGTH];
+    for (i = 0; i < VEC_LENGTH; i++) {
+        vec_src_min[i] = 0.f;
+        vec_src_max[i] = 1.f + i;
+        vec_dest_min[i] = -1.f * i;
+        vec_dest_max[i] = 10.f;
+    }
+    vecmap = mapper_map_new(1, &sendvec, 1, &recvvec);
+    mapper_map_set_mode(vecmap, MAPPER_MODE_LINEAR);
+    slot = mapper_map_slot(vecmap, MAPPER_LOC_SOURCE, 0);
+    mapper_slot_set_minimum(slot, VEC_LENGTH, 'f', vec_src_min);
+    mapper_slot_set_maximum(slot, VEC_LENGTH, 'f', vec_src_max);
+    slot = mapper_map_slot(vecmap, MAPPER_LOC_DESTINATION, 0);
+    mapper_slot_set_minimum(slot, VEC_LENGTH, 'f', vec_dest_min);
+    mapper_slot_set_maximum(slot, VEC_LENGTH, 'f', vec_dest_max);
+    mapper_map_push(vecmap);
+
     // Wait until mapping has been established
-    while (!done && !mapper_map_ready(map)) {
+    while (!done && !(mapper_map_ready(map) && mapper_map_ready(vecmap))) {
         mapper_device_poll(source, 10);
         mapper_device_poll(destination, 10);
     }
@@ -154,6 +193,52 @@ void loop()
     }
 }
 
+/*! Time evaluation of the wide linear map with and without the linear
+ *  kernel, checking that both produce the same values. */
+int time_linear_kernel()
+{
+    int i, enabled;
+    float value[VEC_LENGTH], results[2][VEC_LENGTH];
+    char types[VEC_LENGTH];
+    double elapsed[2], then;
+
+    if (!vecmap->local || !vecmap->local->expr) {
+        eprintf("Linear map is not processed locally, skipping timing.\n");
+        return 0;
+    }
+
+    mapper_slot slot = vecmap->sources[0];
+    for (i = 0; i < VEC_LENGTH; i++)
+        value[i] = (float)i * 0.5f;
+    mapper_signal_update(sendvec, value, 1, MAPPER_NOW);
+
+    for (enabled = 0; enabled < 2; enabled++) {
+        mapper_map_enable_linear_kernel(enabled);
+        then = current_time();
+        for (i = 0; i < iterations; i++)
+            mapper_map_perform(vecmap, slot, 0, types);
+        elapsed[enabled] = current_time() - then;
+        memcpy(results[enabled],
+               mapper_history_value_ptr(vecmap->destination.local->history[0]),
+               sizeof(float) * VEC_LENGTH);
+    }
+    mapper_map_enable_linear_kernel(1);
+
+    eprintf("linear map of length %d: expression %.1f ns, kernel %.1f ns\n",
+            VEC_LENGTH, elapsed[0] * 1000000000. / iterations,
+            elapsed[1] * 1000000000. / iterations);
+
+    // the kernel must give exactly the values of the expression string
+    for (i = 0; i < VEC_LENGTH; i++) {
+        if (results[0][i] != results[1][i]) {
+            eprintf("mismatch at element %d: %g != %g\n", i, results[0][i],
+                    results[1][i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void ctrlc(int signal)
 {
     done = 1;
@@ -199,6 +284,10 @@ int main(int argc, char **argv)
 
     signal(SIGINT, ctrlc);
 
+    // use a shorter run when terminating automatically
+    if (terminate)
+        iterations = 10000;
+
     if (setup_destination(iface)) {
         eprintf("Error initializing destination.\n");
         result = 1;
@@ -221,6 +310,11 @@ int main(int argc, char **argv)
 
     loop();
 
+    if (autoconnect && time_linear_kernel()) {
+        eprintf("Linear kernel FAILED.\n");
+        result = 1;
+    }
+
     if (sent != received) {
         eprintf("Not all sent messages were received.\n");
         eprintf("Updated value %d time%s, but received %d of them.\n",
@@ -28,6 +28,7 @@ float src_float[] = {1.0f, 2.0f, 3.0f}, dest_float[DEST_ARRAY_LEN];
 double src_double[] = {1.0, 2.0, 3.0}, dest_double[DEST_ARRAY_LEN];
 double then, now;
 double total_elapsed_time = 0;
+double total_interpreted_time = 0;
 char typestring[3];
 
 mapper_timetag_t tt_in = {0, 0}, tt_out = {0, 0};
@@ -152,6 +153,51 @@ void setup_test(char in_type, int in_length, void *in_value,
                            out_length, out_value);
 }
 
+/*! Re-run the current expression from a clean state with the token
+ *  interpreter, returning non-zero if the output differs from the compiled
+ *  evaluation. */
+int compare_interpreted()
+{
+    int i, compiled_position = outh.position;
+    int compiled_int[DEST_ARRAY_LEN];
+    float compiled_float[DEST_ARRAY_LEN];
+    double compiled_double[DEST_ARRAY_LEN];
+    char compiled_types[3];
+
+    memcpy(compiled_int, dest_int, sizeof(dest_int));
+    memcpy(compiled_float, dest_float, sizeof(dest_float));
+    memcpy(compiled_double, dest_double, sizeof(dest_double));
+    memcpy(compiled_types, typestring, sizeof(typestring));
+
+    // reset output and user variable histories
+    for (i = 0; i < DEST_ARRAY_LEN; i++) {
+        dest_int[i] = 0;
+        dest_float[i] = 0.0f;
+        dest_double[i] = 0.0;
+    }
+    outh.position = -1;
+    for (i = 0; i < e->num_variables; i++) {
+        memset(user_vars[i].value, 0, user_vars[i].size * sizeof(double));
+        user_vars[i].position = -1;
+    }
+
+    then = current_time();
+    i = iterations;
+    while (i--) {
+        mapper_expr_evaluate(e, inh_p, &user_vars_p, &outh, &tt_in, typestring);
+    }
+    now = current_time();
+    eprintf("Interpreted: %g seconds (%g ns per evaluation).\n", now-then,
+            (now-then) * 1000000000. / iterations);
+    total_interpreted_time += now-then;
+
+    return (outh.position != compiled_position
+            || memcmp(compiled_int, dest_int, sizeof(dest_int))
+            || memcmp(compiled_float, dest_float, sizeof(dest_float))
+            || memcmp(compiled_double, dest_double, sizeof(dest_double))
+            || memcmp(compiled_types, typestring, sizeof(typestring)));
+}
+
 #define EXPECT_SUCCESS 0
 #define EXPECT_FAILURE 1
 
@@ -216,7 +262,8 @@ int parse_and_eval(int expectation)
         mapper_expr_evaluate(e, inh_p, &user_vars_p, &outh, &tt_in, typestring);
     }
     now = current_time();
-    eprintf("%g seconds.\n", now-then);
+    eprintf("%g seconds (%g ns per evaluation).\n", now-then,
+            (now-then) * 1000000000. / iterations);
     total_elapsed_time += now-then;
 
     if (verbose) {
@@ -227,6 +274,13 @@ int parse_and_eval(int expectation)
     else
         printf(".");
 
+    // repeat using the token interpreter and compare results
+    if (mapper_expr_use_compiled(e, 0) && compare_interpreted()) {
+        eprintf("Interpreted result does not match.\n");
+        mapper_expr_free(e);
+        goto fail;
+    }
+
     mapper_expr_free(e);
 
     return expectation != EXPECT_SUCCESS;
@@ -657,8 +711,8 @@ int main(int argc, char **argv)
     eprintf("**********************************\n");
     printf("...............Test %s ", result ? "FAILED" : "PASSED");
     if (!result)
-        printf("(%f seconds, %d tokens).\n",
-               total_elapsed_time, token_count);
+        printf("(%f seconds, %d tokens, %f seconds interpreted).\n",
+               total_elapsed_time, token_count, total_interpreted_time);
     else
         printf(".\n");
 }
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <lo/lo_lowlevel.h>
+#include "../src/mapper_internal.h"
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define SIGNALS_PER_DEVICE 100
+#define NUM_UNITS 50
+#define NUM_MAPS 4
+
+int verbose = 1;
+int terminate = 0;
+
+int sizes[] = {10000, 40000, 100000};
+int num_sizes = sizeof(sizes) / sizeof(int);
+
+mapper_network net = 0;
+mapper_database db = 0;
+mapper_signal *signals = 0;
+int num_signals;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*! Build a parsed property message containing a unit and a rate.  The
+ *  lo_message must be freed after the parsed message. */
+static mapper_message signal_props(lo_message *lom, const char *unit,
+                                   float rate)
+{
+    *lom = lo_message_new();
+    lo_message_add_string(*lom, "@unit");
+    lo_message_add_string(*lom, unit);
+    lo_message_add_string(*lom, "@rate");
+    lo_message_add_float(*lom, rate);
+    return mapper_message_parse_properties(lo_message_get_argc(*lom),
+                                           lo_message_get_types(*lom),
+                                           lo_message_get_argv(*lom));
+}
+
+static void unit_name(char *str, int i)
+{
+    snprintf(str, 16, "unit%d", i % NUM_UNITS);
+}
+
+/*! Populate the database with 'count' signals spread across devices, with
+ *  units cycling through NUM_UNITS values and rates from 0 to 999. */
+int populate(int count)
+{
+    int i;
+    char devname[32], signame[32], unit[16];
+    lo_message lom;
+    mapper_message msg;
+
+    net = mapper_network_new(0, 0, 0);
+    if (!net)
+        return 1;
+    db = &net->database;
+
+    num_signals = count;
+    signals = (mapper_signal*)malloc(sizeof(mapper_signal) * num_signals);
+
+    for (i = 0; i < num_signals; i++) {
+        snprintf(devname, 32, "testpropindex.%d", i / SIGNALS_PER_DEVICE + 1);
+        snprintf(signame, 32, "sig%d", i % SIGNALS_PER_DEVICE);
+        unit_name(unit, i);
+        msg = signal_props(&lom, unit, (i * 7) % 1000);
+        signals[i] = mapper_database_add_or_update_signal(db, signame, devname,
+                                                          msg);
+        mapper_message_free(msg);
+        lo_message_free(lom);
+        if (!signals[i])
+            return 1;
+    }
+    return 0;
+}
+
+void depopulate()
+{
+    if (net)
+        mapper_network_free(net);
+    net = 0;
+    db = 0;
+    free(signals);
+    signals = 0;
+}
+
+/*! Sum the addresses of query results so that result sets can be compared
+ *  independently of their order. */
+static int query_checksum(mapper_signal *query, uintptr_t *sum)
+{
+    int count = 0;
+    *sum = 0;
+    while (query) {
+        *sum += (uintptr_t)*query;
+        ++count;
+        query = mapper_signal_query_next(query);
+    }
+    return count;
+}
+
+/*! Run a set of property queries and return the elapsed time per query in
+ *  microseconds.  Result counts and checksums are written to the arrays. */
+static double run_queries(int *counts, uintptr_t *sums)
+{
+    int i, n = 0;
+    char unit[16];
+    float rate;
+    mapper_signal *q;
+    double then = current_time();
+
+    for (i = 0; i < NUM_UNITS; i++, n++) {
+        unit_name(unit, i);
+        q = mapper_database_signals_by_property(db, "@unit", 1, 's', unit,
+                                                MAPPER_OP_EQUAL);
+        counts[n] = query_checksum(q, &sums[n]);
+    }
+    for (i = 0; i < NUM_UNITS; i++, n++) {
+        rate = i * 20 + 0.5;
+        q = mapper_database_signals_by_property(db, "@rate", 1, 'f', &rate,
+                                                MAPPER_OP_LESS_THAN);
+        counts[n] = query_checksum(q, &sums[n]);
+    }
+    for (i = 0; i < NUM_UNITS; i++, n++) {
+        rate = 990 - i;
+        q = mapper_database_signals_by_property(db, "@rate", 1, 'f', &rate,
+                                                MAPPER_OP_GREATER_THAN_OR_EQUAL);
+        counts[n] = query_checksum(q, &sums[n]);
+    }
+    return (current_time() - then) * 1000000. / n;
+}
+
+/*! Check that an indexed query follows a signal whose unit changes. */
+int check_updates()
+{
+    lo_message lom;
+    mapper_message msg;
+    mapper_signal sig = signals[0];
+    const char *unit = "updated";
+
+    msg = signal_props(&lom, unit, 0);
+    mapper_database_add_or_update_signal(db, sig->name, sig->device->name, msg);
+    mapper_message_free(msg);
+    lo_message_free(lom);
+
+    mapper_signal *q = mapper_database_signals_by_property(db, "@unit", 1, 's',
+                                                           unit,
+                                                           MAPPER_OP_EQUAL);
+    if (!q || *q != sig || mapper_signal_query_next(q)) {
+        eprintf("Indexed query did not follow updated unit.\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*! Check that a live query holds exactly the signals with a given unit. */
+static int check_live_results(mapper_live_query live, const char *unit)
+{
+    int i, count = 0, num_results = mapper_live_query_num_results(live);
+    mapper_signal *q = mapper_database_signals_by_property(db, "@unit", 1, 's',
+                                                           unit,
+                                                           MAPPER_OP_EQUAL);
+    while (q) {
+        for (i = 0; i < num_results; i++) {
+            if (mapper_live_query_result(live, i) == *q)
+                break;
+        }
+        if (i == num_results) {
+            mapper_signal_query_done(q);
+            return 1;
+        }
+        ++count;
+        q = mapper_signal_query_next(q);
+    }
+    return count != num_results;
+}
+
+/*! Check that a live query follows modified and removed signals, returning
+ *  the time taken to read its results in microseconds, or -1 on failure. */
+static double check_live_query()
+{
+    int i;
+    char unit[16];
+    lo_message lom;
+    mapper_message msg;
+
+    unit_name(unit, 3);
+    mapper_live_query live = mapper_database_new_live_query(db,
+                                                            MAPPER_OBJ_SIGNALS,
+                                                            "@unit", 1, 's',
+                                                            unit,
+                                                            MAPPER_OP_EQUAL);
+    if (!live || check_live_results(live, unit)) {
+        eprintf("Live query initial results are incorrect.\n");
+        return -1;
+    }
+
+    double then = current_time();
+    for (i = 0; i < mapper_live_query_num_results(live); i++)
+        mapper_live_query_result(live, i);
+    double elapsed = (current_time() - then) * 1000000.;
+
+    // move some signals into and out of the result set
+    for (i = 1; i <= NUM_UNITS * 4; i++) {
+        msg = signal_props(&lom, i % 2 ? unit : "other", 0);
+        mapper_database_add_or_update_signal(db, signals[i]->name,
+                                             signals[i]->device->name, msg);
+        mapper_message_free(msg);
+        lo_message_free(lom);
+    }
+    if (check_live_results(live, unit)) {
+        eprintf("Live query did not follow modified signals.\n");
+        return -1;
+    }
+
+    mapper_database_remove_device(db, signals[0]->device, MAPPER_REMOVED, 1);
+    if (check_live_results(live, unit)) {
+        eprintf("Live query did not follow removed signals.\n");
+        return -1;
+    }
+    mapper_live_query_free(live);
+    return elapsed;
+}
+
+/*! Count the maps of a database processed at 'loc', both by scanning and
+ *  using the index, returning non-zero if the counts differ. */
+static int check_location_query(mapper_database db, mapper_location loc)
+{
+    int scanned = 0, indexed = 0;
+    mapper_map *q = mapper_database_maps(db);
+    while (q) {
+        scanned += (*q)->process_location == loc;
+        q = mapper_map_query_next(q);
+    }
+    q = mapper_database_maps_by_property(db, "@process_location", 1, 'i', &loc,
+                                         MAPPER_OP_EQUAL);
+    while (q) {
+        ++indexed;
+        q = mapper_map_query_next(q);
+    }
+    if (scanned != indexed) {
+        eprintf("Indexed query found %d maps processed at %s, expected %d.\n",
+                indexed, mapper_location_string(loc), scanned);
+        return 1;
+    }
+    return 0;
+}
+
+static void poll_devices(mapper_device a, mapper_device b, int count)
+{
+    while (count--) {
+        mapper_device_poll(a, 10);
+        mapper_device_poll(b, 10);
+    }
+}
+
+/*! Check that indexed map queries follow processing locations changed by
+ *  /map/modify messages, which are not set through the property table. */
+int check_map_locations()
+{
+    int i, result = 1;
+    char name[16];
+    mapper_signal outs[NUM_MAPS], ins[NUM_MAPS];
+    mapper_map maps[NUM_MAPS], *q;
+    mapper_device src = mapper_device_new("testpropindex-send", 0, 0);
+    mapper_device dst = mapper_device_new("testpropindex-recv", 0, 0);
+    if (!src || !dst)
+        goto done;
+    for (i = 0; i < NUM_MAPS; i++) {
+        snprintf(name, 16, "sig%d", i);
+        outs[i] = mapper_device_add_output_signal(src, name, 1, 'f', 0, 0, 0);
+        ins[i] = mapper_device_add_input_signal(dst, name, 1, 'f', 0, 0, 0,
+                                                0, 0);
+    }
+    while (!mapper_device_ready(src) || !mapper_device_ready(dst))
+        poll_devices(src, dst, 1);
+
+    for (i = 0; i < NUM_MAPS; i++) {
+        maps[i] = mapper_map_new(1, &outs[i], 1, &ins[i]);
+        mapper_map_push(maps[i]);
+    }
+    for (i = 0; i < NUM_MAPS; i++) {
+        while (!mapper_map_ready(maps[i]))
+            poll_devices(src, dst, 1);
+    }
+
+    mapper_database db = src->database;
+    if (mapper_database_add_property_index(db, MAPPER_OBJ_MAPS,
+                                           "@process_location")
+        || check_location_query(db, MAPPER_LOC_SOURCE))
+        goto done;
+
+    // move processing to the destination one map at a time, in list order
+    for (q = mapper_database_maps(db); q; q = mapper_map_query_next(q)) {
+        mapper_map_set_process_location(*q, MAPPER_LOC_DESTINATION);
+        mapper_map_push(*q);
+        for (i = 0; i < 100; i++) {
+            poll_devices(src, dst, 1);
+            if ((*q)->process_location == MAPPER_LOC_DESTINATION)
+                break;
+        }
+        if ((*q)->process_location != MAPPER_LOC_DESTINATION) {
+            eprintf("Processing location was not changed.\n");
+            mapper_map_query_done(q);
+            goto done;
+        }
+        if (check_location_query(db, MAPPER_LOC_SOURCE)
+            || check_location_query(db, MAPPER_LOC_DESTINATION)) {
+            mapper_map_query_done(q);
+            goto done;
+        }
+    }
+    result = 0;
+
+  done:
+    if (dst)
+        mapper_device_free(dst);
+    if (src)
+        mapper_device_free(src);
+    return result;
+}
+
+int run_tests()
+{
+    int i, j, counts[2][NUM_UNITS * 3];
+    uintptr_t sums[2][NUM_UNITS * 3];
+    double scan, indexed, live;
+
+    eprintf("signals   scan (us)  indexed (us)  live (us)\n");
+    for (i = 0; i < num_sizes; i++) {
+        if (populate(sizes[i])) {
+            eprintf("Error populating database.\n");
+            return 1;
+        }
+        scan = run_queries(counts[0], sums[0]);
+
+        if (!mapper_database_add_property_index(db, MAPPER_OBJ_SIGNALS,
+                                                "@num_maps")) {
+            eprintf("Bookkeeping property was accepted for indexing.\n");
+            return 1;
+        }
+        if (mapper_database_add_property_index(db, MAPPER_OBJ_SIGNALS, "@unit")
+            || mapper_database_add_property_index(db, MAPPER_OBJ_SIGNALS,
+                                                  "@rate")) {
+            eprintf("Error adding property indexes.\n");
+            return 1;
+        }
+        // first run includes building the indexes
+        run_queries(counts[1], sums[1]);
+        indexed = run_queries(counts[1], sums[1]);
+
+        for (j = 0; j < NUM_UNITS * 3; j++) {
+            if (counts[0][j] != counts[1][j] || sums[0][j] != sums[1][j]) {
+                eprintf("Indexed query %d returned %d results, expected %d.\n",
+                        j, counts[1][j], counts[0][j]);
+                return 1;
+            }
+        }
+        if (check_updates() || (live = check_live_query()) < 0)
+            return 1;
+        eprintf("%7d  %10.1f  %12.1f  %9.1f\n", sizes[i], scan, indexed, live);
+
+        mapper_database_remove_property_index(db, MAPPER_OBJ_SIGNALS, "@rate");
+        depopulate();
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testpropindex.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    // use only the smallest database when terminating automatically
+    if (terminate)
+        num_sizes = 1;
+
+    result = run_tests();
+    depopulate();
+    if (!result)
+        result = check_map_locations();
+
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
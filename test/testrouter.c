@@ -0,0 +1,205 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <lo/lo.h>
+#include <unistd.h>
+#include <signal.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+
+mapper_device source = 0;
+mapper_device destination = 0;
+mapper_signal *sendsigs = 0;
+mapper_signal *recvsigs = 0;
+int num_signals = 0;
+
+int max_signals = 2048;
+int iterations = 10000;
+
+double results[32];
+int num_results = 0;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int setup_devices()
+{
+    source = mapper_device_new("testrouter-send", 0, 0);
+    destination = mapper_device_new("testrouter-recv", 0, 0);
+    if (!source || !destination)
+        return 1;
+
+    sendsigs = (mapper_signal*)calloc(1, sizeof(mapper_signal) * max_signals);
+    recvsigs = (mapper_signal*)calloc(1, sizeof(mapper_signal) * max_signals);
+
+    while (!done && !(mapper_device_ready(source)
+                      && mapper_device_ready(destination))) {
+        mapper_device_poll(source, 25);
+        mapper_device_poll(destination, 25);
+    }
+    eprintf("devices ready.\n");
+    return 0;
+}
+
+void cleanup_devices()
+{
+    if (destination) {
+        eprintf("Freeing destination.. ");
+        fflush(stdout);
+        mapper_device_free(destination);
+        eprintf("ok\n");
+    }
+    if (source) {
+        eprintf("Freeing source.. ");
+        fflush(stdout);
+        mapper_device_free(source);
+        eprintf("ok\n");
+    }
+    if (sendsigs)
+        free(sendsigs);
+    if (recvsigs)
+        free(recvsigs);
+}
+
+/*! Add and map signal pairs until we have 'count' of them. */
+int add_maps(int count)
+{
+    char name[32];
+    int i, first = num_signals;
+    mapper_map *maps = (mapper_map*)malloc(sizeof(mapper_map) * count);
+
+    for (i = num_signals; i < count; i++) {
+        snprintf(name, 32, "out%d", i);
+        sendsigs[i] = mapper_device_add_output_signal(source, name, 1, 'f', 0,
+                                                      0, 0);
+        snprintf(name, 32, "in%d", i);
+        recvsigs[i] = mapper_device_add_input_signal(destination, name, 1, 'f',
+                                                     0, 0, 0, 0, 0);
+        maps[i] = mapper_map_new(1, &sendsigs[i], 1, &recvsigs[i]);
+        mapper_map_push(maps[i]);
+    }
+    num_signals = count;
+
+    // wait until all maps have been established
+    int ready = 0;
+    while (!done && ready < count - first) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+        ready = 0;
+        for (i = first; i < count; i++)
+            ready += mapper_map_ready(maps[i]);
+    }
+    free(maps);
+    return done;
+}
+
+/*! Time updates of the first mapped signal, which used to be found at the
+ *  tail of the router's signal list. */
+double time_updates()
+{
+    int i;
+    float value = 0;
+    double elapsed = 0, then;
+    for (i = 0; i < iterations && !done; i++) {
+        value = (float)i;
+        then = current_time();
+        mapper_signal_update(sendsigs[0], &value, 1, MAPPER_NOW);
+        elapsed += current_time() - then;
+
+        // drain destination socket periodically
+        if (i % 100 == 0)
+            mapper_device_poll(destination, 0);
+    }
+    return elapsed / iterations;
+}
+
+void loop()
+{
+    int count = 1;
+    while (!done && count <= max_signals) {
+        if (add_maps(count))
+            break;
+        results[num_results] = time_updates();
+        eprintf("%5d mapped signals: %f usec per update\n", count,
+                results[num_results] * 1000000.);
+        ++num_results;
+        count *= 4;
+    }
+}
+
+void ctrlc(int sig)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testrouter.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    // use a smaller run when terminating automatically
+    if (terminate) {
+        max_signals = 256;
+        iterations = 1000;
+    }
+
+    if (setup_devices()) {
+        eprintf("Error initializing devices.\n");
+        result = 1;
+        goto done;
+    }
+
+    loop();
+
+    if (verbose && num_results > 1) {
+        printf("\nper-update cost ratio (largest/smallest): %f\n",
+               results[num_results-1] / results[0]);
+    }
+
+  done:
+    cleanup_devices();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
@@ -0,0 +1,311 @@
+#include <../src/mapper_internal.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define MAX_LENGTH 1024
+
+int verbose = 1;
+int terminate = 0;
+int iterations = 20000;
+
+int lengths[] = {1, 2, 4, 8, 16, 64, 256, 512, 1024};
+int num_lengths = sizeof(lengths) / sizeof(int);
+
+/* Vector functions reduce to a single element, so their output is scalar. */
+struct {
+    const char *str;
+    int reduces;
+} expressions[] = {
+    { "y=x*2.5+x",                  0 },
+    { "y=(x>0.5)*x",                0 },
+    { "y=sqrt(abs(x))",             0 },
+    { "y=max(x,0.25)",              0 },
+    { "y=sum(x)",                   1 },
+    { "y=mean(x)",                  1 },
+    { "y=max(x)-min(x)",            1 },
+    { "y=any(x>2)+all(x)",          1 },
+};
+int num_expressions = sizeof(expressions) / sizeof(expressions[0]);
+
+/* Expressions mixing types, history and indexing, which must move values
+ * between registers and memory in natural element order. */
+struct {
+    const char *str;
+    char in_type;
+    char out_type;
+    int length;
+} mixed_expressions[] = {
+    { "y=x*2.5",                            'f', 'd', 8  },
+    { "y=x*2.5",                            'd', 'f', 19 },
+    { "y=x-x{-1}",                          'f', 'f', 8  },
+    { "y=x-x{-1}",                          'f', 'd', 16 },
+    { "y=x-x{-2}*0.5",                      'd', 'f', 19 },
+    { "y=x+y{-1}*0.5",                      'f', 'f', 16 },
+    { "y=x+y{-1}*0.5",                      'd', 'f', 8  },
+    { "y=x[1:8]*2",                         'f', 'f', 8  },
+    { "y=x[2:9]+x[0:7]",                    'f', 'd', 8  },
+    { "y=x+[1,2,3,4,5,6,7,8]",              'f', 'f', 8  },
+    { "y=x*[1,2,3,4,5,6,7,8]+y{-1}",        'f', 'd', 8  },
+};
+int num_mixed = sizeof(mixed_expressions) / sizeof(mixed_expressions[0]);
+
+#define MIXED_HISTORY 4
+#define MIXED_EVALUATIONS 6
+
+float src_float[MAX_LENGTH], dest_float[MAX_LENGTH], ref_float[MAX_LENGTH];
+double src_double[MAX_LENGTH], dest_double[MAX_LENGTH], ref_double[MAX_LENGTH];
+char typestring[MAX_LENGTH];
+
+mapper_timetag_t tt_in = {0, 0}, tt_out = {0, 0};
+mapper_history_t inh, outh;
+mapper_history inh_p = &inh;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void setup_histories(char type, int in_length, int out_length)
+{
+    inh.type = outh.type = type;
+    inh.length = in_length;
+    outh.length = out_length;
+    inh.size = outh.size = 1;
+    inh.position = 0;
+    outh.position = -1;
+    inh.timetag = &tt_in;
+    outh.timetag = &tt_out;
+    if (type == 'f') {
+        inh.value = src_float;
+        outh.value = dest_float;
+    }
+    else {
+        inh.value = src_double;
+        outh.value = dest_double;
+    }
+}
+
+/*! Time evaluation of an expression, returning nanoseconds per evaluation or
+ *  a negative value if the expression could not be parsed. */
+double time_expression(const char *str, char type, int length, int out_length)
+{
+    int i;
+    double then;
+    setup_histories(type, length, out_length);
+    mapper_expr e = mapper_expr_new_from_string(str, 1, &type, &length, type,
+                                                out_length);
+    if (!e)
+        return -1;
+
+    then = current_time();
+    for (i = 0; i < iterations; i++)
+        mapper_expr_evaluate(e, &inh_p, 0, &outh, &tt_in, typestring);
+    then = current_time() - then;
+
+    mapper_expr_free(e);
+    return then * 1000000000. / iterations;
+}
+
+/*! Reductions may be summed in a different order, so allow for rounding. */
+int compare(char type, int length)
+{
+    int i;
+    for (i = 0; i < length; i++) {
+        double a = (type == 'f') ? dest_float[i] : dest_double[i];
+        double b = (type == 'f') ? ref_float[i] : ref_double[i];
+        if (fabs(a - b) > fabs(b) * 0.0001 + 0.0001) {
+            eprintf("mismatch at element %d: %g != %g\n", i, a, b);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*! Evaluate an expression several times over input and output histories,
+ *  leaving the output history in 'out'.  Returns non-zero if the expression
+ *  could not be parsed. */
+int evaluate_mixed(int index, void *out)
+{
+    int i, j, in_length, out_length;
+    char in_type = mixed_expressions[index].in_type;
+    char out_type = mixed_expressions[index].out_type;
+    mapper_timetag_t in_tt[MIXED_HISTORY], out_tt[MIXED_HISTORY];
+    mapper_history_t in, result;
+    mapper_history in_p = &in;
+
+    out_length = mixed_expressions[index].length;
+    in_length = out_length + (strchr(mixed_expressions[index].str, '[')
+                              && strchr(mixed_expressions[index].str, ':')
+                              ? 2 : 0);
+
+    mapper_expr e = mapper_expr_new_from_string(mixed_expressions[index].str,
+                                                1, &in_type, &in_length,
+                                                out_type, out_length);
+    if (!e)
+        return 1;
+
+    memset(in_tt, 0, sizeof(in_tt));
+    memset(out_tt, 0, sizeof(out_tt));
+    memset(out, 0, sizeof(double) * MIXED_HISTORY * MAX_LENGTH);
+    in.type = in_type;
+    in.length = in_length;
+    in.size = MIXED_HISTORY;
+    in.position = -1;
+    in.timetag = in_tt;
+    in.value = in_type == 'f' ? (void*)src_float : (void*)src_double;
+    result.type = out_type;
+    result.length = out_length;
+    result.size = MIXED_HISTORY;
+    result.position = -1;
+    result.timetag = out_tt;
+    result.value = out;
+
+    for (i = 0; i < MIXED_EVALUATIONS; i++) {
+        in.position = (in.position + 1) % MIXED_HISTORY;
+        for (j = 0; j < in_length; j++) {
+            double v = (double)((j * 37 + i * 11) % 100) * 0.04 + j;
+            if (in_type == 'f')
+                src_float[in.position * in_length + j] = v;
+            else
+                src_double[in.position * in_length + j] = v;
+        }
+        mapper_expr_evaluate(e, &in_p, 0, &result, &in_tt[in.position],
+                             typestring);
+    }
+    mapper_expr_free(e);
+    return 0;
+}
+
+/*! Compare SIMD and scalar evaluation of expressions mixing types, history
+ *  and vector indexing. */
+int run_mixed_tests()
+{
+    int i, j, length;
+    double simd[MIXED_HISTORY * MAX_LENGTH], scalar[MIXED_HISTORY * MAX_LENGTH];
+
+    for (i = 0; i < num_mixed; i++) {
+        eprintf("'%s' (%c -> %c, length %d)\n", mixed_expressions[i].str,
+                mixed_expressions[i].in_type, mixed_expressions[i].out_type,
+                mixed_expressions[i].length);
+        mapper_expr_enable_simd(0);
+        if (evaluate_mixed(i, scalar)) {
+            eprintf("Parser FAILED.\n");
+            return 1;
+        }
+        mapper_expr_enable_simd(1);
+        evaluate_mixed(i, simd);
+
+        // the whole output history must match, not only the latest sample
+        length = MIXED_HISTORY * mixed_expressions[i].length;
+        for (j = 0; j < length; j++) {
+            double a, b;
+            if (mixed_expressions[i].out_type == 'f') {
+                a = ((float*)simd)[j];
+                b = ((float*)scalar)[j];
+            }
+            else {
+                a = simd[j];
+                b = scalar[j];
+            }
+            if (a != b) {
+                eprintf("mismatch at element %d: %g != %g\n", j, a, b);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int run_tests()
+{
+    int i, j, k, out_length;
+    char types[] = {'f', 'd'};
+    double simd, scalar;
+
+    for (i = 0; i < MAX_LENGTH; i++) {
+        src_float[i] = (float)((i * 37) % 100) * 0.04f;
+        src_double[i] = (double)((i * 37) % 100) * 0.04;
+    }
+
+    for (i = 0; i < num_expressions; i++) {
+        for (j = 0; j < 2; j++) {
+            eprintf("\n'%s' (%s)\n", expressions[i].str,
+                    types[j] == 'f' ? "float" : "double");
+            eprintf("  length     scalar ns       simd ns    speedup\n");
+            for (k = 0; k < num_lengths; k++) {
+                out_length = expressions[i].reduces ? 1 : lengths[k];
+                mapper_expr_enable_simd(0);
+                scalar = time_expression(expressions[i].str, types[j],
+                                         lengths[k], out_length);
+                memcpy(ref_float, dest_float, sizeof(float) * out_length);
+                memcpy(ref_double, dest_double, sizeof(double) * out_length);
+
+                mapper_expr_enable_simd(1);
+                simd = time_expression(expressions[i].str, types[j],
+                                       lengths[k], out_length);
+                if (simd < 0 || scalar < 0) {
+                    eprintf("Parser FAILED.\n");
+                    return 1;
+                }
+                if (compare(types[j], out_length))
+                    return 1;
+                eprintf("%8d  %12.1f  %12.1f  %8.2fx\n", lengths[k], scalar,
+                        simd, scalar / simd);
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testsimd.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    // use a shorter run when terminating automatically
+    if (terminate)
+        iterations = 1000;
+
+    i = mapper_expr_enable_simd(1);
+    eprintf("SIMD kernels: %s\n", i == 2 ? "AVX2" : i == 1 ? "SSE2" : "none");
+
+    result = run_tests() || run_mixed_tests();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
@@ -5,6 +5,7 @@
 #include <math.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <lo/lo.h>
 #include <unistd.h>
 #include <signal.h>
@@ -34,8 +35,16 @@ int iterations = 100000;
 int counter = 0;
 int received = 0;
 int done = 0;
+int block_ms = 0;
+int batch_receive = 0;
+int path_aliases = 1;
+int in_process = 0;
+int shared_memory = 0;
 
+mapper_map map = 0;
 double times[100];
+double cpu[100];
+long wakeups[100];
 float value;
 
 void switch_modes();
@@ -49,6 +58,23 @@ static double current_time()
     return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
+/*! Count the number of times this process has blocked and been woken. */
+static long current_wakeups()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw;
+}
+
+/*! Get the processor time used by this process in seconds. */
+static double current_cpu()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+            + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0);
+}
+
 /*! Creation of a local source. */
 int setup_source()
 {
@@ -61,6 +87,7 @@ int setup_source()
     if (!sendsig)
         goto error;
     mapper_signal_reserve_instances(sendsig, 10, 0, 0);
+    mapper_device_set_in_process_delivery(source, in_process);
 
     eprintf("Output signal registered.\n");
     eprintf("Number of outputs: %d\n",
@@ -115,6 +142,12 @@ int setup_destination()
         goto error;
     mapper_signal_reserve_instances(recvsig, 10, 0, 0);
 
+    if (batch_receive && !mapper_device_set_batch_receive(destination, 1))
+        eprintf("Batched receive not available.\n");
+    mapper_device_set_path_aliases(destination, path_aliases);
+    if (shared_memory && !mapper_device_set_shared_memory(destination, 1))
+        eprintf("Shared memory transport not available.\n");
+
     eprintf("Input signal registered.\n");
     eprintf("Number of inputs: %d\n",
             mapper_device_num_signals(destination, MAPPER_DIR_INCOMING));
@@ -146,7 +179,7 @@ void wait_local_devices()
 
 void map_signals()
 {
-    mapper_map map = mapper_map_new(1, &sendsig, 1, &recvsig);
+    map = mapper_map_new(1, &sendsig, 1, &recvsig);
     mapper_map_set_mode(map, MAPPER_MODE_EXPRESSION);
     mapper_map_set_expression(map, "y=y{-1}+1");
     mapper_map_push(map);
@@ -170,6 +203,9 @@ void switch_modes()
     eprintf("MODE %i TRIAL %i COMPLETED...\n", mode, trial);
     received = 0;
     times[mode*numTrials+trial] = current_time() - times[mode*numTrials+trial];
+    wakeups[mode*numTrials+trial] = (current_wakeups()
+                                     - wakeups[mode*numTrials+trial]);
+    cpu[mode*numTrials+trial] = current_cpu() - cpu[mode*numTrials+trial];
     if (++trial >= numTrials) {
         eprintf("SWITCHING MODES...\n");
         trial = 0;
@@ -194,6 +230,8 @@ void switch_modes()
     }
 
     times[mode*numTrials+trial] = current_time();
+    wakeups[mode*numTrials+trial] = current_wakeups();
+    cpu[mode*numTrials+trial] = current_cpu();
 }
 
 void print_results()
@@ -206,11 +244,23 @@ void print_results()
         float bestTime = times[i*numTrials];
         for (j=0; j<numTrials; j++) {
             printf("trial %i: %i messages processed in %f seconds\n", j, iterations, times[i*numTrials+j]);
+            printf("         %.1f usec latency, %.0f wakeups/sec, "
+                   "%.2f usec cpu/msg\n",
+                   times[i*numTrials+j] * 1000000. / iterations,
+                   wakeups[i*numTrials+j] / times[i*numTrials+j],
+                   cpu[i*numTrials+j] * 1000000. / iterations);
             if (times[i*numTrials+j] < bestTime)
                 bestTime = times[i*numTrials+j];
         }
         printf("\nbest trial: %i messages in %f seconds\n", iterations, bestTime);
     }
+    printf("\nin-process delivery %s, shared memory transport %s\n",
+           in_process ? "enabled" : "disabled",
+           shared_memory ? "enabled" : "disabled");
+    if (map && map->sources[0]->local && map->sources[0]->local->msg_template.size)
+        printf("\n%d bytes per datagram, path aliases %s\n",
+               (int)map->sources[0]->local->msg_template.size,
+               path_aliases ? "enabled" : "disabled");
     printf("\n*****************************************************\n");
 }
 
@@ -218,7 +268,8 @@ int main(int argc, char **argv)
 {
     int i, j, result = 0;
 
-    // process flags for -v verbose, -h help
+    // process flags for -v verbose, -b blocking, -r batched receive,
+    // -p full signal paths, -d in-process delivery, -s shared memory, -h help
     for (i = 1; i < argc; i++) {
         if (argv[i] && argv[i][0] == '-') {
             int len = strlen(argv[i]);
@@ -227,12 +278,32 @@ int main(int argc, char **argv)
                     case 'h':
                         printf("testspeed.c: possible arguments "
                                "-q quiet (suppress output), "
+                               "-b block in mapper_device_poll(), "
+                               "-r batched receive, "
+                               "-p disable path aliases, "
+                               "-d in-process delivery, "
+                               "-s shared memory transport, "
                                "-h help\n");
                         return 1;
                         break;
                     case 'q':
                         verbose = 0;
                         break;
+                    case 'b':
+                        block_ms = 100;
+                        break;
+                    case 'r':
+                        batch_receive = 1;
+                        break;
+                    case 'p':
+                        path_aliases = 0;
+                        break;
+                    case 'd':
+                        in_process = 1;
+                        break;
+                    case 's':
+                        shared_memory = 1;
+                        break;
                     default:
                         break;
                 }
@@ -263,9 +334,11 @@ int main(int argc, char **argv)
     // start things off
     eprintf("STARTING TEST...\n");
     times[0] = current_time();
+    wakeups[0] = current_wakeups();
+    cpu[0] = current_cpu();
     mapper_signal_instance_update(sendsig, counter++, &value, 0, MAPPER_NOW);
     while (!done) {
-        mapper_device_poll(destination, 0);
+        mapper_device_poll(destination, block_ms);
         mapper_device_poll(source, 0);
     }
     goto done;
@@ -0,0 +1,297 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define VEC_LENGTH MAPPER_MAX_VECTOR_LEN
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+
+mapper_device source = 0;
+mapper_device destination = 0;
+mapper_signal sendsig = 0;
+mapper_signal recvsig = 0;
+
+int sent = 0;
+int received = 0;
+int mismatched = 0;
+float last_value = -1;
+int iterations = 1000;
+
+float vector[VEC_LENGTH];
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int setup_source()
+{
+    source = mapper_device_new("teststream-send", 0, 0);
+    if (!source)
+        goto error;
+    eprintf("source created.\n");
+
+    // updates must cross the network for the stream to be used
+    mapper_device_set_in_process_delivery(source, 0);
+
+    sendsig = mapper_device_add_output_signal(source, "outsig", VEC_LENGTH,
+                                              'f', 0, 0, 0);
+
+    eprintf("Output signal 'outsig' registered.\n");
+    return 0;
+
+  error:
+    return 1;
+}
+
+void cleanup_source()
+{
+    if (source) {
+        eprintf("Freeing source.. ");
+        fflush(stdout);
+        mapper_device_free(source);
+        eprintf("ok\n");
+    }
+}
+
+void insig_handler(mapper_signal sig, mapper_id instance, const void *value,
+                   int count, mapper_timetag_t *timetag)
+{
+    if (!value)
+        return;
+    const float *f = (const float*)value;
+    if (f[0] != f[VEC_LENGTH - 1])
+        ++mismatched;
+    last_value = f[0];
+    received++;
+}
+
+int setup_destination()
+{
+    destination = mapper_device_new("teststream-recv", 0, 0);
+    if (!destination)
+        goto error;
+    eprintf("destination created.\n");
+
+    recvsig = mapper_device_add_input_signal(destination, "insig", VEC_LENGTH,
+                                             'f', 0, 0, 0, insig_handler, 0);
+
+    eprintf("Input signal 'insig' registered.\n");
+    return 0;
+
+  error:
+    return 1;
+}
+
+void cleanup_destination()
+{
+    if (destination) {
+        eprintf("Freeing destination.. ");
+        fflush(stdout);
+        mapper_device_free(destination);
+        eprintf("ok\n");
+    }
+}
+
+void wait_ready()
+{
+    while (!done && !(mapper_device_ready(source)
+                      && mapper_device_ready(destination))) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+    }
+}
+
+/*! Find the source device's link to the destination device. */
+mapper_link find_link()
+{
+    int i;
+    const char *name = mapper_device_name(destination);
+    mapper_link *links = mapper_device_links(source, MAPPER_DIR_ANY);
+    while (links) {
+        for (i = 0; i < 2; i++) {
+            if (strcmp(mapper_device_name(mapper_link_device(*links, i)),
+                       name) == 0) {
+                mapper_link link = *links;
+                mapper_link_query_done(links);
+                return link;
+            }
+        }
+        links = mapper_link_query_next(links);
+    }
+    return 0;
+}
+
+int setup_stream()
+{
+    mapper_map map = mapper_map_new(1, &sendsig, 1, &recvsig);
+    mapper_map_push(map);
+
+    // Wait until mapping has been established
+    while (!done && !mapper_map_ready(map)) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+    }
+
+    mapper_link link = find_link();
+    if (!link) {
+        eprintf("Couldn't find link to destination.\n");
+        return 1;
+    }
+
+    mapper_link_set_property(link, "transport", 1, 's', "tcp", 1);
+    mapper_link_push(link);
+
+    // Wait until both ends have switched transport and the stream connects
+    mapper_link dlink = 0;
+    double then = current_time();
+    while (!done && current_time() - then < 5) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+        if (!link->local->use_stream)
+            continue;
+        if (!dlink) {
+            mapper_link *links = mapper_device_links(destination,
+                                                     MAPPER_DIR_ANY);
+            if (links) {
+                dlink = *links;
+                mapper_link_query_done(links);
+            }
+        }
+        if (!dlink || !dlink->local->use_stream)
+            continue;
+        // the stream is connected lazily by the first update
+        mapper_signal_update(sendsig, vector, 1, MAPPER_NOW);
+        ++sent;
+        if (link->local->stream_state == STREAM_CONNECTED)
+            return 0;
+    }
+    eprintf("Stream was not connected.\n");
+    return 1;
+}
+
+/*! Send vectors to the destination at about 1 kHz, returning the achieved
+ *  update rate. */
+double loop()
+{
+    int i, j;
+    double then = current_time();
+
+    eprintf("Sending %d updates of %d floats..\n", iterations, VEC_LENGTH);
+    for (i = 0; i < iterations && !done; i++) {
+        for (j = 0; j < VEC_LENGTH; j++)
+            vector[j] = sent;
+        mapper_signal_update(sendsig, vector, 1, MAPPER_NOW);
+        sent++;
+        mapper_device_poll(source, 0);
+        mapper_device_poll(destination, 1);
+    }
+    double rate = i / (current_time() - then);
+
+    // collect updates still in flight
+    then = current_time();
+    while (!done && received < sent && current_time() - then < 5) {
+        mapper_device_poll(source, 0);
+        mapper_device_poll(destination, 10);
+    }
+    return rate;
+}
+
+void ctrlc(int signal)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("teststream.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    // use a shorter run when terminating automatically
+    if (terminate)
+        iterations = 200;
+
+    if (setup_destination()) {
+        eprintf("Error initializing destination.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (setup_source()) {
+        eprintf("Error initializing source.\n");
+        result = 1;
+        goto done;
+    }
+
+    wait_ready();
+
+    if (setup_stream()) {
+        result = 1;
+        goto done;
+    }
+
+    double rate = loop();
+    eprintf("Sent %d updates at %.0f Hz (%.1f MB/s).\n", sent, rate,
+            rate * VEC_LENGTH * sizeof(float) / 1000000.);
+
+    if (!destination->local->streams) {
+        eprintf("Destination did not accept a stream.\n");
+        result = 1;
+    }
+    if (received != sent) {
+        eprintf("Sent %d updates but received %d of them.\n", sent, received);
+        result = 1;
+    }
+    if (mismatched || last_value != sent - 1) {
+        eprintf("Received %d corrupt updates, last value was %g.\n",
+                mismatched, last_value);
+        result = 1;
+    }
+
+  done:
+    cleanup_destination();
+    cleanup_source();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}
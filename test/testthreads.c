@@ -0,0 +1,325 @@
+#include "../src/mapper_internal.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define eprintf(format, ...) do {               \
+    if (verbose)                                \
+        fprintf(stdout, format, ##__VA_ARGS__); \
+} while(0)
+
+#define NUM_PRODUCERS 4
+#define NUM_BUCKETS 20
+#define NUM_PROBES 20
+#define MAX_LATENCY_USEC 20000
+
+int verbose = 1;
+int terminate = 0;
+int done = 0;
+
+mapper_device source = 0;
+mapper_device destination = 0;
+mapper_signal sendsigs[NUM_PRODUCERS];
+mapper_signal recvsigs[NUM_PRODUCERS];
+
+int iterations = 20000;
+int queue_size = 1024;
+
+/* Written only by the polling thread. */
+int received[NUM_PRODUCERS];
+int last_value[NUM_PRODUCERS];
+int out_of_order = 0;
+int histogram[NUM_BUCKETS];
+double max_latency = 0;
+
+/* Written only by the producer threads. */
+int queue_full[NUM_PRODUCERS];
+int producers_done = 0;
+
+/*! Internal function to get the current time. */
+static double current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void handler(mapper_signal sig, mapper_id instance, const void *value,
+             int count, mapper_timetag_t *timetag)
+{
+    if (!value)
+        return;
+
+    int i = (int)(long)mapper_signal_user_data(sig);
+    int v = *(int*)value;
+    if (v <= last_value[i])
+        ++out_of_order;
+    last_value[i] = v;
+    ++received[i];
+
+    // latency from enqueue to delivery, in power-of-two microsecond buckets
+    mapper_timetag_t now;
+    mapper_timetag_now(&now);
+    double usec = mapper_timetag_difference(now, *timetag) * 1000000.;
+    if (usec > max_latency)
+        max_latency = usec;
+    int bucket = 0;
+    while (usec >= 1 && bucket < NUM_BUCKETS - 1) {
+        usec *= 0.5;
+        ++bucket;
+    }
+    ++histogram[bucket];
+}
+
+int setup_devices()
+{
+    int i;
+    char name[32];
+
+    source = mapper_device_new("testthreads-send", 0, 0);
+    destination = mapper_device_new("testthreads-recv", 0, 0);
+    if (!source || !destination)
+        return 1;
+
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        snprintf(name, 32, "out%d", i);
+        sendsigs[i] = mapper_device_add_output_signal(source, name, 1, 'i', 0,
+                                                      0, 0);
+        snprintf(name, 32, "in%d", i);
+        recvsigs[i] = mapper_device_add_input_signal(destination, name, 1, 'i',
+                                                     0, 0, 0, handler,
+                                                     (void*)(long)i);
+    }
+
+    if (mapper_device_reserve_update_queue(source, queue_size, sizeof(int)))
+        return 1;
+
+    while (!done && !(mapper_device_ready(source)
+                      && mapper_device_ready(destination))) {
+        mapper_device_poll(source, 25);
+        mapper_device_poll(destination, 25);
+    }
+    eprintf("devices ready.\n");
+    return 0;
+}
+
+void cleanup_devices()
+{
+    if (destination) {
+        eprintf("Freeing destination.. ");
+        fflush(stdout);
+        mapper_device_free(destination);
+        eprintf("ok\n");
+    }
+    if (source) {
+        eprintf("Freeing source.. ");
+        fflush(stdout);
+        mapper_device_free(source);
+        eprintf("ok\n");
+    }
+}
+
+int setup_maps()
+{
+    int i, ready = 0;
+    mapper_map maps[NUM_PRODUCERS];
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        maps[i] = mapper_map_new(1, &sendsigs[i], 1, &recvsigs[i]);
+        mapper_map_push(maps[i]);
+    }
+
+    // wait until all maps have been established
+    while (!done && ready < NUM_PRODUCERS) {
+        mapper_device_poll(source, 10);
+        mapper_device_poll(destination, 10);
+        ready = 0;
+        for (i = 0; i < NUM_PRODUCERS; i++)
+            ready += mapper_map_ready(maps[i]);
+    }
+    eprintf("maps ready.\n");
+    return done;
+}
+
+/*! Each producer updates its own signal with increasing values, retrying
+ *  whenever the queue is full. */
+void *producer(void *arg)
+{
+    int i, index = (int)(long)arg;
+    for (i = 0; i < iterations && !done; i++) {
+        while (mapper_signal_enqueue_update(sendsigs[index], &i, 1,
+                                            MAPPER_NOW) && !done) {
+            ++queue_full[index];
+            sched_yield();
+        }
+    }
+    __atomic_add_fetch(&producers_done, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*! Queue single updates while the devices are otherwise idle, returning
+ *  non-zero if any took longer than MAX_LATENCY_USEC to be delivered. Only
+ *  a wakeup of the network thread can send them promptly. */
+int probe_latency()
+{
+    int i, target;
+    double then;
+
+    max_latency = 0;
+    for (i = 0; i < NUM_PROBES && !done; i++) {
+        usleep(5000);
+        target = received[0] + 1;
+        int value = iterations + i;
+        if (mapper_signal_enqueue_update(sendsigs[0], &value, 1, MAPPER_NOW))
+            return 1;
+        then = current_time();
+        while (!done && received[0] < target
+               && current_time() - then < 1)
+            mapper_device_poll(destination, 1);
+        if (received[0] < target) {
+            eprintf("Probe %d was not received.\n", i);
+            return 1;
+        }
+    }
+    eprintf("maximum idle latency: %.0f usec\n", max_latency);
+    if (max_latency > MAX_LATENCY_USEC) {
+        eprintf("Idle latency exceeds %d usec.\n", MAX_LATENCY_USEC);
+        return 1;
+    }
+    return 0;
+}
+
+/*! Run the producers against the source device. If 'threaded' is set, both
+ *  devices are serviced by their own network threads and the destination's
+ *  handlers are deferred to this thread. */
+int run_producers(int threaded)
+{
+    int i, total, idle = 0, result = 0;
+    pthread_t threads[NUM_PRODUCERS];
+
+    producers_done = out_of_order = 0;
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        received[i] = queue_full[i] = 0;
+        last_value[i] = -1;
+    }
+    memset(histogram, 0, sizeof(histogram));
+
+    if (threaded) {
+        eprintf("\nUsing network threads.\n");
+        if (mapper_device_start_thread(source, 0)
+            || mapper_device_start_thread(destination, 1)) {
+            eprintf("Network threads not available.\n");
+            mapper_device_stop_thread(source);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < NUM_PRODUCERS; i++)
+        pthread_create(&threads[i], 0, producer, (void*)(long)i);
+
+    // poll until all producers are done and the destination has gone quiet
+    while (!done && idle < 50) {
+        total = mapper_device_poll(source, 0);
+        total += mapper_device_poll(destination, 1);
+        if (__atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) == NUM_PRODUCERS
+            && !total)
+            ++idle;
+    }
+
+    for (i = 0; i < NUM_PRODUCERS; i++)
+        pthread_join(threads[i], 0);
+
+    if (threaded) {
+        result = probe_latency();
+        mapper_device_stop_thread(source);
+        mapper_device_stop_thread(destination);
+    }
+
+    total = 0;
+    for (i = 0; i < NUM_PRODUCERS; i++) {
+        eprintf("producer %d: %d received, queue full %d times\n", i,
+                received[i], queue_full[i]);
+        total += received[i];
+    }
+    eprintf("\nlatency histogram:\n");
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        if (histogram[i])
+            eprintf("  < %8d usec: %d\n", 1 << i, histogram[i]);
+    }
+
+    if (out_of_order) {
+        eprintf("%d updates arrived out of order.\n", out_of_order);
+        return 1;
+    }
+    if (!total) {
+        eprintf("No updates received.\n");
+        return 1;
+    }
+    return result;
+}
+
+void ctrlc(int sig)
+{
+    done = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, j, result = 0;
+
+    // process flags for -v verbose, -t terminate, -h help
+    for (i = 1; i < argc; i++) {
+        if (argv[i] && argv[i][0] == '-') {
+            int len = strlen(argv[i]);
+            for (j = 1; j < len; j++) {
+                switch (argv[i][j]) {
+                    case 'h':
+                        printf("testthreads.c: possible arguments "
+                               "-q quiet (suppress output), "
+                               "-t terminate automatically, "
+                               "-h help\n");
+                        return 1;
+                        break;
+                    case 'q':
+                        verbose = 0;
+                        break;
+                    case 't':
+                        terminate = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, ctrlc);
+
+    // use a shorter run when terminating automatically
+    if (terminate)
+        iterations = 2000;
+
+    if (setup_devices()) {
+        eprintf("Error initializing devices.\n");
+        result = 1;
+        goto done;
+    }
+
+    if (setup_maps()) {
+        eprintf("Error initializing maps.\n");
+        result = 1;
+        goto done;
+    }
+
+    result = run_producers(0) || run_producers(1);
+
+  done:
+    cleanup_devices();
+    printf("Test %s.\n", result ? "FAILED" : "PASSED");
+    return result;
+}